@@ -1,21 +1,379 @@
 #pragma once
 #include <Arduino.h>
 #include <SD.h>
-#include <ArduinoJson.h>
+#include "sample_log.h"
 
+#ifndef SD_CS_PIN
+#define SD_CS_PIN 22
+#endif
+
+// SD card logging on the network core.
+//
+// Samples go to a binary log (format in shared/sample_log.h): 512-byte
+// blocks of delta/varint records, each with a CRC and its timestamp range.
+// Log files are preallocated with zero blocks a few at a time from
+// update(), then written in place at block-aligned offsets, so logging
+// never grows a file or touches the FAT. The open block is rewritten in
+// its slot every BLOCK_SYNC_INTERVAL until it fills. A file is rotated
+// when full or MAX_LOG_FILE_AGE after it was opened. On boot the newest
+// file is scanned for its last valid block and logging resumes after it;
+// a block torn by power loss is zeroed.
+//
+// Besides the sample log it keeps a spool: an append-only file for data
+// that could not be delivered (see DatabaseManager), replayed front to
+// back. The replay position is kept in a side file so a reboot resumes
+// where delivery stopped.
 class DataLogger {
 public:
-    void begin();
-    void update();
-    void logData(const JsonDocument& data);
-    bool isReady();
-    
+    static const uint32_t MAX_LOG_FILE_BYTES = 1024UL * 1024UL;
+    static const uint32_t MAX_LOG_FILE_AGE = 24UL * 3600UL * 1000UL;   // ms
+    static const uint32_t BLOCK_SYNC_INTERVAL = 30000;                  // ms
+    static const uint16_t PREALLOCATE_BLOCKS_PER_UPDATE = 16;
+    static const uint32_t MAX_SPOOL_BYTES = 16UL * 1024UL * 1024UL;
+
+    typedef const char* (*ChannelNameFunction)(uint8_t channel);
+
+    // Channel names for the file header; call before begin()
+    void setChannels(ChannelNameFunction nameOf, uint8_t count) {
+        channelName = nameOf;
+        channelCount = min(count, SampleLog::BlockWriter::MAX_CHANNELS);
+    }
+
+    void begin() {
+        initSD();
+        if (sdReady) {
+            resumeLogFile();
+        }
+    }
+
+    void update() {
+        if (!sdReady || !currentLogFile) return;
+
+        preallocate();
+
+        // Bound the data lost on power failure
+        unsigned long now = millis();
+        if (blockDirty && now - lastSync >= BLOCK_SYNC_INTERVAL) {
+            writeBlock();
+            currentLogFile.flush();
+            lastSync = now;
+        }
+
+        if (now - logOpened >= MAX_LOG_FILE_AGE && (nextBlock > 1 || !block.empty())) {
+            rotateLogFile();
+        }
+    }
+
+    // Pairs SAMD51 millis() with Unix seconds (0 if not known yet); blocks
+    // opened afterwards carry it so the reader can place their samples
+    void setTimeReference(uint32_t unixTime, uint32_t timestamp) {
+        referenceUnixTime = unixTime;
+        referenceTimestamp = timestamp;
+
+        // The clock became known while a block was open
+        if (unixTime != 0 && block.unixTime() == 0) {
+            block.setUnixTime(unixTime - (int32_t)(timestamp - block.referenceTimestamp()) / 1000);
+            blockDirty |= !block.empty();
+        }
+    }
+
+    // One compressed sample; timestamp is SAMD51 millis()
+    void logSample(uint8_t channel, float value, uint32_t timestamp) {
+        if (!sdReady) return;
+        if (!currentLogFile) {
+            rotateLogFile();
+            if (!currentLogFile) return;
+        }
+
+        if (!block.append(channel, timestamp, value)) {
+            sealBlock();
+            if (!currentLogFile || !block.append(channel, timestamp, value)) return;
+        }
+        blockDirty = true;
+        samplesLogged++;
+    }
+
+    uint32_t getSamplesLogged() const { return samplesLogged; }
+    uint32_t getBlocksWritten() const { return blocksWritten; }     // Including rewrites of the open block
+    uint32_t getBlocksSealed() const { return blocksSealed; }
+    uint32_t getBlocksPreallocated() const { return blocksPreallocated; }
+
+    bool isReady() {
+        return sdReady;
+    }
+
+    // Append to the spool; false if the card is missing or the spool is full
+    bool spoolAppend(const char* data, size_t length) {
+        if (!sdReady || !checkSDSpace(length)) return false;
+
+        File spool = SD.open(SPOOL_FILE, FILE_WRITE);
+        if (!spool) return false;
+        size_t written = spool.write((const uint8_t*)data, length);
+        spoolSize = spool.size();
+        spool.close();
+        return written == length;
+    }
+
+    bool hasSpooledData() const {
+        return sdReady && spoolOffset < spoolSize;
+    }
+
+    // Copy whole lines from the replay position; returns bytes copied
+    size_t spoolRead(char* buffer, size_t maxLength, uint16_t& lines) {
+        lines = 0;
+        if (!hasSpooledData()) return 0;
+
+        File spool = SD.open(SPOOL_FILE, FILE_READ);
+        if (!spool) return 0;
+        spool.seek(spoolOffset);
+        size_t length = spool.read((uint8_t*)buffer, maxLength);
+        spool.close();
+
+        // Never hand out a partial line
+        size_t end = 0;
+        for (size_t i = 0; i < length; i++) {
+            if (buffer[i] == '\n') {
+                end = i + 1;
+                lines++;
+            }
+        }
+        return end;
+    }
+
+    // Mark bytes returned by spoolRead() as delivered
+    void spoolConsume(size_t length) {
+        spoolOffset += length;
+        if (spoolOffset >= spoolSize) {
+            SD.remove(SPOOL_FILE);
+            SD.remove(SPOOL_POSITION_FILE);
+            spoolOffset = 0;
+            spoolSize = 0;
+            return;
+        }
+        saveSpoolPosition();
+    }
+
+    uint32_t getSpooledBytes() const {
+        return spoolSize - spoolOffset;
+    }
+
 private:
+    static const uint32_t BLOCKS_PER_FILE = MAX_LOG_FILE_BYTES / SampleLog::BLOCK_SIZE;
+    static const uint16_t MAX_LOG_FILES = 1000;
+    static constexpr const char* LOG_DIRECTORY = "/log";
+    static constexpr const char* SPOOL_FILE = "/spool.lp";
+    static constexpr const char* SPOOL_POSITION_FILE = "/spool.pos";
+    // Log files are written in place, block by block; FILE_WRITE appends
+    static const uint8_t IN_PLACE = O_READ | O_WRITE | O_CREAT;
+
     File currentLogFile;
-    bool sdReady;
-    
-    void initSD();
-    String getLogFileName();
-    void rotateLogFile();
-    void checkSDSpace();
+    bool sdReady = false;
+    uint16_t logIndex = 0;
+    unsigned long lastSync = 0;
+    unsigned long logOpened = 0;
+    uint32_t spoolOffset = 0;
+    uint32_t spoolSize = 0;
+
+    ChannelNameFunction channelName = nullptr;
+    uint8_t channelCount = 0;
+    uint32_t referenceUnixTime = 0;
+    uint32_t referenceTimestamp = 0;
+
+    SampleLog::BlockWriter block;
+    bool blockDirty = false;
+    uint32_t sequence = 0;           // Of the next block
+    uint32_t nextBlock = 0;          // Slot of the open block in the file
+    uint32_t allocatedBlocks = 0;
+    uint32_t samplesLogged = 0;
+    uint32_t blocksWritten = 0;
+    uint32_t blocksSealed = 0;
+    uint32_t blocksPreallocated = 0;
+
+    void initSD() {
+        sdReady = SD.begin(SD_CS_PIN);
+        if (!sdReady) {
+            Serial.println("SD card initialization failed");
+            return;
+        }
+
+        if (!SD.exists(LOG_DIRECTORY)) {
+            SD.mkdir(LOG_DIRECTORY);
+        }
+
+        // Resume an interrupted replay
+        File spool = SD.open(SPOOL_FILE, FILE_READ);
+        if (spool) {
+            spoolSize = spool.size();
+            spool.close();
+        }
+        File position = SD.open(SPOOL_POSITION_FILE, FILE_READ);
+        if (position) {
+            position.read((uint8_t*)&spoolOffset, sizeof(spoolOffset));
+            position.close();
+        }
+        if (spoolOffset > spoolSize) {
+            spoolOffset = 0;
+        }
+    }
+
+    String getLogFileName() {
+        char name[24];
+        snprintf(name, sizeof(name), "%s/data%03u.bin", LOG_DIRECTORY, logIndex);
+        return String(name);
+    }
+
+    bool readBlock(uint32_t slot, uint8_t* buffer, SampleLog::BlockHeader& header) {
+        return currentLogFile.seek(slot * SampleLog::BLOCK_SIZE) &&
+               currentLogFile.read(buffer, SampleLog::BLOCK_SIZE) == (int)SampleLog::BLOCK_SIZE &&
+               SampleLog::validBlock(buffer, header);
+    }
+
+    // Header block for files written by this build
+    void buildFileHeader() {
+        block.begin(SampleLog::BLOCK_FILE_HEADER, sequence, referenceUnixTime, referenceTimestamp);
+        block.appendBytes(&channelCount, 1);
+        for (uint8_t channel = 0; channel < channelCount; channel++) {
+            const char* name = channelName(channel);
+            block.appendBytes(name, strlen(name) + 1);
+        }
+    }
+
+    // Continue the newest log file after its last valid block. Valid blocks
+    // are a prefix of the file, so a binary search finds the end.
+    void resumeLogFile() {
+        while (logIndex < MAX_LOG_FILES && SD.exists(getLogFileName().c_str())) {
+            logIndex++;
+        }
+        if (logIndex == 0) return;
+        logIndex--;
+
+        currentLogFile = SD.open(getLogFileName().c_str(), IN_PLACE);
+        if (!currentLogFile) return;
+
+        uint8_t buffer[SampleLog::BLOCK_SIZE];
+        SampleLog::BlockHeader header;
+        uint32_t blocks = currentLogFile.size() / SampleLog::BLOCK_SIZE;
+        if (!readBlock(0, buffer, header) || header.kind != SampleLog::BLOCK_FILE_HEADER) {
+            currentLogFile.close();
+            logIndex++;
+            return;
+        }
+
+        // Different channels: leave the file as it is and start a new one
+        sequence = header.sequence + 1;
+        buildFileHeader();
+        if (header.length != block.length() ||
+            memcmp(buffer + SampleLog::HEADER_SIZE, block.finish() + SampleLog::HEADER_SIZE, header.length) != 0) {
+            currentLogFile.close();
+            logIndex++;
+            return;
+        }
+
+        uint32_t low = 1, high = blocks;
+        while (low < high) {
+            uint32_t middle = (low + high) / 2;
+            if (readBlock(middle, buffer, header)) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        if (readBlock(low - 1, buffer, header)) {
+            sequence = header.sequence + 1;
+        }
+
+        // Cut off whatever a power loss left in the next slot
+        nextBlock = low;
+        allocatedBlocks = blocks;
+        if (nextBlock >= BLOCKS_PER_FILE) {
+            rotateLogFile();
+            return;
+        }
+        if (nextBlock < allocatedBlocks) {
+            writeZeroBlock(nextBlock);
+        }
+        block.begin(SampleLog::BLOCK_DATA, sequence, referenceUnixTime, referenceTimestamp);
+        blockDirty = false;
+        logOpened = millis();
+        lastSync = logOpened;
+    }
+
+    // Close the current file and start the next free one
+    void rotateLogFile() {
+        if (currentLogFile) {
+            if (!block.empty()) {
+                if (blockDirty) writeBlock();
+                sequence++;
+            }
+            currentLogFile.close();
+        }
+        while (logIndex < MAX_LOG_FILES && SD.exists(getLogFileName().c_str())) {
+            logIndex++;
+        }
+        if (logIndex >= MAX_LOG_FILES) return;
+
+        currentLogFile = SD.open(getLogFileName().c_str(), IN_PLACE);
+        if (!currentLogFile) return;
+
+        nextBlock = 0;
+        allocatedBlocks = 0;
+        buildFileHeader();
+        writeBlock();
+        sequence++;
+        nextBlock = 1;
+
+        block.begin(SampleLog::BLOCK_DATA, sequence, referenceUnixTime, referenceTimestamp);
+        blockDirty = false;
+        logOpened = millis();
+        lastSync = logOpened;
+    }
+
+    // Write the full block and open the next slot
+    void sealBlock() {
+        writeBlock();
+        blocksSealed++;
+        sequence++;
+        nextBlock++;
+        block.begin(SampleLog::BLOCK_DATA, sequence, referenceUnixTime, referenceTimestamp);
+        if (nextBlock >= BLOCKS_PER_FILE) {
+            rotateLogFile();
+        }
+    }
+
+    void writeBlock() {
+        currentLogFile.seek(nextBlock * SampleLog::BLOCK_SIZE);
+        currentLogFile.write(block.finish(), SampleLog::BLOCK_SIZE);
+        if (nextBlock >= allocatedBlocks) {
+            allocatedBlocks = nextBlock + 1;
+        }
+        blocksWritten++;
+        blockDirty = false;
+    }
+
+    void writeZeroBlock(uint32_t slot) {
+        static const uint8_t ZEROS[SampleLog::BLOCK_SIZE] = {};
+        currentLogFile.seek(slot * SampleLog::BLOCK_SIZE);
+        currentLogFile.write(ZEROS, SampleLog::BLOCK_SIZE);
+    }
+
+    // Grow the file to its final size in small steps so no call blocks for long
+    void preallocate() {
+        for (uint16_t i = 0; i < PREALLOCATE_BLOCKS_PER_UPDATE && allocatedBlocks < BLOCKS_PER_FILE; i++) {
+            writeZeroBlock(allocatedBlocks++);
+            blocksPreallocated++;
+        }
+    }
+
+    bool checkSDSpace(size_t additional) {
+        return spoolSize + additional <= MAX_SPOOL_BYTES;
+    }
+
+    void saveSpoolPosition() {
+        SD.remove(SPOOL_POSITION_FILE);
+        File position = SD.open(SPOOL_POSITION_FILE, FILE_WRITE);
+        if (position) {
+            position.write((const uint8_t*)&spoolOffset, sizeof(spoolOffset));
+            position.close();
+        }
+    }
 };
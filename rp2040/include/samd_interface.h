@@ -1,23 +1,302 @@
 #pragma once
 #include <Arduino.h>
 #include <SPI.h>
-#include <ArduinoJson.h>
+#include "link_protocol.h"
 
+// The link has SPI1 to itself so it never contends with the Ethernet
+// controller and SD card on SPI0, which are driven from the other core
+#ifndef SAMD_LINK_SPI
+#define SAMD_LINK_SPI SPI1
+#endif
+#ifndef SAMD_LINK_CS_PIN
+#define SAMD_LINK_CS_PIN 13
+#endif
+#ifndef SAMD_LINK_SCK_PIN
+#define SAMD_LINK_SCK_PIN 10
+#endif
+#ifndef SAMD_LINK_MOSI_PIN
+#define SAMD_LINK_MOSI_PIN 11
+#endif
+#ifndef SAMD_LINK_MISO_PIN
+#define SAMD_LINK_MISO_PIN 12
+#endif
+
+// RP2040 end of the SAMD51 link. The RP2040 is SPI master and polls the
+// SAMD51 with one frame each way per transaction (see shared/link_protocol.h).
+// Transfers run on the SPI DMA via transferAsync(), so update() never waits
+// on the bus. Commands are queued and retransmitted until the SAMD51 ACKs them.
+// Runs on core 1; every method must be called from that core.
 class SAMDInterface {
 public:
-    void begin();
-    void update();
-    void sendCommand(const JsonDocument& command);
-    bool hasNewData();
-    JsonDocument getLatestData();
-    
+    static const uint32_t SPI_CLOCK = 4000000;
+    static const uint32_t POLL_INTERVAL_MS = 20;
+    static const uint8_t COMMAND_QUEUE_SIZE = 4;
+    static const uint8_t ACK_TIMEOUT_POLLS = 3;   // Exchanges to wait for an ACK
+    static const uint8_t MAX_RETRIES = 3;
+    static const uint8_t ALARM_QUEUE_SIZE = 4;
+
+    void begin() {
+        // Never 0, which the SAMD51 has before its first command
+        session = rp2040.hwrand32() % 255 + 1;
+        initSPI();
+        LinkProtocol::encodeIdle(txBuffer, txSequence);
+    }
+
+    void update() {
+        handleSPICommunication();
+    }
+
+    bool sendSetpoints(const LinkProtocol::Setpoints& setpoints) {
+        return queueCommand(LinkProtocol::MSG_SETPOINTS, &setpoints, sizeof(setpoints));
+    }
+
+    bool sendModeChange(uint8_t loop, uint8_t mode, float manualOutput = 0) {
+        LinkProtocol::ModeChange change = {loop, mode, manualOutput};
+        return queueCommand(LinkProtocol::MSG_MODE_CHANGE, &change, sizeof(change));
+    }
+
+    bool sendCalibration(uint8_t sensor, uint8_t action, float value) {
+        LinkProtocol::Calibration calibration = {sensor, action, value};
+        return queueCommand(LinkProtocol::MSG_CALIBRATION, &calibration, sizeof(calibration));
+    }
+
+    bool sendAutotune(const LinkProtocol::AutotuneCommand& command) {
+        return queueCommand(LinkProtocol::MSG_AUTOTUNE, &command, sizeof(command));
+    }
+
+    // True once per new snapshot from the SAMD51
+    bool hasNewData() {
+        bool available = newDataAvailable;
+        newDataAvailable = false;
+        return available;
+    }
+
+    const LinkProtocol::Snapshot& getLatestData() const {
+        return snapshot;
+    }
+
+    float getPH() const { return snapshot.ph; }
+    float getDO() const { return snapshot.dissolvedOxygen; }
+    float getTemperature() const { return snapshot.temperature; }
+    float getPressure() const { return snapshot.pressure; }
+    float getBiomass() const { return snapshot.biomass; }
+
+    bool isValid(uint16_t validBit) const {
+        return (snapshot.validMask & validBit) != 0;
+    }
+
+    bool popAlarm(LinkProtocol::Alarm& alarm) {
+        if (alarmCount == 0) return false;
+        alarm = alarms[alarmTail];
+        alarmTail = (alarmTail + 1) % ALARM_QUEUE_SIZE;
+        alarmCount--;
+        return true;
+    }
+
+    // Auto-tune progress, once per status message from the SAMD51
+    bool popAutotuneStatus(LinkProtocol::AutotuneStatus& status) {
+        if (!autotuneStatusPending) return false;
+        status = autotuneStatus;
+        autotuneStatusPending = false;
+        return true;
+    }
+
+    // Status of the most recently completed command
+    uint8_t getLastAckStatus() const { return lastAckStatus; }
+
+    uint32_t getFramesReceived() const { return rxSequence.received(); }
+    uint32_t getFramesLost() const { return rxSequence.lost(); }
+    uint32_t getFrameErrors() const { return frameErrors; }
+    uint32_t getCommandsFailed() const { return commandsFailed; }
+
 private:
-    static const uint8_t BUFFER_SIZE = 256;
-    uint8_t txBuffer[BUFFER_SIZE];
-    uint8_t rxBuffer[BUFFER_SIZE];
-    bool newDataAvailable;
-    
-    void initSPI();
-    void handleSPICommunication();
-    void processReceivedData();
+    struct Command {
+        uint8_t type;
+        uint8_t length;
+        uint8_t payload[LinkProtocol::MAX_PAYLOAD];
+    };
+
+    uint8_t txBuffer[LinkProtocol::FRAME_SIZE];
+    uint8_t rxBuffer[LinkProtocol::FRAME_SIZE];
+    bool newDataAvailable = false;
+    bool transferActive = false;
+    unsigned long lastPoll = 0;
+
+    LinkProtocol::Snapshot snapshot = {};
+    LinkProtocol::SequenceTracker rxSequence;
+    uint8_t txSequence = 0;
+    uint32_t frameErrors = 0;
+
+    // Commands waiting to be sent; the head is the one in flight
+    Command commands[COMMAND_QUEUE_SIZE];
+    uint8_t commandHead = 0;
+    uint8_t commandCount = 0;
+    bool commandInFlight = false;
+    uint8_t commandSequence = 0;
+    uint8_t nextCommandSequence = 0;
+    uint8_t session = 0;
+    uint8_t pollsSinceSend = 0;
+    uint8_t retries = 0;
+    uint8_t lastAckStatus = LinkProtocol::ACK_OK;
+    uint32_t commandsFailed = 0;
+
+    // Only the latest status matters; each one carries the whole state
+    LinkProtocol::AutotuneStatus autotuneStatus = {};
+    bool autotuneStatusPending = false;
+
+    LinkProtocol::Alarm alarms[ALARM_QUEUE_SIZE];
+    uint8_t alarmHead = 0;
+    uint8_t alarmTail = 0;
+    uint8_t alarmCount = 0;
+
+    void initSPI() {
+        pinMode(SAMD_LINK_CS_PIN, OUTPUT);
+        digitalWrite(SAMD_LINK_CS_PIN, HIGH);
+        SAMD_LINK_SPI.setSCK(SAMD_LINK_SCK_PIN);
+        SAMD_LINK_SPI.setTX(SAMD_LINK_MOSI_PIN);
+        SAMD_LINK_SPI.setRX(SAMD_LINK_MISO_PIN);
+        SAMD_LINK_SPI.begin();
+    }
+
+    void handleSPICommunication() {
+        if (transferActive) {
+            if (!SAMD_LINK_SPI.finishedAsync()) return;
+
+            digitalWrite(SAMD_LINK_CS_PIN, HIGH);
+            SAMD_LINK_SPI.endTransaction();
+            transferActive = false;
+            processReceivedData();
+        }
+
+        unsigned long now = millis();
+        if (now - lastPoll < POLL_INTERVAL_MS) return;
+        lastPoll = now;
+
+        prepareFrame();
+        SAMD_LINK_SPI.beginTransaction(SPISettings(SPI_CLOCK, MSBFIRST, SPI_MODE0));
+        digitalWrite(SAMD_LINK_CS_PIN, LOW);
+        transferActive = SAMD_LINK_SPI.transferAsync(txBuffer, rxBuffer, LinkProtocol::FRAME_SIZE);
+        if (!transferActive) {
+            digitalWrite(SAMD_LINK_CS_PIN, HIGH);
+            SAMD_LINK_SPI.endTransaction();
+        }
+    }
+
+    void processReceivedData() {
+        LinkProtocol::FrameHeader header;
+        LinkProtocol::DecodeResult result = LinkProtocol::decodeFrame(rxBuffer, header);
+        if (result == LinkProtocol::DECODE_EMPTY) return;
+        if (result != LinkProtocol::DECODE_OK) {
+            frameErrors++;
+            return;
+        }
+
+        // The SAMD51 repeats its last frame until it stages the next one,
+        // so a frame whose sequence repeats has been handled already
+        bool repeat = rxSequence.isRepeat(header.sequence);
+        rxSequence.update(header.sequence);
+        if (repeat) return;
+
+        switch (header.type) {
+            case LinkProtocol::MSG_SNAPSHOT: {
+                LinkProtocol::Snapshot received;
+                if (LinkProtocol::decodePayload(rxBuffer, header, received)) {
+                    if (received.timestamp != snapshot.timestamp) {
+                        newDataAvailable = true;
+                    }
+                    snapshot = received;
+                }
+                break;
+            }
+            case LinkProtocol::MSG_ALARM: {
+                LinkProtocol::Alarm alarm;
+                if (LinkProtocol::decodePayload(rxBuffer, header, alarm)) {
+                    pushAlarm(alarm);
+                }
+                break;
+            }
+            case LinkProtocol::MSG_AUTOTUNE_STATUS: {
+                if (LinkProtocol::decodePayload(rxBuffer, header, autotuneStatus)) {
+                    autotuneStatusPending = true;
+                }
+                break;
+            }
+            case LinkProtocol::MSG_ACK: {
+                LinkProtocol::Ack ack;
+                if (LinkProtocol::decodePayload(rxBuffer, header, ack)) {
+                    handleAck(ack);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    // Choose what goes out in the next transaction: a new or retried command, else idle
+    void prepareFrame() {
+        if (commandInFlight) {
+            if (++pollsSinceSend < ACK_TIMEOUT_POLLS) {
+                LinkProtocol::encodeIdle(txBuffer, txSequence++);
+                return;
+            }
+            if (++retries > MAX_RETRIES) {
+                commandsFailed++;
+                popCommand();
+            }
+        }
+
+        if (commandCount == 0) {
+            LinkProtocol::encodeIdle(txBuffer, txSequence++);
+            return;
+        }
+
+        // Commands are numbered apart from the idle polls, so two in a row
+        // never share a number however many polls went between them.
+        // Retransmissions reuse the original one so the SAMD51 can drop them.
+        const Command& command = commands[commandHead];
+        if (!commandInFlight) {
+            commandSequence = nextCommandSequence++;
+            retries = 0;
+            commandInFlight = true;
+        }
+        LinkProtocol::encodeFrame(txBuffer, command.type, commandSequence, command.payload, command.length, session);
+        pollsSinceSend = 0;
+    }
+
+    bool queueCommand(uint8_t type, const void* payload, uint8_t length) {
+        if (commandCount >= COMMAND_QUEUE_SIZE || length > LinkProtocol::MAX_PAYLOAD) {
+            return false;
+        }
+        Command& command = commands[(commandHead + commandCount) % COMMAND_QUEUE_SIZE];
+        command.type = type;
+        command.length = length;
+        memcpy(command.payload, payload, length);
+        commandCount++;
+        return true;
+    }
+
+    void popCommand() {
+        commandHead = (commandHead + 1) % COMMAND_QUEUE_SIZE;
+        commandCount--;
+        commandInFlight = false;
+    }
+
+    void handleAck(const LinkProtocol::Ack& ack) {
+        if (!commandInFlight) return;
+        if (ack.type != commands[commandHead].type || ack.sequence != commandSequence) return;
+        lastAckStatus = ack.status;
+        popCommand();
+    }
+
+    void pushAlarm(const LinkProtocol::Alarm& alarm) {
+        // Keep the newest alarms when the queue is full
+        if (alarmCount == ALARM_QUEUE_SIZE) {
+            alarmTail = (alarmTail + 1) % ALARM_QUEUE_SIZE;
+            alarmCount--;
+        }
+        alarms[alarmHead] = alarm;
+        alarmHead = (alarmHead + 1) % ALARM_QUEUE_SIZE;
+        alarmCount++;
+    }
 };
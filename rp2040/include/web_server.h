@@ -3,6 +3,11 @@
 #include <EthernetServer.h>
 #include <ArduinoJson.h>
 
+// Concurrent HTTP clients, also the cap on live event streams (WebInterface)
+#ifndef WEB_MAX_CLIENTS
+#define WEB_MAX_CLIENTS 4
+#endif
+
 class WebServerManager {
 public:
     void begin();
@@ -10,7 +15,7 @@ public:
     
 private:
     EthernetServer server;
-    static const int MAX_CLIENTS = 4;
+    static const int MAX_CLIENTS = WEB_MAX_CLIENTS;
     EthernetClient clients[MAX_CLIENTS];
     
     void handleClient(EthernetClient& client);
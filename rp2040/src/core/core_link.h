@@ -0,0 +1,61 @@
+#pragma once
+
+#include <Arduino.h>
+#include "link_protocol.h"
+#include "spsc_ring.h"
+
+// Queues between the two RP2040 cores. Core 1 owns the SAMD51 link and
+// pushes what it receives; core 0 runs networking and persistence and
+// pushes commands for the SAMD51. Each ring has exactly one producer core
+// and one consumer core, so no locks or FIFO handshakes are needed.
+struct LinkCommand {
+    uint8_t type;   // LinkProtocol::MessageType
+    union {
+        LinkProtocol::Setpoints setpoints;
+        LinkProtocol::ModeChange modeChange;
+        LinkProtocol::Calibration calibration;
+        LinkProtocol::AutotuneCommand autotune;
+    };
+};
+
+class CoreLink {
+public:
+    static const uint16_t TELEMETRY_DEPTH = 8;
+    static const uint16_t ALARM_DEPTH = 8;
+    static const uint16_t COMMAND_DEPTH = 8;
+    static const uint16_t AUTOTUNE_DEPTH = 4;
+
+    SpscRing<LinkProtocol::Snapshot, TELEMETRY_DEPTH> telemetry;   // core 1 -> core 0
+    SpscRing<LinkProtocol::Alarm, ALARM_DEPTH> alarms;             // core 1 -> core 0
+    SpscRing<LinkCommand, COMMAND_DEPTH> commands;                 // core 0 -> core 1
+    SpscRing<LinkProtocol::AutotuneStatus, AUTOTUNE_DEPTH> autotune;   // core 1 -> core 0
+
+    // Core 0 side helpers
+    bool sendSetpoints(const LinkProtocol::Setpoints& setpoints) {
+        LinkCommand command;
+        command.type = LinkProtocol::MSG_SETPOINTS;
+        command.setpoints = setpoints;
+        return commands.push(command);
+    }
+
+    bool sendModeChange(uint8_t loop, uint8_t mode, float manualOutput = 0) {
+        LinkCommand command;
+        command.type = LinkProtocol::MSG_MODE_CHANGE;
+        command.modeChange = {loop, mode, manualOutput};
+        return commands.push(command);
+    }
+
+    bool sendCalibration(uint8_t sensor, uint8_t action, float value) {
+        LinkCommand command;
+        command.type = LinkProtocol::MSG_CALIBRATION;
+        command.calibration = {sensor, action, value};
+        return commands.push(command);
+    }
+
+    bool sendAutotune(const LinkProtocol::AutotuneCommand& autotune) {
+        LinkCommand command;
+        command.type = LinkProtocol::MSG_AUTOTUNE;
+        command.autotune = autotune;
+        return commands.push(command);
+    }
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Fraction of time a core spends doing work, averaged over one-second
+// windows. The owning core brackets its work with beginWork()/endWork();
+// anything outside the brackets (delay, waiting on a poll interval) counts
+// as idle. getLoad() may be called from the other core.
+class CoreLoad {
+public:
+    static const uint32_t WINDOW_MICROS = 1000000;
+
+    void beginWork() {
+        workStart = micros();
+        if (windowStart == 0) {
+            windowStart = workStart;
+        }
+    }
+
+    void endWork() {
+        uint32_t now = micros();
+        busyMicros += now - workStart;
+
+        uint32_t elapsed = now - windowStart;
+        if (elapsed >= WINDOW_MICROS) {
+            permille = (uint32_t)(((uint64_t)busyMicros * 1000) / elapsed);
+            busyMicros = 0;
+            windowStart = now;
+        }
+    }
+
+    // Load over the last complete window, in percent
+    float getLoad() const {
+        return permille / 10.0f;
+    }
+
+private:
+    uint32_t workStart = 0;
+    uint32_t windowStart = 0;
+    uint32_t busyMicros = 0;
+    volatile uint32_t permille = 0;
+};
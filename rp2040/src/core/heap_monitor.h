@@ -0,0 +1,32 @@
+#pragma once
+
+#include <Arduino.h>
+#include <malloc.h>
+
+// Heap usage as seen by newlib's allocator. The arena only grows, so its
+// size is the heap's high-water mark including fragmentation; peak use is
+// the largest allocated total seen by sample(), which loop() calls once
+// per pass.
+class HeapMonitor {
+public:
+    void sample() {
+        size_t used = mallinfo().uordblks;
+        if (used > peakUsed) {
+            peakUsed = used;
+        }
+    }
+
+    size_t getUsed() const { return mallinfo().uordblks; }
+    size_t getPeakUsed() const { return peakUsed; }
+
+    // Bytes claimed from the system so far, in use or free
+    size_t getArena() const { return mallinfo().arena; }
+
+    // Free space inside the arena, a measure of fragmentation
+    size_t getFreeInArena() const { return mallinfo().fordblks; }
+
+    size_t getTotal() const { return rp2040.getTotalHeap(); }
+
+private:
+    size_t peakUsed = 0;
+};
@@ -1,61 +1,434 @@
 #pragma once
 
 #include <Arduino.h>
-#include <InfluxDbClient.h>
-#include <InfluxDbCloud.h>
+#include <Ethernet.h>
+#include "data_logger.h"
+#include "line_protocol_batch.h"
 
+// Batched InfluxDB v2 writer.
+//
+// Points are formatted into a line-protocol arena and written with one
+// HTTP POST per batch, once BATCH_POINTS have accumulated or the oldest
+// point is FLUSH_INTERVAL old. Two arenas alternate so logging continues
+// while a batch is in flight. Nothing waits on the network: the TCP
+// handshake is bounded by CONNECT_TIMEOUT, the body goes out in pieces
+// that fit the socket's free buffer space, and the response is collected,
+// all across update() calls.
+//
+// A batch the server does not accept goes to the SD spool through
+// DataLogger. While anything is spooled, new batches are appended behind
+// it and the spool is replayed front to back, so points reach InfluxDB in
+// the order they were logged.
+//
+// Timestamps come from the Date header of InfluxDB's own responses. Until
+// the first one arrives points are stamped with millis() since boot, and
+// the server is asked for the time with GET /ping (on the retry backoff).
+// Such points are never sent: a full arena of them goes to the spool as
+// it is, and they are rewritten to Unix times, in the arena or as they are
+// replayed, once the clock is known. Points an earlier boot spooled without
+// ever learning the clock cannot be placed and are dropped on replay.
 class DatabaseManager {
 public:
+    static const uint16_t BATCH_POINTS = 30;
+    static const uint32_t FLUSH_INTERVAL = 10000;      // ms
+    static const uint32_t RESPONSE_TIMEOUT = 5000;     // ms
+    static const uint16_t CONNECT_TIMEOUT = 100;       // ms, bounds the TCP handshake
+    static const uint32_t RETRY_INTERVAL_MIN = 5000;   // ms, doubled per failure
+    static const uint32_t RETRY_INTERVAL_MAX = 300000;
+    static const size_t MAX_POINT_BYTES = 256;         // Headroom kept for the next point
+
+    DatabaseManager(DataLogger& logger) : logger(logger) {}
+
     void begin() {
-        // InfluxDB connection parameters
-        client.setConnectionParams(INFLUXDB_URL, INFLUXDB_ORG, INFLUXDB_BUCKET, INFLUXDB_TOKEN);
-        
-        // Check server connection
-        if (client.validateConnection()) {
-            Serial.println("Connected to InfluxDB");
-        } else {
-            Serial.println("InfluxDB connection failed");
+        http.setConnectionTimeout(CONNECT_TIMEOUT);
+        batches[0].clear();
+        batches[1].clear();
+        state = State::IDLE;
+        earlierBootSpool = logger.getSpooledBytes();
+    }
+
+    // Drive flushing, sending, response handling and spool replay; call from loop()
+    void update() {
+        if (state == State::SENDING) {
+            sendBody();
+            return;
+        }
+        if (state == State::AWAITING_RESPONSE) {
+            pollResponse();
+            return;
         }
 
-        // Configure data point
-        sensor.addTag("device", "bioreactor");
-        sensor.addTag("location", "lab");
+        LineProtocolBatch& batch = batches[active];
+        if (!batch.empty() && batchDue(batch)) {
+            flushActive();
+        } else if (logger.hasSpooledData() && retryDue()) {
+            replaySpool();
+        }
     }
 
     void logSensorData(float ph, float do_level, float temp, float pressure) {
-        // Clear fields from previous use
-        sensor.clearFields();
-        
-        // Add fields
-        sensor.addField("ph", ph);
-        sensor.addField("dissolved_oxygen", do_level);
-        sensor.addField("temperature", temp);
-        sensor.addField("pressure", pressure);
-        
-        // Write point
-        if (!client.writePoint(sensor)) {
-            Serial.println("InfluxDB write failed");
-        }
+        LineProtocolBatch& batch = beginPoint("bioreactor_sensors");
+        batch.field("ph", ph);
+        batch.field("dissolved_oxygen", do_level);
+        batch.field("temperature", temp);
+        batch.field("pressure", pressure);
+        endPoint();
+    }
+
+    // One sample kept by TelemetryCompressor, taken ageMs before now
+    void logSample(const char* field, float value, uint32_t ageMs) {
+        LineProtocolBatch& batch = beginPoint("bioreactor_sensors");
+        batch.field(field, value);
+        endPoint(ageMs);
     }
 
     void logControlAction(const char* controller, const char* action, float value) {
-        Point event("control_actions");
-        event.addTag("controller", controller);
-        event.addTag("action", action);
-        event.addField("value", value);
-        
-        if (!client.writePoint(event)) {
-            Serial.println("InfluxDB write failed");
-        }
+        LineProtocolBatch& batch = beginPoint("control_actions");
+        batch.tag("controller", controller);
+        batch.tag("action", action);
+        batch.field("value", value);
+        endPoint();
+    }
+
+    // Unix seconds from the server's Date header, 0 until the first response
+    uint32_t getUnixTime() const {
+        return (uint32_t)(timestampMillis() / 1000);
     }
 
+    uint32_t getBatchesWritten() const { return batchesWritten; }
+    uint32_t getBatchesSpooled() const { return batchesSpooled; }
+    uint32_t getBatchesRejected() const { return batchesRejected; }    // 4xx: dropped, not retried
+    uint32_t getPointsDropped() const { return pointsDropped; }
+    bool isBackendReachable() const { return consecutiveFailures == 0; }
+
 private:
-    InfluxDBClient client;
-    Point sensor = Point("bioreactor_sensors");
-    
+    enum class State {
+        IDLE,
+        SENDING,
+        AWAITING_RESPONSE
+    };
+
+    enum class Source {
+        BATCH,
+        SPOOL,
+        PING            // Only after the Date header
+    };
+
+    DataLogger& logger;
+    EthernetClient http;
+    LineProtocolBatch batches[2];
+    uint8_t active = 0;              // Arena taking new points; the other may be in flight
+    State state = State::IDLE;
+    Source inFlightSource = Source::BATCH;
+    size_t inFlightLength = 0;       // Spool bytes a replay in flight came from
+    const char* body = nullptr;      // Request body still to send, in the idle arena
+    size_t bodyRemaining = 0;
+    uint32_t earlierBootSpool = 0;   // Spool bytes left from before this boot
+    unsigned long requestStart = 0;
+
+    // Response parsing, one header line at a time
+    char line[80];
+    uint8_t lineLength = 0;
+    int statusCode = 0;
+
+    // Wall clock from the Date header
+    uint32_t epochSeconds = 0;
+    unsigned long epochMillis = 0;
+
+    uint8_t consecutiveFailures = 0;
+    unsigned long nextRetry = 0;
+
+    uint32_t batchesWritten = 0;
+    uint32_t batchesSpooled = 0;
+    uint32_t batchesRejected = 0;
+    uint32_t pointsDropped = 0;
+
     // InfluxDB connection details
-    const char* INFLUXDB_URL = "http://localhost:8086";
+    const char* INFLUXDB_HOST = "localhost";
+    const uint16_t INFLUXDB_PORT = 8086;
     const char* INFLUXDB_TOKEN = "your-token";
     const char* INFLUXDB_ORG = "your-org";
     const char* INFLUXDB_BUCKET = "bioreactor";
+
+    LineProtocolBatch& beginPoint(const char* measurement) {
+        if (batches[active].remaining() < MAX_POINT_BYTES) {
+            flushActive();
+        }
+
+        LineProtocolBatch& batch = batches[active];
+        batch.beginPoint(measurement);
+        batch.tag("device", "bioreactor");
+        batch.tag("location", "lab");
+        return batch;
+    }
+
+    void endPoint(uint32_t ageMs = 0) {
+        uint64_t timestamp = timestampMillis();
+        bool added;
+        if (timestamp) {
+            added = batches[active].endPoint(timestamp - ageMs);
+        } else {
+            uint32_t now = millis();
+            added = batches[active].endPointRelative(now > ageMs ? now - ageMs : 0);
+        }
+        if (!added) {
+            pointsDropped++;
+        }
+    }
+
+    uint64_t timestampMillis() const {
+        if (epochSeconds == 0) return 0;
+        return (uint64_t)epochSeconds * 1000 + (millis() - epochMillis);
+    }
+
+    bool batchDue(const LineProtocolBatch& batch) const {
+        return batch.count() >= BATCH_POINTS ||
+               millis() - batch.firstPointMillis() >= FLUSH_INTERVAL;
+    }
+
+    bool retryDue() const {
+        return consecutiveFailures == 0 || (long)(millis() - nextRetry) >= 0;
+    }
+
+    // Send the active arena, or spool it if the backend is down or behind.
+    // Points waiting for the clock stay in the arena until it is full.
+    void flushActive() {
+        LineProtocolBatch& batch = batches[active];
+        if (batch.empty()) return;
+
+        if (batch.hasRelativeTimestamps()) {
+            if (batch.remaining() < MAX_POINT_BYTES) {
+                spool(batch);
+            } else if (state == State::IDLE && retryDue()) {
+                requestClock();
+            }
+            return;
+        }
+
+        if (state != State::IDLE || logger.hasSpooledData() || !retryDue()) {
+            spool(batch);
+            return;
+        }
+
+        active ^= 1;
+        batches[active].clear();
+        inFlightSource = Source::BATCH;
+        sendRequest(batch.data(), batch.length());
+    }
+
+    void replaySpool() {
+        // The idle arena is free whenever no request is in flight
+        LineProtocolBatch& buffer = batches[active ^ 1];
+        uint16_t lines = 0;
+        size_t length = logger.spoolRead(buffer.rawBuffer(), LineProtocolBatch::CAPACITY, lines);
+        if (length == 0) return;
+
+        buffer.setRaw(length, lines);
+        if (buffer.hasRelativeTimestamps()) {
+            if (!timestampMillis()) {
+                buffer.clear();
+                requestClock();
+                return;
+            }
+            pointsDropped += buffer.dropRelative(min((size_t)earlierBootSpool, length));
+            buffer.resolveTimestamps(timestampMillis() - millis());
+        }
+
+        if (buffer.empty()) {
+            consumeSpool(length);
+            return;
+        }
+        inFlightSource = Source::SPOOL;
+        inFlightLength = length;
+        sendRequest(buffer.data(), buffer.length());
+    }
+
+    void consumeSpool(size_t length) {
+        logger.spoolConsume(length);
+        earlierBootSpool -= min((uint32_t)length, earlierBootSpool);
+    }
+
+    void spool(LineProtocolBatch& batch) {
+        if (logger.spoolAppend(batch.data(), batch.length())) {
+            batchesSpooled++;
+        } else {
+            pointsDropped += batch.count();
+        }
+        batch.clear();
+    }
+
+    void requestClock() {
+        inFlightSource = Source::PING;
+        if (!http.connect(INFLUXDB_HOST, INFLUXDB_PORT)) {
+            requestFailed();
+            return;
+        }
+
+        http.print("GET /ping HTTP/1.1\r\nHost: ");
+        http.print(INFLUXDB_HOST);
+        http.print("\r\nConnection: close\r\n\r\n");
+        awaitResponse();
+    }
+
+    // Send the headers; sendBody() follows with the body from update()
+    void sendRequest(const char* data, size_t length) {
+        if (!http.connect(INFLUXDB_HOST, INFLUXDB_PORT)) {
+            requestFailed();
+            return;
+        }
+
+        http.print("POST /api/v2/write?org=");
+        http.print(INFLUXDB_ORG);
+        http.print("&bucket=");
+        http.print(INFLUXDB_BUCKET);
+        http.print("&precision=ms HTTP/1.1\r\nHost: ");
+        http.print(INFLUXDB_HOST);
+        http.print("\r\nAuthorization: Token ");
+        http.print(INFLUXDB_TOKEN);
+        http.print("\r\nContent-Type: text/plain; charset=utf-8\r\nContent-Length: ");
+        http.print((unsigned long)length);
+        http.print("\r\nConnection: close\r\n\r\n");
+
+        body = data;
+        bodyRemaining = length;
+        state = State::SENDING;
+        requestStart = millis();
+        sendBody();
+    }
+
+    // As much of the body as the socket takes without waiting
+    void sendBody() {
+        int space = http.availableForWrite();
+        if (space > 0) {
+            size_t chunk = min(bodyRemaining, (size_t)space);
+            size_t written = http.write((const uint8_t*)body, chunk);
+            body += written;
+            bodyRemaining -= written;
+        }
+
+        if (bodyRemaining == 0) {
+            awaitResponse();
+        } else if (!http.connected() || millis() - requestStart >= RESPONSE_TIMEOUT) {
+            requestFailed();
+        }
+    }
+
+    void awaitResponse() {
+        state = State::AWAITING_RESPONSE;
+        requestStart = millis();
+        lineLength = 0;
+        statusCode = 0;
+    }
+
+    // Read the status line and headers as they arrive; the body is ignored
+    void pollResponse() {
+        while (http.available()) {
+            char c = http.read();
+            if (c == '\r') continue;
+            if (c != '\n') {
+                if (lineLength < sizeof(line) - 1) line[lineLength++] = c;
+                continue;
+            }
+
+            line[lineLength] = '\0';
+            if (lineLength == 0) {
+                // End of headers
+                finishRequest();
+                return;
+            }
+            parseLine();
+            lineLength = 0;
+        }
+
+        if (!http.connected() || millis() - requestStart >= RESPONSE_TIMEOUT) {
+            finishRequest();
+        }
+    }
+
+    void parseLine() {
+        if (statusCode == 0 && strncmp(line, "HTTP/1.", 7) == 0) {
+            statusCode = atoi(line + 9);
+        } else if (strncasecmp(line, "Date: ", 6) == 0) {
+            uint32_t seconds = parseHttpDate(line + 6);
+            if (seconds) {
+                epochSeconds = seconds;
+                epochMillis = millis();
+                uint64_t bootEpochMs = timestampMillis() - millis();
+                batches[0].resolveTimestamps(bootEpochMs);
+                batches[1].resolveTimestamps(bootEpochMs);
+            }
+        }
+    }
+
+    void finishRequest() {
+        http.stop();
+        state = State::IDLE;
+
+        if (inFlightSource == Source::PING) {
+            if (epochSeconds) {
+                consecutiveFailures = 0;
+            } else {
+                requestFailed();
+            }
+        } else if (statusCode >= 200 && statusCode < 300) {
+            requestSucceeded();
+        } else if (statusCode >= 400 && statusCode < 500 && statusCode != 429) {
+            // The server will never take this data; don't retry it forever
+            batchesRejected++;
+            requestSucceeded();
+        } else {
+            requestFailed();
+        }
+    }
+
+    void requestSucceeded() {
+        if (inFlightSource == Source::SPOOL) {
+            consumeSpool(inFlightLength);
+        }
+        batchesWritten++;
+        consecutiveFailures = 0;
+        batches[active ^ 1].clear();
+    }
+
+    void requestFailed() {
+        http.stop();
+        state = State::IDLE;
+
+        // A failed live batch joins the spool; a failed replay stays where it is
+        LineProtocolBatch& batch = batches[active ^ 1];
+        if (inFlightSource == Source::BATCH) {
+            spool(batch);
+        } else if (inFlightSource == Source::SPOOL) {
+            batch.clear();
+        }
+
+        if (consecutiveFailures < 10) consecutiveFailures++;
+        uint32_t backoff = RETRY_INTERVAL_MIN << (consecutiveFailures - 1);
+        if (backoff > RETRY_INTERVAL_MAX) backoff = RETRY_INTERVAL_MAX;
+        nextRetry = millis() + backoff;
+        Serial.println("InfluxDB write failed");
+    }
+
+    // "Tue, 15 Nov 1994 08:12:31 GMT" -> seconds since 1970
+    static uint32_t parseHttpDate(const char* text) {
+        static const char MONTHS[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+        int day, year, hour, minute, second;
+        char month[4];
+        if (sscanf(text, "%*3s, %d %3s %d %d:%d:%d", &day, month, &year, &hour, &minute, &second) != 6) {
+            return 0;
+        }
+        const char* found = strstr(MONTHS, month);
+        if (!found) return 0;
+        int m = (found - MONTHS) / 3 + 1;
+
+        // Days from civil (proleptic Gregorian)
+        int y = year - (m <= 2);
+        int era = y / 400;
+        int yoe = y - era * 400;
+        int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+        int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        int32_t days = era * 146097 + doe - 719468;
+
+        return (uint32_t)days * 86400UL + hour * 3600UL + minute * 60UL + second;
+    }
 };
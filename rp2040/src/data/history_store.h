@@ -0,0 +1,354 @@
+#pragma once
+
+#include <Arduino.h>
+#include <SD.h>
+#include <math.h>
+#include "data_logger.h"
+#include "telemetry_compressor.h"
+
+// On-device sensor history for the web charts, at three resolutions:
+//   1 s samples          for the last hour
+//   1 min min/max/mean   for the last day
+//   15 min min/max/mean  for the last week
+//
+// Each tier is a fixed ring of int16 values stored structure-of-arrays
+// ([series][channel][slot]) and indexed by time / step, so no per-slot
+// timestamps are kept; slots skipped by a gap are cleared to NO_DATA when
+// the ring advances. Values are scaled per channel to fit int16.
+//
+// Times are Unix seconds from DatabaseManager's clock; samples arriving
+// before the clock is known are not recorded. Tiers are written to SD one
+// at a time every SAVE_INTERVAL and reloaded on boot, so a power failure
+// loses at most the last three intervals of one tier.
+class HistoryStore {
+public:
+    // The first channels of TelemetryCompressor: pH, DO, temperature, pressure
+    static const uint8_t CHANNEL_COUNT = 4;
+    static const int16_t NO_DATA = INT16_MIN;
+    static const uint16_t MAX_POINTS = 1000;       // Per query; the step grows to fit
+    static const uint32_t SAVE_INTERVAL = 300000;  // ms
+
+    HistoryStore(DataLogger& logger) : logger(logger) {}
+
+    void begin() {
+        if (!logger.isReady()) return;
+        if (!SD.exists(DIRECTORY)) {
+            SD.mkdir(DIRECTORY);
+        }
+        load(seconds);
+        load(minutes);
+        load(quarters);
+        lastSave = millis();
+    }
+
+    // Save one tier per interval so no single call blocks for long
+    void update() {
+        unsigned long currentTime = millis();
+        if (currentTime - lastSave < SAVE_INTERVAL) return;
+        lastSave = currentTime;
+
+        switch (nextSave) {
+            case 0: save(seconds); break;
+            case 1: save(minutes); break;
+            default: save(quarters); break;
+        }
+        nextSave = (nextSave + 1) % 3;
+    }
+
+    // Called once per snapshot; now is Unix seconds, 0 if not known yet
+    void record(const LinkProtocol::Snapshot& snapshot, uint32_t now) {
+        if (now == 0) return;
+        lastRecorded = now;
+
+        float values[CHANNEL_COUNT];
+        for (uint8_t channel = 0; channel < CHANNEL_COUNT; channel++) {
+            if (!TelemetryCompressor::channelValue(snapshot, channel, values[channel])) {
+                values[channel] = NAN;
+            }
+        }
+
+        seconds.advance(now);
+        for (uint8_t channel = 0; channel < CHANNEL_COUNT; channel++) {
+            seconds.set(now, MEAN, channel, encode(channel, values[channel]));
+        }
+
+        accumulate(minuteSums, minutes, now / minutes.step, values);
+        accumulate(quarterSums, quarters, now / quarters.step, values);
+    }
+
+    // Channel index for a name as used by TelemetryCompressor, or -1
+    static int8_t findChannel(const char* name) {
+        for (uint8_t channel = 0; channel < CHANNEL_COUNT; channel++) {
+            if (strcmp(name, TelemetryCompressor::channelName(channel)) == 0) return channel;
+        }
+        return -1;
+    }
+
+    // Unix time of the newest sample, 0 if nothing was recorded since boot
+    uint32_t latest() const { return lastRecorded; }
+
+    // Calls visit(time, mean, min, max) for each step in [from, to] that
+    // has data, oldest first, from the finest tier that reaches back to
+    // from. Returns the step actually used, a multiple of the tier's step.
+    template <typename Visitor>
+    uint32_t query(uint8_t channel, uint32_t from, uint32_t to, uint32_t step, Visitor visit) const {
+        if (channel >= CHANNEL_COUNT || from > to) return 0;
+        if (step < minutes.step && seconds.covers(from)) {
+            return queryTier(seconds, channel, from, to, step, visit);
+        }
+        if (step < quarters.step && minutes.covers(from)) {
+            return queryTier(minutes, channel, from, to, step, visit);
+        }
+        return queryTier(quarters, channel, from, to, step, visit);
+    }
+
+private:
+    enum Series : uint8_t {
+        MEAN = 0,
+        MIN,
+        MAX
+    };
+
+    template <uint16_t SLOTS, uint8_t SERIES>
+    struct Tier {
+        const uint32_t step;            // Seconds per slot
+        const char* path;
+        uint32_t newest = 0;            // Bucket (time / step) of the newest slot; 0 while empty
+        int16_t values[SERIES][CHANNEL_COUNT][SLOTS];
+
+        Tier(uint32_t step, const char* path) : step(step), path(path) {}
+
+        bool inWindow(uint32_t bucket) const {
+            return newest != 0 && bucket <= newest && newest - bucket < SLOTS;
+        }
+
+        // Reaches back to time, or to within a slot of it: the slot before
+        // the oldest is the one the newest overwrote, so a window of
+        // exactly SLOTS steps ending now stays on this tier
+        bool covers(uint32_t time) const {
+            return newest != 0 && time / step + SLOTS >= newest;
+        }
+
+        uint32_t oldest() const {
+            return newest >= SLOTS ? newest - SLOTS + 1 : 0;
+        }
+
+        // Make bucket the newest slot, clearing the slots skipped on the way
+        void advance(uint32_t bucket) {
+            if (newest != 0 && bucket <= newest) return;
+            uint32_t gap = newest != 0 ? bucket - newest : SLOTS;
+            if (gap > SLOTS) gap = SLOTS;
+            for (uint32_t b = bucket - gap + 1; b <= bucket; b++) {
+                for (uint8_t s = 0; s < SERIES; s++) {
+                    for (uint8_t c = 0; c < CHANNEL_COUNT; c++) {
+                        values[s][c][b % SLOTS] = NO_DATA;
+                    }
+                }
+            }
+            newest = bucket;
+        }
+
+        void set(uint32_t bucket, uint8_t series, uint8_t channel, int16_t value) {
+            if (inWindow(bucket)) values[series][channel][bucket % SLOTS] = value;
+        }
+
+        // Raw tiers keep a single series, which is also their min and max
+        int16_t get(uint32_t bucket, uint8_t series, uint8_t channel) const {
+            if (!inWindow(bucket)) return NO_DATA;
+            return values[series < SERIES ? series : (uint8_t)MEAN][channel][bucket % SLOTS];
+        }
+    };
+
+    // Running aggregate of the bucket an aggregate tier is filling
+    struct Accumulator {
+        uint32_t bucket = 0;
+        float sum[CHANNEL_COUNT];
+        float min[CHANNEL_COUNT];
+        float max[CHANNEL_COUNT];
+        uint16_t count[CHANNEL_COUNT];
+    };
+
+    struct FileHeader {
+        uint32_t magic;
+        uint32_t step;
+        uint32_t newest;
+        uint16_t slots;
+        uint8_t series;
+        uint8_t channels;
+    };
+
+    static const uint32_t FILE_MAGIC = 0x54534948;  // "HIST"
+    static constexpr const char* DIRECTORY = "/hist";
+    static constexpr const char* TEMP_PATH = "/hist/save.tmp";
+
+    DataLogger& logger;
+    Tier<3600, 1> seconds{1, "/hist/1s.bin"};
+    Tier<1440, 3> minutes{60, "/hist/1m.bin"};
+    Tier<672, 3> quarters{900, "/hist/15m.bin"};
+    Accumulator minuteSums;
+    Accumulator quarterSums;
+    uint32_t lastRecorded = 0;
+    unsigned long lastSave = 0;
+    uint8_t nextSave = 0;
+
+    // Fixed-point resolution per channel: pH 0.001, DO 0.01, °C 0.01, pressure 0.01
+    static int16_t encode(uint8_t channel, float value) {
+        static const float SCALE[CHANNEL_COUNT] = {1000.0f, 100.0f, 100.0f, 100.0f};
+        if (isnan(value)) return NO_DATA;
+        float scaled = roundf(value * SCALE[channel]);
+        if (scaled > 32767.0f) return 32767;
+        if (scaled < -32767.0f) return -32767;
+        return (int16_t)scaled;
+    }
+
+    static float decode(uint8_t channel, int16_t value) {
+        static const float SCALE[CHANNEL_COUNT] = {1000.0f, 100.0f, 100.0f, 100.0f};
+        return value / SCALE[channel];
+    }
+
+    template <typename T>
+    void accumulate(Accumulator& sums, T& tier, uint32_t bucket, const float* values) {
+        if (sums.bucket != bucket) {
+            if (sums.bucket != 0) commit(sums, tier);
+            sums.bucket = bucket;
+            for (uint8_t c = 0; c < CHANNEL_COUNT; c++) {
+                sums.sum[c] = 0;
+                sums.min[c] = INFINITY;
+                sums.max[c] = -INFINITY;
+                sums.count[c] = 0;
+            }
+        }
+
+        for (uint8_t c = 0; c < CHANNEL_COUNT; c++) {
+            if (isnan(values[c])) continue;
+            sums.sum[c] += values[c];
+            sums.min[c] = min(sums.min[c], values[c]);
+            sums.max[c] = max(sums.max[c], values[c]);
+            sums.count[c]++;
+        }
+    }
+
+    template <typename T>
+    void commit(const Accumulator& sums, T& tier) {
+        tier.advance(sums.bucket);
+        for (uint8_t c = 0; c < CHANNEL_COUNT; c++) {
+            bool any = sums.count[c] > 0;
+            tier.set(sums.bucket, MEAN, c, any ? encode(c, sums.sum[c] / sums.count[c]) : NO_DATA);
+            tier.set(sums.bucket, MIN, c, any ? encode(c, sums.min[c]) : NO_DATA);
+            tier.set(sums.bucket, MAX, c, any ? encode(c, sums.max[c]) : NO_DATA);
+        }
+    }
+
+    template <typename T, typename Visitor>
+    uint32_t queryTier(const T& tier, uint8_t channel, uint32_t from, uint32_t to,
+                       uint32_t step, Visitor& visit) const {
+        uint32_t first = max(from / tier.step, tier.oldest());
+        uint32_t last = min(to / tier.step, tier.newest);
+
+        // Tier buckets per output point
+        uint32_t per = (step + tier.step - 1) / tier.step;
+        if (per == 0) per = 1;
+        if (tier.newest == 0 || first > last) return per * tier.step;
+        uint32_t fewest = (last - first) / MAX_POINTS + 1;
+        if (per < fewest) per = fewest;
+        first = first / per * per;
+
+        for (uint32_t bucket = first; bucket <= last; bucket += per) {
+            float sum = 0, low = INFINITY, high = -INFINITY;
+            uint32_t count = 0;
+            for (uint32_t b = bucket; b < bucket + per && b <= last; b++) {
+                int16_t mean = tier.get(b, MEAN, channel);
+                if (mean == NO_DATA) continue;
+                sum += decode(channel, mean);
+                low = min(low, decode(channel, tier.get(b, MIN, channel)));
+                high = max(high, decode(channel, tier.get(b, MAX, channel)));
+                count++;
+            }
+            if (count) {
+                visit(bucket * tier.step, sum / count, low, high);
+            }
+        }
+        return per * tier.step;
+    }
+
+    // Falls back to the temporary copy when a reset cut a save short
+    template <typename T>
+    void load(T& tier) {
+        if (!loadFrom(tier, tier.path) && !loadFrom(tier, TEMP_PATH)) {
+            tier.newest = 0;
+        }
+    }
+
+    template <typename T>
+    bool loadFrom(T& tier, const char* path) {
+        File file = SD.open(path, FILE_READ);
+        if (!file) return false;
+
+        FileHeader header;
+        FileHeader expected = headerFor(tier);
+        bool valid = file.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+                     header.magic == expected.magic && header.step == expected.step &&
+                     header.slots == expected.slots && header.series == expected.series &&
+                     header.channels == expected.channels &&
+                     file.read((uint8_t*)tier.values, sizeof(tier.values)) == sizeof(tier.values);
+        file.close();
+
+        if (valid) tier.newest = header.newest;
+        return valid;
+    }
+
+    // The SD library has no rename, so the tier is written twice: to a
+    // temporary file, then over the real one, each read back before the
+    // next step. A reset at any point leaves one good copy for load().
+    template <typename T>
+    void save(T& tier) {
+        if (!logger.isReady() || tier.newest == 0) return;
+        if (!writeVerified(tier, TEMP_PATH)) return;
+        if (writeVerified(tier, tier.path)) {
+            SD.remove(TEMP_PATH);
+        }
+    }
+
+    template <typename T>
+    static FileHeader headerFor(const T& tier) {
+        return {
+            FILE_MAGIC, tier.step, tier.newest,
+            (uint16_t)(sizeof(tier.values[0][0]) / sizeof(int16_t)),
+            (uint8_t)(sizeof(tier.values) / sizeof(tier.values[0])),
+            CHANNEL_COUNT
+        };
+    }
+
+    template <typename T>
+    bool writeVerified(const T& tier, const char* path) {
+        SD.remove(path);
+        File file = SD.open(path, FILE_WRITE);
+        if (!file) return false;
+
+        FileHeader header = headerFor(tier);
+        bool written = file.write((const uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+                       file.write((const uint8_t*)tier.values, sizeof(tier.values)) == sizeof(tier.values);
+        file.close();
+        if (!written) return false;
+
+        file = SD.open(path, FILE_READ);
+        if (!file) return false;
+        bool same = sameBytes(file, &header, sizeof(header)) &&
+                    sameBytes(file, tier.values, sizeof(tier.values));
+        file.close();
+        return same;
+    }
+
+    // Compare the next length bytes of file with data, a chunk at a time
+    static bool sameBytes(File& file, const void* data, size_t length) {
+        const uint8_t* expected = (const uint8_t*)data;
+        uint8_t chunk[128];
+        while (length > 0) {
+            size_t size = min(length, sizeof(chunk));
+            if (file.read(chunk, size) != (int)size || memcmp(chunk, expected, size) != 0) return false;
+            expected += size;
+            length -= size;
+        }
+        return true;
+    }
+};
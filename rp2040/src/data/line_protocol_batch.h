@@ -0,0 +1,268 @@
+#pragma once
+
+#include <Arduino.h>
+#include <math.h>
+
+// InfluxDB line-protocol points accumulated in a fixed arena. Points are
+// formatted in place with no heap use:
+//
+//   batch.beginPoint("bioreactor_sensors");
+//   batch.tag("device", "bioreactor");
+//   batch.field("ph", 7.02f);
+//   batch.endPoint(timestampMs);
+//
+// A point that does not fit is rolled back as a whole and endPoint()
+// returns false. Floats are written with at most four decimals and
+// trailing zeros trimmed to keep the body compact; NaN fields are skipped
+// since line protocol cannot carry them. Keys and tag values are not
+// escaped, so they must not contain spaces, commas or '='.
+//
+// Points taken before the wall clock is known can be stamped with millis()
+// instead (endPointRelative()). Those stamps are zero padded to the width
+// of a millisecond Unix time, which no Unix time starts with, so they can
+// be recognised after a trip through the spool and turned into Unix times
+// in place by resolveTimestamps() once the clock is known.
+class LineProtocolBatch {
+public:
+    static const size_t CAPACITY = 4096;
+    static const uint8_t TIMESTAMP_DIGITS = 13;    // ms Unix time, 2001 to 2286
+
+    void clear() {
+        length_ = 0;
+        points_ = 0;
+        relativePoints_ = 0;
+        firstPointMillis_ = 0;
+    }
+
+    void beginPoint(const char* measurement) {
+        pointStart_ = length_;
+        fieldCount_ = 0;
+        overflow_ = false;
+        append(measurement);
+    }
+
+    void tag(const char* key, const char* value) {
+        append(',');
+        append(key);
+        append('=');
+        append(value);
+    }
+
+    void field(const char* key, float value) {
+        if (isnan(value) || isinf(value)) return;
+        beginField(key);
+        appendFloat(value);
+    }
+
+    void field(const char* key, int32_t value) {
+        beginField(key);
+        if (value < 0) {
+            append('-');
+            appendUnsigned((uint64_t)(-(int64_t)value));
+        } else {
+            appendUnsigned((uint64_t)value);
+        }
+        append('i');
+    }
+
+    // timestampMs == 0 leaves the timestamp to the server
+    bool endPoint(uint64_t timestampMs) {
+        if (timestampMs) {
+            append(' ');
+            appendUnsigned(timestampMs);
+        }
+        return finishPoint();
+    }
+
+    // Stamped with millis() since boot, to be resolved before sending
+    bool endPointRelative(uint32_t bootMillis) {
+        append(' ');
+        appendPadded(bootMillis, TIMESTAMP_DIGITS);
+        if (!finishPoint()) return false;
+        if (fieldCount_) relativePoints_++;
+        return true;
+    }
+
+    // Points still stamped with millis() since boot
+    bool hasRelativeTimestamps() const { return relativePoints_ > 0; }
+
+    // Turn every millis() stamp into a Unix time, bootEpochMs being the
+    // Unix time in ms at which millis() was 0
+    void resolveTimestamps(uint64_t bootEpochMs) {
+        for (size_t start = 0; relativePoints_ && start < length_; start = lineEnd(start) + 1) {
+            size_t stamp = relativeStamp(start);
+            if (!stamp) continue;
+
+            uint64_t unixMs = bootEpochMs + parseStamp(stamp);
+            for (size_t i = stamp + TIMESTAMP_DIGITS; i > stamp; i--) {
+                arena_[i - 1] = '0' + unixMs % 10;
+                unixMs /= 10;
+            }
+            relativePoints_--;
+        }
+    }
+
+    // Remove millis() stamped points that start before offset, e.g. spooled
+    // by an earlier boot whose clock was never learned; returns how many
+    uint16_t dropRelative(size_t offset) {
+        uint16_t dropped = 0;
+        size_t kept = 0;
+        for (size_t start = 0; start < length_;) {
+            size_t next = lineEnd(start) + 1;
+            if (start < offset && relativeStamp(start)) {
+                dropped++;
+            } else {
+                memmove(arena_ + kept, arena_ + start, next - start);
+                kept += next - start;
+            }
+            start = next;
+        }
+        length_ = kept;
+        points_ -= dropped;
+        relativePoints_ -= dropped;
+        return dropped;
+    }
+
+    const char* data() const { return arena_; }
+    size_t length() const { return length_; }
+    uint16_t count() const { return points_; }
+    bool empty() const { return points_ == 0; }
+    size_t remaining() const { return CAPACITY - length_; }
+
+    // millis() when the oldest point in the batch was added
+    uint32_t firstPointMillis() const { return firstPointMillis_; }
+
+    // Direct access for filling the arena with already formatted lines
+    char* rawBuffer() { return arena_; }
+
+    void setRaw(size_t length, uint16_t points) {
+        length_ = length < CAPACITY ? length : CAPACITY;
+        points_ = points;
+        relativePoints_ = 0;
+        for (size_t start = 0; start < length_; start = lineEnd(start) + 1) {
+            if (relativeStamp(start)) relativePoints_++;
+        }
+        firstPointMillis_ = millis();
+    }
+
+private:
+    char arena_[CAPACITY];
+    size_t length_ = 0;
+    size_t pointStart_ = 0;
+    uint16_t points_ = 0;
+    uint16_t relativePoints_ = 0;
+    uint8_t fieldCount_ = 0;
+    bool overflow_ = false;
+    uint32_t firstPointMillis_ = 0;
+
+    size_t lineEnd(size_t start) const {
+        while (start < length_ && arena_[start] != '\n') start++;
+        return start;
+    }
+
+    // Offset of the millis() stamp ending the line at start, 0 if it has none
+    size_t relativeStamp(size_t start) const {
+        size_t end = lineEnd(start);
+        if (end - start <= TIMESTAMP_DIGITS) return 0;
+        size_t stamp = end - TIMESTAMP_DIGITS;
+        return arena_[stamp - 1] == ' ' && arena_[stamp] == '0' ? stamp : 0;
+    }
+
+    uint64_t parseStamp(size_t stamp) const {
+        uint64_t value = 0;
+        for (size_t i = stamp; i < stamp + TIMESTAMP_DIGITS; i++) {
+            value = value * 10 + (arena_[i] - '0');
+        }
+        return value;
+    }
+
+    bool finishPoint() {
+        append('\n');
+
+        if (overflow_) {
+            length_ = pointStart_;
+            return false;
+        }
+        if (fieldCount_ == 0) {
+            // Every field was NaN; nothing to write
+            length_ = pointStart_;
+            return true;
+        }
+
+        if (points_ == 0) {
+            firstPointMillis_ = millis();
+        }
+        points_++;
+        return true;
+    }
+
+    void beginField(const char* key) {
+        append(fieldCount_++ == 0 ? ' ' : ',');
+        append(key);
+        append('=');
+    }
+
+    void append(char c) {
+        if (length_ >= CAPACITY) {
+            overflow_ = true;
+            return;
+        }
+        arena_[length_++] = c;
+    }
+
+    void append(const char* text) {
+        while (*text) {
+            append(*text++);
+        }
+    }
+
+    void appendUnsigned(uint64_t value) {
+        char digits[20];
+        uint8_t n = 0;
+        do {
+            digits[n++] = '0' + (value % 10);
+            value /= 10;
+        } while (value);
+        while (n) {
+            append(digits[--n]);
+        }
+    }
+
+    void appendPadded(uint32_t value, uint8_t width) {
+        char digits[TIMESTAMP_DIGITS];
+        for (int8_t i = width - 1; i >= 0; i--) {
+            digits[i] = '0' + value % 10;
+            value /= 10;
+        }
+        for (uint8_t i = 0; i < width; i++) {
+            append(digits[i]);
+        }
+    }
+
+    void appendFloat(float value) {
+        if (value < 0) {
+            append('-');
+            value = -value;
+        }
+
+        // Fixed point with four decimals, rounded
+        uint64_t scaled = (uint64_t)(value * 10000.0f + 0.5f);
+        appendUnsigned(scaled / 10000);
+
+        uint32_t fraction = scaled % 10000;
+        if (fraction == 0) return;
+
+        char decimals[4];
+        for (int8_t i = 3; i >= 0; i--) {
+            decimals[i] = '0' + (fraction % 10);
+            fraction /= 10;
+        }
+        uint8_t used = 4;
+        while (decimals[used - 1] == '0') used--;
+
+        append('.');
+        for (uint8_t i = 0; i < used; i++) {
+            append(decimals[i]);
+        }
+    }
+};
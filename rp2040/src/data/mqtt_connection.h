@@ -0,0 +1,304 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Client.h>
+
+#ifndef MQTT_MAX_PACKET_SIZE
+#define MQTT_MAX_PACKET_SIZE 256
+#endif
+
+// MQTT 3.1.1 session for MQTTHandler that never waits on the broker.
+//
+// connect() opens the TCP connection and sends CONNECT; the CONNACK, like
+// everything else the broker sends, is picked up by loop() on later calls
+// and the session gives up if it has not come within CONNACK_TIMEOUT. The
+// TCP handshake is the one wait left: the W5500 library has no
+// asynchronous connect, so the caller bounds it with the client's
+// connection timeout (a LAN broker answers in a few ms).
+//
+// Publishes are QoS 0 and written to the socket in one piece. Incoming
+// QoS 1 publishes are acknowledged and handed to the callback. loop()
+// sends a PINGREQ once the broker has been silent, or nothing has been
+// sent, for KEEPALIVE seconds, and drops a broker that leaves the
+// PINGREQ unanswered for half a keepalive period. A session busy
+// publishing still pings: the broker answers publishes with nothing.
+class MqttConnection {
+public:
+    enum class State : uint8_t {
+        DISCONNECTED,
+        CONNECTING,     // CONNECT sent, waiting for the CONNACK
+        CONNECTED
+    };
+
+    static const uint32_t CONNACK_TIMEOUT = 2000;     // ms
+    static const uint16_t KEEPALIVE = 15;             // s
+    static const size_t PACKET_SIZE = MQTT_MAX_PACKET_SIZE;
+
+    typedef void (*MessageCallback)(const char* topic, const uint8_t* payload, uint16_t length);
+
+    void begin(Client& networkClient, const char* brokerHost, uint16_t brokerPort) {
+        client = &networkClient;
+        host = brokerHost;
+        port = brokerPort;
+        state = State::DISCONNECTED;
+    }
+
+    void setCallback(MessageCallback messageCallback) {
+        callback = messageCallback;
+    }
+
+    // Open the connection and send CONNECT; false if the broker could not
+    // be reached. Otherwise the outcome shows in getState() after loop().
+    bool connect(const char* clientId) {
+        close();
+        if (!client->connect(host, port)) return false;
+
+        size_t idLength = strlen(clientId);
+        uint8_t* body = beginPacket();
+        body = putString(body, "MQTT", 4);
+        *body++ = 4;                        // Protocol level 3.1.1
+        *body++ = 0x02;                     // Clean session
+        *body++ = KEEPALIVE >> 8;
+        *body++ = KEEPALIVE & 0xFF;
+        body = putString(body, clientId, idLength);
+        if (!sendPacket(0x10, body)) {
+            close();
+            return false;
+        }
+
+        state = State::CONNECTING;
+        connectStarted = millis();
+        lastReceived = connectStarted;
+        return true;
+    }
+
+    void disconnect() {
+        if (state == State::CONNECTED) {
+            const uint8_t packet[] = {0xE0, 0x00};
+            client->write(packet, sizeof(packet));
+        }
+        close();
+    }
+
+    // Read what the broker sent and keep the session alive
+    void loop() {
+        if (state == State::DISCONNECTED) return;
+        if (!client->connected()) {
+            close();
+            return;
+        }
+
+        receive();
+        if (state == State::DISCONNECTED) return;
+
+        unsigned long now = millis();
+        if (state == State::CONNECTING) {
+            if (now - connectStarted >= CONNACK_TIMEOUT) close();
+            return;
+        }
+
+        if (pingOutstanding) {
+            if (now - pingSent >= KEEPALIVE * 500UL) close();
+        } else if (now - lastReceived >= KEEPALIVE * 1000UL || now - lastSent >= KEEPALIVE * 1000UL) {
+            const uint8_t packet[] = {0xC0, 0x00};
+            if (client->write(packet, sizeof(packet)) == sizeof(packet)) {
+                lastSent = now;
+                pingSent = now;
+                pingOutstanding = true;
+            }
+        }
+    }
+
+    bool connected() const { return state == State::CONNECTED; }
+    State getState() const { return state; }
+
+    // Return code of the last CONNACK; 0 is accepted
+    uint8_t getConnackCode() const { return connackCode; }
+
+    bool publish(const char* topic, const uint8_t* payload, uint16_t length, bool retained = false) {
+        if (state != State::CONNECTED) return false;
+        size_t topicLength = strlen(topic);
+        if (5 + 2 + topicLength + length > PACKET_SIZE) return false;
+
+        uint8_t* body = putString(beginPacket(), topic, topicLength);
+        memcpy(body, payload, length);
+        return sendPacket(retained ? 0x31 : 0x30, body + length);
+    }
+
+    bool subscribe(const char* topic, uint8_t qos) {
+        if (state != State::CONNECTED) return false;
+        size_t topicLength = strlen(topic);
+        if (5 + 2 + 2 + topicLength + 1 > PACKET_SIZE) return false;
+
+        uint8_t* body = beginPacket();
+        if (++packetId == 0) packetId = 1;
+        *body++ = packetId >> 8;
+        *body++ = packetId & 0xFF;
+        body = putString(body, topic, topicLength);
+        *body++ = qos;
+        return sendPacket(0x82, body);
+    }
+
+private:
+    // Room for the fixed header ahead of the body in txBuffer
+    static const size_t HEADER_ROOM = 5;
+
+    Client* client = nullptr;
+    const char* host = nullptr;
+    uint16_t port = 0;
+    MessageCallback callback = nullptr;
+    State state = State::DISCONNECTED;
+    uint8_t connackCode = 0;
+    uint16_t packetId = 0;
+
+    unsigned long connectStarted = 0;
+    unsigned long lastSent = 0;
+    unsigned long lastReceived = 0;
+    unsigned long pingSent = 0;
+    bool pingOutstanding = false;
+
+    uint8_t txBuffer[PACKET_SIZE];
+
+    // Incoming packet, assembled across loop() calls. A body too large
+    // for the buffer is read through and dropped.
+    enum class RxPhase : uint8_t {
+        TYPE,
+        LENGTH,
+        BODY
+    };
+
+    RxPhase rxPhase = RxPhase::TYPE;
+    uint8_t rxType = 0;
+    uint32_t rxBodyLength = 0;
+    uint8_t rxShift = 0;
+    uint32_t rxLength = 0;
+    uint8_t rxBuffer[PACKET_SIZE];
+
+    void close() {
+        if (client) client->stop();
+        state = State::DISCONNECTED;
+        pingOutstanding = false;
+        rxPhase = RxPhase::TYPE;
+    }
+
+    uint8_t* beginPacket() {
+        return txBuffer + HEADER_ROOM;
+    }
+
+    static uint8_t* putString(uint8_t* out, const char* text, size_t length) {
+        *out++ = length >> 8;
+        *out++ = length & 0xFF;
+        memcpy(out, text, length);
+        return out + length;
+    }
+
+    // Put the fixed header in front of the body ending at end and write it all at once
+    bool sendPacket(uint8_t type, uint8_t* end) {
+        uint32_t remaining = end - beginPacket();
+        uint8_t lengthBytes[4];
+        uint8_t count = 0;
+        do {
+            uint8_t digit = remaining % 128;
+            remaining /= 128;
+            lengthBytes[count++] = remaining ? digit | 0x80 : digit;
+        } while (remaining);
+
+        uint8_t* start = beginPacket() - count - 1;
+        start[0] = type;
+        memcpy(start + 1, lengthBytes, count);
+        size_t length = end - start;
+        if (client->write(start, length) != length) return false;
+        lastSent = millis();
+        return true;
+    }
+
+    void receive() {
+        while (client->available() && state != State::DISCONNECTED) {
+            int byte = client->read();
+            if (byte < 0) return;
+            if (!consume((uint8_t)byte)) return;
+        }
+    }
+
+    // Feed one received byte; false once the session has been closed
+    bool consume(uint8_t byte) {
+        switch (rxPhase) {
+            case RxPhase::TYPE:
+                rxType = byte;
+                rxBodyLength = 0;
+                rxShift = 0;
+                rxLength = 0;
+                rxPhase = RxPhase::LENGTH;
+                return true;
+
+            case RxPhase::LENGTH:
+                // Remaining length, seven bits a byte, at most four bytes
+                rxBodyLength |= (uint32_t)(byte & 0x7F) << rxShift;
+                rxShift += 7;
+                if (byte & 0x80) {
+                    if (rxShift < 28) return true;
+                    close();
+                    return false;
+                }
+                rxPhase = RxPhase::BODY;
+                return rxBodyLength ? true : finishPacket();
+
+            case RxPhase::BODY:
+            default:
+                if (rxLength < PACKET_SIZE) rxBuffer[rxLength] = byte;
+                rxLength++;
+                return rxLength < rxBodyLength ? true : finishPacket();
+        }
+    }
+
+    bool finishPacket() {
+        rxPhase = RxPhase::TYPE;
+        lastReceived = millis();
+        if (rxLength > PACKET_SIZE) return true;
+
+        const uint8_t* body = rxBuffer;
+        switch (rxType >> 4) {
+            case 2:     // CONNACK
+                if (state != State::CONNECTING || rxLength < 2) break;
+                connackCode = body[1];
+                if (connackCode != 0) {
+                    close();
+                    return false;
+                }
+                state = State::CONNECTED;
+                lastSent = millis();
+                break;
+            case 3:     // PUBLISH
+                handlePublish(rxType, body, rxLength);
+                break;
+            case 13:    // PINGRESP
+                pingOutstanding = false;
+                break;
+            default:    // SUBACK and anything else needs nothing from us
+                break;
+        }
+        return true;
+    }
+
+    void handlePublish(uint8_t flags, const uint8_t* body, size_t length) {
+        if (length < 2) return;
+        uint16_t topicLength = (body[0] << 8) | body[1];
+        uint8_t qos = (flags >> 1) & 0x03;
+        size_t payloadStart = 2 + topicLength + (qos ? 2 : 0);
+        if (payloadStart > length) return;
+
+        if (qos == 1) {
+            const uint8_t* id = body + 2 + topicLength;
+            const uint8_t packet[] = {0x40, 0x02, id[0], id[1]};
+            client->write(packet, sizeof(packet));
+        }
+        if (!callback) return;
+
+        // The topic is copied out so it can be handed over terminated
+        char topic[64];
+        if (topicLength >= sizeof(topic)) return;
+        memcpy(topic, body + 2, topicLength);
+        topic[topicLength] = '\0';
+        callback(topic, body + payloadStart, length - payloadStart);
+    }
+};
@@ -1,67 +1,262 @@
 #pragma once
 
 #include <Arduino.h>
-#include <PubSubClient.h>
-#include <ArduinoJson.h>
+#include <Ethernet.h>
+#include "mqtt_connection.h"
+#include "outbound_queue.h"
+#include "telemetry_encoder.h"
+#include "telemetry_compressor.h"
 
+// MQTT publisher that never stalls loop().
+//
+// Connection attempts are made from update() with jittered exponential
+// backoff (equal jitter: half the window fixed, half random). An attempt
+// only starts the session (see MqttConnection): the TCP handshake is
+// bounded by CONNECT_TIMEOUT and the CONNACK is collected by later
+// update() calls, so a broker that is down or slow never holds loop() up.
+// Messages published while the broker is away are queued in a bounded RAM
+// queue and drained at a limited rate once the session is back, oldest
+// first.
+//
+// The session only publishes at QoS 0, so QoS 1 is honoured locally: a
+// QoS 1 message is kept until it has been written to the socket and is
+// the last thing dropped when the queue is full.
+//
+// Telemetry: a SAMD51 snapshot goes out on bioreactor/telemetry/<format>,
+// in the configured encoding, when TelemetryCompressor kept at least one
+// of its channels. The legacy per-channel topics (bioreactor/data/<channel>)
+// carry the kept samples as plain retained values. Optionally, every
+// snapshot is also collected into a burst message on
+// bioreactor/telemetry/burst every N snapshots.
 class MQTTHandler {
 public:
-    void begin(Client& networkClient) {
-        mqtt.setClient(networkClient);
-        mqtt.setServer(MQTT_SERVER, MQTT_PORT);
-        lastPublish = 0;
+    enum class State {
+        DISCONNECTED,   // Waiting for the backoff to expire
+        CONNECTING,     // Waiting for the CONNACK
+        CONNECTED
+    };
+
+    static const uint32_t BACKOFF_MIN = 1000;         // ms
+    static const uint32_t BACKOFF_MAX = 60000;        // ms
+    static const uint16_t CONNECT_TIMEOUT = 100;      // ms, bounds the TCP handshake
+    static const uint8_t QUEUE_DEPTH = 32;
+    static const uint8_t DRAIN_RATE = 10;             // Messages per second after reconnect
+    static const uint8_t DRAIN_BURST = 5;
+    static const size_t SNAPSHOT_BUFFER = 256;
+    static const size_t BURST_BUFFER = MQTT_MAX_PACKET_SIZE - 64;  // Room for the MQTT header and topic
+
+    void begin(EthernetClient& networkClient) {
+        networkClient.setConnectionTimeout(CONNECT_TIMEOUT);
+        mqtt.begin(networkClient, MQTT_SERVER, MQTT_PORT);
+        randomSeed(micros());
+        nextAttempt = millis();
+        state = State::DISCONNECTED;
     }
 
     void update() {
-        if (!mqtt.connected()) {
-            reconnect();
-        }
+        unsigned long currentTime = millis();
         mqtt.loop();
 
-        unsigned long currentTime = millis();
-        if (currentTime - lastPublish >= 1000) { // Publish every second
-            publishSensorData();
-            lastPublish = currentTime;
+        if (mqtt.connected()) {
+            if (state != State::CONNECTED) {
+                onConnected();
+            }
+            drainQueue(currentTime);
+            return;
+        }
+
+        if (state == State::CONNECTED) {
+            onDisconnected(currentTime);
+        } else if (state == State::CONNECTING && mqtt.getState() == MqttConnection::State::DISCONNECTED) {
+            // No CONNACK, or the broker refused us
+            connectFailed(currentTime);
+        }
+        if (state == State::DISCONNECTED && (long)(currentTime - nextAttempt) >= 0) {
+            attemptConnect(currentTime);
+        }
+    }
+
+    void setFormat(TelemetryFormat newFormat) {
+        format = newFormat;
+        snprintf(telemetryTopic, sizeof(telemetryTopic), "bioreactor/telemetry/%s",
+                 TelemetryEncoder::formatName(format));
+    }
+
+    // Collect this many 1 Hz samples per burst message; 0 turns bursts off
+    void setBurstLength(uint8_t samples) {
+        burstLength = min<uint8_t>(samples, TelemetryEncoder::MAX_BURST_SAMPLES);
+        burstCount = 0;
+    }
+
+    // Called once per new snapshot from the SAMD51 with the samples the
+    // compressor kept from it
+    void publishSnapshot(const LinkProtocol::Snapshot& snapshot,
+                         const TelemetryCompressor::Sample* kept, uint8_t keptCount) {
+        if (keptCount) {
+            uint8_t buffer[SNAPSHOT_BUFFER];
+            size_t length = TelemetryEncoder::encodeSnapshot(snapshot, format, buffer, sizeof(buffer));
+            if (length) {
+                publish(telemetryTopic, buffer, length);
+            }
+        }
+
+        publishKeptChannels(kept, keptCount);
+        collectBurst(snapshot);
+    }
+
+    // Publish now if possible, otherwise queue; false only if the message was dropped
+    bool publish(const char* topic, const uint8_t* payload, uint16_t length, uint8_t qos = 0, bool retained = false) {
+        if (state == State::CONNECTED && queue.empty() &&
+            mqtt.publish(topic, payload, length, retained)) {
+            return true;
         }
+        return queue.push(topic, payload, length, qos, retained);
     }
 
+    bool publish(const char* topic, const char* payload, uint8_t qos = 0, bool retained = false) {
+        return publish(topic, (const uint8_t*)payload, strlen(payload), qos, retained);
+    }
+
+    bool isConnected() const { return state == State::CONNECTED; }
+    State getState() const { return state; }
+    uint8_t getQueuedMessages() const { return queue.size(); }
+    uint32_t getDroppedMessages() const { return queue.dropped(); }
+    uint32_t getConnectAttempts() const { return connectAttempts; }
+
 private:
-    PubSubClient mqtt;
-    unsigned long lastPublish;
+    // Legacy per-channel topics, in TelemetryCompressor channel order
+    struct Channel {
+        const char* topic;
+        uint16_t validBit;
+    };
+
+    static const uint8_t CHANNEL_COUNT = 4;
+
+    MqttConnection mqtt;
+    OutboundQueue<QUEUE_DEPTH> queue;
+    State state = State::DISCONNECTED;
+    TelemetryFormat format = TelemetryFormat::JSON;
+    char telemetryTopic[40] = "bioreactor/telemetry/json";
+    unsigned long nextAttempt = 0;
+    uint8_t failedAttempts = 0;
+    uint32_t connectAttempts = 0;
+
+    // Token bucket for draining the queue
+    uint8_t drainTokens = DRAIN_BURST;
+    unsigned long lastRefill = 0;
+
+    Channel channels[CHANNEL_COUNT] = {
+        {"bioreactor/data/ph", LinkProtocol::VALID_PH},
+        {"bioreactor/data/do", LinkProtocol::VALID_DISSOLVED_OXYGEN},
+        {"bioreactor/data/temperature", LinkProtocol::VALID_TEMPERATURE},
+        {"bioreactor/data/pressure", LinkProtocol::VALID_PRESSURE}
+    };
+
+    // Burst samples, one series per channel above
+    uint8_t burstLength = 0;
+    uint8_t burstCount = 0;
+    uint32_t burstStart = 0;
+    float burstSeries[CHANNEL_COUNT][TelemetryEncoder::MAX_BURST_SAMPLES];
+
     const char* MQTT_SERVER = "localhost";
     const int MQTT_PORT = 1883;
 
-    void reconnect() {
-        while (!mqtt.connected()) {
-            if (mqtt.connect("BioreactorController")) {
-                // Subscribe to control topics
-                mqtt.subscribe("bioreactor/control/ph/setpoint");
-                mqtt.subscribe("bioreactor/control/do/setpoint");
-                mqtt.subscribe("bioreactor/control/temperature/setpoint");
-                mqtt.subscribe("bioreactor/control/pressure/setpoint");
-            } else {
-                delay(5000);
+    void attemptConnect(unsigned long currentTime) {
+        connectAttempts++;
+        if (mqtt.connect("BioreactorController")) {
+            state = State::CONNECTING;
+            return;
+        }
+        connectFailed(currentTime);
+    }
+
+    void connectFailed(unsigned long currentTime) {
+        state = State::DISCONNECTED;
+
+        // Equal jitter: wait between half and all of the current window
+        uint32_t window = BACKOFF_MIN << (failedAttempts < 6 ? failedAttempts : 6);
+        if (window > BACKOFF_MAX) window = BACKOFF_MAX;
+        nextAttempt = currentTime + window / 2 + random(window / 2 + 1);
+        if (failedAttempts < 255) failedAttempts++;
+    }
+
+    void onConnected() {
+        state = State::CONNECTED;
+        failedAttempts = 0;
+        drainTokens = DRAIN_BURST;
+        lastRefill = millis();
+
+        // Subscribe to control topics
+        mqtt.subscribe("bioreactor/control/ph/setpoint", 1);
+        mqtt.subscribe("bioreactor/control/do/setpoint", 1);
+        mqtt.subscribe("bioreactor/control/temperature/setpoint", 1);
+        mqtt.subscribe("bioreactor/control/pressure/setpoint", 1);
+    }
+
+    void onDisconnected(unsigned long currentTime) {
+        state = State::DISCONNECTED;
+        // Retry quickly after a drop; backoff grows only if the retries fail
+        nextAttempt = currentTime + random(BACKOFF_MIN + 1);
+    }
+
+    void drainQueue(unsigned long currentTime) {
+        uint32_t refill = (currentTime - lastRefill) * DRAIN_RATE / 1000;
+        if (refill) {
+            drainTokens = min<uint32_t>(DRAIN_BURST, drainTokens + refill);
+            lastRefill += refill * 1000 / DRAIN_RATE;
+        }
+
+        while (drainTokens && !queue.empty()) {
+            const auto* message = queue.front();
+            if (!mqtt.publish(message->topic, message->payload, message->length, message->retained)) {
+                // Socket full or session lost; keep the message for the next pass
+                return;
             }
+            queue.pop();
+            drainTokens--;
+        }
+    }
+
+    static float channelValue(const LinkProtocol::Snapshot& snapshot, uint8_t channel) {
+        switch (channel) {
+            case 0: return snapshot.ph;
+            case 1: return snapshot.dissolvedOxygen;
+            case 2: return snapshot.temperature;
+            default: return snapshot.pressure;
+        }
+    }
+
+    void publishKeptChannels(const TelemetryCompressor::Sample* kept, uint8_t keptCount) {
+        for (uint8_t i = 0; i < keptCount; i++) {
+            if (kept[i].channel >= CHANNEL_COUNT) continue;
+
+            char text[16];
+            snprintf(text, sizeof(text), "%.3f", kept[i].value);
+            publish(channels[kept[i].channel].topic, text, 0, true);
         }
     }
 
-    void publishSensorData() {
-        StaticJsonDocument<200> doc;
-        
-        // Create JSON structure
-        doc["timestamp"] = millis();
-        doc["ph"] = 7.0;  // TODO: Get actual values
-        doc["do"] = 40.0;
-        doc["temperature"] = 37.0;
-        doc["pressure"] = 1.0;
-
-        char buffer[200];
-        serializeJson(doc, buffer);
-        
-        // Publish to different topics
-        mqtt.publish("bioreactor/data/ph", buffer);
-        mqtt.publish("bioreactor/data/do", buffer);
-        mqtt.publish("bioreactor/data/temperature", buffer);
-        mqtt.publish("bioreactor/data/pressure", buffer);
+    void collectBurst(const LinkProtocol::Snapshot& snapshot) {
+        if (burstLength == 0) return;
+
+        if (burstCount == 0) {
+            burstStart = snapshot.timestamp;
+        }
+        for (uint8_t i = 0; i < CHANNEL_COUNT; i++) {
+            burstSeries[i][burstCount] = (snapshot.validMask & channels[i].validBit) ? channelValue(snapshot, i) : NAN;
+        }
+        if (++burstCount < burstLength) return;
+
+        static const char* const KEYS[CHANNEL_COUNT] = {"ph", "do", "temp", "pres"};
+        const float* series[CHANNEL_COUNT] = {burstSeries[0], burstSeries[1], burstSeries[2], burstSeries[3]};
+        static uint8_t buffer[BURST_BUFFER];
+        size_t length = TelemetryEncoder::encodeBurst(burstStart, 1000, KEYS, series, CHANNEL_COUNT,
+                                                      burstCount, format, buffer, sizeof(buffer));
+        burstCount = 0;
+
+        // Too large for the offline queue; bursts are only sent live
+        if (length && state == State::CONNECTED) {
+            mqtt.publish("bioreactor/telemetry/burst", buffer, length);
+        }
     }
 };
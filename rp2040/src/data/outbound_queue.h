@@ -0,0 +1,85 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Bounded FIFO of MQTT messages waiting for the broker. Storage is fixed;
+// when it is full, QoS 0 messages give way first so alarms and command
+// replies (QoS 1) survive an outage of any length up to the capacity.
+template <uint8_t N, uint16_t MAX_TOPIC = 48, uint16_t MAX_PAYLOAD = 256>
+class OutboundQueue {
+public:
+    struct Message {
+        char topic[MAX_TOPIC];
+        uint8_t payload[MAX_PAYLOAD];
+        uint16_t length;
+        uint8_t qos;
+        bool retained;
+    };
+
+    // Returns false if the message was too large or had to be dropped
+    bool push(const char* topic, const uint8_t* payload, uint16_t length, uint8_t qos, bool retained = false) {
+        if (strlen(topic) >= MAX_TOPIC || length > MAX_PAYLOAD) {
+            dropped_++;
+            return false;
+        }
+
+        if (count_ == N && !makeRoom(qos)) {
+            dropped_++;
+            return false;
+        }
+
+        Message& message = messages_[(head_ + count_) % N];
+        strcpy(message.topic, topic);
+        memcpy(message.payload, payload, length);
+        message.length = length;
+        message.qos = qos;
+        message.retained = retained;
+        count_++;
+        return true;
+    }
+
+    const Message* front() const {
+        return count_ ? &messages_[head_] : nullptr;
+    }
+
+    void pop() {
+        if (count_ == 0) return;
+        head_ = (head_ + 1) % N;
+        count_--;
+    }
+
+    uint8_t size() const { return count_; }
+    bool empty() const { return count_ == 0; }
+    uint32_t dropped() const { return dropped_; }
+
+private:
+    Message messages_[N];
+    uint8_t head_ = 0;
+    uint8_t count_ = 0;
+    uint32_t dropped_ = 0;
+
+    // Evict the oldest QoS 0 message; a QoS 1 message may also evict the
+    // oldest QoS 1 message when nothing else is left
+    bool makeRoom(uint8_t qos) {
+        for (uint8_t i = 0; i < count_; i++) {
+            if (messages_[(head_ + i) % N].qos == 0) {
+                removeAt(i);
+                dropped_++;
+                return true;
+            }
+        }
+        if (qos > 0) {
+            pop();
+            dropped_++;
+            return true;
+        }
+        return false;
+    }
+
+    void removeAt(uint8_t index) {
+        for (uint8_t i = index; i + 1 < count_; i++) {
+            messages_[(head_ + i) % N] = messages_[(head_ + i + 1) % N];
+        }
+        count_--;
+    }
+};
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <Arduino.h>
+#include <math.h>
+#include "link_protocol.h"
+
+// Per-channel compression of the 1 Hz SAMD51 snapshots, applied before
+// data reaches InfluxDB, MQTT and the SD log.
+//
+// Each channel runs either
+//   DEADBAND       - keep a sample when it differs from the last kept one
+//                    by more than the deviation, or
+//   SWINGING_DOOR  - keep few enough points that linear interpolation
+//                    between them stays within the deviation of every
+//                    dropped sample.
+// Either way a sample is kept at least every maxInterval (heartbeat), and
+// the first valid sample after a gap is always kept.
+//
+// Swinging door decides late: when the doors open it keeps a point at the
+// previous sample's time, so kept samples carry their own SAMD51 timestamp.
+class TelemetryCompressor {
+public:
+    enum Channel : uint8_t {
+        CH_PH = 0,
+        CH_DISSOLVED_OXYGEN,
+        CH_TEMPERATURE,
+        CH_PRESSURE,
+        CH_BIOMASS,
+        CH_PT100_1,
+        CH_PT100_2,
+        CH_PT100_3,
+        CHANNEL_COUNT
+    };
+
+    enum class Mode : uint8_t {
+        OFF,            // Keep every sample
+        DEADBAND,
+        SWINGING_DOOR
+    };
+
+    struct Sample {
+        uint8_t channel;
+        float value;
+        uint32_t timestamp;     // SAMD51 millis() of the snapshot
+    };
+
+    // A channel can emit a door sample and a heartbeat in the same step
+    static const uint8_t MAX_OUTPUT = CHANNEL_COUNT * 2;
+
+    TelemetryCompressor() {
+        configure(CH_PH, Mode::SWINGING_DOOR, 0.01f);
+        configure(CH_DISSOLVED_OXYGEN, Mode::SWINGING_DOOR, 0.5f);
+        configure(CH_TEMPERATURE, Mode::SWINGING_DOOR, 0.05f);
+        configure(CH_PRESSURE, Mode::SWINGING_DOOR, 0.01f);
+        configure(CH_BIOMASS, Mode::SWINGING_DOOR, 0.01f);
+        configure(CH_PT100_1, Mode::SWINGING_DOOR, 0.05f);
+        configure(CH_PT100_2, Mode::SWINGING_DOOR, 0.05f);
+        configure(CH_PT100_3, Mode::SWINGING_DOOR, 0.05f);
+    }
+
+    static const char* channelName(uint8_t channel) {
+        static const char* NAMES[CHANNEL_COUNT] = {
+            "ph", "dissolved_oxygen", "temperature", "pressure",
+            "biomass", "pt100_1", "pt100_2", "pt100_3"
+        };
+        return channel < CHANNEL_COUNT ? NAMES[channel] : "";
+    }
+
+    void configure(uint8_t channel, Mode mode, float deviation, uint32_t maxIntervalMs = 300000) {
+        if (channel >= CHANNEL_COUNT) return;
+        State& state = states[channel];
+        state.mode = mode;
+        state.deviation = deviation > 0 ? deviation : 0;
+        state.maxInterval = maxIntervalMs;
+        state.active = false;
+    }
+
+    // Value of a channel in a snapshot; false if the SAMD51 flagged it invalid
+    static bool channelValue(const LinkProtocol::Snapshot& snapshot, uint8_t channel, float& value) {
+        uint16_t valid = snapshot.validMask;
+        switch (channel) {
+            case CH_PH: value = snapshot.ph; return valid & LinkProtocol::VALID_PH;
+            case CH_DISSOLVED_OXYGEN: value = snapshot.dissolvedOxygen; return valid & LinkProtocol::VALID_DISSOLVED_OXYGEN;
+            case CH_TEMPERATURE: value = snapshot.temperature; return valid & LinkProtocol::VALID_TEMPERATURE;
+            case CH_PRESSURE: value = snapshot.pressure; return valid & LinkProtocol::VALID_PRESSURE;
+            case CH_BIOMASS: value = snapshot.biomass; return valid & LinkProtocol::VALID_BIOMASS;
+            default: {
+                uint8_t sensor = channel - CH_PT100_1;
+                value = snapshot.pt100[sensor];
+                return valid & (LinkProtocol::VALID_PT100_1 << sensor);
+            }
+        }
+    }
+
+    // Feed one snapshot; writes the samples to keep into out[MAX_OUTPUT]
+    uint8_t process(const LinkProtocol::Snapshot& snapshot, Sample* out) {
+        uint8_t count = 0;
+        for (uint8_t channel = 0; channel < CHANNEL_COUNT; channel++) {
+            float value;
+            if (!channelValue(snapshot, channel, value)) {
+                // Gap: restart the channel on its next valid sample
+                states[channel].active = false;
+                continue;
+            }
+            count += processChannel(channel, snapshot.timestamp, value, out + count);
+        }
+        return count;
+    }
+
+    // Input samples per kept sample; 1.0 means no compression
+    float getCompressionRatio(uint8_t channel) const {
+        if (channel >= CHANNEL_COUNT || states[channel].kept == 0) return 1.0f;
+        return (float)states[channel].received / states[channel].kept;
+    }
+
+    float getCompressionRatio() const {
+        uint32_t received = 0, kept = 0;
+        for (uint8_t i = 0; i < CHANNEL_COUNT; i++) {
+            received += states[i].received;
+            kept += states[i].kept;
+        }
+        return kept ? (float)received / kept : 1.0f;
+    }
+
+    void resetStatistics() {
+        for (uint8_t i = 0; i < CHANNEL_COUNT; i++) {
+            states[i].received = 0;
+            states[i].kept = 0;
+        }
+    }
+
+private:
+    struct State {
+        Mode mode;
+        float deviation;
+        uint32_t maxInterval;
+        bool active;            // Has an archived point to compare against
+
+        // Last kept point and the previous input
+        uint32_t archivedTime;
+        float archivedValue;
+        uint32_t lastTime;
+        float lastValue;
+
+        // Swinging door: tightest upper and lower slopes seen since the archive
+        float slopeUpper;
+        float slopeLower;
+
+        uint32_t received;
+        uint32_t kept;
+    };
+
+    State states[CHANNEL_COUNT];
+
+    uint8_t processChannel(uint8_t channel, uint32_t time, float value, Sample* out) {
+        State& state = states[channel];
+        state.received++;
+        uint8_t count = 0;
+
+        if (!state.active || state.mode == Mode::OFF) {
+            archive(state, time, value);
+            out[count++] = {channel, value, time};
+            return count;
+        }
+
+        if (state.mode == Mode::DEADBAND) {
+            if (fabsf(value - state.archivedValue) > state.deviation ||
+                time - state.archivedTime >= state.maxInterval) {
+                archive(state, time, value);
+                out[count++] = {channel, value, time};
+            }
+            return count;
+        }
+
+        // Swinging door
+        float dt = (float)(time - state.archivedTime);
+        if (dt > 0) {
+            float upper = (value + state.deviation - state.archivedValue) / dt;
+            float lower = (value - state.deviation - state.archivedValue) / dt;
+            float slopeUpper = min(state.slopeUpper, upper);
+            float slopeLower = max(state.slopeLower, lower);
+
+            if (slopeLower > slopeUpper) {
+                // The doors opened: end the segment at the previous sample's
+                // time, on the middle slope that was still inside both doors.
+                // Keeping the raw previous value instead could put the line
+                // outside the bound at the samples in between.
+                float slope = (state.slopeUpper + state.slopeLower) / 2;
+                float end = state.archivedValue + slope * (float)(state.lastTime - state.archivedTime);
+                archive(state, state.lastTime, end);
+                out[count++] = {channel, end, state.archivedTime};
+
+                // Reopen the doors from there through the current sample
+                dt = (float)(time - state.archivedTime);
+                state.slopeUpper = (value + state.deviation - state.archivedValue) / dt;
+                state.slopeLower = (value - state.deviation - state.archivedValue) / dt;
+            } else {
+                state.slopeUpper = slopeUpper;
+                state.slopeLower = slopeLower;
+            }
+        }
+
+        if (time - state.archivedTime >= state.maxInterval) {
+            archive(state, time, value);
+            out[count++] = {channel, value, time};
+        }
+
+        state.lastTime = time;
+        state.lastValue = value;
+        return count;
+    }
+
+    // Make (time, value) the new segment start
+    static void archive(State& state, uint32_t time, float value) {
+        state.archivedTime = time;
+        state.archivedValue = value;
+        state.lastTime = time;
+        state.lastValue = value;
+        state.slopeUpper = INFINITY;
+        state.slopeLower = -INFINITY;
+        state.active = true;
+        state.kept++;
+    }
+};
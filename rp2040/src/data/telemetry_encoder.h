@@ -0,0 +1,209 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <math.h>
+#include "link_protocol.h"
+
+// Encodes SAMD51 snapshots for MQTT in one of three formats. JSON and
+// MessagePack go through ArduinoJson; ArduinoJson has no CBOR writer, so
+// CBOR is emitted directly (RFC 8949 maps, text keys, float32 values).
+//
+// Channels whose valid bit is clear are left out rather than sent as
+// placeholders.
+enum class TelemetryFormat : uint8_t {
+    JSON,
+    CBOR,
+    MSGPACK
+};
+
+namespace TelemetryEncoder {
+    struct Field {
+        const char* key;
+        float value;
+    };
+
+    static const uint8_t MAX_FIELDS = 11;
+    static const uint8_t MAX_BURST_CHANNELS = 4;
+    static const uint8_t MAX_BURST_SAMPLES = 30;
+
+    inline const char* formatName(TelemetryFormat format) {
+        switch (format) {
+            case TelemetryFormat::CBOR: return "cbor";
+            case TelemetryFormat::MSGPACK: return "msgpack";
+            default: return "json";
+        }
+    }
+
+    // Valid measurements of a snapshot as key/value pairs
+    inline uint8_t collectFields(const LinkProtocol::Snapshot& snapshot, Field* fields) {
+        static const char* PT100_KEYS[3] = {"pt1", "pt2", "pt3"};
+        uint8_t count = 0;
+        uint16_t valid = snapshot.validMask;
+
+        if (valid & LinkProtocol::VALID_PH) fields[count++] = {"ph", snapshot.ph};
+        if (valid & LinkProtocol::VALID_DISSOLVED_OXYGEN) fields[count++] = {"do", snapshot.dissolvedOxygen};
+        if (valid & LinkProtocol::VALID_TEMPERATURE) fields[count++] = {"temp", snapshot.temperature};
+        if (valid & LinkProtocol::VALID_PRESSURE) fields[count++] = {"pres", snapshot.pressure};
+        if (valid & LinkProtocol::VALID_BIOMASS) fields[count++] = {"bio", snapshot.biomass};
+        for (uint8_t i = 0; i < 3; i++) {
+            if (valid & (LinkProtocol::VALID_PT100_1 << i)) fields[count++] = {PT100_KEYS[i], snapshot.pt100[i]};
+        }
+        fields[count++] = {"stir", snapshot.stirrerSpeed};
+        fields[count++] = {"heat", snapshot.heaterOutput};
+        return count;
+    }
+
+    // Minimal CBOR writer over a caller-owned buffer
+    class CborWriter {
+    public:
+        CborWriter(uint8_t* buffer, size_t capacity) : buffer_(buffer), capacity_(capacity) {}
+
+        void map(size_t entries) { head(5, entries); }
+        void array(size_t entries) { head(4, entries); }
+        void unsignedInt(uint64_t value) { head(0, value); }
+
+        void text(const char* value) {
+            size_t length = strlen(value);
+            head(3, length);
+            bytes((const uint8_t*)value, length);
+        }
+
+        void number(float value) {
+            uint32_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+            byte(0xFA);
+            byte(bits >> 24);
+            byte(bits >> 16);
+            byte(bits >> 8);
+            byte(bits);
+        }
+
+        // Bytes written, or 0 if the buffer was too small
+        size_t length() const { return overflow_ ? 0 : length_; }
+
+    private:
+        uint8_t* buffer_;
+        size_t capacity_;
+        size_t length_ = 0;
+        bool overflow_ = false;
+
+        void byte(uint8_t value) {
+            if (length_ >= capacity_) {
+                overflow_ = true;
+                return;
+            }
+            buffer_[length_++] = value;
+        }
+
+        void bytes(const uint8_t* data, size_t length) {
+            for (size_t i = 0; i < length; i++) byte(data[i]);
+        }
+
+        void head(uint8_t major, uint64_t value) {
+            uint8_t type = major << 5;
+            if (value < 24) {
+                byte(type | value);
+            } else if (value <= 0xFF) {
+                byte(type | 24);
+                byte(value);
+            } else if (value <= 0xFFFF) {
+                byte(type | 25);
+                byte(value >> 8);
+                byte(value);
+            } else if (value <= 0xFFFFFFFFULL) {
+                byte(type | 26);
+                for (int8_t shift = 24; shift >= 0; shift -= 8) byte(value >> shift);
+            } else {
+                byte(type | 27);
+                for (int8_t shift = 56; shift >= 0; shift -= 8) byte(value >> shift);
+            }
+        }
+    };
+
+    // ArduinoJson prints floats with nine significant digits; round to
+    // three decimals in double so 7.02f goes out as 7.02, not 7.019999981
+    inline double compact(float value) {
+        return round((double)value * 1000.0) / 1000.0;
+    }
+
+    inline size_t serialize(JsonDocument& doc, TelemetryFormat format, uint8_t* out, size_t capacity) {
+        if (format == TelemetryFormat::MSGPACK) {
+            return serializeMsgPack(doc, out, capacity);
+        }
+        size_t length = serializeJson(doc, (char*)out, capacity);
+        return length < capacity ? length : 0;
+    }
+
+    // One snapshot: {"ts":..., "status":..., "<channel>":value, ...}
+    inline size_t encodeSnapshot(const LinkProtocol::Snapshot& snapshot, TelemetryFormat format,
+                                 uint8_t* out, size_t capacity) {
+        Field fields[MAX_FIELDS];
+        uint8_t count = collectFields(snapshot, fields);
+
+        if (format == TelemetryFormat::CBOR) {
+            CborWriter cbor(out, capacity);
+            cbor.map(count + 2);
+            cbor.text("ts");
+            cbor.unsignedInt(snapshot.timestamp);
+            cbor.text("status");
+            cbor.unsignedInt(snapshot.statusFlags);
+            for (uint8_t i = 0; i < count; i++) {
+                cbor.text(fields[i].key);
+                cbor.number(fields[i].value);
+            }
+            return cbor.length();
+        }
+
+        StaticJsonDocument<384> doc;
+        doc["ts"] = snapshot.timestamp;
+        doc["status"] = snapshot.statusFlags;
+        for (uint8_t i = 0; i < count; i++) {
+            doc[fields[i].key] = compact(fields[i].value);
+        }
+        return serialize(doc, format, out, capacity);
+    }
+
+    // Several equally spaced samples of up to MAX_BURST_CHANNELS channels:
+    // {"ts":first, "dt":ms, "<channel>":[v0, v1, ...], ...}. NaN marks a missing sample.
+    inline size_t encodeBurst(uint32_t firstTimestamp, uint32_t intervalMs,
+                              const char* const* keys, const float* const* series,
+                              uint8_t channels, uint8_t samples,
+                              TelemetryFormat format, uint8_t* out, size_t capacity) {
+        if (channels > MAX_BURST_CHANNELS) channels = MAX_BURST_CHANNELS;
+        if (samples > MAX_BURST_SAMPLES) samples = MAX_BURST_SAMPLES;
+
+        if (format == TelemetryFormat::CBOR) {
+            CborWriter cbor(out, capacity);
+            cbor.map(channels + 2);
+            cbor.text("ts");
+            cbor.unsignedInt(firstTimestamp);
+            cbor.text("dt");
+            cbor.unsignedInt(intervalMs);
+            for (uint8_t c = 0; c < channels; c++) {
+                cbor.text(keys[c]);
+                cbor.array(samples);
+                for (uint8_t s = 0; s < samples; s++) cbor.number(series[c][s]);
+            }
+            return cbor.length();
+        }
+
+        // Too big for the loop() stack
+        static StaticJsonDocument<JSON_OBJECT_SIZE(MAX_BURST_CHANNELS + 2) +
+                                  MAX_BURST_CHANNELS * JSON_ARRAY_SIZE(MAX_BURST_SAMPLES)> doc;
+        doc.clear();
+        doc["ts"] = firstTimestamp;
+        doc["dt"] = intervalMs;
+        for (uint8_t c = 0; c < channels; c++) {
+            JsonArray values = doc.createNestedArray(keys[c]);
+            for (uint8_t s = 0; s < samples; s++) {
+                if (isnan(series[c][s])) {
+                    values.add(nullptr);
+                } else {
+                    values.add(compact(series[c][s]));
+                }
+            }
+        }
+        return serialize(doc, format, out, capacity);
+    }
+}
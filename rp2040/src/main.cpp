@@ -6,15 +6,31 @@
 #include "samd_interface.h"
 #include "data/mqtt_handler.h"
 #include "data/database_manager.h"
+#include "data/telemetry_compressor.h"
+#include "data/history_store.h"
 #include "web/web_interface.h"
+#include "core/core_link.h"
+#include "core/core_load.h"
+#include "core/heap_monitor.h"
 
-// Global objects
+// Core 0: networking and persistence
 NetworkManager network;
 MQTTHandler mqtt;
-DatabaseManager db;
+DataLogger logger;
+DatabaseManager db(logger);
+TelemetryCompressor compressor;
+HistoryStore history(logger);
 WebInterface webInterface;
+
+// Core 1: SAMD51 link
 SAMDInterface samd;
 
+// Shared between the cores
+CoreLink coreLink;
+CoreLoad core0Load;
+CoreLoad core1Load;
+HeapMonitor heapMonitor;
+
 void setup() {
     Serial.begin(115200);
     while (!Serial) delay(10);
@@ -24,31 +40,133 @@ void setup() {
     
     // Initialize other subsystems
     mqtt.begin(network.getClient());
+    logger.setChannels(TelemetryCompressor::channelName, TelemetryCompressor::CHANNEL_COUNT);
+    logger.begin();
     db.begin();
+    history.begin();
     webInterface.begin();
-    samd.begin();
+    webInterface.setCoreLoad(&core0Load, &core1Load);
+    webInterface.setCompressor(&compressor);
+    webInterface.setHistory(&history);
+    webInterface.setHeapMonitor(&heapMonitor);
+    webInterface.setCommandLink(&coreLink);
 }
 
 void loop() {
+    core0Load.beginWork();
+
     // Update all subsystems
     network.update();
     mqtt.update();
     webInterface.update();
+    logger.update();
+    db.update();
+    history.update();
     
-    // Handle communication with SAMD51
-    samd.update();
-    
-    // Get sensor data from SAMD51 and log it
-    if (samd.hasNewData()) {
-        float ph = samd.getPH();
-        float do_level = samd.getDO();
-        float temp = samd.getTemperature();
-        float pressure = samd.getPressure();
-        
-        // Log to database
-        db.logSensorData(ph, do_level, temp, pressure);
+    // Log and publish sensor data forwarded by core 1; only samples the
+    // compressor keeps reach the database and the SD log
+    LinkProtocol::Snapshot snapshot;
+    while (coreLink.telemetry.pop(snapshot)) {
+        history.record(snapshot, db.getUnixTime());
+        logger.setTimeReference(db.getUnixTime(), snapshot.timestamp);
+        webInterface.updateReadings(snapshot);
+
+        TelemetryCompressor::Sample kept[TelemetryCompressor::MAX_OUTPUT];
+        uint8_t keptCount = compressor.process(snapshot, kept);
+        for (uint8_t i = 0; i < keptCount; i++) {
+            const char* name = TelemetryCompressor::channelName(kept[i].channel);
+            db.logSample(name, kept[i].value, snapshot.timestamp - kept[i].timestamp);
+            logger.logSample(kept[i].channel, kept[i].value, kept[i].timestamp);
+        }
+        mqtt.publishSnapshot(snapshot, kept, keptCount);
     }
+
+    LinkProtocol::Alarm alarm;
+    while (coreLink.alarms.pop(alarm)) {
+        const char* source = alarm.code == LinkProtocol::ALARM_SAFETY_INTERLOCK ? "safety" : "ph";
+        db.logControlAction(source, alarm.active ? "alarm_raised" : "alarm_cleared", alarm.code);
+
+        // Alarms must not be lost to a broker outage
+        char payload[96];
+        snprintf(payload, sizeof(payload), "{\"code\":%u,\"severity\":%u,\"active\":%s,\"value\":%.3f}",
+                 alarm.code, alarm.severity, alarm.active ? "true" : "false", alarm.value);
+        mqtt.publish("bioreactor/alarms", payload, 1);
+    }
+
+    LinkProtocol::AutotuneStatus autotune;
+    while (coreLink.autotune.pop(autotune)) {
+        webInterface.updateAutotune(autotune);
+        if (autotune.state == LinkProtocol::AUTOTUNE_COMPLETE) {
+            db.logControlAction(WebInterface::controlLoopName(autotune.loop), "autotune_kp", autotune.kp);
+            db.logControlAction(WebInterface::controlLoopName(autotune.loop), "autotune_ki", autotune.ki);
+            db.logControlAction(WebInterface::controlLoopName(autotune.loop), "autotune_kd", autotune.kd);
+        } else if (autotune.state == LinkProtocol::AUTOTUNE_FAILED) {
+            db.logControlAction(WebInterface::controlLoopName(autotune.loop), "autotune_failed", autotune.failure);
+        }
+    }
+
+    heapMonitor.sample();
+    core0Load.endWork();
     
     // Small delay to prevent tight looping
     delay(1);
 }
+
+// The SAMD51 link runs on its own core so slow TCP or database writes on
+// core 0 never delay it
+void setup1() {
+    samd.begin();
+}
+
+void loop1() {
+    core1Load.beginWork();
+
+    samd.update();
+
+    if (samd.hasNewData()) {
+        coreLink.telemetry.push(samd.getLatestData());
+    }
+
+    LinkProtocol::Alarm alarm;
+    while (samd.popAlarm(alarm)) {
+        coreLink.alarms.push(alarm);
+    }
+
+    LinkProtocol::AutotuneStatus autotune;
+    if (samd.popAutotuneStatus(autotune)) {
+        coreLink.autotune.push(autotune);
+    }
+
+    // Forward commands from core 0; a command the link can't queue yet waits here
+    static LinkCommand command;
+    static bool commandWaiting = false;
+    while (commandWaiting || coreLink.commands.pop(command)) {
+        bool queued = false;
+        switch (command.type) {
+            case LinkProtocol::MSG_SETPOINTS:
+                queued = samd.sendSetpoints(command.setpoints);
+                break;
+            case LinkProtocol::MSG_MODE_CHANGE:
+                queued = samd.sendModeChange(command.modeChange.loop, command.modeChange.mode,
+                                             command.modeChange.manualOutput);
+                break;
+            case LinkProtocol::MSG_CALIBRATION:
+                queued = samd.sendCalibration(command.calibration.sensor, command.calibration.action,
+                                              command.calibration.value);
+                break;
+            case LinkProtocol::MSG_AUTOTUNE:
+                queued = samd.sendAutotune(command.autotune);
+                break;
+            default:
+                queued = true;  // Unknown, drop it
+                break;
+        }
+        commandWaiting = !queued;
+        if (commandWaiting) break;
+    }
+
+    core1Load.endWork();
+
+    // The link polls every 20 ms; there is nothing to do in between
+    delay(1);
+}
@@ -0,0 +1,166 @@
+// Host entry point for [env:native]: drives the RP2040 data path (SAMD51
+// link, telemetry compression, history, line protocol and MQTT encoding)
+// from a simulated SAMD51, faster than real time, and prints what each
+// stage produced. SD card files land in ./sd.
+//
+//   pio run -e native && .pio/build/native/program [seconds]
+//   .pio/build/native/program bench [samples]
+//
+// bench pushes synthetic samples through DataLogger as fast as it takes
+// them and reports sustained throughput and bytes per sample on the card.
+
+#include <Arduino.h>
+#include <chrono>
+#include "samd_interface.h"
+#include "data_logger.h"
+#include "../data/telemetry_compressor.h"
+#include "../data/history_store.h"
+#include "../data/line_protocol_batch.h"
+#include "../data/telemetry_encoder.h"
+#include "simulated_samd51.h"
+
+// Unix time at simulated boot; DatabaseManager would learn it from the server
+static const uint32_t START_TIME = 1767225600;   // 2026-01-01T00:00:00Z
+
+SAMDInterface samd;
+SimulatedSamd51 samdDevice;
+DataLogger logger;
+TelemetryCompressor compressor;
+HistoryStore history(logger);
+LineProtocolBatch batch;
+
+struct Totals {
+    uint32_t snapshots = 0;
+    uint32_t samplesKept = 0;
+    uint32_t batchesSent = 0;
+    uint32_t lineProtocolBytes = 0;
+    uint32_t jsonBytes = 0;
+    uint32_t cborBytes = 0;
+};
+
+Totals totals;
+
+void flushBatch() {
+    if (batch.empty()) return;
+    totals.batchesSent++;
+    totals.lineProtocolBytes += batch.length();
+    batch.clear();
+}
+
+void handleSnapshot(const LinkProtocol::Snapshot& snapshot) {
+    uint32_t now = START_TIME + millis() / 1000;
+    totals.snapshots++;
+    history.record(snapshot, now);
+    logger.setTimeReference(now, snapshot.timestamp);
+
+    uint8_t payload[256];
+    totals.jsonBytes += TelemetryEncoder::encodeSnapshot(snapshot, TelemetryFormat::JSON, payload, sizeof(payload));
+    totals.cborBytes += TelemetryEncoder::encodeSnapshot(snapshot, TelemetryFormat::CBOR, payload, sizeof(payload));
+
+    TelemetryCompressor::Sample kept[TelemetryCompressor::MAX_OUTPUT];
+    uint8_t keptCount = compressor.process(snapshot, kept);
+    for (uint8_t i = 0; i < keptCount; i++) {
+        const char* name = TelemetryCompressor::channelName(kept[i].channel);
+        uint64_t timestampMs = (uint64_t)now * 1000 - (snapshot.timestamp - kept[i].timestamp);
+        batch.beginPoint("bioreactor_sensors");
+        batch.tag("device", "bioreactor");
+        batch.field(name, kept[i].value);
+        if (!batch.endPoint(timestampMs)) {
+            flushBatch();
+        }
+        logger.logSample(kept[i].channel, kept[i].value, kept[i].timestamp);
+    }
+    totals.samplesKept += keptCount;
+
+    if (batch.count() >= 30) flushBatch();
+}
+
+void printReport() {
+    Serial.printf("link        %lu frames, %lu lost, %lu errors, %lu commands failed\n",
+                  (unsigned long)samd.getFramesReceived(), (unsigned long)samd.getFramesLost(),
+                  (unsigned long)samd.getFrameErrors(), (unsigned long)samd.getCommandsFailed());
+    Serial.printf("commands    %lu applied, last ack %u, temperature setpoint %.1f\n",
+                  (unsigned long)samdDevice.getCommandsReceived(), samd.getLastAckStatus(),
+                  samdDevice.getSetpoints().temperature);
+    Serial.printf("snapshots   %lu, %lu samples kept (ratio %.1f)\n", (unsigned long)totals.snapshots,
+                  (unsigned long)totals.samplesKept, compressor.getCompressionRatio());
+    for (uint8_t ch = 0; ch < TelemetryCompressor::CHANNEL_COUNT; ch++) {
+        Serial.printf("  %-18s %.1f\n", TelemetryCompressor::channelName(ch), compressor.getCompressionRatio(ch));
+    }
+    Serial.printf("influx      %lu batches, %lu bytes\n", (unsigned long)totals.batchesSent,
+                  (unsigned long)totals.lineProtocolBytes);
+    Serial.printf("mqtt        json %lu bytes, cbor %lu bytes\n", (unsigned long)totals.jsonBytes,
+                  (unsigned long)totals.cborBytes);
+    Serial.printf("sd log      %lu samples, %lu block writes\n", (unsigned long)logger.getSamplesLogged(),
+                  (unsigned long)logger.getBlocksWritten());
+
+    uint32_t points = 0;
+    uint32_t to = history.latest();
+    uint32_t step = history.query(TelemetryCompressor::CH_PH, to - 3600, to, 60,
+                                  [&](uint32_t, float, float, float) { points++; });
+    Serial.printf("history     last hour of ph: %lu points at %lu s\n", (unsigned long)points, (unsigned long)step);
+}
+
+// Eight random-walk channels, one sample per simulated millisecond
+int runBenchmark(uint32_t samples) {
+    float values[TelemetryCompressor::CHANNEL_COUNT] = {7.0f, 40.0f, 37.0f, 1.0f, 1.0f, 37.0f, 37.0f, 37.0f};
+    uint32_t writesBefore = logger.getBlocksWritten();
+    uint32_t sealedBefore = logger.getBlocksSealed();
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < samples; i++) {
+        uint8_t channel = i % TelemetryCompressor::CHANNEL_COUNT;
+        values[channel] += (random(2001) - 1000) / 100000.0f;
+        logger.logSample(channel, values[channel], millis());
+        if (channel == 0) {
+            logger.update();
+            NativeHal::advance(1000);
+        }
+    }
+    logger.update();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint32_t writes = logger.getBlocksWritten() - writesBefore;
+    uint32_t sealed = logger.getBlocksSealed() - sealedBefore;
+    double bytes = (double)writes * SampleLog::BLOCK_SIZE;
+    Serial.printf("bench       %lu samples in %.3f s: %.0f samples/s, %.2f MB/s written\n",
+                  (unsigned long)samples, elapsed, samples / elapsed, bytes / elapsed / 1e6);
+    Serial.printf("            %lu block writes, %lu sealed, %lu preallocated, %.2f card bytes per sample\n",
+                  (unsigned long)writes, (unsigned long)sealed, (unsigned long)logger.getBlocksPreallocated(),
+                  (double)SampleLog::BLOCK_SIZE * sealed / samples);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    bool bench = argc > 1 && strcmp(argv[1], "bench") == 0;
+    int countArg = bench ? 2 : 1;
+    uint64_t count = argc > countArg ? strtoull(argv[countArg], nullptr, 10) : (bench ? 1000000 : 3600);
+
+    NativeHal::attachSpiDevice(&SAMD_LINK_SPI, SAMD_LINK_CS_PIN, &samdDevice);
+    logger.setChannels(TelemetryCompressor::channelName, TelemetryCompressor::CHANNEL_COUNT);
+    logger.begin();
+    if (bench) {
+        return runBenchmark(count);
+    }
+    history.begin();
+    samd.begin();
+
+    LinkProtocol::Setpoints setpoints = {7.0f, 40.0f, 37.5f, 1.0f, 250.0f, 0};
+    samd.sendSetpoints(setpoints);
+
+    uint64_t end = NativeHal::nowMicros + count * 1000000ULL;
+    while (NativeHal::nowMicros < end) {
+        samd.update();
+        if (samd.hasNewData()) {
+            handleSnapshot(samd.getLatestData());
+        }
+        logger.update();
+        history.update();
+        NativeHal::advance(1000);
+    }
+    flushBatch();
+    logger.update();
+
+    printReport();
+    return 0;
+}
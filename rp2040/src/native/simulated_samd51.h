@@ -0,0 +1,124 @@
+#pragma once
+
+#include <Arduino.h>
+#include <math.h>
+#include "link_protocol.h"
+
+// SAMD51 end of the SPI link for [env:native] builds. Each transaction
+// carries the frame prepared before it started, chosen the way
+// samd51/include/communication.h does: the ACK for the last command
+// received first, then any alarm raised, else the newest snapshot.
+// Retransmissions are spotted the same way, by type, sequence and session.
+// A new snapshot is produced every SNAPSHOT_INTERVAL_MS with slowly
+// drifting, slightly noisy values. While stalled, as when the SAMD51's
+// main loop falls behind the polls, every transaction carries the last
+// frame again.
+class SimulatedSamd51 : public NativeHal::SpiDevice {
+public:
+    static const uint32_t SNAPSHOT_INTERVAL_MS = 1000;
+
+    void select() override {
+        index = 0;
+        if (!stalled) prepareFrame();
+    }
+
+    uint8_t transfer(uint8_t mosi) override {
+        if (index >= LinkProtocol::FRAME_SIZE) return 0xFF;
+        rx[index] = mosi;
+        return tx[index++];
+    }
+
+    void deselect() override {
+        if (index == LinkProtocol::FRAME_SIZE) handleFrame();
+    }
+
+    void advance(uint64_t nowMicros) override {
+        uint32_t now = nowMicros / 1000;
+        if (now - snapshot.timestamp < SNAPSHOT_INTERVAL_MS && snapshot.timestamp != 0) return;
+
+        float t = now / 1000.0f;
+        snapshot.timestamp = now ? now : 1;
+        snapshot.ph = 7.0f + 0.05f * sinf(t / 600.0f) + noise(0.002f);
+        snapshot.dissolvedOxygen = setpoints.dissolvedOxygen + 2.0f * sinf(t / 300.0f) + noise(0.3f);
+        snapshot.temperature = setpoints.temperature - 0.1f + noise(0.02f);
+        snapshot.pressure = setpoints.pressure + noise(0.002f);
+        snapshot.biomass = 1.0f + t / 36000.0f;
+        for (uint8_t i = 0; i < 3; i++) {
+            snapshot.pt100[i] = snapshot.temperature + 0.05f * i + noise(0.01f);
+        }
+        snapshot.stirrerSpeed = setpoints.stirrerSpeed;
+        snapshot.heaterOutput = 1200.0f;
+        snapshot.validMask = 0xFF;
+        snapshot.statusFlags = LinkProtocol::STATUS_SYSTEM_SAFE | LinkProtocol::STATUS_HEATER_ON;
+    }
+
+    void raiseAlarm(const LinkProtocol::Alarm& alarm) {
+        pendingAlarm = alarm;
+        alarmPending = true;
+    }
+
+    void setStalled(bool stall) { stalled = stall; }
+
+    const LinkProtocol::Setpoints& getSetpoints() const { return setpoints; }
+    uint32_t getCommandsReceived() const { return commandsReceived; }
+
+private:
+    uint8_t tx[LinkProtocol::FRAME_SIZE];
+    uint8_t rx[LinkProtocol::FRAME_SIZE];
+    size_t index = 0;
+    uint8_t sequence = 0;
+
+    LinkProtocol::Snapshot snapshot = {};
+    LinkProtocol::Setpoints setpoints = {7.0f, 40.0f, 37.0f, 1.0f, 200.0f, 0};
+    LinkProtocol::Ack pendingAck = {};
+    bool ackPending = false;
+    LinkProtocol::Alarm pendingAlarm = {};
+    bool alarmPending = false;
+    bool stalled = false;
+    uint8_t lastCommandType = LinkProtocol::MSG_IDLE;
+    uint8_t lastCommandSequence = 0;
+    uint8_t lastCommandSession = 0;
+    uint32_t commandsReceived = 0;
+
+    static float noise(float amplitude) {
+        return amplitude * (random(2001) - 1000) / 1000.0f;
+    }
+
+    void prepareFrame() {
+        if (ackPending) {
+            LinkProtocol::encode(tx, LinkProtocol::MSG_ACK, sequence++, pendingAck);
+            ackPending = false;
+        } else if (alarmPending) {
+            LinkProtocol::encode(tx, LinkProtocol::MSG_ALARM, sequence++, pendingAlarm);
+            alarmPending = false;
+        } else if (snapshot.timestamp != 0) {
+            LinkProtocol::encode(tx, LinkProtocol::MSG_SNAPSHOT, sequence++, snapshot);
+        } else {
+            LinkProtocol::encodeIdle(tx, sequence++);
+        }
+    }
+
+    void handleFrame() {
+        LinkProtocol::FrameHeader header;
+        if (LinkProtocol::decodeFrame(rx, header) != LinkProtocol::DECODE_OK) return;
+        if (header.type == LinkProtocol::MSG_IDLE) return;
+
+        // Retransmissions are acknowledged again but applied once
+        bool repeat = header.session == lastCommandSession && header.type == lastCommandType &&
+                      header.sequence == lastCommandSequence;
+        lastCommandType = header.type;
+        lastCommandSequence = header.sequence;
+        lastCommandSession = header.session;
+
+        uint8_t status = LinkProtocol::ACK_OK;
+        if (header.type == LinkProtocol::MSG_SETPOINTS) {
+            if (!repeat && LinkProtocol::decodePayload(rx, header, setpoints)) commandsReceived++;
+        } else if (header.type == LinkProtocol::MSG_MODE_CHANGE || header.type == LinkProtocol::MSG_CALIBRATION) {
+            if (!repeat) commandsReceived++;
+        } else {
+            status = LinkProtocol::ACK_UNSUPPORTED;
+        }
+        pendingAck = {header.type, header.sequence, status};
+        ackPending = true;
+    }
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WebServer.h>
+#include "web_server.h"
+
+// Server-Sent Events fan-out for the live dashboard.
+//
+// The caller formats each event once and hands the same bytes to every
+// client. A client only gets an event if its socket buffer can take all of
+// it, so a slow browser never blocks loop(); an event it misses leaves it
+// out of sync, and it is sent a keyframe (a full snapshot) instead of the
+// next delta. A client that misses MAX_SKIPPED events in a row is dropped.
+class EventStream {
+public:
+    static const uint8_t MAX_CLIENTS = WEB_MAX_CLIENTS;
+    static const uint8_t MAX_SKIPPED = 10;
+
+    // Take over a request's connection; false if all slots are busy
+    bool add(WiFiClient client) {
+        prune();
+        for (uint8_t i = 0; i < MAX_CLIENTS; i++) {
+            Subscriber& subscriber = subscribers[i];
+            if (subscriber.active) continue;
+
+            client.print("HTTP/1.1 200 OK\r\n"
+                         "Content-Type: text/event-stream\r\n"
+                         "Cache-Control: no-cache\r\n"
+                         "Connection: keep-alive\r\n\r\n"
+                         "retry: 2000\n\n");
+            subscriber.client = client;
+            subscriber.active = true;
+            subscriber.needsKeyframe = true;
+            subscriber.skipped = 0;
+            return true;
+        }
+        return false;
+    }
+
+    // Release the slots of clients that went away
+    void prune() {
+        for (uint8_t i = 0; i < MAX_CLIENTS; i++) {
+            Subscriber& subscriber = subscribers[i];
+            if (subscriber.active && !subscriber.client.connected()) {
+                drop(subscriber);
+            }
+        }
+    }
+
+    uint8_t count() const {
+        uint8_t active = 0;
+        for (uint8_t i = 0; i < MAX_CLIENTS; i++) {
+            if (subscribers[i].active) active++;
+        }
+        return active;
+    }
+
+    bool wantsKeyframe() const {
+        for (uint8_t i = 0; i < MAX_CLIENTS; i++) {
+            if (subscribers[i].active && subscribers[i].needsKeyframe) return true;
+        }
+        return false;
+    }
+
+    // Send a keyframe to the clients waiting for one, or a delta to the
+    // clients that are in sync
+    void send(const char* event, size_t length, bool keyframe) {
+        for (uint8_t i = 0; i < MAX_CLIENTS; i++) {
+            Subscriber& subscriber = subscribers[i];
+            if (!subscriber.active || subscriber.needsKeyframe != keyframe) continue;
+
+            if ((size_t)subscriber.client.availableForWrite() < length) {
+                subscriber.needsKeyframe = true;
+                skippedEvents++;
+                if (++subscriber.skipped >= MAX_SKIPPED) {
+                    drop(subscriber);
+                }
+                continue;
+            }
+            subscriber.client.write((const uint8_t*)event, length);
+            subscriber.needsKeyframe = false;
+            subscriber.skipped = 0;
+        }
+    }
+
+    uint32_t getSkippedEvents() const { return skippedEvents; }
+    uint32_t getDroppedClients() const { return droppedClients; }
+
+private:
+    struct Subscriber {
+        WiFiClient client;
+        bool active = false;
+        bool needsKeyframe = false;
+        uint8_t skipped = 0;
+    };
+
+    Subscriber subscribers[MAX_CLIENTS];
+    uint32_t skippedEvents = 0;
+    uint32_t droppedClients = 0;
+
+    void drop(Subscriber& subscriber) {
+        if (subscriber.client.connected()) droppedClients++;
+        subscriber.client.stop();
+        subscriber.active = false;
+    }
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+// Generated by tools/embed_assets.py from web/; do not edit.
+
+#include <Arduino.h>
+
+struct StaticAsset {
+    const char* path;
+    const char* contentType;
+    const char* etag;
+    const uint8_t* data;
+    size_t length;
+    const uint8_t* gzipData;
+    size_t gzipLength;
+};
+
+static const uint8_t ASSET_0[] PROGMEM = {
+    0x3c, 0x21, 0x44, 0x4f, 0x43, 0x54, 0x59, 0x50, 0x45, 0x20, 0x68, 0x74, 0x6d, 0x6c, 0x3e, 0x0a,
+    0x3c, 0x68, 0x74, 0x6d, 0x6c, 0x3e, 0x0a, 0x3c, 0x68, 0x65, 0x61, 0x64, 0x3e, 0x0a, 0x20, 0x20,
+    0x20, 0x20, 0x3c, 0x74, 0x69, 0x74, 0x6c, 0x65, 0x3e, 0x42, 0x69, 0x6f, 0x72, 0x65, 0x61, 0x63,
+    0x74, 0x6f, 0x72, 0x20, 0x43, 0x6f, 0x6e, 0x74, 0x72, 0x6f, 0x6c, 0x20, 0x53, 0x79, 0x73, 0x74,
+    0x65, 0x6d, 0x3c, 0x2f, 0x74, 0x69, 0x74, 0x6c, 0x65, 0x3e, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x3c,
+    0x6c, 0x69, 0x6e, 0x6b, 0x20, 0x72, 0x65, 0x6c, 0x3d, 0x22, 0x73, 0x74, 0x79, 0x6c, 0x65, 0x73,
+    0x68, 0x65, 0x65, 0x74, 0x22, 0x20, 0x68, 0x72, 0x65, 0x66, 0x3d, 0x22, 0x2f, 0x63, 0x73, 0x73,
+    0x2f, 0x73, 0x74, 0x79, 0x6c, 0x65, 0x73, 0x2e, 0x63, 0x73, 0x73, 0x22, 0x3e, 0x0a, 0x3c, 0x2f,
+    0x68, 0x65, 0x61, 0x64, 0x3e, 0x0a, 0x3c, 0x62, 0x6f, 0x64, 0x79, 0x3e, 0x0a, 0x20, 0x20, 0x20,
+    0x20, 0x3c, 0x64, 0x69, 0x76, 0x20, 0x69, 0x64, 0x3d, 0x22, 0x61, 0x70, 0x70, 0x22, 0x3e, 0x0a,
+    0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x68, 0x31, 0x3e, 0x42, 0x69, 0x6f, 0x72,
+    0x65, 0x61, 0x63, 0x74, 0x6f, 0x72, 0x20, 0x43, 0x6f, 0x6e, 0x74, 0x72, 0x6f, 0x6c, 0x20, 0x53,
+    0x79, 0x73, 0x74, 0x65, 0x6d, 0x3c, 0x2f, 0x68, 0x31, 0x3e, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20,
+    0x20, 0x20, 0x20, 0x3c, 0x64, 0x69, 0x76, 0x20, 0x63, 0x6c, 0x61, 0x73, 0x73, 0x3d, 0x22, 0x63,
+    0x6f, 0x6e, 0x74, 0x61, 0x69, 0x6e, 0x65, 0x72, 0x22, 0x3e, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20,
+    0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x21, 0x2d, 0x2d, 0x20, 0x41, 0x64, 0x64, 0x20,
+    0x63, 0x6f, 0x6d, 0x70, 0x72, 0x65, 0x68, 0x65, 0x6e, 0x73, 0x69, 0x76, 0x65, 0x20, 0x55, 0x49,
+    0x20, 0x65, 0x6c, 0x65, 0x6d, 0x65, 0x6e, 0x74, 0x73, 0x20, 0x68, 0x65, 0x72, 0x65, 0x20, 0x2d,
+    0x2d, 0x3e, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 0x64, 0x69, 0x76,
+    0x3e, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x2f, 0x64, 0x69, 0x76, 0x3e, 0x0a, 0x20, 0x20, 0x20,
+    0x20, 0x3c, 0x73, 0x63, 0x72, 0x69, 0x70, 0x74, 0x20, 0x73, 0x72, 0x63, 0x3d, 0x22, 0x2f, 0x6a,
+    0x73, 0x2f, 0x6d, 0x61, 0x69, 0x6e, 0x2e, 0x6a, 0x73, 0x22, 0x3e, 0x3c, 0x2f, 0x73, 0x63, 0x72,
+    0x69, 0x70, 0x74, 0x3e, 0x0a, 0x3c, 0x2f, 0x62, 0x6f, 0x64, 0x79, 0x3e, 0x0a, 0x3c, 0x2f, 0x68,
+    0x74, 0x6d, 0x6c, 0x3e, 0x0a,
+};
+
+static const uint8_t ASSET_0_GZ[] PROGMEM = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x7d, 0x50, 0x3d, 0x4f, 0x03, 0x31,
+    0x0c, 0xdd, 0xfb, 0x2b, 0xdc, 0xec, 0xd7, 0x88, 0x3d, 0x77, 0x12, 0x14, 0x06, 0x26, 0x90, 0x80,
+    0x81, 0x31, 0x24, 0x46, 0x49, 0x9b, 0x8f, 0x53, 0x6c, 0x55, 0xba, 0x7f, 0x8f, 0x7b, 0x29, 0xe2,
+    0x26, 0xb2, 0xc4, 0x7a, 0x7e, 0x7a, 0x1f, 0x36, 0xfb, 0xc7, 0x97, 0xe3, 0xfb, 0xe7, 0xeb, 0x13,
+    0x04, 0xce, 0x69, 0xda, 0x99, 0xdf, 0x0f, 0xad, 0x9f, 0x76, 0x20, 0xcf, 0x70, 0xe4, 0x84, 0xd3,
+    0x43, 0xac, 0x0d, 0xad, 0xe3, 0xda, 0xe0, 0x58, 0x0b, 0xb7, 0x9a, 0xe0, 0x6d, 0x21, 0xc6, 0x6c,
+    0x74, 0x27, 0x74, 0x72, 0x8a, 0xe5, 0x0c, 0x0d, 0xd3, 0xa8, 0x88, 0x97, 0x84, 0x14, 0x10, 0x59,
+    0x41, 0x68, 0xf8, 0x3d, 0x2a, 0xed, 0x88, 0x74, 0x87, 0x0f, 0x32, 0x2a, 0xb1, 0xd1, 0xdd, 0xc7,
+    0x7c, 0x55, 0xbf, 0xdc, 0x14, 0x7c, 0xbc, 0x40, 0xf4, 0xa3, 0xb2, 0xf3, 0xac, 0x3a, 0xb4, 0xc2,
+    0xe1, 0xee, 0xbf, 0x08, 0xb2, 0xfd, 0xa3, 0x5e, 0x15, 0x5c, 0xb2, 0x44, 0xa3, 0x72, 0xc2, 0xb3,
+    0xb1, 0x60, 0xdb, 0x48, 0xad, 0x9c, 0xfd, 0x30, 0xc0, 0xbd, 0xf7, 0xe0, 0x6a, 0x9e, 0x1b, 0x06,
+    0x2c, 0x14, 0x2f, 0x08, 0x1f, 0xcf, 0x80, 0x09, 0x33, 0x16, 0x26, 0x08, 0xd8, 0x10, 0x86, 0x61,
+    0xa3, 0xab, 0x45, 0xf8, 0x16, 0x72, 0x33, 0x92, 0x6b, 0x71, 0x66, 0xa0, 0xe6, 0xa4, 0xe1, 0x89,
+    0x74, 0x16, 0xbf, 0xc3, 0x49, 0xda, 0x19, 0xdd, 0x57, 0xd7, 0x9a, 0xbd, 0x9f, 0xe4, 0x5c, 0xaf,
+    0xfb, 0x03, 0xac, 0x21, 0xeb, 0xc5, 0x75, 0x01, 0x00, 0x00,
+};
+
+static const uint8_t ASSET_1[] PROGMEM = {
+    0x2f, 0x2a, 0x20, 0x41, 0x64, 0x64, 0x20, 0x79, 0x6f, 0x75, 0x72, 0x20, 0x43, 0x53, 0x53, 0x20,
+    0x73, 0x74, 0x79, 0x6c, 0x65, 0x73, 0x20, 0x68, 0x65, 0x72, 0x65, 0x20, 0x2a, 0x2f, 0x0a,
+};
+
+static const uint8_t ASSET_1_GZ[] PROGMEM = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0xd3, 0xd7, 0x52, 0x70, 0x4c, 0x49,
+    0x51, 0xa8, 0xcc, 0x2f, 0x2d, 0x52, 0x70, 0x0e, 0x0e, 0x56, 0x28, 0x2e, 0xa9, 0xcc, 0x49, 0x2d,
+    0x56, 0xc8, 0x48, 0x2d, 0x4a, 0x55, 0xd0, 0xd2, 0xe7, 0x02, 0x00, 0x7d, 0x13, 0xc0, 0x09, 0x1f,
+    0x00, 0x00, 0x00,
+};
+
+static const uint8_t ASSET_2[] PROGMEM = {
+    0x2f, 0x2f, 0x20, 0x41, 0x64, 0x64, 0x20, 0x79, 0x6f, 0x75, 0x72, 0x20, 0x4a, 0x61, 0x76, 0x61,
+    0x53, 0x63, 0x72, 0x69, 0x70, 0x74, 0x20, 0x63, 0x6f, 0x64, 0x65, 0x20, 0x68, 0x65, 0x72, 0x65,
+    0x0a,
+};
+
+static const uint8_t ASSET_2_GZ[] PROGMEM = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0xd3, 0xd7, 0x57, 0x70, 0x4c, 0x49,
+    0x51, 0xa8, 0xcc, 0x2f, 0x2d, 0x52, 0xf0, 0x4a, 0x2c, 0x4b, 0x0c, 0x4e, 0x2e, 0xca, 0x2c, 0x28,
+    0x51, 0x48, 0xce, 0x4f, 0x49, 0x55, 0xc8, 0x48, 0x2d, 0x4a, 0xe5, 0x02, 0x00, 0xda, 0x0d, 0x0c,
+    0x09, 0x21, 0x00, 0x00, 0x00,
+};
+
+static const StaticAsset STATIC_ASSETS[] = {
+    {"/", "text/html", "\"ea8a16ecce5d01d6\"", ASSET_0, 373, ASSET_0_GZ, 234},
+    {"/css/styles.css", "text/css", "\"8a80617ee55f38f1\"", ASSET_1, 31, ASSET_1_GZ, 51},
+    {"/js/main.js", "text/javascript", "\"82e442262d80fa90\"", ASSET_2, 33, ASSET_2_GZ, 53},
+};
+
+static const size_t STATIC_ASSET_COUNT = sizeof(STATIC_ASSETS) / sizeof(STATIC_ASSETS[0]);
@@ -3,7 +3,31 @@
 #include <Arduino.h>
 #include <WebServer.h>
 #include <ArduinoJson.h>
+#include "../core/core_load.h"
+#include "../core/heap_monitor.h"
+#include "../core/core_link.h"
+#include "../data/telemetry_compressor.h"
+#include "../data/history_store.h"
+#include "static_assets.h"
+#include "event_stream.h"
+#include "link_protocol.h"
 
+// HTTP API and UI on the network core.
+//
+// Responses are never built in an Arduino String: JSON documents live on
+// the stack and are serialized straight into the socket through a fixed
+// buffer, and the page assets are served from flash (see
+// tools/embed_assets.py), gzip-compressed when the client accepts it and
+// with an ETag so reloads are answered with 304.
+//
+// /api/events pushes the live readings as Server-Sent Events: a full
+// "snapshot" event when a client joins or falls behind, then once a
+// second a "delta" event holding only the fields that changed. Each event
+// is formatted once and shared by all clients.
+//
+// /api/autotune starts or aborts a relay auto-tune of one SAMD51 loop
+// (POST) and reports its progress (GET) from the status messages the
+// SAMD51 sends as the tune goes.
 class WebInterface {
 public:
     // Setpoint structure for all controllable parameters
@@ -49,6 +73,8 @@ public:
     };
 
     void begin() {
+        static const char* HEADERS[] = {"If-None-Match", "Accept-Encoding"};
+        server.collectHeaders(HEADERS, 2);
         server.begin();
         setupRoutes();
         lastUpdate = 0;
@@ -65,6 +91,63 @@ public:
 
         // Initialize all control modes to OFF
         control_modes = {};
+
+        // No readings until the first snapshot arrives
+        status = {};
+        status.temperature[0] = status.temperature[1] = status.temperature[2] = NAN;
+        status.ph = status.dissolved_oxygen = status.biomass = status.pressure = NAN;
+    }
+
+    // Load counters reported on /api/system
+    void setCoreLoad(const CoreLoad* core0, const CoreLoad* core1) {
+        coreLoad[0] = core0;
+        coreLoad[1] = core1;
+    }
+
+    void setCompressor(const TelemetryCompressor* telemetryCompressor) {
+        compressor = telemetryCompressor;
+    }
+
+    void setHeapMonitor(const HeapMonitor* monitor) {
+        heap = monitor;
+    }
+
+    // Source for /api/history
+    void setHistory(const HistoryStore* historyStore) {
+        history = historyStore;
+    }
+
+    // Where /api/autotune queues commands for the SAMD51
+    void setCommandLink(CoreLink* link) {
+        commandLink = link;
+    }
+
+    // Latest auto-tune progress from the SAMD51
+    void updateAutotune(const LinkProtocol::AutotuneStatus& status) {
+        autotune = status;
+        autotuneReceived = millis();
+        haveAutotune = true;
+    }
+
+    // API name of a LinkProtocol::ControlLoop
+    static const char* controlLoopName(uint8_t loop) {
+        return loop < CONTROL_LOOP_COUNT ? CONTROL_LOOP_NAMES[loop] : "unknown";
+    }
+
+    // Latest readings from the SAMD51, called once per snapshot
+    void updateReadings(const LinkProtocol::Snapshot& snapshot) {
+        uint16_t valid = snapshot.validMask;
+        for (uint8_t i = 0; i < 3; i++) {
+            status.temperature[i] = (valid & (LinkProtocol::VALID_PT100_1 << i)) ? snapshot.pt100[i] : NAN;
+        }
+        status.ph = (valid & LinkProtocol::VALID_PH) ? snapshot.ph : NAN;
+        status.dissolved_oxygen = (valid & LinkProtocol::VALID_DISSOLVED_OXYGEN) ? snapshot.dissolvedOxygen : NAN;
+        status.biomass = (valid & LinkProtocol::VALID_BIOMASS) ? snapshot.biomass : NAN;
+        status.pressure = (valid & LinkProtocol::VALID_PRESSURE) ? snapshot.pressure : NAN;
+        status.stirring_speed = snapshot.stirrerSpeed;
+        status.heater_on = snapshot.statusFlags & LinkProtocol::STATUS_HEATER_ON;
+        status.stirrer_on = snapshot.statusFlags & LinkProtocol::STATUS_STIRRER_ON;
+        status.pump_on = snapshot.statusFlags & LinkProtocol::STATUS_PUMP_ON;
     }
 
     void update() {
@@ -72,7 +155,7 @@ public:
         
         unsigned long currentTime = millis();
         if (currentTime - lastUpdate >= 1000) { // Update every second
-            updateWebSocketClients();
+            pushEvents();
             lastUpdate = currentTime;
         }
     }
@@ -83,9 +166,83 @@ private:
     Setpoints setpoints;
     ControlModes control_modes;
     SystemStatus status;
+    const CoreLoad* coreLoad[2] = {nullptr, nullptr};
+    const TelemetryCompressor* compressor = nullptr;
+    const HistoryStore* history = nullptr;
+    const HeapMonitor* heap = nullptr;
+    CoreLink* commandLink = nullptr;
+    LinkProtocol::AutotuneStatus autotune = {};
+    unsigned long autotuneReceived = 0;
+    bool haveAutotune = false;
+
+    // Indexed by LinkProtocol::ControlLoop, AutotuneRule, AutotuneState and AutotuneFailure
+    static const uint8_t CONTROL_LOOP_COUNT = 6;
+    static constexpr const char* CONTROL_LOOP_NAMES[CONTROL_LOOP_COUNT] = {
+        "temperature", "ph", "dissolved_oxygen", "stirring", "feeding", "pressure"
+    };
+    static const uint8_t AUTOTUNE_RULE_COUNT = 6;
+    static constexpr const char* AUTOTUNE_RULE_NAMES[AUTOTUNE_RULE_COUNT] = {
+        "ziegler_nichols", "ziegler_nichols_pi", "tyreus_luyben",
+        "pessen_integral", "some_overshoot", "no_overshoot"
+    };
+    static constexpr const char* AUTOTUNE_STATE_NAMES[] = {"idle", "running", "complete", "failed"};
+    static constexpr const char* AUTOTUNE_FAILURE_NAMES[] = {"none", "timeout", "no_oscillation", "aborted"};
+
+    // Live event stream; values are kept scaled to integers so unchanged
+    // fields compare equal and deltas stay small
+    static const uint8_t LIVE_FIELD_COUNT = 13;
+    static const int32_t NO_VALUE = INT32_MIN;
+    static const uint32_t EVENT_HEARTBEAT = 15000;    // ms, keeps idle connections open
+    EventStream events;
+    int32_t liveSent[LIVE_FIELD_COUNT];
+    unsigned long lastEvent = 0;
+
+    // Collects response bytes in a fixed buffer and sends them as it fills
+    class ChunkWriter : public Print {
+    public:
+        ChunkWriter(WebServer& server) : server(server) {}
+
+        size_t write(uint8_t c) override {
+            if (length == sizeof(buffer)) flush();
+            buffer[length++] = c;
+            return 1;
+        }
+
+        size_t write(const uint8_t* data, size_t size) override {
+            for (size_t i = 0; i < size; i++) write(data[i]);
+            return size;
+        }
+
+        void printf(const char* format, ...) {
+            for (uint8_t attempt = 0; attempt < 2; attempt++) {
+                va_list args;
+                va_start(args, format);
+                int written = vsnprintf(buffer + length, sizeof(buffer) - length, format, args);
+                va_end(args);
+                if (written < 0) return;
+                if (length + written < sizeof(buffer)) {
+                    length += written;
+                    return;
+                }
+                // Did not fit; send what we have and format again into an empty buffer
+                flush();
+            }
+        }
+
+        void flush() {
+            if (length) {
+                server.sendContent(buffer, length);
+                length = 0;
+            }
+        }
+
+    private:
+        WebServer& server;
+        char buffer[512];
+        size_t length = 0;
+    };
 
     void setupRoutes() {
-        server.on("/", HTTP_GET, [this]() { handleRoot(); });
         server.on("/api/setpoints", HTTP_GET, [this]() { handleGetSetpoints(); });
         server.on("/api/setpoints", HTTP_POST, [this]() { handleSetpoints(); });
         server.on("/api/control", HTTP_GET, [this]() { handleGetControl(); });
@@ -93,14 +250,47 @@ private:
         server.on("/api/data", HTTP_GET, [this]() { handleData(); });
         server.on("/api/calibration", HTTP_POST, [this]() { handleCalibration(); });
         server.on("/api/system", HTTP_GET, [this]() { handleSystem(); });
-        
+        server.on("/api/history", HTTP_GET, [this]() { handleHistory(); });
+        server.on("/api/events", HTTP_GET, [this]() { handleEvents(); });
+        server.on("/api/autotune", HTTP_GET, [this]() { handleGetAutotune(); });
+        server.on("/api/autotune", HTTP_POST, [this]() { handleAutotune(); });
+
         // Static files
-        server.on("/css/styles.css", HTTP_GET, [this]() { handleStyles(); });
-        server.on("/js/main.js", HTTP_GET, [this]() { handleJavascript(); });
+        for (size_t i = 0; i < STATIC_ASSET_COUNT; i++) {
+            const StaticAsset* asset = &STATIC_ASSETS[i];
+            server.on(asset->path, HTTP_GET, [this, asset]() { handleAsset(*asset); });
+        }
     }
 
-    void handleRoot() {
-        server.send(200, "text/html", generateHTML());
+    // Send a document with a Content-Length, without an intermediate copy
+    void sendJson(const JsonDocument& doc, int code = 200) {
+        server.setContentLength(measureJson(doc));
+        server.send(code, "application/json", "");
+        ChunkWriter out(server);
+        serializeJson(doc, out);
+        out.flush();
+    }
+
+    void handleAsset(const StaticAsset& asset) {
+        server.sendHeader("ETag", asset.etag);
+        // Revalidate every time; unchanged assets cost a 304 with no body
+        server.sendHeader("Cache-Control", "no-cache");
+        if (server.header("If-None-Match") == asset.etag) {
+            server.send(304);
+            return;
+        }
+
+        bool gzip = asset.gzipLength < asset.length &&
+                    strstr(server.header("Accept-Encoding").c_str(), "gzip") != nullptr;
+        const uint8_t* data = gzip ? asset.gzipData : asset.data;
+        size_t length = gzip ? asset.gzipLength : asset.length;
+        if (gzip) {
+            server.sendHeader("Content-Encoding", "gzip");
+        }
+        server.sendHeader("Vary", "Accept-Encoding");
+        server.setContentLength(length);
+        server.send(200, asset.contentType, "");
+        server.sendContent((const char*)data, length);
     }
 
     void handleGetSetpoints() {
@@ -113,9 +303,7 @@ private:
         doc["feed_rate"] = setpoints.feed_rate;
         doc["pressure"] = setpoints.pressure;
         
-        String response;
-        serializeJson(doc, response);
-        server.send(200, "application/json", response);
+        sendJson(doc);
     }
 
     void handleSetpoints() {
@@ -149,9 +337,7 @@ private:
         doc["feeding"] = static_cast<int>(control_modes.feeding);
         doc["pressure"] = static_cast<int>(control_modes.pressure);
         
-        String response;
-        serializeJson(doc, response);
-        server.send(200, "application/json", response);
+        sendJson(doc);
     }
 
     void handleControl() {
@@ -204,9 +390,47 @@ private:
         sys_status["pump"] = status.pump_on;
         sys_status["uptime"] = status.uptime;
         
-        String response;
-        serializeJson(doc, response);
-        server.send(200, "application/json", response);
+        sendJson(doc);
+    }
+
+    // /api/history?channel=ph&from=<unix s>&to=<unix s>&step=<s>
+    // Defaults: the last hour up to the newest sample, at the finest step.
+    // Points are [time, mean, min, max], streamed as they are read.
+    void handleHistory() {
+        if (!history || history->latest() == 0) {
+            server.send(503, "application/json", "{\"status\":\"error\",\"message\":\"No history yet\"}");
+            return;
+        }
+
+        int8_t channel = HistoryStore::findChannel(server.arg("channel").c_str());
+        if (channel < 0) {
+            server.send(400, "application/json", "{\"status\":\"error\",\"message\":\"Unknown channel\"}");
+            return;
+        }
+
+        uint32_t to = server.hasArg("to") ? strtoul(server.arg("to").c_str(), nullptr, 10) : history->latest();
+        uint32_t from = server.hasArg("from") ? strtoul(server.arg("from").c_str(), nullptr, 10)
+                                              : (to > 3600 ? to - 3600 : 0);
+        uint32_t step = server.hasArg("step") ? strtoul(server.arg("step").c_str(), nullptr, 10) : 1;
+        if (from > to) {
+            server.send(400, "application/json", "{\"status\":\"error\",\"message\":\"from is after to\"}");
+            return;
+        }
+
+        server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+        server.send(200, "application/json", "");
+
+        ChunkWriter out(server);
+        out.printf("{\"channel\":\"%s\",\"points\":[", TelemetryCompressor::channelName(channel));
+        bool first = true;
+        uint32_t used = history->query(channel, from, to, step,
+            [&](uint32_t time, float mean, float low, float high) {
+                out.printf("%s[%lu,%.3f,%.3f,%.3f]", first ? "" : ",", (unsigned long)time, mean, low, high);
+                first = false;
+            });
+        out.printf("],\"step\":%lu}", (unsigned long)used);
+        out.flush();
+        server.sendContent("");
     }
 
     void handleCalibration() {
@@ -215,8 +439,8 @@ private:
             DeserializationError error = deserializeJson(doc, server.arg("plain"));
             
             if (!error) {
-                String sensor = doc["sensor"].as<String>();
-                String action = doc["action"].as<String>();
+                const char* sensor = doc["sensor"] | "";
+                const char* action = doc["action"] | "";
                 float value = doc["value"] | 0.0f;
                 
                 // Handle calibration based on sensor type
@@ -233,24 +457,206 @@ private:
         }
     }
 
-    void handleSystem() {
+    static int8_t findName(const char* const* names, uint8_t count, const char* name) {
+        for (uint8_t i = 0; i < count; i++) {
+            if (strcmp(names[i], name) == 0) return i;
+        }
+        return -1;
+    }
+
+    // {"loop": "temperature", "action": "start" | "abort", "rule": "tyreus_luyben",
+    //  "amplitude": 0.25, "hysteresis": 0.05}
+    // rule defaults to tyreus_luyben, amplitude (fraction of the output
+    // range) and hysteresis (process units) to the SAMD51's per-loop
+    // defaults. Accepted once queued; the SAMD51 may still refuse it
+    // (another tune running, interlock tripped), which GET shows.
+    void handleAutotune() {
         StaticJsonDocument<256> doc;
+        if (!server.hasArg("plain") || deserializeJson(doc, server.arg("plain"))) {
+            server.send(400, "application/json", "{\"status\":\"error\",\"message\":\"Invalid JSON\"}");
+            return;
+        }
+
+        int8_t loop = findName(CONTROL_LOOP_NAMES, CONTROL_LOOP_COUNT, doc["loop"] | "");
+        if (loop != LinkProtocol::LOOP_TEMPERATURE && loop != LinkProtocol::LOOP_PH &&
+            loop != LinkProtocol::LOOP_DISSOLVED_OXYGEN && loop != LinkProtocol::LOOP_PRESSURE) {
+            server.send(400, "application/json", "{\"status\":\"error\",\"message\":\"Loop cannot be tuned\"}");
+            return;
+        }
+
+        const char* action = doc["action"] | "start";
+        int8_t rule = findName(AUTOTUNE_RULE_NAMES, AUTOTUNE_RULE_COUNT, doc["rule"] | "tyreus_luyben");
+        LinkProtocol::AutotuneCommand command = {};
+        command.loop = loop;
+        if (strcmp(action, "abort") == 0) {
+            command.action = LinkProtocol::AUTOTUNE_ABORT;
+        } else if (strcmp(action, "start") == 0 && rule >= 0) {
+            command.action = LinkProtocol::AUTOTUNE_START;
+            command.rule = rule;
+            command.amplitude = doc["amplitude"] | 0.0f;
+            command.hysteresis = doc["hysteresis"] | 0.0f;
+        } else {
+            server.send(400, "application/json", "{\"status\":\"error\",\"message\":\"Unknown action or rule\"}");
+            return;
+        }
+
+        if (!commandLink || !commandLink->sendAutotune(command)) {
+            server.send(503, "application/json", "{\"status\":\"error\",\"message\":\"Command queue full\"}");
+            return;
+        }
+        server.send(202, "application/json", "{\"status\":\"queued\"}");
+    }
+
+    void handleGetAutotune() {
+        StaticJsonDocument<512> doc;
+        if (!haveAutotune) {
+            doc["state"] = AUTOTUNE_STATE_NAMES[LinkProtocol::AUTOTUNE_IDLE];
+            sendJson(doc);
+            return;
+        }
+
+        doc["loop"] = controlLoopName(autotune.loop);
+        doc["state"] = autotune.state <= LinkProtocol::AUTOTUNE_FAILED ? AUTOTUNE_STATE_NAMES[autotune.state] : "unknown";
+        doc["rule"] = autotune.rule < AUTOTUNE_RULE_COUNT ? AUTOTUNE_RULE_NAMES[autotune.rule] : "unknown";
+        doc["cycles"] = autotune.cycles;
+        doc["setpoint"] = autotune.setpoint;
+        doc["age"] = millis() - autotuneReceived;       // ms since the last status
+        if (autotune.state == LinkProtocol::AUTOTUNE_FAILED) {
+            doc["failure"] = autotune.failure <= LinkProtocol::AUTOTUNE_FAILURE_ABORTED
+                             ? AUTOTUNE_FAILURE_NAMES[autotune.failure] : "unknown";
+        }
+        if (autotune.state == LinkProtocol::AUTOTUNE_COMPLETE) {
+            doc["ultimate_gain"] = autotune.ultimateGain;
+            doc["ultimate_period"] = autotune.ultimatePeriod;
+            doc["amplitude"] = autotune.amplitude;
+            doc["kp"] = autotune.kp;
+            doc["ki"] = autotune.ki;
+            doc["kd"] = autotune.kd;
+        }
+        sendJson(doc);
+    }
+
+    void handleSystem() {
+        StaticJsonDocument<768> doc;
         doc["version"] = "1.0.0";
         doc["uptime"] = millis();
+        for (uint8_t core = 0; core < 2; core++) {
+            if (coreLoad[core]) {
+                doc["core_load"][core] = coreLoad[core]->getLoad();
+            }
+        }
+        if (compressor) {
+            JsonObject ratios = doc.createNestedObject("compression_ratio");
+            ratios["total"] = compressor->getCompressionRatio();
+            for (uint8_t channel = 0; channel < TelemetryCompressor::CHANNEL_COUNT; channel++) {
+                ratios[TelemetryCompressor::channelName(channel)] = compressor->getCompressionRatio(channel);
+            }
+        }
+        doc["event_clients"] = events.count();
+        doc["event_skipped"] = events.getSkippedEvents();
+        doc["event_dropped"] = events.getDroppedClients();
+        if (heap) {
+            JsonObject memory = doc.createNestedObject("heap");
+            memory["used"] = heap->getUsed();
+            memory["peak_used"] = heap->getPeakUsed();
+            memory["arena"] = heap->getArena();
+            memory["free_in_arena"] = heap->getFreeInArena();
+            memory["total"] = heap->getTotal();
+        }
         // Add other system information as needed
         
-        String response;
-        serializeJson(doc, response);
-        server.send(200, "application/json", response);
+        sendJson(doc);
+    }
+
+    void handleEvents() {
+        if (!events.add(server.client())) {
+            server.send(503, "application/json", "{\"status\":\"error\",\"message\":\"Too many clients\"}");
+        }
     }
 
-    void updateWebSocketClients() {
-        // Update status from actual sensors and controllers
+    struct LiveField {
+        const char* key;
+        uint8_t decimals;       // 0 for counts and flags
+    };
+
+    void liveValues(int32_t* values) {
+        const float* const READINGS[] = {
+            &status.temperature[0], &status.temperature[1], &status.temperature[2],
+            &status.ph, &status.dissolved_oxygen, &status.biomass,
+            &status.stirring_speed, &status.feed_rate, &status.pressure
+        };
+        for (uint8_t i = 0; i < 9; i++) {
+            float value = *READINGS[i];
+            values[i] = isnan(value) ? NO_VALUE : (int32_t)lroundf(value * 1000.0f);
+        }
+        values[9] = status.heater_on;
+        values[10] = status.cooler_on;
+        values[11] = status.stirrer_on;
+        values[12] = status.pump_on;
+    }
+
+    // "event: <name>\ndata: {...}\n\n" with all fields, or only those that
+    // differ from liveSent; returns 0 if a delta would be empty
+    size_t formatEvent(char* buffer, size_t capacity, const int32_t* values, bool keyframe) {
+        static const LiveField FIELDS[LIVE_FIELD_COUNT] = {
+            {"temperature_1", 3}, {"temperature_2", 3}, {"temperature_3", 3},
+            {"ph", 3}, {"dissolved_oxygen", 3}, {"biomass", 3},
+            {"stirring_speed", 3}, {"feed_rate", 3}, {"pressure", 3},
+            {"heater", 0}, {"cooler", 0}, {"stirrer", 0}, {"pump", 0}
+        };
+
+        int length = snprintf(buffer, capacity, "event: %s\ndata: {\"uptime\":%lu",
+                              keyframe ? "snapshot" : "delta", (unsigned long)status.uptime);
+        uint8_t changed = 0;
+        for (uint8_t i = 0; i < LIVE_FIELD_COUNT && length > 0 && (size_t)length < capacity; i++) {
+            if (!keyframe && values[i] == liveSent[i]) continue;
+            changed++;
+
+            char* out = buffer + length;
+            size_t room = capacity - length;
+            if (values[i] == NO_VALUE) {
+                length += snprintf(out, room, ",\"%s\":null", FIELDS[i].key);
+            } else if (FIELDS[i].decimals == 0) {
+                length += snprintf(out, room, ",\"%s\":%ld", FIELDS[i].key, (long)values[i]);
+            } else {
+                length += snprintf(out, room, ",\"%s\":%.3f", FIELDS[i].key, values[i] / 1000.0);
+            }
+        }
+        if (length > 0 && (size_t)length < capacity) {
+            length += snprintf(buffer + length, capacity - length, "}\n\n");
+        }
+        if (length <= 0 || (size_t)length >= capacity || (!keyframe && changed == 0)) return 0;
+        return length;
+    }
+
+    // One tick of the live stream
+    void pushEvents() {
         updateSystemStatus();
-        // Implement WebSocket updates for real-time data
+        events.prune();
+        if (events.count() == 0) return;
+
+        int32_t values[LIVE_FIELD_COUNT];
+        liveValues(values);
+        char buffer[512];
+        unsigned long currentTime = millis();
+
+        if (events.wantsKeyframe()) {
+            size_t length = formatEvent(buffer, sizeof(buffer), values, true);
+            if (length) events.send(buffer, length, true);
+        }
+
+        size_t length = formatEvent(buffer, sizeof(buffer), values, false);
+        if (length) {
+            events.send(buffer, length, false);
+            lastEvent = currentTime;
+        } else if (currentTime - lastEvent >= EVENT_HEARTBEAT) {
+            events.send(":\n\n", 3, false);
+            lastEvent = currentTime;
+        }
+        memcpy(liveSent, values, sizeof(liveSent));
     }
 
-    bool performCalibration(const String& sensor, const String& action, float value) {
+    bool performCalibration(const char* sensor, const char* action, float value) {
         // Implement calibration logic for different sensors
         // Return true if calibration was successful
         return false;
@@ -260,36 +666,4 @@ private:
         // Update status structure with current readings and system state
         status.uptime = millis();
     }
-
-    String generateHTML() {
-        // Return a comprehensive HTML interface
-        return R"(
-<!DOCTYPE html>
-<html>
-<head>
-    <title>Bioreactor Control System</title>
-    <link rel="stylesheet" href="/css/styles.css">
-</head>
-<body>
-    <div id="app">
-        <h1>Bioreactor Control System</h1>
-        <div class="container">
-            <!-- Add comprehensive UI elements here -->
-        </div>
-    </div>
-    <script src="/js/main.js"></script>
-</body>
-</html>
-)";
-    }
-
-    void handleStyles() {
-        // Serve CSS file
-        server.send(200, "text/css", "/* Add your CSS styles here */");
-    }
-
-    void handleJavascript() {
-        // Serve JavaScript file
-        server.send(200, "text/javascript", "// Add your JavaScript code here");
-    }
 };
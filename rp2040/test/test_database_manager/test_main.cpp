@@ -0,0 +1,294 @@
+// DatabaseManager against a stand-in InfluxDB: batching, the SD spool,
+// the timestamps points carry when they were logged before the clock was
+// known or while the server was down, requests that never wait on the
+// network, and batches the server rejects
+//
+//   pio test -e native -f test_database_manager
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include "data/database_manager.h"
+
+// Unix time at simulated boot
+static const uint64_t START_MS = 1767225600000ULL;   // 2026-01-01T00:00:00Z
+
+// Answers /ping and /api/v2/write like InfluxDB, with a Date header from
+// the simulated clock, and keeps every point written
+class FakeInflux : public NativeHal::TcpServer {
+public:
+    struct Point {
+        int index;          // The test logs its own sequence number as the value
+        uint64_t timestamp;
+    };
+
+    bool reachable = true;
+    int status = 204;
+    size_t largestWrite = 0;    // Bytes in the largest single write from the client
+    std::vector<Point> points;
+    std::vector<std::string> requests;
+
+    bool accept() override {
+        request.clear();
+        return reachable;
+    }
+
+    void receive(const uint8_t* data, size_t length) override {
+        largestWrite = max(largestWrite, length);
+        request.append((const char*)data, length);
+        size_t headerEnd = request.find("\r\n\r\n");
+        if (headerEnd == std::string::npos) return;
+
+        size_t bodyLength = 0;
+        size_t field = request.find("Content-Length: ");
+        if (field != std::string::npos && field < headerEnd) bodyLength = atoi(request.c_str() + field + 16);
+        if (request.size() < headerEnd + 4 + bodyLength) return;
+
+        requests.push_back(request.substr(0, request.find(' ', request.find(' ') + 1)));
+        if (status / 100 == 2) parsePoints(request.substr(headerEnd + 4, bodyLength));
+        respond();
+        request.clear();
+    }
+
+private:
+    std::string request;
+
+    void parsePoints(const std::string& body) {
+        size_t start = 0;
+        while (start < body.size()) {
+            size_t end = body.find('\n', start);
+            std::string line = body.substr(start, end - start);
+            size_t value = line.find("ph=");
+            size_t stamp = line.rfind(' ');
+            TEST_ASSERT_TRUE(value != std::string::npos && stamp != std::string::npos && stamp > value);
+            points.push_back({atoi(line.c_str() + value + 3), strtoull(line.c_str() + stamp + 1, nullptr, 10)});
+            start = end + 1;
+        }
+    }
+
+    void respond() {
+        time_t now = (START_MS + NativeHal::nowMicros / 1000) / 1000;
+        struct tm utc;
+        gmtime_r(&now, &utc);
+        char date[64];
+        strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &utc);
+
+        char response[128];
+        snprintf(response, sizeof(response), "HTTP/1.1 %d %s\r\nDate: %s\r\n\r\n",
+                 status, status / 100 == 2 ? "No Content" : "Bad Request", date);
+        send(response);
+        close();
+    }
+};
+
+static FakeInflux influx;
+
+// Unix ms at which each logged point was taken
+static std::vector<uint64_t> loggedAt;
+
+// A fresh card for every test
+void setUp() {
+    char root[] = "/tmp/test_database_manager_XXXXXX";
+    TEST_ASSERT_NOT_NULL(mkdtemp(root));
+    SD.root = root;
+    influx.reachable = true;
+    influx.status = 204;
+    influx.window = 2048;
+    influx.largestWrite = 0;
+    influx.points.clear();
+    influx.requests.clear();
+    loggedAt.clear();
+}
+
+void tearDown() {}
+
+static void logPoint(DatabaseManager& db) {
+    db.logSample("ph", (float)loggedAt.size(), 0);
+    loggedAt.push_back(START_MS + millis());
+}
+
+// One point every pointInterval ms for duration ms; update() every 10 ms
+static void run(DatabaseManager& db, uint32_t duration, uint32_t pointInterval = 0) {
+    uint64_t end = NativeHal::nowMicros + (uint64_t)duration * 1000;
+    uint64_t nextPoint = NativeHal::nowMicros;
+    while (NativeHal::nowMicros < end) {
+        if (pointInterval && NativeHal::nowMicros >= nextPoint) {
+            logPoint(db);
+            nextPoint += (uint64_t)pointInterval * 1000;
+        }
+        db.update();
+        NativeHal::advance(10000);
+    }
+}
+
+// Every point arrived once, in order, stamped within the Date header's
+// one-second resolution of when it was logged
+static void assertDeliveredWithLoggedTimes(uint32_t dropped) {
+    TEST_ASSERT_EQUAL(loggedAt.size() - dropped, influx.points.size());
+    for (size_t i = 0; i < influx.points.size(); i++) {
+        const FakeInflux::Point& point = influx.points[i];
+        TEST_ASSERT_EQUAL(dropped + i, point.index);
+        TEST_ASSERT_LESS_OR_EQUAL(loggedAt[point.index], point.timestamp);
+        TEST_ASSERT_GREATER_THAN(loggedAt[point.index] - 1000, point.timestamp);
+    }
+}
+
+void test_points_before_the_clock_keep_their_time() {
+    DataLogger logger;
+    logger.begin();
+    DatabaseManager db(logger);
+    db.begin();
+    TEST_ASSERT_EQUAL(0, db.getUnixTime());
+
+    // Down for five minutes from boot: the arena fills and goes to the spool
+    influx.reachable = false;
+    run(db, 300000, 1000);
+    TEST_ASSERT_EQUAL(0, influx.requests.size());
+    TEST_ASSERT_TRUE(db.getBatchesSpooled() > 0);
+
+    // The points still carry their own time when the server comes up
+    influx.reachable = true;
+    run(db, 300000);
+    TEST_ASSERT_EQUAL_STRING("GET /ping", influx.requests[0].c_str());
+    TEST_ASSERT_FALSE(logger.hasSpooledData());
+    TEST_ASSERT_EQUAL(0, db.getPointsDropped());
+    assertDeliveredWithLoggedTimes(0);
+}
+
+void test_spooled_points_keep_their_time() {
+    DataLogger logger;
+    logger.begin();
+    DatabaseManager db(logger);
+    db.begin();
+
+    run(db, 20000, 1000);
+    TEST_ASSERT_TRUE(db.getUnixTime() != 0);
+
+    // Two minutes down: batches go to the spool
+    influx.reachable = false;
+    run(db, 120000, 1000);
+    TEST_ASSERT_TRUE(db.getBatchesSpooled() > 0);
+    TEST_ASSERT_TRUE(logger.hasSpooledData());
+
+    // Replayed well after they were logged, with their own timestamps
+    influx.reachable = true;
+    run(db, 600000);
+    TEST_ASSERT_FALSE(logger.hasSpooledData());
+    TEST_ASSERT_EQUAL(0, db.getPointsDropped());
+    assertDeliveredWithLoggedTimes(0);
+}
+
+// Without a card a full arena of points waiting for the clock is dropped
+void test_full_arena_without_a_card_drops_points() {
+    DataLogger logger;
+    DatabaseManager db(logger);
+    db.begin();
+
+    influx.reachable = false;
+    for (uint16_t i = 0; i < 200; i++) {
+        logPoint(db);
+        NativeHal::advance(1000);
+    }
+    uint32_t dropped = db.getPointsDropped();
+    TEST_ASSERT_TRUE(dropped > 0);
+    TEST_ASSERT_TRUE(dropped < 200);
+
+    influx.reachable = true;
+    run(db, 60000);
+    assertDeliveredWithLoggedTimes(dropped);
+}
+
+// An earlier boot that never learned the clock left points that cannot be placed
+void test_earlier_boot_points_without_a_clock_are_dropped() {
+    DataLogger logger;
+    logger.begin();
+    const char earlier[] = "bioreactor_sensors,device=bioreactor ph=999 0000000012345\n";
+    TEST_ASSERT_TRUE(logger.spoolAppend(earlier, strlen(earlier)));
+
+    DatabaseManager db(logger);
+    db.begin();
+    influx.reachable = false;
+    run(db, 10000, 1000);
+    influx.reachable = true;
+    run(db, 60000, 1000);
+    run(db, DatabaseManager::FLUSH_INTERVAL * 2);
+
+    TEST_ASSERT_FALSE(logger.hasSpooledData());
+    TEST_ASSERT_EQUAL(1, db.getPointsDropped());
+    TEST_ASSERT_EQUAL(loggedAt.size(), influx.points.size());
+    for (size_t i = 0; i < influx.points.size(); i++) {
+        TEST_ASSERT_EQUAL(i, influx.points[i].index);
+        TEST_ASSERT_LESS_OR_EQUAL(loggedAt[i], influx.points[i].timestamp);
+        TEST_ASSERT_GREATER_THAN(loggedAt[i] - 1000, influx.points[i].timestamp);
+    }
+}
+
+// An unreachable server costs an update() no more than 100 ms,
+// and a batch larger than the socket's free buffer goes out over several
+// update() calls in writes that fit it
+void test_requests_do_not_block() {
+    DataLogger logger;
+    logger.begin();
+    DatabaseManager db(logger);
+    db.begin();
+
+    influx.reachable = false;
+    uint64_t longestUpdate = 0;
+    for (uint32_t i = 0; i < 60; i++) {
+        logPoint(db);
+        uint64_t before = NativeHal::nowMicros;
+        db.update();
+        longestUpdate = max(longestUpdate, NativeHal::nowMicros - before);
+        NativeHal::advance(1000000);
+    }
+    TEST_ASSERT_LESS_OR_EQUAL(100000ULL, longestUpdate);
+
+    // A whole arena of points, through a 256-byte window
+    influx.reachable = true;
+    influx.window = 256;
+    run(db, 600000, 100);
+    run(db, DatabaseManager::FLUSH_INTERVAL * 2);
+    TEST_ASSERT_LESS_OR_EQUAL(256, influx.largestWrite);
+    TEST_ASSERT_FALSE(logger.hasSpooledData());
+    TEST_ASSERT_EQUAL(0, db.getPointsDropped());
+    assertDeliveredWithLoggedTimes(0);
+}
+
+// A batch the server refuses with a 4xx is counted and dropped, not retried
+void test_rejected_batch_is_counted() {
+    DataLogger logger;
+    logger.begin();
+    DatabaseManager db(logger);
+    db.begin();
+    run(db, 20000, 1000);
+    uint32_t written = influx.points.size();
+    TEST_ASSERT_TRUE(written > 0);
+
+    influx.status = 400;
+    run(db, DatabaseManager::FLUSH_INTERVAL * 3, 1000);
+    uint32_t rejected = db.getBatchesRejected();
+    TEST_ASSERT_TRUE(rejected > 0);
+    TEST_ASSERT_FALSE(logger.hasSpooledData());
+    TEST_ASSERT_TRUE(db.isBackendReachable());
+
+    influx.status = 204;
+    run(db, DatabaseManager::FLUSH_INTERVAL * 3, 1000);
+    TEST_ASSERT_EQUAL(rejected, db.getBatchesRejected());
+    TEST_ASSERT_TRUE(influx.points.size() > written);
+}
+
+int main(int argc, char** argv) {
+    NativeHal::attachTcpServer("localhost", 8086, &influx);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_points_before_the_clock_keep_their_time);
+    RUN_TEST(test_spooled_points_keep_their_time);
+    RUN_TEST(test_full_arena_without_a_card_drops_points);
+    RUN_TEST(test_earlier_boot_points_without_a_clock_are_dropped);
+    RUN_TEST(test_requests_do_not_block);
+    RUN_TEST(test_rejected_batch_is_counted);
+    return UNITY_END();
+}
@@ -0,0 +1,250 @@
+// HistoryStore's rings: slots skipped by a gap read as no data, the tier
+// a query is answered from, the step growing to keep a query within
+// MAX_POINTS, and the tiers saved to the card and loaded back on boot
+//
+//   pio test -e native -f test_history_store
+
+#include <unity.h>
+#include <stdlib.h>
+#include <vector>
+#include "data/history_store.h"
+
+static const uint32_t START = 1767225600;    // 2026-01-01T00:00:00Z, a whole quarter hour
+static const uint8_t CHANNEL = TelemetryCompressor::CH_TEMPERATURE;
+
+struct Point {
+    uint32_t time;
+    float mean;
+    float low;
+    float high;
+};
+
+// A temperature that repeats every 1000 s, in steps the 0.01 °C
+// encoding keeps exactly
+static float valueAt(uint32_t time) {
+    return 20.0f + (time % 1000) * 0.01f;
+}
+
+static void record(HistoryStore& store, uint32_t time, float temperature) {
+    LinkProtocol::Snapshot snapshot = {};
+    snapshot.temperature = temperature;
+    snapshot.validMask = LinkProtocol::VALID_TEMPERATURE;
+    store.record(snapshot, time);
+}
+
+// One sample a second over [from, to)
+static void recordRange(HistoryStore& store, uint32_t from, uint32_t to) {
+    for (uint32_t time = from; time < to; time++) {
+        record(store, time, valueAt(time));
+    }
+}
+
+static std::vector<Point> query(const HistoryStore& store, uint32_t from, uint32_t to,
+                                uint32_t step, uint32_t* used = nullptr) {
+    std::vector<Point> points;
+    uint32_t actual = store.query(CHANNEL, from, to, step, [&](uint32_t time, float mean, float low, float high) {
+        points.push_back({time, mean, low, high});
+    });
+    if (used) *used = actual;
+    return points;
+}
+
+static void copyFile(const char* from, const char* to) {
+    File source = SD.open(from, FILE_READ);
+    File copy = SD.open(to, FILE_WRITE);
+    TEST_ASSERT_TRUE((bool)source);
+    TEST_ASSERT_TRUE((bool)copy);
+    uint8_t buffer[512];
+    int length;
+    while ((length = source.read(buffer, sizeof(buffer))) > 0) {
+        copy.write(buffer, length);
+    }
+}
+
+// Leave only the header's magic number, as a write cut short would
+static void truncateFile(const char* path) {
+    SD.remove(path);
+    File file = SD.open(path, FILE_WRITE);
+    TEST_ASSERT_TRUE((bool)file);
+    uint32_t magic = 0x54534948;
+    file.write((const uint8_t*)&magic, sizeof(magic));
+}
+
+// A fresh card for every test
+void setUp() {
+    char root[] = "/tmp/test_history_store_XXXXXX";
+    TEST_ASSERT_NOT_NULL(mkdtemp(root));
+    SD.root = root;
+}
+
+void tearDown() {}
+
+// Slots skipped by a gap are cleared, not left holding the samples the
+// ring put there an hour earlier
+void test_gap_clears_slots() {
+    DataLogger logger;
+    HistoryStore store(logger);
+
+    for (uint32_t i = 0; i < 10; i++) {
+        record(store, START + i, 30.0f);
+    }
+    for (uint32_t i = 0; i < 5; i++) {
+        record(store, START + 3600 + i, 35.0f);
+    }
+    record(store, START + 3609, 35.0f);
+
+    uint32_t step;
+    std::vector<Point> points = query(store, START + 3600, START + 3609, 1, &step);
+    TEST_ASSERT_EQUAL(1, step);
+    TEST_ASSERT_EQUAL(6, points.size());
+    for (size_t i = 0; i < 5; i++) {
+        TEST_ASSERT_EQUAL(START + 3600 + i, points[i].time);
+    }
+    TEST_ASSERT_EQUAL(START + 3609, points[5].time);
+    for (const Point& point : points) {
+        TEST_ASSERT_EQUAL_FLOAT(35.0f, point.mean);
+    }
+
+    // A gap longer than the ring clears all of it
+    record(store, START + 3 * 3600, 36.0f);
+    points = query(store, START + 3 * 3600 - 999, START + 3 * 3600, 1, &step);
+    TEST_ASSERT_EQUAL(1, step);
+    TEST_ASSERT_EQUAL(1, points.size());
+    TEST_ASSERT_EQUAL(START + 3 * 3600, points[0].time);
+}
+
+// The finest tier that reaches back to from answers, unless the step
+// asked for is one of a coarser tier
+void test_tier_choice() {
+    DataLogger logger;
+    HistoryStore store(logger);
+    recordRange(store, START, START + 2 * 3600);
+    uint32_t latest = store.latest();
+    TEST_ASSERT_EQUAL(START + 2 * 3600 - 1, latest);
+
+    // The web page's default window, the last hour: the 1 s tier, at the
+    // step that keeps it within MAX_POINTS
+    uint32_t step;
+    std::vector<Point> points = query(store, latest - 3600, latest, 1, &step);
+    TEST_ASSERT_EQUAL(4, step);
+    TEST_ASSERT_UINT32_WITHIN(1, 900, points.size());
+
+    // A second further back than the 1 s ring goes
+    query(store, latest - 3601, latest, 1, &step);
+    TEST_ASSERT_EQUAL(60, step);
+
+    points = query(store, START, latest, 1, &step);
+    TEST_ASSERT_EQUAL(60, step);
+    TEST_ASSERT_EQUAL(START, points.front().time);
+    TEST_ASSERT_EQUAL(0, points.front().time % 60);
+
+    // A step of a quarter hour, for any window
+    query(store, latest - 600, latest, 900, &step);
+    TEST_ASSERT_EQUAL(900, step);
+    points = query(store, START, latest, 1000, &step);
+    TEST_ASSERT_EQUAL(1800, step);
+    TEST_ASSERT_EQUAL(START, points.front().time);
+
+    // A step between tiers' steps rounds up to a multiple of the tier's
+    query(store, latest - 600, latest, 90, &step);
+    TEST_ASSERT_EQUAL(120, step);
+}
+
+// Up to MAX_POINTS steps a query keeps the step asked for; past that
+// the step grows, each point the mean, min and max of the slots it spans
+void test_step_grows_past_max_points() {
+    DataLogger logger;
+    HistoryStore store(logger);
+    recordRange(store, START, START + 3600);
+    uint32_t latest = store.latest();
+
+    uint32_t step;
+    std::vector<Point> points = query(store, latest - (HistoryStore::MAX_POINTS - 1), latest, 1, &step);
+    TEST_ASSERT_EQUAL(1, step);
+    TEST_ASSERT_EQUAL(HistoryStore::MAX_POINTS, points.size());
+
+    points = query(store, latest - HistoryStore::MAX_POINTS, latest, 1, &step);
+    TEST_ASSERT_EQUAL(2, step);
+    TEST_ASSERT_LESS_OR_EQUAL(HistoryStore::MAX_POINTS, points.size());
+    // Pairs start on even seconds, so none spans the wrap of valueAt()
+    for (const Point& point : points) {
+        TEST_ASSERT_EQUAL(0, point.time % 2);
+        TEST_ASSERT_FLOAT_WITHIN(0.001f, (valueAt(point.time) + valueAt(point.time + 1)) / 2, point.mean);
+        TEST_ASSERT_FLOAT_WITHIN(0.001f, valueAt(point.time), point.low);
+        TEST_ASSERT_FLOAT_WITHIN(0.001f, valueAt(point.time + 1), point.high);
+    }
+
+    points = query(store, START, latest, 1, &step);
+    TEST_ASSERT_EQUAL(4, step);
+    TEST_ASSERT_LESS_OR_EQUAL(HistoryStore::MAX_POINTS, points.size());
+}
+
+// Each update() after SAVE_INTERVAL saves one tier; a store begun on
+// the same card answers as the one that saved them, from the temporary
+// copy if the save was cut short
+void test_save_and_load() {
+    DataLogger logger;
+    logger.begin();
+    TEST_ASSERT_TRUE(logger.isReady());
+
+    HistoryStore saved(logger);
+    saved.begin();
+    recordRange(saved, START, START + 2 * 3600);
+    uint32_t latest = saved.latest();
+    for (uint8_t tier = 0; tier < 3; tier++) {
+        NativeHal::advance((uint64_t)HistoryStore::SAVE_INTERVAL * 1000);
+        saved.update();
+    }
+    TEST_ASSERT_TRUE(SD.exists("/hist/1m.bin"));
+    TEST_ASSERT_FALSE(SD.exists("/hist/save.tmp"));
+
+    HistoryStore loaded(logger);
+    loaded.begin();
+    const uint32_t FROM[] = {latest - 3600, START, START};
+    const uint32_t STEP[] = {1, 60, 900};
+    for (uint8_t i = 0; i < 3; i++) {
+        uint32_t savedStep, loadedStep;
+        std::vector<Point> expected = query(saved, FROM[i], latest, STEP[i], &savedStep);
+        std::vector<Point> actual = query(loaded, FROM[i], latest, STEP[i], &loadedStep);
+        TEST_ASSERT_EQUAL(savedStep, loadedStep);
+        TEST_ASSERT_GREATER_THAN(0, expected.size());
+        TEST_ASSERT_EQUAL(expected.size(), actual.size());
+        for (size_t p = 0; p < expected.size(); p++) {
+            TEST_ASSERT_EQUAL(expected[p].time, actual[p].time);
+            TEST_ASSERT_EQUAL_FLOAT(expected[p].mean, actual[p].mean);
+            TEST_ASSERT_EQUAL_FLOAT(expected[p].low, actual[p].low);
+            TEST_ASSERT_EQUAL_FLOAT(expected[p].high, actual[p].high);
+        }
+    }
+
+    // A reset while the minute tier was being written over its file: the
+    // temporary copy written first is loaded instead
+    copyFile("/hist/1m.bin", "/hist/save.tmp");
+    truncateFile("/hist/1m.bin");
+    HistoryStore recovered(logger);
+    recovered.begin();
+    uint32_t savedStep, recoveredStep;
+    std::vector<Point> expected = query(saved, START, latest, 60, &savedStep);
+    std::vector<Point> actual = query(recovered, START, latest, 60, &recoveredStep);
+    TEST_ASSERT_EQUAL(60, recoveredStep);
+    TEST_ASSERT_EQUAL(expected.size(), actual.size());
+    TEST_ASSERT_EQUAL(expected.back().time, actual.back().time);
+    TEST_ASSERT_EQUAL_FLOAT(expected.back().mean, actual.back().mean);
+
+    // With neither copy whole the tier is empty rather than misread, and
+    // a minute step falls through to the quarter hours
+    SD.remove("/hist/save.tmp");
+    HistoryStore truncated(logger);
+    truncated.begin();
+    query(truncated, START, latest, 60, &recoveredStep);
+    TEST_ASSERT_EQUAL(900, recoveredStep);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_gap_clears_slots);
+    RUN_TEST(test_tier_choice);
+    RUN_TEST(test_step_grows_past_max_points);
+    RUN_TEST(test_save_and_load);
+    return UNITY_END();
+}
@@ -0,0 +1,271 @@
+// SPI link frame codec, sequence tracking, the command path between
+// SAMDInterface and the simulated SAMD51, and codec throughput
+//
+//   pio test -e native -f test_link_protocol
+
+#include <unity.h>
+#include <stdio.h>
+#include <chrono>
+#include "samd_interface.h"
+#include "native/simulated_samd51.h"
+
+using namespace LinkProtocol;
+
+SAMDInterface samd;
+SimulatedSamd51 samdDevice;
+
+void setUp() {}
+void tearDown() {}
+
+static Snapshot testSnapshot() {
+    Snapshot snapshot = {};
+    snapshot.timestamp = 123456;
+    snapshot.ph = 7.02f;
+    snapshot.dissolvedOxygen = 41.5f;
+    snapshot.temperature = 37.01f;
+    snapshot.pressure = 1.013f;
+    snapshot.biomass = 2.5f;
+    snapshot.pt100[0] = 37.0f;
+    snapshot.pt100[1] = 37.1f;
+    snapshot.pt100[2] = 36.9f;
+    snapshot.stirrerSpeed = 250.0f;
+    snapshot.heaterOutput = 1200.0f;
+    snapshot.validMask = 0xFF;
+    snapshot.statusFlags = STATUS_SYSTEM_SAFE | STATUS_HEATER_ON;
+    return snapshot;
+}
+
+void test_crc_check_value() {
+    const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    TEST_ASSERT_EQUAL_HEX16(0x29B1, crc16(check, sizeof(check)));
+}
+
+void test_snapshot_round_trip() {
+    uint8_t frame[FRAME_SIZE];
+    Snapshot sent = testSnapshot();
+    TEST_ASSERT_EQUAL(FRAME_SIZE, encode(frame, MSG_SNAPSHOT, 42, sent));
+
+    FrameHeader header;
+    TEST_ASSERT_EQUAL(DECODE_OK, decodeFrame(frame, header));
+    TEST_ASSERT_EQUAL(MSG_SNAPSHOT, header.type);
+    TEST_ASSERT_EQUAL(42, header.sequence);
+    TEST_ASSERT_EQUAL(sizeof(Snapshot), header.length);
+
+    Snapshot received;
+    TEST_ASSERT_TRUE(decodePayload(frame, header, received));
+    TEST_ASSERT_EQUAL_MEMORY(&sent, &received, sizeof(Snapshot));
+}
+
+void test_every_bit_flip_is_caught() {
+    uint8_t frame[FRAME_SIZE];
+    encode(frame, MSG_SNAPSHOT, 7, testSnapshot());
+
+    FrameHeader header;
+    for (size_t bit = 0; bit < FRAME_SIZE * 8; bit++) {
+        frame[bit / 8] ^= 1 << (bit % 8);
+        TEST_ASSERT_NOT_EQUAL(DECODE_OK, decodeFrame(frame, header));
+        frame[bit / 8] ^= 1 << (bit % 8);
+    }
+    TEST_ASSERT_EQUAL(DECODE_OK, decodeFrame(frame, header));
+}
+
+void test_idle_bus_is_empty() {
+    uint8_t frame[FRAME_SIZE];
+    FrameHeader header;
+    memset(frame, 0x00, sizeof(frame));
+    TEST_ASSERT_EQUAL(DECODE_EMPTY, decodeFrame(frame, header));
+    memset(frame, 0xFF, sizeof(frame));
+    TEST_ASSERT_EQUAL(DECODE_EMPTY, decodeFrame(frame, header));
+    frame[2] = 0x12;
+    TEST_ASSERT_EQUAL(DECODE_BAD_SYNC, decodeFrame(frame, header));
+}
+
+void test_bad_header_fields() {
+    uint8_t frame[FRAME_SIZE];
+    FrameHeader header;
+
+    encodeIdle(frame, 0);
+    frame[1] = PROTOCOL_VERSION + 1;
+    TEST_ASSERT_EQUAL(DECODE_BAD_VERSION, decodeFrame(frame, header));
+
+    encodeIdle(frame, 0);
+    frame[4] = MAX_PAYLOAD + 1;
+    TEST_ASSERT_EQUAL(DECODE_BAD_LENGTH, decodeFrame(frame, header));
+}
+
+void test_payload_length_must_match() {
+    uint8_t frame[FRAME_SIZE];
+    encode(frame, MSG_ACK, 1, Ack{MSG_SETPOINTS, 1, ACK_OK});
+
+    FrameHeader header;
+    TEST_ASSERT_EQUAL(DECODE_OK, decodeFrame(frame, header));
+    Setpoints setpoints;
+    TEST_ASSERT_FALSE(decodePayload(frame, header, setpoints));
+    Ack ack;
+    TEST_ASSERT_TRUE(decodePayload(frame, header, ack));
+    TEST_ASSERT_EQUAL(MSG_SETPOINTS, ack.type);
+}
+
+void test_oversized_payload_sends_idle() {
+    uint8_t frame[FRAME_SIZE];
+    uint8_t payload[MAX_PAYLOAD + 1] = {};
+    encodeFrame(frame, MSG_SETPOINTS, 3, payload, sizeof(payload));
+
+    FrameHeader header;
+    TEST_ASSERT_EQUAL(DECODE_OK, decodeFrame(frame, header));
+    TEST_ASSERT_EQUAL(MSG_IDLE, header.type);
+    TEST_ASSERT_EQUAL(0, header.length);
+}
+
+void test_sequence_losses_across_wrap() {
+    SequenceTracker tracker;
+    TEST_ASSERT_EQUAL(0, tracker.update(250));
+    TEST_ASSERT_EQUAL(0, tracker.update(251));
+    TEST_ASSERT_EQUAL(6, tracker.update(2));     // 252..255, 0, 1
+    TEST_ASSERT_EQUAL(0, tracker.update(2));     // Retransmission
+    TEST_ASSERT_EQUAL(0, tracker.update(3));
+    TEST_ASSERT_EQUAL(4, tracker.received());
+    TEST_ASSERT_EQUAL(6, tracker.lost());
+    TEST_ASSERT_EQUAL(1, tracker.duplicates());
+    TEST_ASSERT_TRUE(tracker.isRepeat(3));
+    TEST_ASSERT_FALSE(tracker.isRepeat(4));
+}
+
+static void runLink(uint32_t ms) {
+    for (uint32_t i = 0; i < ms; i++) {
+        samd.update();
+        NativeHal::advance(1000);
+    }
+}
+
+static uint32_t framesSent() {
+    return SAMD_LINK_SPI.getBytesTransferred() / FRAME_SIZE;
+}
+
+static void runLinkUntilFrame(uint32_t frame) {
+    while (framesSent() < frame) {
+        runLink(1);
+    }
+}
+
+// Commands exactly 256 frames apart used to repeat the previous command's
+// sequence number and be dropped as retransmissions
+void test_commands_survive_sequence_wrap() {
+    Setpoints setpoints = {7.0f, 40.0f, 30.0f, 1.0f, 200.0f, 0};
+    uint32_t appliedBefore = samdDevice.getCommandsReceived();
+
+    runLink(1000);
+    for (uint8_t i = 0; i < 10; i++) {
+        setpoints.temperature = 30.0f + i;
+        TEST_ASSERT_TRUE(samd.sendSetpoints(setpoints));
+        uint32_t commandFrame = framesSent() + 1;
+        runLinkUntilFrame(commandFrame + 255);
+        TEST_ASSERT_EQUAL_FLOAT(setpoints.temperature, samdDevice.getSetpoints().temperature);
+    }
+    TEST_ASSERT_EQUAL(10, samdDevice.getCommandsReceived() - appliedBefore);
+    TEST_ASSERT_EQUAL(ACK_OK, samd.getLastAckStatus());
+    TEST_ASSERT_EQUAL(0, samd.getCommandsFailed());
+    TEST_ASSERT_EQUAL(0, samd.getFrameErrors());
+}
+
+// A rebooted RP2040 numbers its commands from 0 again; its first command
+// is applied even where it matches the type and sequence of the last one
+// before the reboot
+void test_reboot_is_not_a_retransmission() {
+    Setpoints setpoints = {7.0f, 40.0f, 30.0f, 1.0f, 200.0f, 0};
+    uint32_t appliedBefore = samdDevice.getCommandsReceived();
+
+    SAMDInterface beforeReboot;
+    beforeReboot.begin();
+    TEST_ASSERT_TRUE(beforeReboot.sendSetpoints(setpoints));
+    for (uint32_t i = 0; i < 200; i++) {
+        beforeReboot.update();
+        NativeHal::advance(1000);
+    }
+    TEST_ASSERT_EQUAL_FLOAT(30.0f, samdDevice.getSetpoints().temperature);
+
+    SAMDInterface afterReboot;
+    afterReboot.begin();
+    setpoints.temperature = 32.0f;
+    TEST_ASSERT_TRUE(afterReboot.sendSetpoints(setpoints));
+    for (uint32_t i = 0; i < 200; i++) {
+        afterReboot.update();
+        NativeHal::advance(1000);
+    }
+    TEST_ASSERT_EQUAL_FLOAT(32.0f, samdDevice.getSetpoints().temperature);
+    TEST_ASSERT_EQUAL(2, samdDevice.getCommandsReceived() - appliedBefore);
+    TEST_ASSERT_EQUAL(ACK_OK, afterReboot.getLastAckStatus());
+}
+
+// An alarm read again and again while the SAMD51 is stalled is queued once
+void test_repeated_frame_handled_once() {
+    Alarm alarm = {1000, ALARM_SAFETY_INTERLOCK, 2, 1, 0};
+    Alarm popped;
+    runLink(100);
+    while (samd.popAlarm(popped)) {}
+
+    samdDevice.raiseAlarm(alarm);
+    runLinkUntilFrame(framesSent() + 1);
+    samdDevice.setStalled(true);
+    uint32_t duplicatesFrom = framesSent();
+    runLink(10 * SAMDInterface::POLL_INTERVAL_MS);
+    TEST_ASSERT_GREATER_OR_EQUAL(5, framesSent() - duplicatesFrom);
+    samdDevice.setStalled(false);
+    runLink(100);
+
+    TEST_ASSERT_TRUE(samd.popAlarm(popped));
+    TEST_ASSERT_EQUAL(ALARM_SAFETY_INTERLOCK, popped.code);
+    TEST_ASSERT_FALSE(samd.popAlarm(popped));
+    TEST_ASSERT_EQUAL(0, samd.getFrameErrors());
+}
+
+// Encode and decode of a snapshot frame, against what the link needs:
+// one frame each way every POLL_INTERVAL_MS
+void test_codec_throughput() {
+    const uint32_t frames = 1000000;
+    uint8_t frame[FRAME_SIZE];
+    Snapshot snapshot = testSnapshot();
+    Snapshot received;
+    FrameHeader header;
+    uint32_t decoded = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < frames; i++) {
+        snapshot.timestamp = i;
+        encode(frame, MSG_SNAPSHOT, (uint8_t)i, snapshot);
+        if (decodeFrame(frame, header) == DECODE_OK && decodePayload(frame, header, received)) {
+            decoded += received.timestamp == i;
+        }
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    TEST_ASSERT_EQUAL(frames, decoded);
+
+    double rate = frames / elapsed;
+    double needed = 2 * 1000.0 / SAMDInterface::POLL_INTERVAL_MS;
+    double busFrameMicros = FRAME_SIZE * 8 * 1e6 / SAMDInterface::SPI_CLOCK;
+    char line[128];
+    snprintf(line, sizeof(line), "%.0f frames/s encoded and decoded (%.1f MB/s), link needs %.0f; %.0f us per frame on the bus",
+             rate, rate * FRAME_SIZE / 1e6, needed, busFrameMicros);
+    TEST_MESSAGE(line);
+    TEST_ASSERT_GREATER_THAN(needed * 100, rate);
+}
+
+int main(int argc, char** argv) {
+    NativeHal::attachSpiDevice(&SAMD_LINK_SPI, SAMD_LINK_CS_PIN, &samdDevice);
+    samd.begin();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_crc_check_value);
+    RUN_TEST(test_snapshot_round_trip);
+    RUN_TEST(test_every_bit_flip_is_caught);
+    RUN_TEST(test_idle_bus_is_empty);
+    RUN_TEST(test_bad_header_fields);
+    RUN_TEST(test_payload_length_must_match);
+    RUN_TEST(test_oversized_payload_sends_idle);
+    RUN_TEST(test_sequence_losses_across_wrap);
+    RUN_TEST(test_commands_survive_sequence_wrap);
+    RUN_TEST(test_reboot_is_not_a_retransmission);
+    RUN_TEST(test_repeated_frame_handled_once);
+    RUN_TEST(test_codec_throughput);
+    return UNITY_END();
+}
@@ -0,0 +1,312 @@
+// MQTTHandler against a stand-in broker: connecting without holding up
+// loop(), the CONNACK timeout, reconnecting after a drop and replaying
+// what was queued while the broker was away
+//
+//   pio test -e native -f test_mqtt_handler
+
+#include <unity.h>
+#include <string>
+#include <vector>
+#include "data/mqtt_handler.h"
+
+// Speaks enough MQTT 3.1.1 for MQTTHandler and records what it was sent
+class FakeBroker : public NativeHal::TcpServer {
+public:
+    struct Publish {
+        std::string topic;
+        std::string payload;
+        bool retained;
+    };
+
+    bool reachable = true;
+    bool answerConnect = true;
+    bool answerPing = true;
+    uint32_t connects = 0;
+    uint32_t pings = 0;
+    std::vector<std::string> subscriptions;
+    std::vector<Publish> published;
+
+    bool accept() override {
+        inbound.clear();
+        return reachable;
+    }
+
+    void receive(const uint8_t* data, size_t length) override {
+        inbound.insert(inbound.end(), data, data + length);
+        while (takePacket()) {}
+    }
+
+    // Drop the connection as a broker restart would
+    void drop() { close(); }
+
+private:
+    std::vector<uint8_t> inbound;
+
+    bool takePacket() {
+        size_t lengthBytes = 0;
+        uint32_t length = 0;
+        for (uint8_t shift = 0;; shift += 7) {
+            if (inbound.size() < 2 + lengthBytes) return false;
+            uint8_t digit = inbound[1 + lengthBytes++];
+            length |= (uint32_t)(digit & 0x7F) << shift;
+            if (!(digit & 0x80)) break;
+        }
+        size_t start = 1 + lengthBytes;
+        if (inbound.size() < start + length) return false;
+
+        uint8_t type = inbound[0];
+        std::vector<uint8_t> body(inbound.begin() + start, inbound.begin() + start + length);
+        inbound.erase(inbound.begin(), inbound.begin() + start + length);
+        handle(type, body);
+        return true;
+    }
+
+    static std::string string(const std::vector<uint8_t>& body, size_t at) {
+        size_t length = (body[at] << 8) | body[at + 1];
+        return std::string(body.begin() + at + 2, body.begin() + at + 2 + length);
+    }
+
+    void handle(uint8_t type, const std::vector<uint8_t>& body) {
+        switch (type >> 4) {
+            case 1: {   // CONNECT
+                TEST_ASSERT_EQUAL_STRING("MQTT", string(body, 0).c_str());
+                TEST_ASSERT_EQUAL(4, body[6]);
+                connects++;
+                if (answerConnect) {
+                    const uint8_t connack[] = {0x20, 0x02, 0x00, 0x00};
+                    send(connack, sizeof(connack));
+                }
+                break;
+            }
+            case 3: {   // PUBLISH, QoS 0
+                std::string topic = string(body, 0);
+                published.push_back({topic, std::string(body.begin() + 2 + topic.size(), body.end()), (type & 0x01) != 0});
+                break;
+            }
+            case 8: {   // SUBSCRIBE
+                subscriptions.push_back(string(body, 2));
+                const uint8_t suback[] = {0x90, 0x03, body[0], body[1], body.back()};
+                send(suback, sizeof(suback));
+                break;
+            }
+            case 12: {  // PINGREQ
+                pings++;
+                if (answerPing) {
+                    const uint8_t pingresp[] = {0xD0, 0x00};
+                    send(pingresp, sizeof(pingresp));
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+};
+
+static FakeBroker broker;
+
+void setUp() {
+    broker = FakeBroker();
+}
+
+void tearDown() {}
+
+// update() every 10 ms for duration ms; returns the longest single call
+static uint64_t run(MQTTHandler& mqtt, uint32_t duration) {
+    uint64_t end = NativeHal::nowMicros + (uint64_t)duration * 1000;
+    uint64_t longest = 0;
+    while (NativeHal::nowMicros < end) {
+        uint64_t before = NativeHal::nowMicros;
+        mqtt.update();
+        if (NativeHal::nowMicros - before > longest) longest = NativeHal::nowMicros - before;
+        NativeHal::advance(10000);
+    }
+    return longest;
+}
+
+static void start(MQTTHandler& mqtt, EthernetClient& client) {
+    mqtt.begin(client);
+    run(mqtt, 100);
+    TEST_ASSERT_TRUE(mqtt.isConnected());
+}
+
+void test_connects_and_subscribes() {
+    EthernetClient client;
+    MQTTHandler mqtt;
+    start(mqtt, client);
+
+    TEST_ASSERT_EQUAL(1, broker.connects);
+    TEST_ASSERT_EQUAL(4, broker.subscriptions.size());
+    TEST_ASSERT_EQUAL_STRING("bioreactor/control/ph/setpoint", broker.subscriptions[0].c_str());
+
+    TEST_ASSERT_TRUE(mqtt.publish("bioreactor/alarms", "high ph", 1));
+    TEST_ASSERT_EQUAL(1, broker.published.size());
+    TEST_ASSERT_EQUAL_STRING("high ph", broker.published[0].payload.c_str());
+    TEST_ASSERT_EQUAL(0, mqtt.getQueuedMessages());
+}
+
+// A broker that is down costs each attempt no more than the connection
+// timeout, and attempts back off
+void test_unreachable_broker_does_not_block() {
+    EthernetClient client;
+    MQTTHandler mqtt;
+    broker.reachable = false;
+    mqtt.begin(client);
+
+    uint64_t longest = run(mqtt, 120000);
+    TEST_ASSERT_FALSE(mqtt.isConnected());
+    TEST_ASSERT_LESS_OR_EQUAL(MQTTHandler::CONNECT_TIMEOUT * 1000ULL, longest);
+    // 1, 2, 4, ... s windows of which at least half is waited out
+    TEST_ASSERT_LESS_OR_EQUAL(9, mqtt.getConnectAttempts());
+    TEST_ASSERT_GREATER_OR_EQUAL(5, mqtt.getConnectAttempts());
+}
+
+// A broker that takes the connection but never sends CONNACK is given up
+// on from update(), which never waits for it
+void test_missing_connack_times_out() {
+    EthernetClient client;
+    MQTTHandler mqtt;
+    broker.answerConnect = false;
+    mqtt.begin(client);
+
+    uint64_t longest = run(mqtt, MqttConnection::CONNACK_TIMEOUT - 100);
+    TEST_ASSERT_EQUAL(0, longest);
+    TEST_ASSERT_EQUAL(MQTTHandler::State::CONNECTING, mqtt.getState());
+    TEST_ASSERT_EQUAL(1, broker.connects);
+
+    run(mqtt, 200);
+    TEST_ASSERT_EQUAL(MQTTHandler::State::DISCONNECTED, mqtt.getState());
+    TEST_ASSERT_FALSE(broker.open);
+
+    // A broker that answers again gets the next attempt
+    broker.answerConnect = true;
+    run(mqtt, 2 * MQTTHandler::BACKOFF_MIN);
+    TEST_ASSERT_TRUE(mqtt.isConnected());
+    TEST_ASSERT_EQUAL(2, broker.connects);
+}
+
+void test_reconnects_after_drop() {
+    EthernetClient client;
+    MQTTHandler mqtt;
+    start(mqtt, client);
+
+    broker.drop();
+    run(mqtt, 20);
+    TEST_ASSERT_FALSE(mqtt.isConnected());
+
+    // The first retry after a drop comes within BACKOFF_MIN
+    run(mqtt, MQTTHandler::BACKOFF_MIN + 100);
+    TEST_ASSERT_TRUE(mqtt.isConnected());
+    TEST_ASSERT_EQUAL(2, broker.connects);
+    TEST_ASSERT_EQUAL(8, broker.subscriptions.size());
+}
+
+// Messages published while the broker was away go out after the
+// reconnect, oldest first, at DRAIN_RATE
+void test_queue_replayed_in_order_after_reconnect() {
+    EthernetClient client;
+    MQTTHandler mqtt;
+    start(mqtt, client);
+
+    broker.drop();
+    broker.reachable = false;
+    run(mqtt, 20);
+
+    const uint8_t count = 20;
+    for (uint8_t i = 0; i < count; i++) {
+        char payload[8];
+        snprintf(payload, sizeof(payload), "%u", i);
+        TEST_ASSERT_TRUE(mqtt.publish("bioreactor/data/ph", payload, i % 2, i == 0));
+    }
+    TEST_ASSERT_EQUAL(count, mqtt.getQueuedMessages());
+    TEST_ASSERT_EQUAL(0, broker.published.size());
+
+    broker.reachable = true;
+    run(mqtt, 5000);
+    TEST_ASSERT_TRUE(mqtt.isConnected());
+    TEST_ASSERT_EQUAL(0, mqtt.getQueuedMessages());
+    TEST_ASSERT_EQUAL(count, broker.published.size());
+    for (uint8_t i = 0; i < count; i++) {
+        TEST_ASSERT_EQUAL(i, atoi(broker.published[i].payload.c_str()));
+        TEST_ASSERT_EQUAL(i == 0, broker.published[i].retained);
+    }
+}
+
+// An outage longer than the queue keeps the QoS 1 messages
+void test_long_outage_keeps_qos1() {
+    EthernetClient client;
+    MQTTHandler mqtt;
+    broker.reachable = false;
+    mqtt.begin(client);
+
+    for (uint8_t i = 0; i < 3 * MQTTHandler::QUEUE_DEPTH; i++) {
+        char payload[8];
+        snprintf(payload, sizeof(payload), "%u", i);
+        mqtt.publish("bioreactor/alarms", payload, i % 8 == 0);
+        run(mqtt, 100);
+    }
+    TEST_ASSERT_EQUAL(MQTTHandler::QUEUE_DEPTH, mqtt.getQueuedMessages());
+
+    broker.reachable = true;
+    run(mqtt, 70000);
+    TEST_ASSERT_EQUAL(MQTTHandler::QUEUE_DEPTH, broker.published.size());
+    uint8_t qos1 = 0;
+    int previous = -1;
+    for (const FakeBroker::Publish& message : broker.published) {
+        int index = atoi(message.payload.c_str());
+        TEST_ASSERT_GREATER_THAN(previous, index);
+        previous = index;
+        qos1 += index % 8 == 0;
+    }
+    TEST_ASSERT_EQUAL(3 * MQTTHandler::QUEUE_DEPTH / 8, qos1);
+}
+
+// Keepalive pings hold an idle session open; a broker that stops
+// answering is dropped and reconnected
+void test_keepalive() {
+    EthernetClient client;
+    MQTTHandler mqtt;
+    start(mqtt, client);
+
+    run(mqtt, 60000);
+    TEST_ASSERT_TRUE(mqtt.isConnected());
+    TEST_ASSERT_GREATER_OR_EQUAL(3, broker.pings);
+    TEST_ASSERT_EQUAL(1, broker.connects);
+
+    broker.answerPing = false;
+    run(mqtt, MqttConnection::KEEPALIVE * 2000UL);
+    TEST_ASSERT_GREATER_OR_EQUAL(2, broker.connects);
+}
+
+// A session publishing every second gets no traffic back from the
+// broker; it still pings and is never dropped
+void test_keepalive_while_publishing() {
+    EthernetClient client;
+    MQTTHandler mqtt;
+    start(mqtt, client);
+
+    const uint32_t seconds = 8 * MqttConnection::KEEPALIVE;
+    for (uint32_t i = 0; i < seconds; i++) {
+        TEST_ASSERT_TRUE(mqtt.publish("bioreactor/data/ph", "7.00", 0));
+        run(mqtt, 1000);
+        TEST_ASSERT_TRUE(mqtt.isConnected());
+    }
+    TEST_ASSERT_EQUAL(1, broker.connects);
+    TEST_ASSERT_GREATER_OR_EQUAL(seconds / MqttConnection::KEEPALIVE - 1, broker.pings);
+    TEST_ASSERT_EQUAL(seconds, broker.published.size());
+}
+
+int main(int argc, char** argv) {
+    NativeHal::attachTcpServer("localhost", 1883, &broker);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_connects_and_subscribes);
+    RUN_TEST(test_unreachable_broker_does_not_block);
+    RUN_TEST(test_missing_connack_times_out);
+    RUN_TEST(test_reconnects_after_drop);
+    RUN_TEST(test_queue_replayed_in_order_after_reconnect);
+    RUN_TEST(test_long_outage_keeps_qos1);
+    RUN_TEST(test_keepalive);
+    RUN_TEST(test_keepalive_while_publishing);
+    return UNITY_END();
+}
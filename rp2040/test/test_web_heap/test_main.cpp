@@ -0,0 +1,198 @@
+// Heap taken by each WebInterface GET, against the handlers it replaced,
+// which built the body in a String (serializeJson into a String, or
+// generateHTML() returning the page) and then sent that String.
+// Allocations are counted through global operator new; the native String
+// and WebServer allocate there, like the real ones do from the heap.
+//
+//   pio test -e native -f test_web_heap
+
+#include <unity.h>
+#include <malloc.h>
+#include <new>
+#include <string>
+
+// HeapMonitor reads newlib's mallinfo(), which glibc deprecates
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+#include "web/web_interface.h"
+
+static size_t liveBytes = 0;
+static size_t peakBytes = 0;
+static uint32_t allocationCount = 0;
+
+void* operator new(size_t size) {
+    void* block = malloc(size ? size : 1);
+    if (!block) throw std::bad_alloc();
+    liveBytes += malloc_usable_size(block);
+    if (liveBytes > peakBytes) peakBytes = liveBytes;
+    allocationCount++;
+    return block;
+}
+
+void operator delete(void* block) noexcept {
+    if (!block) return;
+    liveBytes -= malloc_usable_size(block);
+    free(block);
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete[](void* block) noexcept { operator delete(block); }
+void operator delete(void* block, size_t) noexcept { operator delete(block); }
+void operator delete[](void* block, size_t) noexcept { operator delete(block); }
+
+struct Cost {
+    size_t peak;            // Bytes in use at the worst point of the request
+    uint32_t allocations;
+    size_t bodyLength;
+};
+
+static WebInterface web;
+static TelemetryCompressor compressor;
+static HeapMonitor heapMonitor;
+static CoreLoad coreLoad[2];
+
+// Replays of the old handlers, on their own server
+static WebServer legacy;
+static std::string legacyBody;
+static const char* legacyType = "";
+
+static const char* BROWSER_HEADERS[][2] = {
+    {"Accept-Encoding", "gzip, deflate"}
+};
+
+static NativeHal::HttpRequest get(const char* uri) {
+    NativeHal::HttpRequest request = {HTTP_GET, uri, {}, {}};
+    for (const auto& header : BROWSER_HEADERS) {
+        request.headers.push_back({header[0], header[1]});
+    }
+    return request;
+}
+
+// The server keeps the capacity of its header String between requests, so
+// each request is measured on its second run
+static Cost measure(WebServer& server, const NativeHal::HttpRequest& request) {
+    std::string response;
+    response.reserve(16384);
+    server.serve(request, response);
+    response.clear();
+
+    size_t before = liveBytes;
+    peakBytes = liveBytes;
+    allocationCount = 0;
+    server.serve(request, response);
+    TEST_ASSERT_EQUAL(before, liveBytes);
+
+    size_t headerEnd = response.find("\r\n\r\n");
+    TEST_ASSERT_TRUE(headerEnd != std::string::npos);
+    return {peakBytes - before, allocationCount, response.size() - headerEnd - 4};
+}
+
+// Body of the new response, without its header block
+static std::string body(const char* uri) {
+    std::string response;
+    NativeHal::HttpRequest request = {HTTP_GET, uri, {}, {}};
+    NativeHal::webServer->serve(request, response);
+    return response.substr(response.find("\r\n\r\n") + 4);
+}
+
+// What the old handler allocated for the same body
+static Cost legacyCost(const char* uri, const char* contentType, bool page) {
+    legacyBody = body(uri);
+    legacyType = contentType;
+    return measure(legacy, get(page ? "/legacy/page" : "/legacy/json"));
+}
+
+void setUp() {}
+void tearDown() {}
+
+static void report(const char* uri, const Cost& before, const Cost& after) {
+    char line[160];
+    snprintf(line, sizeof(line), "%-16s body %4zu B: String handler %4zu B in %2u allocations, now %4zu B in %2u",
+             uri, before.bodyLength, before.peak, (unsigned)before.allocations, after.peak, (unsigned)after.allocations);
+    TEST_MESSAGE(line);
+}
+
+// JSON bodies are serialized into the socket; only the header block
+// still goes through the heap
+void test_json_bodies_stay_off_the_heap() {
+    const char* const URIS[] = {"/api/data", "/api/setpoints", "/api/control", "/api/system", "/api/autotune"};
+    for (const char* uri : URIS) {
+        Cost before = legacyCost(uri, "application/json", false);
+        Cost after = measure(*NativeHal::webServer, get(uri));
+        report(uri, before, after);
+        TEST_ASSERT_LESS_OR_EQUAL(before.peak - after.bodyLength, after.peak);
+        TEST_ASSERT_LESS_THAN(before.allocations, after.allocations);
+    }
+}
+
+// The page came from a String copy of a literal on every request. It now
+// comes from flash, though its ETag and caching headers take some of that
+// back in the header String.
+void test_page_served_from_flash() {
+    Cost before = legacyCost("/", "text/html", true);
+    Cost after = measure(*NativeHal::webServer, get("/"));
+    report("/", before, after);
+    TEST_ASSERT_LESS_THAN(before.peak, after.peak);
+
+    // A reload is answered with a 304 and no body
+    NativeHal::HttpRequest reload = get("/");
+    reload.headers.push_back({"If-None-Match", STATIC_ASSETS[0].etag});
+    Cost revalidate = measure(*NativeHal::webServer, reload);
+    report("/ (304)", before, revalidate);
+    TEST_ASSERT_EQUAL(0, revalidate.bodyLength);
+}
+
+// Serving does not leave anything behind on the heap
+void test_requests_do_not_accumulate() {
+    const char* const URIS[] = {"/", "/css/styles.css", "/js/main.js", "/api/data", "/api/system"};
+    std::string response;
+    response.reserve(16384);
+    for (const char* uri : URIS) {
+        NativeHal::webServer->serve(get(uri), response);
+        response.clear();
+    }
+
+    size_t before = liveBytes;
+    for (uint16_t i = 0; i < 1000; i++) {
+        response.clear();
+        NativeHal::webServer->serve(get(URIS[i % 5]), response);
+    }
+    TEST_ASSERT_EQUAL(before, liveBytes);
+}
+
+int main(int argc, char** argv) {
+    legacy.on("/legacy/json", HTTP_GET, []() {
+        // serializeJson(doc, response): ArduinoJson appends to a String 32 bytes at a time
+        String response;
+        for (size_t at = 0; at < legacyBody.size(); at += 32) {
+            response += String(legacyBody.substr(at, 32));
+        }
+        legacy.send(200, legacyType, response);
+    });
+    legacy.on("/legacy/page", HTTP_GET, []() {
+        legacy.send(200, legacyType, String(legacyBody));
+    });
+
+    web.begin();
+    web.setCompressor(&compressor);
+    web.setHeapMonitor(&heapMonitor);
+    web.setCoreLoad(&coreLoad[0], &coreLoad[1]);
+
+    LinkProtocol::Snapshot snapshot = {};
+    snapshot.ph = 7.02f;
+    snapshot.dissolvedOxygen = 41.5f;
+    snapshot.temperature = 37.01f;
+    snapshot.pressure = 1.013f;
+    snapshot.biomass = 2.5f;
+    snapshot.pt100[0] = 37.0f;
+    snapshot.pt100[1] = 37.1f;
+    snapshot.pt100[2] = 36.9f;
+    snapshot.stirrerSpeed = 250.0f;
+    snapshot.validMask = 0xFFFF;
+    web.updateReadings(snapshot);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_json_bodies_stay_off_the_heap);
+    RUN_TEST(test_page_served_from_flash);
+    RUN_TEST(test_requests_do_not_accumulate);
+    return UNITY_END();
+}
@@ -0,0 +1,72 @@
+"""Embed the files in web/ into src/web/static_assets.h.
+
+Each asset is stored twice in flash, gzip-compressed and plain, with an
+ETag derived from its content. Runs before every PlatformIO build
+(extra_scripts) and can also be run by hand: python tools/embed_assets.py
+"""
+
+import gzip
+import hashlib
+import os
+
+ASSETS = [
+    # URL path, file under web/, content type
+    ("/", "index.html", "text/html"),
+    ("/css/styles.css", "styles.css", "text/css"),
+    ("/js/main.js", "main.js", "text/javascript"),
+]
+
+
+def project_dir():
+    try:
+        Import("env")  # noqa: F821 - provided by PlatformIO
+        return env.subst("$PROJECT_DIR")  # noqa: F821
+    except NameError:
+        return os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+
+def byte_array(name, data):
+    lines = []
+    for i in range(0, len(data), 16):
+        lines.append("    " + ", ".join("0x%02x" % b for b in data[i:i + 16]) + ",")
+    return "static const uint8_t %s[] PROGMEM = {\n%s\n};\n" % (name, "\n".join(lines))
+
+
+def generate(project):
+    out = [
+        "#pragma once\n",
+        "// Generated by tools/embed_assets.py from web/; do not edit.\n",
+        "#include <Arduino.h>\n",
+        "struct StaticAsset {",
+        "    const char* path;",
+        "    const char* contentType;",
+        "    const char* etag;",
+        "    const uint8_t* data;",
+        "    size_t length;",
+        "    const uint8_t* gzipData;",
+        "    size_t gzipLength;",
+        "};\n",
+    ]
+    entries = []
+    for index, (path, name, content_type) in enumerate(ASSETS):
+        with open(os.path.join(project, "web", name), "rb") as f:
+            data = f.read()
+        # mtime=0 keeps the output identical between builds
+        compressed = gzip.compress(data, compresslevel=9, mtime=0)
+        etag = '"%s"' % hashlib.sha1(data).hexdigest()[:16]
+        out.append(byte_array("ASSET_%d" % index, data))
+        out.append(byte_array("ASSET_%d_GZ" % index, compressed))
+        entries.append('    {"%s", "%s", "\\"%s\\"", ASSET_%d, %d, ASSET_%d_GZ, %d},'
+                       % (path, content_type, etag.strip('"'), index, len(data), index, len(compressed)))
+
+    out.append("static const StaticAsset STATIC_ASSETS[] = {\n%s\n};\n" % "\n".join(entries))
+    out.append("static const size_t STATIC_ASSET_COUNT = sizeof(STATIC_ASSETS) / sizeof(STATIC_ASSETS[0]);\n")
+
+    target = os.path.join(project, "src", "web", "static_assets.h")
+    text = "\n".join(out)
+    if not os.path.exists(target) or open(target).read() != text:
+        with open(target, "w") as f:
+            f.write(text)
+
+
+generate(project_dir())
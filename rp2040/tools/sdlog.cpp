@@ -0,0 +1,202 @@
+// Reads the RP2040 SD sample log (shared/sample_log.h) on a host and
+// exports it. Takes log files or directories of them (the card's /log).
+//
+//   cd rp2040 && g++ -std=c++17 -O2 -I ../shared tools/sdlog.cpp -o sdlog
+//   sdlog info /media/sd/log
+//   sdlog csv /media/sd/log > samples.csv
+//   sdlog lp /media/sd/log > samples.lp
+//
+// csv writes unix_ms,samd_ms,channel,value, with unix_ms empty for blocks
+// logged before the RP2040 knew the time. lp writes InfluxDB line protocol
+// in the shape DatabaseManager uses, millisecond precision; samples without
+// a Unix time are skipped and counted on stderr.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "sample_log.h"
+
+enum class Output { INFO, CSV, LINE_PROTOCOL };
+
+struct Totals {
+    uint64_t blocks = 0;
+    uint64_t records = 0;
+    uint64_t withoutTime = 0;
+    uint64_t bytes = 0;
+};
+
+static std::vector<std::string> expandPaths(int argc, char** argv) {
+    std::vector<std::string> files;
+    for (int i = 0; i < argc; i++) {
+        struct stat info;
+        if (stat(argv[i], &info) != 0) {
+            fprintf(stderr, "%s: not found\n", argv[i]);
+            continue;
+        }
+        if (!S_ISDIR(info.st_mode)) {
+            files.push_back(argv[i]);
+            continue;
+        }
+
+        // Log files are numbered, so name order is write order
+        std::vector<std::string> names;
+        DIR* dir = opendir(argv[i]);
+        while (dir) {
+            dirent* entry = readdir(dir);
+            if (!entry) break;
+            std::string name = entry->d_name;
+            if (name.size() > 4 && name.compare(name.size() - 4, 4, ".bin") == 0) {
+                names.push_back(std::string(argv[i]) + "/" + name);
+            }
+        }
+        if (dir) closedir(dir);
+        std::sort(names.begin(), names.end());
+        files.insert(files.end(), names.begin(), names.end());
+    }
+    return files;
+}
+
+static void printRecord(Output output, const std::vector<std::string>& names,
+                        const SampleLog::BlockHeader& header, const SampleLog::Record& record, Totals& totals) {
+    std::string name = record.channel < names.size() ? names[record.channel]
+                                                     : "channel_" + std::to_string(record.channel);
+    bool timed = header.unixTime != 0;
+    int64_t unixMs = (int64_t)header.unixTime * 1000 + (int32_t)(record.timestamp - header.referenceTimestamp);
+    if (!timed) totals.withoutTime++;
+
+    if (output == Output::CSV) {
+        if (timed) printf("%lld", (long long)unixMs);
+        printf(",%lu,%s,", (unsigned long)record.timestamp, name.c_str());
+        if (!isnan(record.value)) printf("%.3f", record.value);
+        printf("\n");
+    } else if (output == Output::LINE_PROTOCOL && timed && !isnan(record.value)) {
+        printf("bioreactor_sensors,device=bioreactor %s=%.3f %lld\n", name.c_str(), record.value, (long long)unixMs);
+    }
+}
+
+static void readFile(const std::string& path, Output output, Totals& totals) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        fprintf(stderr, "%s: cannot open\n", path.c_str());
+        return;
+    }
+
+    uint8_t block[SampleLog::BLOCK_SIZE];
+    SampleLog::BlockHeader header;
+    std::vector<std::string> names;
+    uint64_t index = 0;
+    uint64_t records = 0;
+    uint32_t firstSequence = 0, lastSequence = 0;
+    uint32_t minTimestamp = 0, maxTimestamp = 0;
+    uint64_t invalid = 0;
+    const char* end = "end of file";
+
+    // Zero blocks are preallocated space; anything else that fails the CRC
+    // is skipped so one bad sector does not hide the rest of the file
+    while (fread(block, 1, sizeof(block), file) == sizeof(block)) {
+        if (!SampleLog::validBlock(block, header)) {
+            if (std::all_of(block, block + sizeof(block), [](uint8_t b) { return b == 0; })) {
+                end = "preallocated space";
+                break;
+            }
+            if (index == 0) {
+                end = "invalid file header";
+                break;
+            }
+            fprintf(stderr, "%s: block %llu: invalid, skipped\n", path.c_str(), (unsigned long long)index);
+            invalid++;
+            index++;
+            continue;
+        }
+
+        if (index == 0) {
+            if (header.kind != SampleLog::BLOCK_FILE_HEADER) {
+                end = "missing file header";
+                break;
+            }
+            const uint8_t* payload = block + SampleLog::HEADER_SIZE;
+            const uint8_t* payloadEnd = payload + header.length;
+            uint8_t count = header.length ? *payload++ : 0;
+            for (uint8_t i = 0; i < count && payload < payloadEnd; i++) {
+                const uint8_t* nul = (const uint8_t*)memchr(payload, 0, payloadEnd - payload);
+                if (!nul) break;
+                names.emplace_back((const char*)payload, nul - payload);
+                payload = nul + 1;
+            }
+            firstSequence = header.sequence;
+        } else {
+            if (header.kind != SampleLog::BLOCK_DATA) {
+                end = "unexpected block kind";
+                break;
+            }
+            if (header.sequence != lastSequence + 1 + invalid) {
+                fprintf(stderr, "%s: block %llu: sequence %lu after %lu\n", path.c_str(),
+                        (unsigned long long)index, (unsigned long)header.sequence, (unsigned long)lastSequence);
+            }
+            bool ok = SampleLog::decodeBlock(block, header, [&](const SampleLog::Record& record) {
+                printRecord(output, names, header, record, totals);
+            });
+            if (!ok) {
+                end = "malformed payload";
+                break;
+            }
+            if (records == 0 || (int32_t)(header.minTimestamp - minTimestamp) < 0) minTimestamp = header.minTimestamp;
+            if (records == 0 || (int32_t)(header.maxTimestamp - maxTimestamp) > 0) maxTimestamp = header.maxTimestamp;
+            records += header.count;
+            totals.bytes += header.length;
+        }
+        lastSequence = header.sequence;
+        invalid = 0;
+        index++;
+    }
+    fclose(file);
+
+    totals.blocks += index;
+    totals.records += records;
+    if (output == Output::INFO) {
+        printf("%s: %llu blocks, sequence %lu-%lu, %llu samples, samd ms %lu-%lu, %zu channels, stops at %s\n",
+               path.c_str(), (unsigned long long)index, (unsigned long)firstSequence, (unsigned long)lastSequence,
+               (unsigned long long)records, (unsigned long)minTimestamp, (unsigned long)maxTimestamp,
+               names.size(), end);
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s info|csv|lp <file or directory>...\n", argv[0]);
+        return 2;
+    }
+
+    Output output;
+    if (strcmp(argv[1], "info") == 0) {
+        output = Output::INFO;
+    } else if (strcmp(argv[1], "csv") == 0) {
+        output = Output::CSV;
+        printf("unix_ms,samd_ms,channel,value\n");
+    } else if (strcmp(argv[1], "lp") == 0) {
+        output = Output::LINE_PROTOCOL;
+    } else {
+        fprintf(stderr, "unknown command %s\n", argv[1]);
+        return 2;
+    }
+
+    Totals totals;
+    std::vector<std::string> files = expandPaths(argc - 2, argv + 2);
+    for (const std::string& path : files) {
+        readFile(path, output, totals);
+    }
+
+    if (output == Output::INFO) {
+        printf("total: %zu files, %llu blocks, %llu samples, %.2f payload bytes per sample\n", files.size(),
+               (unsigned long long)totals.blocks, (unsigned long long)totals.records,
+               totals.records ? (double)totals.bytes / totals.records : 0.0);
+    } else if (output == Output::LINE_PROTOCOL && totals.withoutTime) {
+        fprintf(stderr, "%llu samples without a Unix time skipped\n", (unsigned long long)totals.withoutTime);
+    }
+    return files.empty() ? 1 : 0;
+}
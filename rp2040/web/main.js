@@ -0,0 +1 @@
+// Add your JavaScript code here
@@ -1,20 +1,320 @@
 #pragma once
 #include <Arduino.h>
-#include <SPI.h>
+#include "link_protocol.h"
+#include "comm/link_spi_slave.h"
+#include "sensors/sensor_manager.h"
+#include "controllers/controller_manager.h"
 
+// SAMD51 end of the RP2040 link. Every SPI transaction carries one frame
+// each way (see shared/link_protocol.h). The transport is double buffered
+// and re-armed from the DMA interrupt, so this class never sits in the
+// transfer path: it decodes commands that have arrived and stages the next
+// reply (an ACK, a pending alarm, auto-tune progress or a fresh snapshot,
+// in that order) in the idle buffer. The staged frame is repeated until
+// the next one is published.
 class CommunicationManager {
 public:
-    void begin();
-    void handleCommunication();
-    void sendSensorData();
-    void receiveCommands();
-    
+    static const uint8_t ALARM_QUEUE_SIZE = 4;
+
+    CommunicationManager(SensorManager& sensors, ControllerManager& controllers)
+        : sensors(sensors), controllers(controllers) {}
+
+    void begin() {
+        initSPI();
+    }
+
+    // Called from the scheduler; cheap when there is nothing to do
+    void handleCommunication() {
+        link.service();
+        raiseSafetyAlarm();
+        raiseDosingAlarms();
+
+        if (link.frameReceived()) {
+            receiveCommands();
+            link.releaseFrame();
+        }
+
+        sendSensorData();
+    }
+
+    // Stage the next reply in the idle buffer if the previous one has gone out
+    void sendSensorData() {
+        if (!link.canPublish()) return;
+
+        uint8_t* frame = link.idleFrame();
+        if (ackPending) {
+            LinkProtocol::encode(frame, LinkProtocol::MSG_ACK, txSequence++, pendingAck);
+            ackPending = false;
+            publishedType = LinkProtocol::MSG_ACK;
+        } else if (alarmCount > 0) {
+            LinkProtocol::encode(frame, LinkProtocol::MSG_ALARM, txSequence++, alarms[alarmTail]);
+            alarmTail = (alarmTail + 1) % ALARM_QUEUE_SIZE;
+            alarmCount--;
+            publishedType = LinkProtocol::MSG_ALARM;
+        } else if (controllers.autotuneChanged(lastAutotuneSequence)) {
+            packAutotuneStatus();
+            LinkProtocol::encode(frame, LinkProtocol::MSG_AUTOTUNE_STATUS, txSequence++, autotuneStatus);
+            publishedType = LinkProtocol::MSG_AUTOTUNE_STATUS;
+        } else if (sensors.snapshotChanged(lastSnapshotSequence) ||
+                   publishedType != LinkProtocol::MSG_SNAPSHOT) {
+            packSensorData();
+            LinkProtocol::encode(frame, LinkProtocol::MSG_SNAPSHOT, txSequence++, snapshot);
+            publishedType = LinkProtocol::MSG_SNAPSHOT;
+        } else {
+            return;
+        }
+
+        link.publish();
+    }
+
+    void receiveCommands() {
+        processSPIData();
+    }
+
+    // Queue an alarm for the RP2040; they go out one per frame, oldest first
+    void queueAlarm(uint16_t code, uint8_t severity, bool active, float value) {
+        // Keep the newest alarms when the queue is full
+        if (alarmCount == ALARM_QUEUE_SIZE) {
+            alarmTail = (alarmTail + 1) % ALARM_QUEUE_SIZE;
+            alarmCount--;
+        }
+        LinkProtocol::Alarm& alarm = alarms[alarmHead];
+        alarm.timestamp = millis();
+        alarm.code = code;
+        alarm.severity = severity;
+        alarm.active = active ? 1 : 0;
+        alarm.value = value;
+        alarmHead = (alarmHead + 1) % ALARM_QUEUE_SIZE;
+        alarmCount++;
+    }
+
+    uint32_t getFramesReceived() const { return rxSequence.received(); }
+    uint32_t getFramesLost() const { return rxSequence.lost(); }
+    uint32_t getFrameErrors() const { return frameErrors; }
+    uint32_t getFrameOverruns() const { return link.getOverruns(); }
+
 private:
-    static const uint8_t BUFFER_SIZE = 256;
-    uint8_t txBuffer[BUFFER_SIZE];
-    uint8_t rxBuffer[BUFFER_SIZE];
-    
-    void initSPI();
-    void processSPIData();
-    void packSensorData();
+    SensorManager& sensors;
+    ControllerManager& controllers;
+    LinkSpiSlave link;
+
+    LinkProtocol::Snapshot snapshot = {};
+    LinkProtocol::Ack pendingAck = {};
+    LinkProtocol::AutotuneStatus autotuneStatus = {};
+    LinkProtocol::SequenceTracker rxSequence;
+    uint8_t txSequence = 0;
+    uint8_t publishedType = LinkProtocol::MSG_IDLE;
+    uint32_t lastSnapshotSequence = 0;
+    uint32_t lastAutotuneSequence = 0;
+    uint8_t lastCommandType = LinkProtocol::MSG_IDLE;
+    uint8_t lastCommandSequence = 0;
+    uint8_t lastCommandSession = 0;     // 0 until the first command
+    bool ackPending = false;
+    LinkProtocol::Alarm alarms[ALARM_QUEUE_SIZE] = {};
+    uint8_t alarmHead = 0;
+    uint8_t alarmTail = 0;
+    uint8_t alarmCount = 0;
+    bool lastSystemSafe = true;
+    bool lastReservoirEmpty[PHController::REAGENT_COUNT] = {};
+    uint32_t frameErrors = 0;
+
+    void initSPI() {
+        // Stage a first snapshot so the RP2040 never sees an empty link
+        sendSensorData();
+        link.begin();
+    }
+
+    void processSPIData() {
+        const uint8_t* frame = link.rxFrame();
+        LinkProtocol::FrameHeader header;
+
+        LinkProtocol::DecodeResult result = LinkProtocol::decodeFrame(frame, header);
+        if (result == LinkProtocol::DECODE_EMPTY) return;
+        if (result != LinkProtocol::DECODE_OK) {
+            frameErrors++;
+            return;
+        }
+
+        // Commands are numbered on their own, so only the polls between
+        // them count towards frames lost
+        if (header.type == LinkProtocol::MSG_IDLE || header.type == LinkProtocol::MSG_ACK) {
+            rxSequence.update(header.sequence);
+            return;
+        }
+
+        // A retransmission of the last command only needs its ACK repeated
+        if (header.session == lastCommandSession && header.type == lastCommandType &&
+            header.sequence == lastCommandSequence) {
+            ackPending = true;
+            return;
+        }
+
+        uint8_t status = LinkProtocol::ACK_REJECTED;
+        switch (header.type) {
+            case LinkProtocol::MSG_SETPOINTS: {
+                LinkProtocol::Setpoints received;
+                if (LinkProtocol::decodePayload(frame, header, received)) {
+                    applySetpoints(received);
+                    status = LinkProtocol::ACK_OK;
+                }
+                break;
+            }
+            case LinkProtocol::MSG_AUTOTUNE: {
+                LinkProtocol::AutotuneCommand received;
+                if (LinkProtocol::decodePayload(frame, header, received) && handleAutotune(received)) {
+                    status = LinkProtocol::ACK_OK;
+                }
+                break;
+            }
+            case LinkProtocol::MSG_MODE_CHANGE:
+            case LinkProtocol::MSG_CALIBRATION:
+                // No manual modes or probe calibration on the controller side yet
+                status = LinkProtocol::ACK_UNSUPPORTED;
+                break;
+            default:
+                status = LinkProtocol::ACK_UNSUPPORTED;
+                break;
+        }
+
+        lastCommandType = header.type;
+        lastCommandSequence = header.sequence;
+        lastCommandSession = header.session;
+        pendingAck.type = header.type;
+        pendingAck.sequence = header.sequence;
+        pendingAck.status = status;
+        ackPending = true;
+    }
+
+    void applySetpoints(const LinkProtocol::Setpoints& received) {
+        ControllerManager::Setpoints setpoints;
+        setpoints.ph = received.ph;
+        setpoints.dissolvedOxygen = received.dissolvedOxygen;
+        setpoints.temperature = received.temperature;
+        setpoints.pressure = received.pressure;
+        setpoints.stirrerSpeed = received.stirrerSpeed;
+        setpoints.pumpSpeed = received.pumpSpeed;
+        controllers.setSetpoints(setpoints);
+    }
+
+    // Rejected for loops without a PID (stirring, feeding), while another
+    // tune runs or while the system is unsafe
+    bool handleAutotune(const LinkProtocol::AutotuneCommand& command) {
+        ControllerManager::TunedLoop loop;
+        if (!tunedLoop(command.loop, loop)) return false;
+
+        if (command.action == LinkProtocol::AUTOTUNE_ABORT) {
+            if (!controllers.isAutotuning(loop)) return false;
+            controllers.abortAutotune();
+            return true;
+        }
+        if (command.action != LinkProtocol::AUTOTUNE_START ||
+            command.rule > LinkProtocol::RULE_NO_OVERSHOOT) {
+            return false;
+        }
+        return controllers.startAutotune(loop, (RelayAutotuner::Rule)command.rule,
+                                         command.amplitude, command.hysteresis);
+    }
+
+    static bool tunedLoop(uint8_t loop, ControllerManager::TunedLoop& tuned) {
+        switch (loop) {
+            case LinkProtocol::LOOP_TEMPERATURE: tuned = ControllerManager::TUNED_TEMPERATURE; return true;
+            case LinkProtocol::LOOP_PH: tuned = ControllerManager::TUNED_PH; return true;
+            case LinkProtocol::LOOP_DISSOLVED_OXYGEN: tuned = ControllerManager::TUNED_DISSOLVED_OXYGEN; return true;
+            case LinkProtocol::LOOP_PRESSURE: tuned = ControllerManager::TUNED_PRESSURE; return true;
+            default: return false;
+        }
+    }
+
+    static uint8_t controlLoop(ControllerManager::TunedLoop loop) {
+        switch (loop) {
+            case ControllerManager::TUNED_PH: return LinkProtocol::LOOP_PH;
+            case ControllerManager::TUNED_DISSOLVED_OXYGEN: return LinkProtocol::LOOP_DISSOLVED_OXYGEN;
+            case ControllerManager::TUNED_PRESSURE: return LinkProtocol::LOOP_PRESSURE;
+            default: return LinkProtocol::LOOP_TEMPERATURE;
+        }
+    }
+
+    void packAutotuneStatus() {
+        const RelayAutotuner& tuner = controllers.getAutotuner();
+        RelayAutotuner::Gains gains = tuner.getGains(controllers.getAutotuneRule());
+
+        autotuneStatus.timestamp = millis();
+        autotuneStatus.loop = controlLoop(controllers.getAutotuneLoop());
+        autotuneStatus.state = (uint8_t)tuner.getState();
+        autotuneStatus.rule = (uint8_t)controllers.getAutotuneRule();
+        autotuneStatus.cycles = tuner.getCycles();
+        autotuneStatus.failure = (uint8_t)tuner.getFailure();
+        autotuneStatus.setpoint = tuner.getSetpoint();
+        autotuneStatus.ultimateGain = tuner.getUltimateGain();
+        autotuneStatus.ultimatePeriod = tuner.getUltimatePeriod();
+        autotuneStatus.amplitude = tuner.getAmplitude();
+        autotuneStatus.kp = gains.kp;
+        autotuneStatus.ki = gains.ki;
+        autotuneStatus.kd = gains.kd;
+    }
+
+    void packSensorData() {
+        const SensorManager::SensorReadings& readings = sensors.getSnapshot();
+        TemperatureController& temperature = controllers.getTemperatureController();
+        uint16_t valid = 0;
+
+        snapshot.timestamp = readings.timestamp;
+
+        snapshot.ph = readings.ph_reading.pH;
+        if (readings.ph_reading.valid) valid |= LinkProtocol::VALID_PH;
+
+        snapshot.dissolvedOxygen = readings.do_reading.dissolvedOxygen;
+        if (readings.do_reading.valid) valid |= LinkProtocol::VALID_DISSOLVED_OXYGEN;
+
+        snapshot.temperature = temperature.getCurrentTemperature();
+        if (readings.ph_reading.valid || readings.do_reading.valid) valid |= LinkProtocol::VALID_TEMPERATURE;
+
+        // No pressure transducer fitted yet
+        snapshot.pressure = NAN;
+
+        snapshot.biomass = readings.biomass_reading.density;
+        if (readings.biomass_reading.valid) valid |= LinkProtocol::VALID_BIOMASS;
+
+        for (uint8_t i = 0; i < 3; i++) {
+            snapshot.pt100[i] = readings.pt100_reading.sensors[i].temperature;
+            if (readings.pt100_reading.sensors[i].valid) valid |= LinkProtocol::VALID_PT100_1 << i;
+        }
+
+        snapshot.stirrerSpeed = controllers.getStirrerController().getTargetSpeed();
+        snapshot.heaterOutput = temperature.getHeaterOutput();
+        snapshot.validMask = valid;
+
+        uint16_t status = 0;
+        if (controllers.isSystemSafe()) status |= LinkProtocol::STATUS_SYSTEM_SAFE;
+        if (snapshot.heaterOutput > 0) status |= LinkProtocol::STATUS_HEATER_ON;
+        if (snapshot.stirrerSpeed > 0) status |= LinkProtocol::STATUS_STIRRER_ON;
+        if (controllers.getSetpoints().pumpSpeed != 0) status |= LinkProtocol::STATUS_PUMP_ON;
+        snapshot.statusFlags = status;
+    }
+
+    // Report safety interlock transitions to the RP2040
+    void raiseSafetyAlarm() {
+        bool safe = controllers.isSystemSafe();
+        if (safe != lastSystemSafe) {
+            queueAlarm(LinkProtocol::ALARM_SAFETY_INTERLOCK, 2, !safe, 0);
+            lastSystemSafe = safe;
+        }
+    }
+
+    // Report dosing reservoirs running out and being refilled
+    void raiseDosingAlarms() {
+        static const uint16_t codes[PHController::REAGENT_COUNT] = {
+            LinkProtocol::ALARM_ACID_RESERVOIR_EMPTY,
+            LinkProtocol::ALARM_BASE_RESERVOIR_EMPTY
+        };
+
+        const PHController& ph = controllers.getPHController();
+        for (uint8_t i = 0; i < PHController::REAGENT_COUNT; i++) {
+            const DosingPump& pump = ph.getPump((PHController::Reagent)i);
+            if (pump.isEmpty() != lastReservoirEmpty[i]) {
+                queueAlarm(codes[i], 1, pump.isEmpty(), pump.getRemaining());
+                lastReservoirEmpty[i] = pump.isEmpty();
+            }
+        }
+    }
 };
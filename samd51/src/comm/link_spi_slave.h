@@ -0,0 +1,215 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Adafruit_ZeroDMA.h>
+#include <wiring_private.h>
+#include "link_protocol.h"
+
+// SERCOM wiring of the RP2040 link; override from build_flags to match the board.
+// Pads: MISO on PAD0, SCK on PAD1, SS on PAD2, MOSI on PAD3 (DOPO 0, DIPO 3).
+#ifndef LINK_SPI_SERCOM
+#define LINK_SPI_SERCOM       SERCOM2
+#define LINK_SPI_GCLK_ID      SERCOM2_GCLK_ID_CORE
+#define LINK_SPI_DMAC_ID_TX   SERCOM2_DMAC_ID_TX
+#define LINK_SPI_DMAC_ID_RX   SERCOM2_DMAC_ID_RX
+#endif
+#ifndef LINK_SPI_MISO_PIN
+#define LINK_SPI_MISO_PIN     21   // PA12, SERCOM2 PAD0
+#define LINK_SPI_SCK_PIN      22   // PA13, SERCOM2 PAD1
+#define LINK_SPI_SS_PIN       4    // PA14, SERCOM2 PAD2
+#define LINK_SPI_MOSI_PIN     23   // PA15, SERCOM2 PAD3
+#define LINK_SPI_PIO          PIO_SERCOM
+#endif
+
+// SPI slave for the inter-MCU link, double buffered in both directions.
+//
+// The DMAC owns one TX and one RX buffer at a time. When the last byte of
+// a frame has been clocked in, the RX completion interrupt swaps buffers
+// and restarts both channels, so the master can clock out the ready frame
+// whenever it likes without waiting on the main loop. The master must
+// leave a few microseconds between frames for that interrupt to run.
+//
+// Producer side: when canPublish() is true, fill idleFrame() and call
+// publish(); the frame goes out from the next transaction onwards and is
+// repeated until another one is published.
+//
+// Consumer side: when frameReceived() is true, read rxFrame() and hand it
+// back with releaseFrame(). Frames arriving before that are dropped and
+// counted as overruns.
+class LinkSpiSlave {
+public:
+    static const size_t FRAME_SIZE = LinkProtocol::FRAME_SIZE;
+
+    bool begin() {
+        instance() = this;
+
+        pinPeripheral(LINK_SPI_MISO_PIN, LINK_SPI_PIO);
+        pinPeripheral(LINK_SPI_SCK_PIN, LINK_SPI_PIO);
+        pinPeripheral(LINK_SPI_SS_PIN, LINK_SPI_PIO);
+        pinPeripheral(LINK_SPI_MOSI_PIN, LINK_SPI_PIO);
+
+        GCLK->PCHCTRL[LINK_SPI_GCLK_ID].reg = GCLK_PCHCTRL_GEN_GCLK1_Val | GCLK_PCHCTRL_CHEN;
+        while (GCLK->SYNCBUSY.reg);
+
+        Sercom* sercom = LINK_SPI_SERCOM;
+        sercom->SPI.CTRLA.bit.SWRST = 1;
+        while (sercom->SPI.SYNCBUSY.bit.SWRST);
+
+        // Slave, SPI mode 0, MSB first
+        sercom->SPI.CTRLA.reg = SERCOM_SPI_CTRLA_MODE(2) |
+                                SERCOM_SPI_CTRLA_DOPO(0) |
+                                SERCOM_SPI_CTRLA_DIPO(3);
+
+        // Receiver on, first byte preloaded before SS falls, SS low flag for resync
+        sercom->SPI.CTRLB.reg = SERCOM_SPI_CTRLB_RXEN | SERCOM_SPI_CTRLB_PLOADEN | SERCOM_SPI_CTRLB_SSDE;
+        while (sercom->SPI.SYNCBUSY.bit.CTRLB);
+
+        sercom->SPI.CTRLA.bit.ENABLE = 1;
+        while (sercom->SPI.SYNCBUSY.bit.ENABLE);
+
+        if (txDma.allocate() != DMA_STATUS_OK || rxDma.allocate() != DMA_STATUS_OK) {
+            return false;
+        }
+
+        txDma.setTrigger(LINK_SPI_DMAC_ID_TX);
+        txDma.setAction(DMA_TRIGGER_ACTON_BEAT);
+        txDescriptor = txDma.addDescriptor(txBuffers[txActive], (void*)&sercom->SPI.DATA.reg,
+                                           FRAME_SIZE, DMA_BEAT_SIZE_BYTE, true, false);
+
+        rxDma.setTrigger(LINK_SPI_DMAC_ID_RX);
+        rxDma.setAction(DMA_TRIGGER_ACTON_BEAT);
+        rxDescriptor = rxDma.addDescriptor((void*)&sercom->SPI.DATA.reg, rxBuffers[rxActive],
+                                           FRAME_SIZE, DMA_BEAT_SIZE_BYTE, false, true);
+        rxDma.setCallback(onReceiveComplete);
+
+        // Whatever the owner staged before begin() goes out first
+        if (txPending) {
+            txActive ^= 1;
+            txPending = false;
+        } else {
+            LinkProtocol::encodeIdle(txBuffers[txActive], 0);
+        }
+
+        restart();
+        return true;
+    }
+
+    // Call periodically from the main loop. Recovers from a transaction the
+    // master cut short, which would otherwise leave the DMA mid-frame.
+    void service() {
+        Sercom* sercom = LINK_SPI_SERCOM;
+
+        // SSL is cleared each time a frame completes, so a set flag with SS
+        // released on two consecutive calls means a partial frame
+        bool stalled = sercom->SPI.INTFLAG.bit.SSL && !isSelected();
+        if (stalled && stalledLastCall) {
+            noInterrupts();
+            restart();
+            interrupts();
+            aborted++;
+            stalled = false;
+        }
+        stalledLastCall = stalled;
+    }
+
+    bool isSelected() const {
+        return digitalRead(LINK_SPI_SS_PIN) == LOW;
+    }
+
+    // Receive side
+    bool frameReceived() const {
+        return rxPending;
+    }
+
+    const uint8_t* rxFrame() const {
+        return rxBuffers[rxReady];
+    }
+
+    void releaseFrame() {
+        rxPending = false;
+    }
+
+    // Transmit side
+    bool canPublish() const {
+        return !txPending;
+    }
+
+    uint8_t* idleFrame() {
+        return txBuffers[txActive ^ 1];
+    }
+
+    void publish() {
+        txPending = true;
+    }
+
+    uint32_t getFrameCount() const { return frames; }
+    uint32_t getOverruns() const { return overruns; }
+    uint32_t getAborted() const { return aborted; }
+
+private:
+    Adafruit_ZeroDMA txDma;
+    Adafruit_ZeroDMA rxDma;
+    DmacDescriptor* txDescriptor = nullptr;
+    DmacDescriptor* rxDescriptor = nullptr;
+    __attribute__((aligned(4))) uint8_t txBuffers[2][FRAME_SIZE];
+    __attribute__((aligned(4))) uint8_t rxBuffers[2][FRAME_SIZE];
+
+    // Indices of the buffers the DMAC is using; the other one belongs to the CPU
+    volatile uint8_t txActive = 0;
+    volatile uint8_t rxActive = 0;
+    volatile uint8_t rxReady = 1;
+    volatile bool txPending = false;
+    volatile bool rxPending = false;
+    bool stalledLastCall = false;
+
+    volatile uint32_t frames = 0;
+    volatile uint32_t overruns = 0;
+    volatile uint32_t aborted = 0;
+
+    static LinkSpiSlave*& instance() {
+        static LinkSpiSlave* slave = nullptr;
+        return slave;
+    }
+
+    // Point both channels at the active buffers and start them
+    void restart() {
+        rxDma.abort();
+        txDma.abort();
+
+        // Drop anything left in the receiver and clear the start-of-frame flag
+        Sercom* sercom = LINK_SPI_SERCOM;
+        while (sercom->SPI.INTFLAG.bit.RXC) {
+            (void)sercom->SPI.DATA.reg;
+        }
+        sercom->SPI.INTFLAG.reg = SERCOM_SPI_INTFLAG_SSL;
+
+        rxDma.changeDescriptor(rxDescriptor, nullptr, rxBuffers[rxActive], FRAME_SIZE);
+        txDma.changeDescriptor(txDescriptor, txBuffers[txActive], nullptr, FRAME_SIZE);
+        rxDma.startJob();
+        txDma.startJob();
+    }
+
+    // Runs in the DMAC interrupt once the master has clocked a whole frame
+    void frameComplete() {
+        frames = frames + 1;
+
+        if (rxPending) {
+            overruns = overruns + 1;
+        } else {
+            rxReady = rxActive;
+            rxActive ^= 1;
+            rxPending = true;
+        }
+
+        if (txPending) {
+            txActive ^= 1;
+            txPending = false;
+        }
+
+        restart();
+    }
+
+    static void onReceiveComplete(Adafruit_ZeroDMA*) {
+        instance()->frameComplete();
+    }
+};
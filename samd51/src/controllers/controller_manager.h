@@ -6,6 +6,10 @@
 #include "pressure_controller.h"
 #include "stirrer_controller.h"
 #include "stepper_controller.h"
+#include "dosing_pump.h"
+#include "task_scheduler.h"
+#include "relay_autotuner.h"
+#include "tuning_store.h"
 #include "../safety/safety_manager.h"
 #include "../sensors/sensor_manager.h"
 
@@ -18,6 +22,12 @@ namespace ControllerPins {
     // Additional stepper motor pins
     constexpr uint8_t PUMP_CS_PIN = 12;       // Chip select for pump stepper
     constexpr uint8_t PUMP_EN_PIN = 13;       // Enable pin for pump stepper
+
+    // pH dosing pump steppers
+    constexpr uint8_t ACID_PUMP_CS_PIN = 6;   // Chip select for acid pump TMC5130
+    constexpr uint8_t ACID_PUMP_EN_PIN = 7;   // Enable pin for acid pump TMC5130
+    constexpr uint8_t BASE_PUMP_CS_PIN = 8;   // Chip select for base pump TMC5130
+    constexpr uint8_t BASE_PUMP_EN_PIN = 9;   // Enable pin for base pump TMC5130
     
     // PWM control pins
     constexpr uint8_t HEATER_PWM_PIN = 32;    // PB10 for heater control
@@ -27,10 +37,16 @@ namespace ControllerPins {
 class ControllerManager {
 public:
     ControllerManager(SensorManager& sensors)
-        : tempController(sensors)
-        , safetyManager(sensors)
+        : sensors(sensors)
+        , acidPump(ControllerPins::ACID_PUMP_CS_PIN, ControllerPins::ACID_PUMP_EN_PIN)
+        , basePump(ControllerPins::BASE_PUMP_CS_PIN, ControllerPins::BASE_PUMP_EN_PIN)
+        , phController(sensors, acidPump, basePump)
+        , doController(sensors)
+        , tempController(sensors)
+        , pressureController(sensors)
         , stirrerController(ControllerPins::STIRRER_CS_PIN, ControllerPins::STIRRER_EN_PIN)
         , pumpStepper(ControllerPins::PUMP_CS_PIN, ControllerPins::PUMP_EN_PIN)
+        , safetyManager(sensors)
     {
         // Initialize default setpoints
         setpoints = {
@@ -43,8 +59,50 @@ public:
         };
     }
 
+    // Loops the relay auto-tuner can tune; also their TuningStore records
+    enum TunedLoop : uint8_t {
+        TUNED_TEMPERATURE = 0,
+        TUNED_PH,
+        TUNED_DISSOLVED_OXYGEN,
+        TUNED_PRESSURE,
+        TUNED_LOOP_COUNT
+    };
+    static_assert(TUNED_LOOP_COUNT <= TuningStore::MAX_LOOPS, "TuningStore has no record for every tuned loop");
+
+    // Relay test defaults per loop: relay amplitude as a fraction of the
+    // output range, hysteresis in process units (above the measurement
+    // noise) and how long to wait for a stable cycle
+    struct AutotuneDefaults {
+        float amplitude;
+        float hysteresis;
+        uint32_t timeoutMs;
+    };
+
+    static constexpr AutotuneDefaults AUTOTUNE_DEFAULTS[TUNED_LOOP_COUNT] = {
+        {0.25f, 0.05f, 12UL * 3600000},     // Temperature, °C; the jacket cycles in hours
+        {0.2f, 0.02f, 2UL * 3600000},       // pH
+        {0.2f, 1.0f, 3600000},              // DO, % saturation
+        {0.2f, 0.01f, 1800000},             // Pressure
+    };
+
+    // Task priorities, 0 is most urgent
+    enum TaskPriority : uint8_t {
+        PRIORITY_SAFETY = 0,
+        PRIORITY_ACQUISITION = 1,
+        PRIORITY_CONTROL = 2,
+        PRIORITY_MEASUREMENT = 3,
+        PRIORITY_ACTUATORS = 4,
+        PRIORITY_BACKGROUND = 5
+    };
+
     void begin() {
+        // Gains from the last auto-tune of each loop, if any
+        tuningStore.begin();
+        applyStoredTunings();
+
         // Initialize all controllers
+        acidPump.begin();
+        basePump.begin();
         phController.begin();
         doController.begin();
         tempController.begin();
@@ -55,27 +113,96 @@ public:
 
         // Set initial setpoints
         applySetpoints();
+        stirrerController.flush();
+        pumpStepper.flush();
+        acidPump.flush();
+        basePump.flush();
+
+        registerTasks();
+        scheduler.begin();
     }
 
+    // Run one scheduler pass; call this from loop()
     void update() {
-        // Only update controllers if safety checks pass
-        if (safetyManager.isSystemSafe()) {
-            phController.update();
-            doController.update();
-            tempController.update();
-            pressureController.update();
-            
-            // Update stirrer speed based on DO control requirements
-            float requiredStirrerSpeed = doController.getRequiredStirrerSpeed();
-            if (requiredStirrerSpeed > 0) {
-                stirrerController.setSpeed(requiredStirrerSpeed);
-            }
-
-            // Update stepper positions and velocities
-            pumpStepper.updatePosition();
-        } else {
-            handleSafetyShutdown();
-        }
+        scheduler.run();
+    }
+
+    // Lets other subsystems (communication, PWM) share the task table
+    int8_t addTask(const char* name, TaskScheduler::TaskFunction function, void* context,
+                   uint32_t periodMs, uint32_t phaseMs, uint32_t deadlineMs, uint8_t priority) {
+        return scheduler.addTask(name, function, context, periodMs, phaseMs, deadlineMs, priority);
+    }
+
+    const TaskScheduler& getScheduler() const {
+        return scheduler;
+    }
+
+    TaskScheduler& getScheduler() {
+        return scheduler;
+    }
+
+    // Control intervals are owned by the scheduler, keep both in step
+    void setTemperatureControlInterval(unsigned long interval) {
+        tempController.setControlInterval(interval);
+        scheduler.setPeriod(tempControlTask, tempController.getControlInterval());
+    }
+
+    void setPressureControlInterval(unsigned long interval) {
+        pressureController.setControlInterval(interval);
+        scheduler.setPeriod(pressureControlTask, pressureController.getControlInterval());
+    }
+
+    // Start a relay auto-tune of one loop around its current setpoint.
+    // amplitude (fraction of the output range) and hysteresis (process
+    // units) of 0 take AUTOTUNE_DEFAULTS. The loop runs open until the
+    // tune ends; on success the gains from rule are applied and stored.
+    // Only one loop is tuned at a time.
+    bool startAutotune(TunedLoop loop, RelayAutotuner::Rule rule, float amplitude = 0, float hysteresis = 0) {
+        if (loop >= TUNED_LOOP_COUNT || autotuner.isRunning() || !systemSafe) return false;
+        if (loop == TUNED_PRESSURE && !pressureController.isFitted()) return false;
+
+        const AutotuneDefaults& defaults = AUTOTUNE_DEFAULTS[loop];
+        amplitude = amplitude > 0 ? min(amplitude, 1.0f) : defaults.amplitude;
+        hysteresis = hysteresis > 0 ? hysteresis : defaults.hysteresis;
+        autotuneLoop = loop;
+        autotuneRule = rule;
+        withTunedLoop(loop, [&](auto& controller) {
+            const PIDController<>& pid = controller.getPID();
+            float range = pid.getOutputMax() - pid.getOutputMin();
+            autotuner.start(pid.getSetpoint(), controller.getOutput(), amplitude * range, hysteresis,
+                            pid.getOutputMin(), pid.getOutputMax(),
+                            pid.getDirection() == PIDController<>::Direction::REVERSE,
+                            defaults.timeoutMs, millis());
+        });
+        autotuneSequence++;
+        return true;
+    }
+
+    // Give the loop back to its PID with the gains it had
+    void abortAutotune() {
+        if (!autotuner.isRunning()) return;
+        autotuner.abort();
+        finishAutotune();
+    }
+
+    bool isAutotuning(TunedLoop loop) const {
+        return autotuner.isRunning() && autotuneLoop == loop;
+    }
+
+    const RelayAutotuner& getAutotuner() const { return autotuner; }
+    TunedLoop getAutotuneLoop() const { return autotuneLoop; }
+    RelayAutotuner::Rule getAutotuneRule() const { return autotuneRule; }
+
+    // True once per change of the tuner state or cycle count
+    bool autotuneChanged(uint32_t& lastSeenSequence) const {
+        if (lastSeenSequence == autotuneSequence) return false;
+        lastSeenSequence = autotuneSequence;
+        return true;
+    }
+
+    // Last stored tune of a loop; false if it still runs on its defaults
+    bool getStoredTuning(TunedLoop loop, TuningStore::Record& record) const {
+        return tuningStore.load(loop, record);
     }
 
     // Setpoint structure for all controllable parameters
@@ -84,7 +211,7 @@ public:
         float dissolvedOxygen;
         float temperature;
         float pressure;
-        float stirrerSpeed;
+        float stirrerSpeed;        // RPM, the floor of the DO cascade
         int32_t pumpSpeed;
     };
 
@@ -107,6 +234,11 @@ public:
         return setpoints;
     }
 
+    // Result of the last safety task run
+    bool isSystemSafe() const {
+        return systemSafe;
+    }
+
     // Stepper motor direct control methods
     void setPumpSpeed(int32_t speed) {
         setpoints.pumpSpeed = speed;
@@ -128,7 +260,10 @@ public:
 
     // Emergency stop
     void emergencyStop() {
+        abortAutotune();
         stirrerController.stop();
+        doController.stopGasFlow();
+        phController.stopDosing();
         pumpStepper.stop();
         pumpStepper.disable();
         tempController.setSetpoint(20.0); // Room temperature
@@ -136,7 +271,11 @@ public:
     }
 
 private:
-    // Controllers
+    SensorManager& sensors;
+
+    // Controllers; the pumps before the pH controller that uses them
+    DosingPump acidPump;
+    DosingPump basePump;
     PHController phController;
     DOController doController;
     TemperatureController tempController;
@@ -148,9 +287,148 @@ private:
     // Current setpoints
     Setpoints setpoints;
 
+    RelayAutotuner autotuner;
+    TuningStore tuningStore;
+    TunedLoop autotuneLoop = TUNED_TEMPERATURE;
+    RelayAutotuner::Rule autotuneRule = RelayAutotuner::Rule::ZIEGLER_NICHOLS;
+    uint32_t autotuneSequence = 0;
+    uint8_t autotuneCycles = 0;
+
+    TaskScheduler scheduler;
+    int8_t tempControlTask = -1;
+    int8_t pressureControlTask = -1;
+    bool systemSafe = true;
+
+    // Static task table; phases stagger the 1 s work across the second
+    void registerTasks() {
+        scheduler.addTask("safety", [](void* self) { static_cast<ControllerManager*>(self)->runSafety(); },
+                          this, 1000, 0, 100, PRIORITY_SAFETY);
+        scheduler.addTask("sensors", [](void* self) { static_cast<ControllerManager*>(self)->sensors.update(); },
+                          this, 1, 0, 1, PRIORITY_ACQUISITION);
+        scheduler.addTask("measure", [](void* self) { static_cast<ControllerManager*>(self)->runMeasurements(); },
+                          this, 1000, 50, 100, PRIORITY_MEASUREMENT);
+        scheduler.addTask("ph", [](void* self) { static_cast<ControllerManager*>(self)->runPHControl(); },
+                          this, PHController::CONTROL_INTERVAL, 100, 500, PRIORITY_CONTROL);
+        scheduler.addTask("do", [](void* self) { static_cast<ControllerManager*>(self)->runDOControl(); },
+                          this, DOController::CONTROL_INTERVAL, 150, 500, PRIORITY_CONTROL);
+        tempControlTask = scheduler.addTask("temperature",
+                          [](void* self) { static_cast<ControllerManager*>(self)->runTemperatureControl(); },
+                          this, tempController.getControlInterval(), 200, 500, PRIORITY_CONTROL);
+        pressureControlTask = scheduler.addTask("pressure",
+                          [](void* self) { static_cast<ControllerManager*>(self)->runPressureControl(); },
+                          this, pressureController.getControlInterval(), 250, 500, PRIORITY_CONTROL);
+        scheduler.addTask("actuators", [](void* self) { static_cast<ControllerManager*>(self)->runActuators(); },
+                          this, 100, 75, 50, PRIORITY_ACTUATORS);
+    }
+
+    void runSafety() {
+        systemSafe = safetyManager.isSystemSafe();
+        if (!systemSafe) {
+            handleSafetyShutdown();
+        }
+    }
+
+    void runMeasurements() {
+        phController.measure();
+        doController.measure();
+        tempController.measure();
+        pressureController.measure();
+        runAutotune();
+    }
+
+    // Only update controllers if safety checks pass and the tuner does not hold them
+    void runPHControl() {
+        if (systemSafe && !isAutotuning(TUNED_PH)) phController.control();
+    }
+
+    void runDOControl() {
+        if (systemSafe && !isAutotuning(TUNED_DISSOLVED_OXYGEN)) doController.control();
+    }
+
+    void runTemperatureControl() {
+        if (systemSafe && !isAutotuning(TUNED_TEMPERATURE)) tempController.control();
+    }
+
+    void runPressureControl() {
+        if (systemSafe && !isAutotuning(TUNED_PRESSURE)) pressureController.control();
+    }
+
+    // The relay switches at the measurement rate, not the loop's control interval
+    void runAutotune() {
+        if (!autotuner.isRunning()) return;
+
+        withTunedLoop(autotuneLoop, [&](auto& controller) {
+            controller.driveOutput(autotuner.update(controller.getProcessValue(), millis()));
+        });
+        if (autotuner.getCycles() != autotuneCycles) {
+            autotuneCycles = autotuner.getCycles();
+            autotuneSequence++;
+        }
+        if (!autotuner.isRunning()) {
+            finishAutotune();
+        }
+    }
+
+    // Apply and store the result, or fall back to the old gains, and close the loop again
+    void finishAutotune() {
+        bool complete = autotuner.getState() == RelayAutotuner::State::COMPLETE;
+        RelayAutotuner::Gains gains = autotuner.getGains(autotuneRule);
+        withTunedLoop(autotuneLoop, [&](auto& controller) {
+            if (complete) controller.setPIDTunings(gains.kp, gains.ki, gains.kd);
+            controller.resumeControl(autotuner.getBias());
+        });
+
+        if (complete) {
+            TuningStore::Record record = {gains.kp, gains.ki, gains.kd, autotuner.getUltimateGain(),
+                                          autotuner.getUltimatePeriod(), (uint8_t)autotuneRule, 1};
+            tuningStore.save(autotuneLoop, record);
+        }
+        autotuneCycles = 0;
+        autotuneSequence++;
+    }
+
+    void applyStoredTunings() {
+        for (uint8_t loop = 0; loop < TUNED_LOOP_COUNT; loop++) {
+            TuningStore::Record record;
+            if (!tuningStore.load(loop, record)) continue;
+            withTunedLoop((TunedLoop)loop, [&](auto& controller) {
+                controller.setPIDTunings(record.kp, record.ki, record.kd);
+            });
+        }
+    }
+
+    // The controllers share the tuning hooks but no base class
+    template <typename Function>
+    void withTunedLoop(TunedLoop loop, Function function) {
+        switch (loop) {
+            case TUNED_TEMPERATURE: function(tempController); break;
+            case TUNED_PH: function(phController); break;
+            case TUNED_DISSOLVED_OXYGEN: function(doController); break;
+            case TUNED_PRESSURE: function(pressureController); break;
+            default: break;
+        }
+    }
+
+    void runActuators() {
+        if (!systemSafe) return;
+
+        // The DO cascade owns the stirrer; the stirrer setpoint is its minimum
+        float requiredStirrerSpeed = doController.getRequiredStirrerSpeed();
+        if (requiredStirrerSpeed > 0) {
+            stirrerController.setSpeed(requiredStirrerSpeed);
+        }
+
+        // One SPI burst per driver for everything staged this tick
+        stirrerController.flush();
+        pumpStepper.flush();
+        acidPump.flush();
+        basePump.flush();
+    }
+
     void applySetpoints() {
         phController.setSetpoint(setpoints.ph);
         doController.setSetpoint(setpoints.dissolvedOxygen);
+        doController.setMinimumStirrerSpeed(setpoints.stirrerSpeed);
         tempController.setSetpoint(setpoints.temperature);
         pressureController.setSetpoint(setpoints.pressure);
         stirrerController.setSpeed(setpoints.stirrerSpeed);
@@ -158,8 +436,12 @@ private:
     }
 
     void handleSafetyShutdown() {
+        abortAutotune();
+
         // Stop all active controls
         stirrerController.stop();
+        doController.stopGasFlow();
+        phController.stopDosing();
         pumpStepper.stop();
         pumpStepper.disable();
         
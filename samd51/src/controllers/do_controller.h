@@ -1,95 +1,289 @@
 #pragma once
 
 #include <Arduino.h>
-#include <PID_v1.h>
+#include "pid_controller.h"
+#include "../sensors/sensor_manager.h"
 
+// Mass flow controller setpoint outputs (0-3.3 V on the DAC pins, scaled
+// to the MFC's analog setpoint input); override from build_flags
+#ifndef DO_AIR_FLOW_PIN
+#define DO_AIR_FLOW_PIN A0
+#endif
+#ifndef DO_OXYGEN_FLOW_PIN
+#define DO_OXYGEN_FLOW_PIN A1
+#endif
+
+// Split-range DO control. One PID drives a single demand of 0-100 %,
+// which is laid across the actuators in turn:
+//
+//   0 %                33 %                 67 %                 100 %
+//   | stirrer min..max  | air flow min..max  | O2 flow 0..max      |
+//
+// (air first, then stirrer, with CascadePriority::GAS_FIRST). A segment
+// only moves once the ones before it are at their maximum, so the
+// actuators never work against each other and there is one integrator
+// to wind up instead of one per actuator.
+//
+// The stirrer maximum is a shear limit that falls from stirrerMax to
+// stirrerMaxDense as the culture approaches shearBiomass (filtered
+// biomass probe reading). Whenever a limit or the segment order changes,
+// the demand is recomputed from where the actuators are and the PID is
+// re-seeded there, so the hand-off does not bump the outputs.
 class DOController {
 public:
-    DOController() : stirrerPID(&input, &stirrerOutput, &setpoint, Kp_s, Ki_s, Kd_s, DIRECT),
-                    gasPID(&input, &gasOutput, &setpoint, Kp_g, Ki_g, Kd_g, DIRECT) {
-        lastControlAction = 0;
-        lastMeasurement = 0;
-        cascadePriority = CascadePriority::STIRRER_FIRST;
-    }
-
     enum class CascadePriority {
         STIRRER_FIRST,
         GAS_FIRST
     };
 
+    struct Limits {
+        float stirrerMin;           // RPM, mixing floor
+        float stirrerMax;           // RPM, with no biomass
+        float stirrerMaxDense;      // RPM, at shearBiomass and above
+        float shearBiomass;         // g/L
+        float airMin;               // vvm
+        float airMax;               // vvm
+        float oxygenMax;            // vvm of pure O2 blended into the air
+        float airFullScale;         // vvm at full DAC output
+        float oxygenFullScale;
+    };
+
+    static const unsigned long CONTROL_INTERVAL = 1000;     // The measurement rate
+    static constexpr float BIOMASS_FILTER = 600.0f;         // s, time constant of the shear limit input
+    static constexpr float REBASE_THRESHOLD = 1.0f;         // RPM of stirrer ceiling change before a hand-off
+
+    DOController(SensorManager& sensorManager)
+        : sensorManager(sensorManager),
+          pid(Kp, Ki, Kd) {
+        cascadePriority = CascadePriority::STIRRER_FIRST;
+        limits = {200.0f, 800.0f, 500.0f, 10.0f, 0.1f, 1.5f, 0.5f, 2.0f, 1.0f};
+        stirrerCeiling = limits.stirrerMax;
+    }
+
     void begin() {
-        stirrerPID.SetMode(AUTOMATIC);
-        gasPID.SetMode(AUTOMATIC);
-        stirrerPID.SetSampleTime(30000); // 30 seconds
-        gasPID.SetSampleTime(30000);     // 30 seconds
+        analogWriteResolution(DAC_BITS);
+        pid.setOutputLimits(0, 100);
+        pid.setMode(PIDController<>::Mode::AUTOMATIC, input);
+        applyOutput(output);
     }
 
     void setCascadePriority(CascadePriority priority) {
+        if (priority == cascadePriority) return;
         cascadePriority = priority;
+        rebase();
+    }
+
+    void setLimits(const Limits& newLimits) {
+        limits = newLimits;
+        stirrerCeiling = shearCeiling();
+        rebase();
+    }
+
+    const Limits& getLimits() const {
+        return limits;
+    }
+
+    // Lowest stirrer speed the cascade will use; the manual stirrer setpoint
+    void setMinimumStirrerSpeed(float rpm) {
+        if (rpm == limits.stirrerMin) return;
+        limits.stirrerMin = rpm;
+        rebase();
     }
 
-    void setSetpoint(double newSetpoint) {
+    void setSetpoint(float newSetpoint) {
         setpoint = newSetpoint;
+        pid.setSetpoint(newSetpoint);
     }
 
-    void update() {
-        unsigned long currentTime = millis();
-        
-        // Take measurement every second
-        if (currentTime - lastMeasurement >= 1000) {
-            input = readDOSensor();
-            lastMeasurement = currentTime;
-        }
+    void setPIDTunings(float kp, float ki, float kd) {
+        pid.setTunings(kp, ki, kd);
+    }
 
-        // Control action every 30 seconds
-        if (currentTime - lastControlAction >= 30000) {
-            if (cascadePriority == CascadePriority::STIRRER_FIRST) {
-                updateStirrerFirst();
-            } else {
-                updateGasFirst();
-            }
-            lastControlAction = currentTime;
-        }
+    // Relay auto-tune hooks (ControllerManager::startAutotune). While the
+    // tuner holds the loop, control() is not run and the tuner drives the
+    // split-range demand through driveOutput() at the measurement rate.
+    const PIDController<>& getPID() const {
+        return pid;
+    }
+
+    float getProcessValue() const {
+        return input;
+    }
+
+    float getOutput() const {
+        return output;
+    }
+
+    void driveOutput(float value) {
+        output = value;
+        applyOutput(output);
+    }
+
+    // Hand the demand back to the PID, carrying on from value without a bump
+    void resumeControl(float value) {
+        output = value;
+        applyOutput(output);
+        seedPID();
+    }
+
+    // Take a measurement; scheduled every second
+    void measure() {
+        readSensors();
+    }
+
+    // Control action; scheduled every CONTROL_INTERVAL
+    void control() {
+        output = pid.compute(input, DT);
+        applyOutput(output);
     }
 
+    // Gas outputs to zero, e.g. on a safety shutdown; the next control()
+    // puts them back
+    void stopGasFlow() {
+        airFlow = 0;
+        oxygenFlow = 0;
+        writeFlow(DO_AIR_FLOW_PIN, 0, limits.airFullScale);
+        writeFlow(DO_OXYGEN_FLOW_PIN, 0, limits.oxygenFullScale);
+    }
+
+    // Stirrer speed in RPM requested by the cascade
+    float getRequiredStirrerSpeed() const {
+        return requiredStirrerSpeed;
+    }
+
+    float getAirFlow() const { return airFlow; }                // vvm
+    float getOxygenFlow() const { return oxygenFlow; }          // vvm
+    float getStirrerCeiling() const { return stirrerCeiling; }  // RPM, after the shear limit
+    float getBiomass() const { return biomass; }                // g/L, filtered
+
 private:
-    double input, stirrerOutput, gasOutput, setpoint;
-    const double Kp_s = 2.0, Ki_s = 0.5, Kd_s = 0.1; // Stirrer PID constants
-    const double Kp_g = 1.0, Ki_g = 0.2, Kd_g = 0.05; // Gas PID constants
-    PID stirrerPID;
-    PID gasPID;
+    enum Segment : uint8_t {
+        SEGMENT_STIRRER,
+        SEGMENT_AIR,
+        SEGMENT_OXYGEN,
+        SEGMENT_COUNT
+    };
+
+    static constexpr float SEGMENT_SPAN = 100.0f / SEGMENT_COUNT;
+    static const uint8_t DAC_BITS = 12;
+    static constexpr float DT = CONTROL_INTERVAL / 1000.0f;
+    static constexpr float Kp = 1.0f, Ki = 0.01f, Kd = 0.0f; // PID constants, % demand per % DO
+
+    SensorManager& sensorManager;
+    uint32_t lastSnapshotSequence = 0;
+    float input = 0, output = 0, setpoint = 0;
+    float requiredStirrerSpeed = 0, airFlow = 0, oxygenFlow = 0;
+    float biomass = 0;
+    bool haveBiomass = false;
+    float stirrerCeiling;
+    Limits limits;
+    PIDController<> pid;
     CascadePriority cascadePriority;
-    unsigned long lastControlAction;
-    unsigned long lastMeasurement;
-
-    void updateStirrerFirst() {
-        stirrerPID.Compute();
-        if (stirrerOutput >= 95) { // If stirrer near max capacity
-            gasPID.Compute();
-            adjustGasFlow(gasOutput);
+
+    void readSensors() {
+        // Only take new values when the sensor manager has published them
+        if (!sensorManager.snapshotChanged(lastSnapshotSequence)) {
+            return;
+        }
+
+        const SensorManager::SensorReadings& readings = sensorManager.getSnapshot();
+        if (readings.do_reading.valid) {
+            input = readings.do_reading.dissolvedOxygen;
+        }
+        if (readings.biomass_reading.valid) {
+            updateShearLimit(readings.biomass_reading.density);
         }
-        adjustStirrerSpeed(stirrerOutput);
     }
 
-    void updateGasFirst() {
-        gasPID.Compute();
-        if (gasOutput >= 95) { // If gas flow near max capacity
-            stirrerPID.Compute();
-            adjustStirrerSpeed(stirrerOutput);
+    // Position of a segment along the demand, in the order of cascadePriority
+    uint8_t segmentIndex(Segment segment) const {
+        if (segment == SEGMENT_OXYGEN || cascadePriority == CascadePriority::STIRRER_FIRST) {
+            return segment;
         }
-        adjustGasFlow(gasOutput);
+        return segment == SEGMENT_STIRRER ? SEGMENT_AIR : SEGMENT_STIRRER;
+    }
+
+    // 0..1 of a segment's range for a demand
+    float segmentFraction(Segment segment, float demand) const {
+        float start = segmentIndex(segment) * SEGMENT_SPAN;
+        return constrain((demand - start) / SEGMENT_SPAN, 0.0f, 1.0f);
+    }
+
+    void applyOutput(float demand) {
+        float stirrerMax = max(stirrerCeiling, limits.stirrerMin);
+        requiredStirrerSpeed = limits.stirrerMin +
+                               segmentFraction(SEGMENT_STIRRER, demand) * (stirrerMax - limits.stirrerMin);
+        adjustStirrerSpeed(requiredStirrerSpeed);
+        airFlow = limits.airMin + segmentFraction(SEGMENT_AIR, demand) * (limits.airMax - limits.airMin);
+        oxygenFlow = segmentFraction(SEGMENT_OXYGEN, demand) * limits.oxygenMax;
+        adjustGasFlow(airFlow, oxygenFlow);
+    }
+
+    // The demand that reproduces the actuators: the furthest segment off
+    // its minimum sets it, the ones before it count as full
+    float currentDemand() const {
+        float fractions[SEGMENT_COUNT];
+        float stirrerRange = max(stirrerCeiling, limits.stirrerMin) - limits.stirrerMin;
+        float airRange = limits.airMax - limits.airMin;
+        fractions[segmentIndex(SEGMENT_STIRRER)] =
+            stirrerRange > 0 ? (requiredStirrerSpeed - limits.stirrerMin) / stirrerRange : 0;
+        fractions[segmentIndex(SEGMENT_AIR)] = airRange > 0 ? (airFlow - limits.airMin) / airRange : 0;
+        fractions[SEGMENT_OXYGEN] = limits.oxygenMax > 0 ? oxygenFlow / limits.oxygenMax : 0;
+
+        for (int8_t i = SEGMENT_COUNT - 1; i >= 0; i--) {
+            if (fractions[i] > 0 || i == 0) {
+                return (i + constrain(fractions[i], 0.0f, 1.0f)) * SEGMENT_SPAN;
+            }
+        }
+        return 0;
+    }
+
+    // Limits moved under the actuators: continue from where they are
+    void rebase() {
+        output = currentDemand();
+        applyOutput(output);
+        seedPID();
+    }
+
+    void seedPID() {
+        if (pid.getMode() != PIDController<>::Mode::AUTOMATIC) return;
+        pid.setMode(PIDController<>::Mode::MANUAL, input);
+        pid.setManualOutput(output);
+        pid.setMode(PIDController<>::Mode::AUTOMATIC, input);
+    }
+
+    float shearCeiling() const {
+        float density = limits.shearBiomass > 0 ? constrain(biomass / limits.shearBiomass, 0.0f, 1.0f) : 0;
+        return limits.stirrerMax + density * (limits.stirrerMaxDense - limits.stirrerMax);
+    }
+
+    void updateShearLimit(float density) {
+        if (!haveBiomass) {
+            biomass = density;
+            haveBiomass = true;
+        } else {
+            biomass += DT / (BIOMASS_FILTER + DT) * (density - biomass);
+        }
+
+        float ceiling = shearCeiling();
+        if (fabsf(ceiling - stirrerCeiling) < REBASE_THRESHOLD) return;
+        stirrerCeiling = ceiling;
+        rebase();
     }
 
-    double readDOSensor() {
-        // TODO: Implement actual DO sensor reading
-        return 0.0;
+    // Staged here, sent by ControllerManager::runActuators() through the StirrerController
+    void adjustStirrerSpeed(float rpm) {
+        requiredStirrerSpeed = rpm;
     }
 
-    void adjustStirrerSpeed(double value) {
-        // TODO: Implement stirrer speed control
+    void adjustGasFlow(float air, float oxygen) {
+        writeFlow(DO_AIR_FLOW_PIN, air, limits.airFullScale);
+        writeFlow(DO_OXYGEN_FLOW_PIN, oxygen, limits.oxygenFullScale);
     }
 
-    void adjustGasFlow(double value) {
-        // TODO: Implement gas flow control
+    void writeFlow(uint8_t pin, float flow, float fullScale) {
+        const int maxCode = (1 << DAC_BITS) - 1;
+        float fraction = fullScale > 0 ? constrain(flow / fullScale, 0.0f, 1.0f) : 0;
+        analogWrite(pin, (int)(fraction * maxCode + 0.5f));
     }
 };
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "stepper_controller.h"
+
+// One peristaltic reagent pump on a TMC5130 in position mode. A shot is a
+// relative move of volume * stepsPerMl microsteps at the pump's flow rate,
+// so the pulse width in time is the shot volume over the flow rate. What
+// was delivered is counted from XACTUAL, the steps the motor actually
+// made, and taken off the reservoir; below reserveVolume the reservoir is
+// empty and the pump refuses shots until refill(). A shot is stopped in
+// velocity mode, which ramps down without reversing: a new XTARGET at the
+// current position would overshoot it and pull reagent back.
+class DosingPump {
+public:
+    struct Config {
+        float stepsPerMl;           // Microsteps per mL of the tubing
+        float flowRate;             // mL/s while a shot runs
+        float reservoirVolume;      // mL when full
+        float reserveVolume;        // mL left when the reservoir counts as empty
+    };
+
+    DosingPump(uint8_t cs_pin, uint8_t en_pin)
+        : stepper_(cs_pin, en_pin) {
+        config_ = {51200.0f, 0.33f, 500.0f, 10.0f};
+        remaining_ = config_.reservoirVolume;
+    }
+
+    void begin() {
+        stepper_.begin();
+        stepper_.setSpeed(velocity());
+        stepper_.flush();
+        stepper_.enable();
+    }
+
+    void setConfig(const Config& config) {
+        config_ = config;
+        remaining_ = min(remaining_, config_.reservoirVolume);
+        stepper_.setSpeed(velocity());
+    }
+
+    const Config& getConfig() const {
+        return config_;
+    }
+
+    // Start a shot; false while one is still running or the reservoir is empty
+    bool dose(float ml) {
+        if (busy_ || empty_ || ml <= 0) return false;
+        float available = remaining_ - config_.reserveVolume;
+        int32_t steps = (int32_t)lroundf(min(ml, available) * config_.stepsPerMl);
+        if (steps <= 0) return false;
+
+        // A shot cut short by the reserve empties the reservoir however
+        // the float accounting of what moved comes out
+        drains_ = ml >= available;
+        target_ += steps;
+        shotStart_ = position_;
+        busy_ = true;
+        shots_++;
+        stepper_.setPosition(target_);     // Sent by the next flush()
+        return true;
+    }
+
+    // Account for what moved; call once per measurement. The position is
+    // only read while a shot is running.
+    void update() {
+        if (!busy_) return;
+
+        int32_t position = stepper_.getCurrentPosition();
+        float moved = (position - position_) / config_.stepsPerMl;
+        position_ = position;
+        dispensed_ += moved;
+        remaining_ -= moved;
+        if (remaining_ <= config_.reserveVolume) {
+            empty_ = true;
+        }
+        if (stopping_) {
+            // At rest: hold where the motor stopped, back in position mode
+            if (stepper_.isVelocityReached()) {
+                stopping_ = false;
+                busy_ = false;
+                target_ = position_;
+                stepper_.holdPosition(target_);
+                stepper_.setSpeed(velocity());
+                stepper_.flush();
+            }
+            return;
+        }
+        if (position_ == target_) {
+            busy_ = false;
+            if (drains_) empty_ = true;
+        }
+    }
+
+    // Abandon the running shot; busy until update() sees the motor at rest
+    void stop() {
+        if (!busy_ || stopping_) return;
+        drains_ = false;
+        stopping_ = true;
+        stepper_.stop();
+        update();
+    }
+
+    // Send any staged register changes; called once per control tick
+    void flush() {
+        stepper_.flush();
+    }
+
+    // Also what the dosing controller calls when shots stop having an effect
+    void markEmpty() {
+        empty_ = true;
+    }
+
+    void refill(float ml) {
+        remaining_ = constrain(ml, 0.0f, config_.reservoirVolume);
+        empty_ = remaining_ <= config_.reserveVolume;
+    }
+
+    bool isBusy() const { return busy_; }
+    bool isEmpty() const { return empty_; }
+    float getDispensed() const { return dispensed_; }                   // mL since boot
+    float getRemaining() const { return remaining_; }                   // mL in the reservoir
+    float getLastShot() const { return (position_ - shotStart_) / config_.stepsPerMl; }  // mL so far
+    uint32_t getShots() const { return shots_; }
+
+private:
+    StepperController stepper_;
+    Config config_;
+    int32_t target_ = 0;
+    int32_t position_ = 0;
+    int32_t shotStart_ = 0;
+    float dispensed_ = 0;
+    float remaining_;
+    uint32_t shots_ = 0;
+    bool busy_ = false;
+    bool empty_ = false;
+    bool drains_ = false;       // The running shot goes down to the reserve
+    bool stopping_ = false;     // Ramping down in velocity mode after stop()
+
+    // VMAX for the flow rate
+    uint32_t velocity() const {
+        return StepperController::toVelocityRegister(config_.flowRate * config_.stepsPerMl);
+    }
+};
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <Arduino.h>
+#include <math.h>
+
+// Online identification of a first-order-plus-dead-time model, sampled
+// every Ts seconds:
+//
+//   y[k+1] = a y[k] + b u[k-d] + c
+//   K = b / (1 - a)   tau = -Ts / ln(a)   theta = d Ts   y0 = c / (1 - a)
+//
+// y0 is where the output settles with no input (ambient, for a heater).
+// One recursive least-squares estimator with exponential forgetting runs
+// for each candidate dead time d < MAX_DELAY; the one with the smallest
+// filtered one-step prediction error is the model. Regressors are centred
+// on the first output seen so the float estimate stays well conditioned;
+// inputs should be normalised (0..1).
+//
+// Samples the model already predicts to within the dead zone are not
+// learned from: in steady state there is nothing to identify, and
+// forgetting would otherwise let the estimate wander. Once b is known,
+// neither are jumps larger than the input could cause in one sample
+// (OUTLIER_RATIO times b, the effect of full input): those are
+// disturbances such as a cold feed, and nothing is learned for
+// HOLD_OFF_SAMPLES after one while the states the model leaves out settle.
+class FOPDTModel {
+public:
+    static const uint8_t MAX_DELAY = 12;                   // Samples
+    static constexpr float FORGETTING = 0.998f;            // Memory of about 500 samples
+    static const uint16_t MIN_SAMPLES = 3 * MAX_DELAY;     // Before the model is trusted
+    static constexpr float MAX_GAIN_UNCERTAINTY = 0.2f;    // Standard deviation of b / b
+    static constexpr float OUTLIER_RATIO = 2.0f;
+    static const uint16_t HOLD_OFF_SAMPLES = 36;           // Not learned from after an outlier
+
+    explicit FOPDTModel(float sampleTime = 10.0f) {
+        reset(sampleTime);
+    }
+
+    // Forget everything; call when the sample time changes
+    void reset(float sampleTime) {
+        this->sampleTime = sampleTime;
+        for (Estimator& estimator : estimators) {
+            estimator.reset();
+        }
+        for (float& u : inputs) u = 0;
+        best = 0;
+        samples = 0;
+        holdOff = 0;
+        haveOutput = false;
+    }
+
+    // Prediction errors below this are not learned from, output units;
+    // about the measurement noise
+    void setDeadZone(float deadZone) {
+        this->deadZone = deadZone > 0 ? deadZone : 0;
+    }
+
+    // Once per sample: the output measured now and the input applied over
+    // the period that just ended
+    void update(float y, float u) {
+        for (uint8_t i = MAX_DELAY; i > 0; i--) {
+            inputs[i] = inputs[i - 1];
+        }
+        inputs[0] = u;
+
+        if (!haveOutput) {
+            centre = y;
+            previousOutput = y;
+            haveOutput = true;
+            return;
+        }
+
+        float target = y - centre;
+        float previous = previousOutput - centre;
+        previousOutput = y;
+        if (samples < 0xFFFF) samples++;
+
+        // A disturbance also leaves the states the model does not have
+        // (the jacket) off for a while; learn nothing until that has passed
+        if (holdOff > 0) {
+            holdOff--;
+            return;
+        }
+        float bestPhi[3] = {previous, inputs[best], 1.0f};
+        if (samples > best && estimators[best].isOutlier(bestPhi, target)) {
+            holdOff = HOLD_OFF_SAMPLES;
+            return;
+        }
+
+        // Estimators whose delay reaches past the first input wait for history
+        for (uint8_t d = 0; d < MAX_DELAY; d++) {
+            if (samples > d) {
+                float phi[3] = {previous, inputs[d], 1.0f};
+                estimators[d].update(phi, target, deadZone);
+            }
+        }
+
+        for (uint8_t d = 0; d < MAX_DELAY; d++) {
+            if (samples > d && estimators[d].error < estimators[best].error) {
+                best = d;
+            }
+        }
+    }
+
+    // Stable, positive gain known to within MAX_GAIN_UNCERTAINTY, and seen long enough
+    bool isValid() const {
+        float a = getA();
+        float b = getB();
+        return samples >= MIN_SAMPLES && a > 0.0f && a < 0.9999f && b > 0.0f &&
+               getGainUncertainty() < MAX_GAIN_UNCERTAINTY;
+    }
+
+    // Relative standard deviation of the input coefficient
+    float getGainUncertainty() const {
+        return estimators[best].gainUncertainty();
+    }
+
+    float getA() const { return estimators[best].theta[0]; }
+    float getB() const { return estimators[best].theta[1]; }
+    float getC() const { return estimators[best].theta[2] + centre * (1.0f - getA()); }
+
+    float getGain() const { return getB() / (1.0f - getA()); }
+    float getTimeConstant() const { return -sampleTime / logf(getA()); }
+    float getDeadTime() const { return best * sampleTime; }
+    uint8_t getDelaySamples() const { return best; }
+    float getOffset() const { return getC() / (1.0f - getA()); }
+    float getSampleTime() const { return sampleTime; }
+    uint16_t getSamples() const { return samples; }
+
+    // RMS one-step prediction error of the chosen model, output units
+    float getPredictionError() const { return sqrtf(estimators[best].error); }
+
+    // Input that holds the output at y in steady state
+    float steadyStateInput(float y) const {
+        return (y - getOffset()) / getGain();
+    }
+
+    // The output d samples from now: the model run forward from the
+    // measurement y over the inputs already applied but not yet seen
+    float predictAhead(float y) const {
+        float a = getA(), b = getB(), c = getC();
+        for (int8_t i = best - 1; i >= 0; i--) {
+            y = a * y + b * inputs[i] + c;
+        }
+        return y;
+    }
+
+private:
+    struct Estimator {
+        float theta[3];
+        float P[3][3];
+        float error;            // Filtered squared a-priori prediction error
+
+        void reset() {
+            theta[0] = 0.9f;
+            theta[1] = 0.0f;
+            theta[2] = 0.0f;
+            for (uint8_t i = 0; i < 3; i++) {
+                for (uint8_t j = 0; j < 3; j++) {
+                    P[i][j] = i == j ? 1000.0f : 0.0f;
+                }
+            }
+            error = INFINITY;
+        }
+
+        float gainUncertainty() const {
+            float b = fabsf(theta[1]);
+            return b > 0 ? sqrtf(P[1][1] * error) / b : INFINITY;
+        }
+
+        float predictionError(const float* phi, float y) const {
+            return y - (theta[0] * phi[0] + theta[1] * phi[1] + theta[2] * phi[2]);
+        }
+
+        bool isOutlier(const float* phi, float y) const {
+            return gainUncertainty() < MAX_GAIN_UNCERTAINTY &&
+                   fabsf(predictionError(phi, y)) > OUTLIER_RATIO * theta[1];
+        }
+
+        void update(const float* phi, float y, float deadZone) {
+            if (isOutlier(phi, y)) return;
+            float e = predictionError(phi, y);
+            error = isinf(error) ? e * e : error + ERROR_FILTER * (e * e - error);
+            if (fabsf(e) < deadZone) return;
+
+            float Pphi[3];
+            float denominator = FORGETTING;
+            for (uint8_t i = 0; i < 3; i++) {
+                Pphi[i] = P[i][0] * phi[0] + P[i][1] * phi[1] + P[i][2] * phi[2];
+                denominator += phi[i] * Pphi[i];
+            }
+
+            float trace = 0;
+            for (uint8_t i = 0; i < 3; i++) {
+                theta[i] += Pphi[i] / denominator * e;
+                for (uint8_t j = 0; j < 3; j++) {
+                    P[i][j] = (P[i][j] - Pphi[i] * Pphi[j] / denominator) / FORGETTING;
+                }
+                trace += P[i][i];
+            }
+
+            // Without excitation forgetting lets P grow without bound; cap it
+            if (trace > MAX_TRACE) {
+                float scale = MAX_TRACE / trace;
+                for (uint8_t i = 0; i < 3; i++) {
+                    for (uint8_t j = 0; j < 3; j++) P[i][j] *= scale;
+                }
+            }
+        }
+    };
+
+    static constexpr float MAX_TRACE = 10000.0f;
+    static constexpr float ERROR_FILTER = 0.02f;
+
+    Estimator estimators[MAX_DELAY];
+    float inputs[MAX_DELAY + 1];     // inputs[0] is the latest
+    float sampleTime;
+    float deadZone = 0.01f;
+    float centre = 0;
+    float previousOutput = 0;
+    uint8_t best = 0;
+    uint16_t samples = 0;
+    uint16_t holdOff = 0;
+    bool haveOutput = false;
+};
@@ -1,58 +1,333 @@
 #pragma once
 
 #include <Arduino.h>
-#include <PID_v1.h>
+#include <math.h>
+#include "pid_controller.h"
+#include "dosing_pump.h"
+#include "../sensors/sensor_manager.h"
 
+// Acid/base dosing. Reagent goes in as shots, each a position move of
+// one of the two DosingPumps; the strategy decides how big and how often.
 class PHController {
 public:
-    PHController() : pid(&input, &output, &setpoint, Kp, Ki, Kd, DIRECT) {
-        lastControlAction = 0;
-        lastMeasurement = 0;
+    // ADAPTIVE sizes each shot from an online estimate of the broth's
+    // buffer capacity beta (mmol/L per pH unit), so that it takes out
+    // SHOT_GAIN of the error, and does nothing more until the shot's
+    // effect has been seen (responseTime after the pump stops: transport,
+    // mixing and probe lag). The pH change it caused, net of the drift
+    // measured before it, updates beta. Shots that move the pH less than
+    // NO_RESPONSE_RATIO of what beta predicts, NO_RESPONSE_SHOTS in a row,
+    // mark that reservoir empty (or its line blocked).
+    //
+    // PID treats the PID output as a signed duty: every PWM_PERIOD the
+    // base (positive) or acid (negative) pump runs for that fraction of
+    // the period. The relay auto-tuner drives the same duty.
+    enum class Strategy : uint8_t {
+        PID,
+        ADAPTIVE
+    };
+
+    enum Reagent : uint8_t {
+        ACID = 0,
+        BASE,
+        REAGENT_COUNT
+    };
+
+    struct DosingConfig {
+        float volume;                   // L of broth
+        float concentration[REAGENT_COUNT];  // mmol/mL of acid and base
+        float deadband;                 // pH either side of the setpoint left alone
+        float minShot;                  // mL
+        float maxShot;                  // mL
+        float responseTime;             // s from the end of a shot to its full effect
+        float initialBufferCapacity;    // mmol/L per pH, until shots have been learned from
+    };
+
+    static const unsigned long CONTROL_INTERVAL = 1000;    // The measurement rate
+    static const unsigned long PWM_PERIOD = 30000;
+    static constexpr float SHOT_GAIN = 0.7f;               // Fraction of the error one shot corrects
+    static constexpr float LEARNING_RATE = 0.3f;           // Per shot, on log(beta)
+    static constexpr float MIN_BUFFER_CAPACITY = 0.5f;     // mmol/L per pH
+    static constexpr float MAX_BUFFER_CAPACITY = 500.0f;
+    static constexpr float MIN_RESPONSE = 0.01f;           // pH; smaller changes are noise
+    static constexpr float NO_RESPONSE_RATIO = 0.1f;
+    static const uint8_t NO_RESPONSE_SHOTS = 3;
+    static const unsigned long DRIFT_WINDOW = 60000;       // Slope over which drift is measured
+    static constexpr float DRIFT_FILTER = 0.3f;            // Per window
+
+    PHController(SensorManager& sensorManager, DosingPump& acidPump, DosingPump& basePump)
+        : sensorManager(sensorManager),
+          pid(Kp, Ki, Kd) {
+        pumps[ACID] = &acidPump;
+        pumps[BASE] = &basePump;
+        config = {5.0f, {0.5f, 0.5f}, 0.02f, 0.05f, 10.0f, 60.0f, 10.0f};
+        bufferCapacity = config.initialBufferCapacity;
+
+        // Signed duty, % of PWM_PERIOD; positive doses base
+        pid.setOutputLimits(-100, 100);
     }
 
     void begin() {
-        pid.SetMode(AUTOMATIC);
-        pid.SetSampleTime(2000); // 2 seconds
+        pid.setMode(PIDController<>::Mode::AUTOMATIC, input);
     }
 
-    void setSetpoint(double newSetpoint) {
+    void setSetpoint(float newSetpoint) {
         setpoint = newSetpoint;
+        pid.setSetpoint(newSetpoint);
+    }
+
+    float getSetpoint() const {
+        return setpoint;
+    }
+
+    // Gains of the PID strategy
+    void setPIDTunings(float kp, float ki, float kd) {
+        pid.setTunings(kp, ki, kd);
+    }
+
+    void setPIDTunings(float kp, float ki, float kd, Strategy newStrategy) {
+        setPIDTunings(kp, ki, kd);
+        setStrategy(newStrategy);
+    }
+
+    void setStrategy(Strategy newStrategy) {
+        if (newStrategy == strategy) return;
+        strategy = newStrategy;
+        output = 0;
+        resumeControl(output);
+    }
+
+    Strategy getStrategy() const {
+        return strategy;
+    }
+
+    void setDosingConfig(const DosingConfig& newConfig) {
+        config = newConfig;
     }
 
-    void update() {
-        unsigned long currentTime = millis();
-        
-        // Take measurement every second
-        if (currentTime - lastMeasurement >= 1000) {
-            input = readPHSensor();
-            lastMeasurement = currentTime;
+    const DosingConfig& getDosingConfig() const {
+        return config;
+    }
+
+    // mmol/L per pH unit, as learned from the shots so far
+    float getBufferCapacity() const {
+        return bufferCapacity;
+    }
+
+    const DosingPump& getPump(Reagent reagent) const {
+        return *pumps[reagent];
+    }
+
+    // The reservoir has been refilled to ml; shots resume if it was empty
+    void refillReservoir(Reagent reagent, float ml) {
+        pumps[reagent]->refill(ml);
+        noResponse[reagent] = 0;
+    }
+
+    // Stop both pumps where they are, e.g. on a safety shutdown
+    void stopDosing() {
+        for (DosingPump* pump : pumps) {
+            pump->stop();
         }
+        phase = Phase::IDLE;
+    }
 
-        // Control action every 2 minutes
-        if (currentTime - lastControlAction >= 120000) {
-            if (setpoint - input >= 0.2) { // Trigger condition: 0.2 pH below setpoint
-                pid.Compute();
-                actuatePump(output);
-                logToDatabase();
-            }
-            lastControlAction = currentTime;
+    // Relay auto-tune hooks (ControllerManager::startAutotune). While the
+    // tuner holds the loop, control() is not run and the tuner sets the
+    // PWM duty through driveOutput() at the measurement rate.
+    const PIDController<>& getPID() const {
+        return pid;
+    }
+
+    float getProcessValue() const {
+        return input;
+    }
+
+    float getOutput() const {
+        return output;
+    }
+
+    void driveOutput(float value) {
+        phase = Phase::IDLE;
+        driftRunning = false;
+        output = constrain(value, -100.0f, 100.0f);
+        updatePWM();
+    }
+
+    // Hand the duty back to the PID, carrying on from value without a bump
+    void resumeControl(float value) {
+        output = constrain(value, -100.0f, 100.0f);
+        pid.setMode(PIDController<>::Mode::MANUAL, input);
+        pid.setManualOutput(output);
+        pid.setMode(PIDController<>::Mode::AUTOMATIC, input);
+    }
+
+    // Take a measurement and account for the pumps; scheduled every second
+    void measure() {
+        bool first = !haveReading;
+        input = readPHSensor();
+        if (first && haveReading) {
+            // The PID was initialised against no reading; start it from this one
+            resumeControl(output);
+        }
+        for (DosingPump* pump : pumps) {
+            pump->update();
+        }
+        if (haveReading && phase == Phase::IDLE) {
+            updateDrift(millis());
+        }
+    }
+
+    // Control action; scheduled every CONTROL_INTERVAL. Nothing is dosed
+    // before the probe has given a reading.
+    void control() {
+        if (!haveReading) return;
+        if (strategy == Strategy::ADAPTIVE) {
+            controlAdaptive();
+        } else {
+            output = pid.compute(input, DT);
+            updatePWM();
         }
     }
 
 private:
-    double input, output, setpoint;
-    const double Kp = 2.0, Ki = 0.5, Kd = 0.1; // PID constants
-    PID pid;
-    unsigned long lastControlAction;
-    unsigned long lastMeasurement;
+    enum class Phase : uint8_t {
+        IDLE,
+        DOSING,         // A pump is running the shot
+        WAITING         // For the shot's effect
+    };
+
+    static constexpr float DT = CONTROL_INTERVAL / 1000.0f;
+    static constexpr float Kp = 300.0f, Ki = 0.1f, Kd = 0.0f; // PID constants, % duty per pH
 
-    double readPHSensor() {
-        // TODO: Implement actual pH sensor reading
-        return 0.0;
+    SensorManager& sensorManager;
+    uint32_t lastSnapshotSequence = 0;
+    float input = 0, output = 0, setpoint = 0;
+    bool haveReading = false;
+    PIDController<> pid;
+    DosingPump* pumps[REAGENT_COUNT];
+    DosingConfig config;
+    Strategy strategy = Strategy::ADAPTIVE;
+
+    // ADAPTIVE
+    Phase phase = Phase::IDLE;
+    float bufferCapacity;
+    float drift = 0;                // pH/s, the culture's own acid (or base)
+    float driftStartPH = 0;
+    uint32_t driftStart = 0;
+    bool driftRunning = false;
+    Reagent shotReagent = BASE;
+    float shotStartPH = 0;
+    uint32_t shotStart = 0;
+    uint32_t shotEnd = 0;
+    uint8_t noResponse[REAGENT_COUNT] = {};
+
+    // PID
+    uint32_t periodStart = 0;
+
+    float readPHSensor() {
+        // Only take a new value when the sensor manager has published one
+        if (!sensorManager.snapshotChanged(lastSnapshotSequence)) {
+            return input;
+        }
+
+        const SensorManager::SensorReadings& readings = sensorManager.getSnapshot();
+        if (!readings.ph_reading.valid) {
+            return input;
+        }
+        haveReading = true;
+        return readings.ph_reading.pH;
     }
 
-    void actuatePump(double value) {
-        // TODO: Implement pump control
+    void controlAdaptive() {
+        uint32_t now = millis();
+        switch (phase) {
+            case Phase::IDLE:
+                startShot(now);
+                break;
+            case Phase::DOSING:
+                if (!pumps[shotReagent]->isBusy()) {
+                    shotEnd = now;
+                    phase = Phase::WAITING;
+                }
+                break;
+            case Phase::WAITING:
+                if (now - shotEnd >= (uint32_t)(config.responseTime * 1000)) {
+                    learnFromShot(now);
+                    phase = Phase::IDLE;
+                }
+                break;
+        }
+    }
+
+    void startShot(uint32_t now) {
+        float error = setpoint - input;
+        if (fabsf(error) <= config.deadband) return;
+
+        Reagent reagent = error > 0 ? BASE : ACID;
+        float mmol = SHOT_GAIN * fabsf(error) * bufferCapacity * config.volume;
+        float ml = constrain(mmol / config.concentration[reagent], config.minShot, config.maxShot);
+        if (!pumps[reagent]->dose(ml)) return;
+
+        driftRunning = false;
+        shotReagent = reagent;
+        shotStartPH = input;
+        shotStart = now;
+        phase = Phase::DOSING;
+        logToDatabase();
+    }
+
+    // Compare the pH change, less the drift over the same time, with what
+    // the shot should have done
+    void learnFromShot(uint32_t now) {
+        float dose = pumps[shotReagent]->getLastShot() * config.concentration[shotReagent] / config.volume;
+        if (dose <= 0) return;
+        float sign = shotReagent == BASE ? 1.0f : -1.0f;
+        float response = sign * (input - shotStartPH - drift * (now - shotStart) / 1000.0f);
+        float expected = dose / bufferCapacity;
+
+        if (response < max(MIN_RESPONSE, NO_RESPONSE_RATIO * expected)) {
+            if (++noResponse[shotReagent] >= NO_RESPONSE_SHOTS) {
+                pumps[shotReagent]->markEmpty();
+            }
+            return;
+        }
+        noResponse[shotReagent] = 0;
+
+        float observed = constrain(dose / response, MIN_BUFFER_CAPACITY, MAX_BUFFER_CAPACITY);
+        bufferCapacity = expf(logf(bufferCapacity) + LEARNING_RATE * (logf(observed) - logf(bufferCapacity)));
+    }
+
+    // Slope of the pH over whole DRIFT_WINDOWs between shots; a window is
+    // long enough that probe noise barely moves it
+    void updateDrift(uint32_t now) {
+        if (!driftRunning) {
+            driftStartPH = input;
+            driftStart = now;
+            driftRunning = true;
+            return;
+        }
+        uint32_t elapsed = now - driftStart;
+        if (elapsed < DRIFT_WINDOW) return;
+        drift += DRIFT_FILTER * ((input - driftStartPH) * 1000.0f / elapsed - drift);
+        driftStartPH = input;
+        driftStart = now;
+    }
+
+    // One shot per PWM_PERIOD, its width the duty; the shot for a period
+    // goes out at its start. A full-width shot overruns the period by the
+    // pump's acceleration, so the next period waits for it.
+    void updatePWM() {
+        uint32_t now = millis();
+        if (now - periodStart < PWM_PERIOD) return;
+        Reagent reagent = output >= 0 ? BASE : ACID;
+        if (pumps[ACID]->isBusy() || pumps[BASE]->isBusy()) return;
+        periodStart = now;
+
+        float ml = fabsf(output) / 100.0f * pumps[reagent]->getConfig().flowRate * (PWM_PERIOD / 1000.0f);
+        if (ml >= config.minShot) {
+            pumps[reagent]->dose(ml);
+        }
     }
 
     void logToDatabase() {
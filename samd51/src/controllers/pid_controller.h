@@ -0,0 +1,176 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Header-only PID controller for the single-precision FPU on the SAMD51.
+// Replaces PID_v1, which works in double and therefore in soft-float.
+//
+//   u = Kp (b r - y) + I - D
+//   I += Ki e dt                       (with anti-windup, see AntiWindup)
+//   D  = filtered Kd dy/dt             (derivative on measurement)
+//
+// The caller owns the timing and passes the elapsed time to compute().
+template <typename T = float>
+class PIDController {
+public:
+    enum class Mode {
+        MANUAL,
+        AUTOMATIC
+    };
+
+    enum class Direction {
+        DIRECT,
+        REVERSE
+    };
+
+    enum class AntiWindup {
+        CLAMPING,          // Stop integrating while the output is saturated in the error's direction
+        BACK_CALCULATION   // Bleed the integrator by the saturation excess with tracking gain Kt
+    };
+
+    PIDController(T kp, T ki, T kd, Direction direction = Direction::DIRECT)
+        : direction_(direction) {
+        setTunings(kp, ki, kd);
+    }
+
+    void setTunings(T kp, T ki, T kd) {
+        if (kp < 0 || ki < 0 || kd < 0) return;
+        T sign = direction_ == Direction::REVERSE ? T(-1) : T(1);
+        kp_ = sign * kp;
+        ki_ = sign * ki;
+        kd_ = sign * kd;
+        if (!trackingGainSet_) {
+            // Tracking time constant equal to the integral time
+            kt_ = kp > 0 ? ki / kp : ki;
+        }
+    }
+
+    void setDirection(Direction direction) {
+        if (direction != direction_) {
+            direction_ = direction;
+            kp_ = -kp_;
+            ki_ = -ki_;
+            kd_ = -kd_;
+        }
+    }
+
+    // Output range; PID_v1 defaults to 0-255 so we do the same
+    void setOutputLimits(T minOutput, T maxOutput) {
+        if (minOutput >= maxOutput) return;
+        outMin_ = minOutput;
+        outMax_ = maxOutput;
+        integral_ = clamp(integral_);
+        output_ = clamp(output_);
+    }
+
+    // Proportional setpoint weight b (0..1). b < 1 softens setpoint steps
+    // without slowing disturbance rejection.
+    void setSetpointWeight(T weight) {
+        setpointWeight_ = constrain(weight, T(0), T(1));
+    }
+
+    // First-order filter on the derivative term, time constant in seconds (0 = unfiltered)
+    void setDerivativeFilter(T timeConstant) {
+        derivativeTau_ = timeConstant > 0 ? timeConstant : T(0);
+    }
+
+    // Anti-windup strategy; trackingGain <= 0 keeps the default Kt = Ki / Kp
+    void setAntiWindup(AntiWindup mode, T trackingGain = 0) {
+        antiWindup_ = mode;
+        if (trackingGain > 0) {
+            kt_ = trackingGain;
+            trackingGainSet_ = true;
+        }
+    }
+
+    // Switching to AUTOMATIC initialises the integrator so the output carries
+    // on from its current value without a bump
+    void setMode(Mode mode, T input) {
+        if (mode == Mode::AUTOMATIC && mode_ == Mode::MANUAL) {
+            initialize(input);
+        }
+        mode_ = mode;
+    }
+
+    // Output used while in MANUAL; also the starting point for the next AUTOMATIC transfer
+    void setManualOutput(T output) {
+        output_ = clamp(output);
+    }
+
+    void setSetpoint(T setpoint) {
+        setpoint_ = setpoint;
+    }
+
+    // Run one step with dt seconds since the previous call; returns the new output
+    T compute(T input, T dt) {
+        if (mode_ == Mode::MANUAL || dt <= 0) {
+            lastInput_ = input;
+            return output_;
+        }
+
+        T error = setpoint_ - input;
+        T proportional = kp_ * (setpointWeight_ * setpoint_ - input);
+
+        // Derivative on measurement avoids the kick on setpoint changes
+        T rawDerivative = kd_ * (input - lastInput_) / dt;
+        if (derivativeTau_ > 0) {
+            T alpha = dt / (derivativeTau_ + dt);
+            derivative_ += alpha * (rawDerivative - derivative_);
+        } else {
+            derivative_ = rawDerivative;
+        }
+
+        T integral = integral_ + ki_ * error * dt;
+        T unsaturated = proportional + integral - derivative_;
+        T output = clamp(unsaturated);
+
+        if (antiWindup_ == AntiWindup::BACK_CALCULATION) {
+            integral += kt_ * (output - unsaturated) * dt;
+        } else if (output != unsaturated && (unsaturated - output) * ki_ * error > 0) {
+            // Saturated and the error would push further into the limit
+            integral = integral_;
+        }
+        integral_ = clamp(integral);
+
+        lastInput_ = input;
+        output_ = output;
+        return output_;
+    }
+
+    T getOutput() const { return output_; }
+    T getSetpoint() const { return setpoint_; }
+    T getKp() const { return direction_ == Direction::REVERSE ? -kp_ : kp_; }
+    T getKi() const { return direction_ == Direction::REVERSE ? -ki_ : ki_; }
+    T getKd() const { return direction_ == Direction::REVERSE ? -kd_ : kd_; }
+    T getOutputMin() const { return outMin_; }
+    T getOutputMax() const { return outMax_; }
+    Mode getMode() const { return mode_; }
+    Direction getDirection() const { return direction_; }
+
+private:
+    T kp_ = 0, ki_ = 0, kd_ = 0, kt_ = 0;
+    T setpoint_ = 0;
+    T setpointWeight_ = 1;
+    T derivativeTau_ = 0;
+    T outMin_ = 0, outMax_ = 255;
+    T integral_ = 0;
+    T derivative_ = 0;
+    T lastInput_ = 0;
+    T output_ = 0;
+    Mode mode_ = Mode::MANUAL;
+    Direction direction_;
+    AntiWindup antiWindup_ = AntiWindup::CLAMPING;
+    bool trackingGainSet_ = false;
+
+    T clamp(T value) const {
+        if (value > outMax_) return outMax_;
+        if (value < outMin_) return outMin_;
+        return value;
+    }
+
+    void initialize(T input) {
+        lastInput_ = input;
+        derivative_ = 0;
+        integral_ = clamp(output_ - kp_ * (setpointWeight_ * setpoint_ - input));
+    }
+};
@@ -1,61 +1,103 @@
 #pragma once
 
 #include <Arduino.h>
-#include <PID_v1.h>
+#include "pid_controller.h"
+#include "../sensors/sensor_manager.h"
 
 class PressureController {
 public:
-    PressureController() : pid(&input, &output, &setpoint, Kp, Ki, Kd, DIRECT) {
-        lastControlAction = 0;
-        lastMeasurement = 0;
+    PressureController(SensorManager& sensorManager)
+        : sensorManager(sensorManager),
+          pid(Kp, Ki, Kd) {
         controlInterval = 5000; // Start with 5 second interval
     }
 
     void begin() {
-        pid.SetMode(AUTOMATIC);
-        pid.SetSampleTime(controlInterval);
+        pid.setMode(PIDController<>::Mode::AUTOMATIC, input);
     }
 
-    void setSetpoint(double newSetpoint) {
+    void setSetpoint(float newSetpoint) {
         setpoint = newSetpoint;
+        pid.setSetpoint(newSetpoint);
     }
 
     void setControlInterval(unsigned long interval) {
-        controlInterval = constrain(interval, 5000, 10000); // 5-10 seconds
-        pid.SetSampleTime(controlInterval);
+        controlInterval = constrain(interval, 5000UL, 10000UL); // 5-10 seconds
     }
 
-    void update() {
-        unsigned long currentTime = millis();
-        
-        // Take measurement every second
-        if (currentTime - lastMeasurement >= 1000) {
-            input = readPressureSensor();
-            lastMeasurement = currentTime;
-        }
+    unsigned long getControlInterval() const {
+        return controlInterval;
+    }
 
-        // Control action based on control interval
-        if (currentTime - lastControlAction >= controlInterval) {
-            pid.Compute();
-            adjustBackpressure(output);
-            lastControlAction = currentTime;
-        }
+    void setPIDTunings(float kp, float ki, float kd) {
+        pid.setTunings(kp, ki, kd);
+    }
+
+    // Relay auto-tune hooks (ControllerManager::startAutotune). While the
+    // tuner holds the loop, control() is not run and the tuner drives the
+    // backpressure valve through driveOutput() at the measurement rate.
+    const PIDController<>& getPID() const {
+        return pid;
+    }
+
+    float getProcessValue() const {
+        return input;
+    }
+
+    float getOutput() const {
+        return output;
+    }
+
+    // Neither the transducer nor the backpressure valve is wired up yet
+    // (see readPressureSensor() and adjustBackpressure()), so a relay test
+    // would swing an output nothing acts on until it timed out
+    bool isFitted() const {
+        return false;
+    }
+
+    void driveOutput(float value) {
+        output = value;
+        adjustBackpressure(output);
+    }
+
+    // Hand the valve back to the PID, carrying on from value without a bump
+    void resumeControl(float value) {
+        output = value;
+        pid.setMode(PIDController<>::Mode::MANUAL, input);
+        pid.setManualOutput(output);
+        pid.setMode(PIDController<>::Mode::AUTOMATIC, input);
+    }
+
+    // Take a measurement; scheduled every second
+    void measure() {
+        input = readPressureSensor();
+    }
+
+    // Control action; scheduled every getControlInterval()
+    void control() {
+        output = pid.compute(input, controlInterval / 1000.0f);
+        adjustBackpressure(output);
     }
 
 private:
-    double input, output, setpoint;
-    const double Kp = 1.0, Ki = 0.2, Kd = 0.05; // PID constants
-    PID pid;
-    unsigned long lastControlAction;
-    unsigned long lastMeasurement;
+    SensorManager& sensorManager;
+    uint32_t lastSnapshotSequence = 0;
+    float input = 0, output = 0, setpoint = 0;
+    static constexpr float Kp = 1.0f, Ki = 0.2f, Kd = 0.05f; // PID constants
+    PIDController<> pid;
     unsigned long controlInterval;
 
-    double readPressureSensor() {
-        // TODO: Implement actual pressure sensor reading
-        return 0.0;
+    float readPressureSensor() {
+        // Only take a new value when the sensor manager has published one
+        if (!sensorManager.snapshotChanged(lastSnapshotSequence)) {
+            return input;
+        }
+
+        // TODO: The pressure transducer is not part of the sensor snapshot yet
+        return input;
     }
 
-    void adjustBackpressure(double value) {
+    void adjustBackpressure(float value) {
         // TODO: Implement backpressure control
     }
 };
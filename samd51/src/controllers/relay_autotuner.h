@@ -0,0 +1,251 @@
+#pragma once
+
+#include <Arduino.h>
+#include <math.h>
+
+// Åström–Hägglund relay auto-tuner. With the loop open, the output is
+// switched between bias + d and bias - d each time the process value
+// crosses the setpoint (with hysteresis eps), which drives the loop into
+// a limit cycle at its ultimate period Pu. From the cycle amplitude a,
+// the describing function of a relay with hysteresis gives the ultimate
+// gain:
+//
+//   Ku = 4 d / (pi sqrt(a^2 - eps^2))
+//
+// PID gains then follow from Ku and Pu by one of the Rule tables. Gains
+// are in the units of the output the tuner drove, per process unit, as
+// PIDController::setTunings() takes them.
+//
+// The bias is nudged after every cycle so the high and low half-periods
+// come out equal; an asymmetric cycle (a load, or a bias against an
+// output limit) would otherwise skew the estimate. The first cycle is the
+// approach to the setpoint and is never used. The tune completes when
+// the last CONSISTENT_CYCLES periods and amplitudes agree to within
+// TOLERANCE, and fails on timeout or if the process never crosses the
+// setpoint.
+class RelayAutotuner {
+public:
+    enum class State : uint8_t {
+        IDLE,
+        RUNNING,
+        COMPLETE,
+        FAILED
+    };
+
+    enum class Rule : uint8_t {
+        ZIEGLER_NICHOLS,        // Quarter-decay; fast, about 50 % overshoot
+        ZIEGLER_NICHOLS_PI,
+        TYREUS_LUYBEN,          // Detuned for lag-dominant loops
+        PESSEN_INTEGRAL,
+        SOME_OVERSHOOT,
+        NO_OVERSHOOT
+    };
+
+    enum class Failure : uint8_t {
+        NONE,
+        TIMEOUT,                // No stable cycle before the timeout
+        NO_OSCILLATION,         // A half-cycle took longer than the timeout allows
+        ABORTED
+    };
+
+    struct Gains {
+        float kp;
+        float ki;
+        float kd;
+    };
+
+    static const uint8_t CONSISTENT_CYCLES = 3;
+    static const uint8_t MAX_CYCLES = 20;
+    static constexpr float TOLERANCE = 0.05f;       // Relative spread of period and amplitude
+    static constexpr float BIAS_GAIN = 0.5f;        // Fraction of the half-period imbalance corrected per cycle
+
+    // Start a tune around setpoint. The output starts at bias and swings
+    // by amplitude either way, clamped to [outputMin, outputMax]; reverse
+    // is true when raising the output lowers the process value.
+    void start(float setpoint, float bias, float amplitude, float hysteresis,
+               float outputMin, float outputMax, bool reverse, uint32_t timeoutMs, uint32_t now) {
+        this->setpoint = setpoint;
+        this->bias = constrain(bias, outputMin, outputMax);
+        this->amplitude = amplitude;
+        this->hysteresis = hysteresis > 0 ? hysteresis : 0;
+        this->outputMin = outputMin;
+        this->outputMax = outputMax;
+        this->reverse = reverse;
+        this->timeoutMs = timeoutMs;
+        startTime = now;
+        switchTime = now;
+        cycleOpen = false;
+        cycles = 0;
+        periodCount = 0;
+        ultimateGain = 0;
+        ultimatePeriod = 0;
+        measuredAmplitude = 0;
+        failure = Failure::NONE;
+        relayHigh = true;       // Settled below the setpoint; corrected on the first sample
+        started = false;
+        peakHigh = -INFINITY;
+        peakLow = INFINITY;
+        state = State::RUNNING;
+    }
+
+    void abort() {
+        if (state == State::RUNNING) finish(Failure::ABORTED);
+    }
+
+    // Feed one measurement; returns the output to apply until the next one
+    float update(float input, uint32_t now) {
+        if (state != State::RUNNING) return output();
+
+        if (now - startTime > timeoutMs) {
+            finish(Failure::TIMEOUT);
+            return output();
+        }
+        // Half the budget spent without a switch: the relay cannot move the process
+        if (now - switchTime > timeoutMs / 2) {
+            finish(Failure::NO_OSCILLATION);
+            return output();
+        }
+
+        // Error in the direction the output acts on
+        float error = reverse ? input - setpoint : setpoint - input;
+        if (!started) {
+            relayHigh = error > 0;
+            started = true;
+        }
+
+        peakHigh = max(peakHigh, input);
+        peakLow = min(peakLow, input);
+        if (relayHigh && error < -hysteresis) {
+            relayHigh = false;
+            highTime = now - switchTime;
+            switchTime = now;
+        } else if (!relayHigh && error > hysteresis) {
+            relayHigh = true;
+            lowTime = now - switchTime;
+            switchTime = now;
+            completeCycle(now);
+        }
+        return output();
+    }
+
+    // Gains for a rule from the last result; zeros until COMPLETE
+    Gains getGains(Rule rule) const {
+        if (state != State::COMPLETE) return {0, 0, 0};
+        return gainsFor(rule, ultimateGain, ultimatePeriod);
+    }
+
+    // Ku and Pu (s) to gains
+    static Gains gainsFor(Rule rule, float ku, float pu) {
+        float kp, ti, td;
+        switch (rule) {
+            case Rule::ZIEGLER_NICHOLS_PI: kp = 0.45f * ku;  ti = pu / 1.2f;  td = 0;          break;
+            case Rule::TYREUS_LUYBEN:      kp = ku / 2.2f;   ti = 2.2f * pu;  td = pu / 6.3f;  break;
+            case Rule::PESSEN_INTEGRAL:    kp = 0.7f * ku;   ti = 0.4f * pu;  td = 0.15f * pu; break;
+            case Rule::SOME_OVERSHOOT:     kp = ku / 3.0f;   ti = 0.5f * pu;  td = pu / 3.0f;  break;
+            case Rule::NO_OVERSHOOT:       kp = 0.2f * ku;   ti = 0.5f * pu;  td = pu / 3.0f;  break;
+            default:                       kp = 0.6f * ku;   ti = 0.5f * pu;  td = pu / 8.0f;  break;
+        }
+        return {kp, ti > 0 ? kp / ti : 0, kp * td};
+    }
+
+    State getState() const { return state; }
+    Failure getFailure() const { return failure; }
+    bool isRunning() const { return state == State::RUNNING; }
+    uint8_t getCycles() const { return cycles; }
+    float getUltimateGain() const { return ultimateGain; }
+    float getUltimatePeriod() const { return ultimatePeriod; }      // s
+    float getAmplitude() const { return measuredAmplitude; }        // Process units, peak to mean
+    float getBias() const { return bias; }
+    float getSetpoint() const { return setpoint; }
+
+private:
+    State state = State::IDLE;
+    Failure failure = Failure::NONE;
+    float setpoint = 0, bias = 0, amplitude = 0, hysteresis = 0;
+    float outputMin = 0, outputMax = 0;
+    bool reverse = false;
+    uint32_t timeoutMs = 0;
+    uint32_t startTime = 0, switchTime = 0, cycleStart = 0;
+    uint32_t highTime = 0, lowTime = 0;
+    bool cycleOpen = false;     // cycleStart is set
+    bool relayHigh = true;
+    bool started = false;
+    float peakHigh = -INFINITY, peakLow = INFINITY;
+    uint8_t cycles = 0;
+
+    // Most recent cycles, oldest first
+    float periods[CONSISTENT_CYCLES];
+    float amplitudes[CONSISTENT_CYCLES];
+    uint8_t periodCount = 0;
+
+    float ultimateGain = 0, ultimatePeriod = 0, measuredAmplitude = 0;
+
+    float high() const { return min(bias + amplitude, outputMax); }
+    float low() const { return max(bias - amplitude, outputMin); }
+
+    float output() const {
+        if (state != State::RUNNING) return bias;
+        return relayHigh ? high() : low();
+    }
+
+    // A low-to-high switch closes a cycle
+    void completeCycle(uint32_t now) {
+        if (cycleOpen) {
+            float period = (now - cycleStart) / 1000.0f;
+            float a = (peakHigh - peakLow) / 2;
+            cycles++;
+            // Cycle 1 still carries the approach to the setpoint
+            if (cycles > 1) record(period, a);
+
+            // A long high half means the bias is short of what the load needs
+            float imbalance = (float)((int32_t)highTime - (int32_t)lowTime) / (highTime + lowTime);
+            float d = (high() - low()) / 2;
+            bias = constrain(bias + BIAS_GAIN * d * imbalance, outputMin, outputMax);
+        }
+        cycleStart = now;
+        cycleOpen = true;
+        peakHigh = -INFINITY;
+        peakLow = INFINITY;
+
+        if (state == State::RUNNING && cycles >= MAX_CYCLES) {
+            finish(Failure::TIMEOUT);
+        }
+    }
+
+    void record(float period, float a) {
+        if (periodCount == CONSISTENT_CYCLES) {
+            for (uint8_t i = 1; i < CONSISTENT_CYCLES; i++) {
+                periods[i - 1] = periods[i];
+                amplitudes[i - 1] = amplitudes[i];
+            }
+            periodCount--;
+        }
+        periods[periodCount] = period;
+        amplitudes[periodCount] = a;
+        periodCount++;
+        if (periodCount < CONSISTENT_CYCLES) return;
+
+        float periodMean = 0, amplitudeMean = 0;
+        for (uint8_t i = 0; i < CONSISTENT_CYCLES; i++) {
+            periodMean += periods[i] / CONSISTENT_CYCLES;
+            amplitudeMean += amplitudes[i] / CONSISTENT_CYCLES;
+        }
+        for (uint8_t i = 0; i < CONSISTENT_CYCLES; i++) {
+            if (fabsf(periods[i] - periodMean) > TOLERANCE * periodMean) return;
+            if (fabsf(amplitudes[i] - amplitudeMean) > TOLERANCE * amplitudeMean) return;
+        }
+        if (amplitudeMean <= hysteresis) return;
+
+        // Effective relay amplitude, as clamped by the output limits
+        float d = (high() - low()) / 2;
+        measuredAmplitude = amplitudeMean;
+        ultimatePeriod = periodMean;
+        ultimateGain = 4 * d / (PI * sqrtf(amplitudeMean * amplitudeMean - hysteresis * hysteresis));
+        state = State::COMPLETE;
+    }
+
+    void finish(Failure reason) {
+        failure = reason;
+        state = State::FAILED;
+    }
+};
@@ -21,8 +21,49 @@
 #define TMC5130A_TZEROWAIT  0x2C
 #define TMC5130A_XTARGET    0x2D
 
+// SPI_STATUS bits returned in the first byte of every datagram
+#define TMC5130A_STATUS_RESET_FLAG      0x01
+#define TMC5130A_STATUS_DRIVER_ERROR    0x02
+#define TMC5130A_STATUS_SG2             0x04
+#define TMC5130A_STATUS_STANDSTILL      0x08
+#define TMC5130A_STATUS_VELOCITY_REACHED 0x10
+#define TMC5130A_STATUS_POSITION_REACHED 0x20
+#define TMC5130A_STATUS_STOP_L          0x40
+#define TMC5130A_STATUS_STOP_R          0x80
+
 class StepperController {
 public:
+    struct RegisterWrite {
+        uint8_t addr;
+        uint32_t data;
+    };
+
+    // Decoded SPI_STATUS from the most recent datagram
+    struct DriverStatus {
+        uint8_t raw;
+        bool resetFlag;
+        bool driverError;
+        bool stallGuard;
+        bool standstill;
+        bool velocityReached;
+        bool positionReached;
+        bool stopLeft;
+        bool stopRight;
+        unsigned long timestamp;
+    };
+
+    // VMAX, VACTUAL and the other velocity registers count microsteps per
+    // 2^24 clock cycles: v[µsteps/s] = VMAX * fCLK / 2^24
+    static constexpr float CLOCK_HZ = 12000000.0f;     // fCLK, internal oscillator
+
+    static uint32_t toVelocityRegister(float microstepsPerSecond) {
+        return (uint32_t)lroundf(microstepsPerSecond * (16777216.0f / CLOCK_HZ));
+    }
+
+    static float fromVelocityRegister(int32_t value) {
+        return value * (CLOCK_HZ / 16777216.0f);
+    }
+
     StepperController(uint8_t cs_pin, uint8_t en_pin, uint32_t max_speed = 200000) 
         : cs_pin_(cs_pin), en_pin_(en_pin), max_speed_(max_speed) {}
 
@@ -36,20 +77,23 @@ public:
         // Initialize SPI
         SPI.begin();
         
-        // Configure TMC5130A
-        writeRegister(TMC5130A_GCONF, 0x00000004);      // Enable internal voltage regulator
-        writeRegister(TMC5130A_IHOLD_IRUN, 0x00071703); // Set motor current
-        
-        // Configure ramp parameters
-        writeRegister(TMC5130A_RAMPMODE, 0);            // Position mode
-        writeRegister(TMC5130A_VSTART, 0);              // Start velocity
-        writeRegister(TMC5130A_A1, 1000);              // First acceleration
-        writeRegister(TMC5130A_V1, 50000);             // First velocity
-        writeRegister(TMC5130A_AMAX, 5000);            // Max acceleration
-        writeRegister(TMC5130A_VMAX, max_speed_);      // Max velocity
-        writeRegister(TMC5130A_DMAX, 5000);            // Max deceleration
-        writeRegister(TMC5130A_D1, 1000);              // First deceleration
-        writeRegister(TMC5130A_VSTOP, 10);             // Stop velocity
+        // Configure TMC5130A in a single burst
+        const RegisterWrite config[] = {
+            {TMC5130A_GCONF, 0x00000004},       // Enable internal voltage regulator
+            {TMC5130A_IHOLD_IRUN, 0x00071703},  // Set motor current
+
+            // Configure ramp parameters
+            {TMC5130A_RAMPMODE, 0},             // Position mode
+            {TMC5130A_VSTART, 0},               // Start velocity
+            {TMC5130A_A1, 1000},                // First acceleration
+            {TMC5130A_V1, 50000},               // First velocity
+            {TMC5130A_AMAX, 5000},              // Max acceleration
+            {TMC5130A_VMAX, max_speed_},        // Max velocity
+            {TMC5130A_DMAX, 5000},              // Max deceleration
+            {TMC5130A_D1, 1000},                // First deceleration
+            {TMC5130A_VSTOP, 10},               // Stop velocity
+        };
+        writeRegisters(config, sizeof(config) / sizeof(config[0]));
     }
 
     void enable() {
@@ -60,13 +104,15 @@ public:
         digitalWrite(en_pin_, HIGH);
     }
 
+    // Staged in the shadow registers; goes out on the next flush()
     void setSpeed(uint32_t speed) {
         if (speed > max_speed_) speed = max_speed_;
-        writeRegister(TMC5130A_VMAX, speed);
+        setRegister(TMC5130A_VMAX, speed);
     }
 
+    // Staged in the shadow registers; goes out on the next flush()
     void setPosition(int32_t position) {
-        writeRegister(TMC5130A_XTARGET, position);
+        setRegister(TMC5130A_XTARGET, position);
     }
 
     int32_t getCurrentPosition() {
@@ -74,12 +120,117 @@ public:
     }
 
     int32_t getCurrentVelocity() {
-        return readRegister(TMC5130A_VACTUAL);
+        // A recent status byte often answers this without a read, against
+        // the VMAX and RAMPMODE the chip has, not ones still staged
+        if (millis() - status_.timestamp <= STATUS_MAX_AGE) {
+            if (status_.standstill) return 0;
+            if (status_.velocityReached && isFlushed(TMC5130A_RAMPMODE) && isFlushed(TMC5130A_VMAX)) {
+                if (shadow_[TMC5130A_RAMPMODE] == 1) return shadow_[TMC5130A_VMAX];
+                if (shadow_[TMC5130A_RAMPMODE] == 2) return -(int32_t)shadow_[TMC5130A_VMAX];
+            }
+        }
+        // VACTUAL is 24 bits, two's complement
+        return (int32_t)(readRegister(TMC5130A_VACTUAL) << 8) >> 8;
     }
 
+    // Written through immediately, never deferred
     void stop() {
-        writeRegister(TMC5130A_RAMPMODE, 1);  // Velocity mode
-        writeRegister(TMC5130A_VMAX, 0);      // Target velocity = 0
+        const RegisterWrite writes[] = {
+            {TMC5130A_RAMPMODE, 1},  // Velocity mode
+            {TMC5130A_VMAX, 0},      // Target velocity = 0
+        };
+        writeRegisters(writes, 2);
+    }
+
+    // Back to position mode after stop(), holding position. Staged, with
+    // XTARGET ahead of RAMPMODE so the motor never heads for an old target.
+    void holdPosition(int32_t position) {
+        setRegister(TMC5130A_XTARGET, position);
+        setRegister(TMC5130A_RAMPMODE, 0);
+    }
+
+    // Stage a register write. Writes that match the shadow copy are dropped;
+    // anything else is sent by the next flush().
+    void setRegister(uint8_t addr, uint32_t data) {
+        addr &= 0x7F;
+        if (isShadowed(addr) && shadow_[addr] == data) {
+            return;
+        }
+        shadow_[addr] = data;
+        shadowed_[addr >> 5] |= 1UL << (addr & 31);
+
+        if (!(dirty_[addr >> 5] & (1UL << (addr & 31)))) {
+            if (pending_count_ == MAX_PENDING) {
+                flush();
+            }
+            dirty_[addr >> 5] |= 1UL << (addr & 31);
+            pending_[pending_count_++] = addr;
+        }
+    }
+
+    // Send every dirty register in one burst, in the order they were first staged.
+    // Called once per control tick.
+    void flush() {
+        if (pending_count_ == 0) return;
+
+        RegisterWrite writes[MAX_PENDING];
+        for (uint8_t i = 0; i < pending_count_; i++) {
+            writes[i].addr = pending_[i];
+            writes[i].data = shadow_[pending_[i]];
+        }
+        writeRegisters(writes, pending_count_);
+    }
+
+    bool isDirty() const {
+        return pending_count_ > 0;
+    }
+
+    // Read several registers in one burst. The TMC5130A answers a read
+    // request on the following datagram, so each datagram carries the next
+    // address and returns the previous one's data; one extra datagram
+    // collects the last reply.
+    void readRegisters(const uint8_t* addrs, uint8_t count, uint32_t* values) {
+        if (count == 0) return;
+
+        SPI.beginTransaction(SPISettings(1000000, MSBFIRST, SPI_MODE3));
+        transferDatagram(addrs[0] & 0x7F, 0);
+        for (uint8_t i = 1; i <= count; i++) {
+            // Re-request the last address for the trailing datagram; it has no side effects
+            uint8_t next = addrs[i < count ? i : count - 1] & 0x7F;
+            values[i - 1] = transferDatagram(next, 0);
+        }
+        SPI.endTransaction();
+    }
+
+    // Push several registers in one SPI transaction burst. CS still toggles
+    // between datagrams because the TMC5130A latches each one on CS rising.
+    void writeRegisters(const RegisterWrite* writes, uint8_t count) {
+        SPI.beginTransaction(SPISettings(1000000, MSBFIRST, SPI_MODE3));
+        for (uint8_t i = 0; i < count; i++) {
+            transferDatagram(writes[i].addr | 0x80, writes[i].data);  // Set write bit
+            updateShadow(writes[i].addr & 0x7F, writes[i].data);
+        }
+        SPI.endTransaction();
+    }
+
+    const DriverStatus& getStatus() const {
+        return status_;
+    }
+
+    bool hasDriverError() const {
+        return status_.driverError;
+    }
+
+    bool isStalled() const {
+        return status_.stallGuard;
+    }
+
+    bool isStandstill() const {
+        return status_.standstill;
+    }
+
+    bool isVelocityReached() const {
+        return status_.velocityReached;
     }
 
 private:
@@ -87,33 +238,84 @@ private:
     uint8_t en_pin_;
     uint32_t max_speed_;
 
-    void writeRegister(uint8_t addr, uint32_t data) {
-        SPI.beginTransaction(SPISettings(1000000, MSBFIRST, SPI_MODE3));
-        digitalWrite(cs_pin_, LOW);
-        
-        SPI.transfer(addr | 0x80);  // Set write bit
-        SPI.transfer((data >> 24) & 0xFF);
-        SPI.transfer((data >> 16) & 0xFF);
-        SPI.transfer((data >> 8) & 0xFF);
-        SPI.transfer(data & 0xFF);
-        
-        digitalWrite(cs_pin_, HIGH);
-        SPI.endTransaction();
+    DriverStatus status_ = {};
+    static const unsigned long STATUS_MAX_AGE = 10;    // ms a status byte stands for the chip
+
+    // Shadow register file, indexed by register address
+    static const uint8_t MAX_PENDING = 16;
+    uint32_t shadow_[128] = {};
+    uint32_t shadowed_[4] = {};   // Bit set once the shadow copy matches the chip
+    uint32_t dirty_[4] = {};      // Bit set while a staged write is pending
+    uint8_t pending_[MAX_PENDING];
+    uint8_t pending_count_ = 0;
+
+    bool isShadowed(uint8_t addr) const {
+        return shadowed_[addr >> 5] & (1UL << (addr & 31));
+    }
+
+    // The shadow copy is what the chip holds, with no staged write pending
+    bool isFlushed(uint8_t addr) const {
+        return isShadowed(addr) && !(dirty_[addr >> 5] & (1UL << (addr & 31)));
+    }
+
+    // Record a completed write and drop it from the pending list
+    void updateShadow(uint8_t addr, uint32_t data) {
+        shadow_[addr] = data;
+        shadowed_[addr >> 5] |= 1UL << (addr & 31);
+
+        if (dirty_[addr >> 5] & (1UL << (addr & 31))) {
+            dirty_[addr >> 5] &= ~(1UL << (addr & 31));
+            uint8_t kept = 0;
+            for (uint8_t i = 0; i < pending_count_; i++) {
+                if (pending_[i] != addr) pending_[kept++] = pending_[i];
+            }
+            pending_count_ = kept;
+        }
     }
 
     uint32_t readRegister(uint8_t addr) {
-        SPI.beginTransaction(SPISettings(1000000, MSBFIRST, SPI_MODE3));
+        uint32_t data;
+        readRegisters(&addr, 1, &data);
+        return data;
+    }
+
+    // One 40-bit datagram; must be called inside an SPI transaction.
+    // Returns the 32-bit data field and caches the SPI_STATUS byte.
+    uint32_t transferDatagram(uint8_t addrByte, uint32_t data) {
+        uint8_t buffer[5] = {
+            addrByte,
+            (uint8_t)(data >> 24),
+            (uint8_t)(data >> 16),
+            (uint8_t)(data >> 8),
+            (uint8_t)data
+        };
+
         digitalWrite(cs_pin_, LOW);
-        
-        SPI.transfer(addr);  // Read operation
-        uint32_t data = 0;
-        data |= SPI.transfer(0) << 24;
-        data |= SPI.transfer(0) << 16;
-        data |= SPI.transfer(0) << 8;
-        data |= SPI.transfer(0);
-        
+#ifdef STEPPER_SPI_DMA
+        // DMA-backed block transfer from the SAMD core
+        uint8_t reply[5];
+        SPI.transfer(buffer, reply, sizeof(buffer), true);
+        memcpy(buffer, reply, sizeof(buffer));
+#else
+        SPI.transfer(buffer, sizeof(buffer));
+#endif
         digitalWrite(cs_pin_, HIGH);
-        SPI.endTransaction();
-        return data;
+
+        decodeStatus(buffer[0]);
+        return ((uint32_t)buffer[1] << 24) | ((uint32_t)buffer[2] << 16) |
+               ((uint32_t)buffer[3] << 8) | buffer[4];
+    }
+
+    void decodeStatus(uint8_t raw) {
+        status_.raw = raw;
+        status_.resetFlag = raw & TMC5130A_STATUS_RESET_FLAG;
+        status_.driverError = raw & TMC5130A_STATUS_DRIVER_ERROR;
+        status_.stallGuard = raw & TMC5130A_STATUS_SG2;
+        status_.standstill = raw & TMC5130A_STATUS_STANDSTILL;
+        status_.velocityReached = raw & TMC5130A_STATUS_VELOCITY_REACHED;
+        status_.positionReached = raw & TMC5130A_STATUS_POSITION_REACHED;
+        status_.stopLeft = raw & TMC5130A_STATUS_STOP_L;
+        status_.stopRight = raw & TMC5130A_STATUS_STOP_R;
+        status_.timestamp = millis();
     }
 };
@@ -5,10 +5,15 @@
 class StirrerController {
 public:
     StirrerController(uint8_t cs_pin, uint8_t en_pin) 
-        : stepper_(cs_pin, en_pin), current_rpm_(0), target_rpm_(0) {}
+        : stepper_(cs_pin, en_pin, rpmToVelocity(MAX_RPM)), current_rpm_(0), target_rpm_(0) {}
 
+    // The driver runs in velocity mode, so VMAX is the stirring speed
     void begin() {
         stepper_.begin();
+        stepper_.setRegister(TMC5130A_RAMPMODE, 1);
+        stepper_.setSpeed(0);
+        stepper_.flush();
+        stepper_.enable();
     }
 
     void enable() {
@@ -25,16 +30,24 @@ public:
         if (rpm > MAX_RPM) rpm = MAX_RPM;
         
         target_rpm_ = rpm;
-        // Convert RPM to internal velocity units
-        // Assuming 200 steps per revolution and 256 microsteps
-        uint32_t steps_per_second = (rpm * 200 * 256) / 60;
-        stepper_.setSpeed(steps_per_second);
+
+        // Staged only; unchanged speeds never reach the bus
+        stepper_.setSpeed(rpmToVelocity(rpm));
+    }
+
+    // Send any staged register changes; called once per control tick
+    void flush() {
+        stepper_.flush();
+    }
+
+    float getTargetSpeed() const {
+        return target_rpm_;
     }
 
     float getCurrentSpeed() {
         int32_t current_velocity = stepper_.getCurrentVelocity();
         // Convert internal velocity units back to RPM
-        current_rpm_ = (current_velocity * 60.0f) / (200 * 256);
+        current_rpm_ = StepperController::fromVelocityRegister(current_velocity) * 60.0f / (200 * 256);
         return current_rpm_;
     }
 
@@ -48,4 +61,9 @@ private:
     float current_rpm_;
     float target_rpm_;
     static constexpr float MAX_RPM = 3000.0f;  // Maximum RPM for the stirrer
+
+    // Internal velocity units; 200 steps per revolution and 256 microsteps
+    static uint32_t rpmToVelocity(float rpm) {
+        return StepperController::toVelocityRegister(rpm * 200 * 256 / 60);
+    }
 };
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Cooperative deadline scheduler driven by a 1 kHz TC3 tick.
+//
+// Tasks live in a fixed table and are released every periodMs, offset by
+// phaseMs from start-up. Among released tasks the lowest priority value runs
+// first, ties going to the earliest absolute deadline. Tasks always run to
+// completion; when nothing is released the core sleeps in WFI until the
+// next interrupt. Each task records its run count, overruns (finished past
+// its deadline or missed a whole release) and worst-case execution time.
+class TaskScheduler {
+public:
+    typedef void (*TaskFunction)(void* context);
+
+    static const uint8_t MAX_TASKS = 16;
+    static const uint32_t TICK_HZ = 1000;
+
+    struct Task {
+        const char* name;
+        TaskFunction function;
+        void* context;
+        uint32_t periodMs;
+        uint32_t phaseMs;
+        uint32_t deadlineMs;     // Relative to the release time
+        uint8_t priority;        // 0 is most urgent
+        uint32_t nextRelease;
+        uint32_t runs;
+        uint32_t overruns;
+        uint32_t wcetMicros;
+    };
+
+    // Returns the task id, or -1 if the table is full
+    int8_t addTask(const char* name, TaskFunction function, void* context,
+                   uint32_t periodMs, uint32_t phaseMs, uint32_t deadlineMs, uint8_t priority) {
+        if (taskCount >= MAX_TASKS || function == nullptr || periodMs == 0) {
+            return -1;
+        }
+
+        Task& task = tasks[taskCount];
+        task.name = name;
+        task.function = function;
+        task.context = context;
+        task.periodMs = periodMs;
+        task.phaseMs = phaseMs;
+        task.deadlineMs = deadlineMs ? deadlineMs : periodMs;
+        task.priority = priority;
+        task.nextRelease = (started ? now() : 0) + phaseMs;
+        task.runs = 0;
+        task.overruns = 0;
+        task.wcetMicros = 0;
+        return taskCount++;
+    }
+
+    // Change a period at run time; the next release keeps its current slot
+    void setPeriod(int8_t id, uint32_t periodMs) {
+        if (id < 0 || id >= taskCount || periodMs == 0) return;
+        tasks[id].deadlineMs = tasks[id].deadlineMs == tasks[id].periodMs ? periodMs : tasks[id].deadlineMs;
+        tasks[id].periodMs = periodMs;
+    }
+
+    void begin() {
+        startTickTimer();
+
+        // Releases are relative to the moment the tick timer starts
+        uint32_t start = now();
+        for (uint8_t i = 0; i < taskCount; i++) {
+            tasks[i].nextRelease = start + tasks[i].phaseMs;
+        }
+        started = true;
+    }
+
+    // Run the most urgent released task, or sleep until the next interrupt
+    void run() {
+        uint32_t currentTick = now();
+        Task* next = nullptr;
+
+        for (uint8_t i = 0; i < taskCount; i++) {
+            Task& task = tasks[i];
+            if ((int32_t)(currentTick - task.nextRelease) < 0) continue;
+
+            if (next == nullptr || task.priority < next->priority ||
+                (task.priority == next->priority &&
+                 (int32_t)((task.nextRelease + task.deadlineMs) - (next->nextRelease + next->deadlineMs)) < 0)) {
+                next = &task;
+            }
+        }
+
+        if (next == nullptr) {
+            __WFI();
+            return;
+        }
+
+        uint32_t release = next->nextRelease;
+        uint32_t startMicros = micros();
+        next->function(next->context);
+        uint32_t elapsed = micros() - startMicros;
+
+        next->runs++;
+        if (elapsed > next->wcetMicros) {
+            next->wcetMicros = elapsed;
+        }
+
+        uint32_t finished = now();
+        if ((int32_t)(finished - (release + next->deadlineMs)) > 0) {
+            next->overruns++;
+        }
+
+        // Keep the phase; releases that were missed entirely count as overruns
+        next->nextRelease = release + next->periodMs;
+        while ((int32_t)(finished - next->nextRelease) >= (int32_t)next->periodMs) {
+            next->nextRelease += next->periodMs;
+            next->overruns++;
+        }
+    }
+
+    uint8_t getTaskCount() const {
+        return taskCount;
+    }
+
+    const Task& getTask(uint8_t id) const {
+        return tasks[id];
+    }
+
+    void resetStatistics() {
+        for (uint8_t i = 0; i < taskCount; i++) {
+            tasks[i].runs = 0;
+            tasks[i].overruns = 0;
+            tasks[i].wcetMicros = 0;
+        }
+    }
+
+    // Scheduler time in milliseconds since the tick timer started
+    static uint32_t now() {
+        return tickCount();
+    }
+
+    static volatile uint32_t& tickCount() {
+        static volatile uint32_t ticks = 0;
+        return ticks;
+    }
+
+private:
+    Task tasks[MAX_TASKS];
+    uint8_t taskCount = 0;
+    bool started = false;
+
+    // TC3 in match-frequency mode, interrupting at TICK_HZ
+    void startTickTimer() {
+        GCLK->PCHCTRL[TC3_GCLK_ID].reg = GCLK_PCHCTRL_GEN_GCLK0_Val | GCLK_PCHCTRL_CHEN;
+        while (GCLK->SYNCBUSY.reg);
+
+        TC3->COUNT16.CTRLA.reg = TC_CTRLA_SWRST;
+        while (TC3->COUNT16.SYNCBUSY.bit.SWRST);
+
+        TC3->COUNT16.CTRLA.reg = TC_CTRLA_MODE_COUNT16 |
+                                TC_CTRLA_PRESCALER_DIV16 |
+                                TC_CTRLA_PRESCSYNC_PRESC;
+
+        TC3->COUNT16.WAVE.reg = TC_WAVE_WAVEGEN_MFRQ;
+        TC3->COUNT16.CC[0].reg = (F_CPU / 16 / TICK_HZ) - 1;
+        while (TC3->COUNT16.SYNCBUSY.bit.CC0);
+
+        TC3->COUNT16.INTENSET.reg = TC_INTENSET_MC0;
+        NVIC_SetPriority(TC3_IRQn, 0);
+        NVIC_EnableIRQ(TC3_IRQn);
+
+        TC3->COUNT16.CTRLA.bit.ENABLE = 1;
+        while (TC3->COUNT16.SYNCBUSY.bit.ENABLE);
+    }
+};
+
+extern "C" void TC3_Handler(void) {
+    TC3->COUNT16.INTFLAG.reg = TC_INTFLAG_MC0;
+    TaskScheduler::tickCount() = TaskScheduler::tickCount() + 1;
+}
@@ -1,7 +1,8 @@
 #pragma once
 
 #include <Arduino.h>
-#include <PID_v1.h>
+#include "pid_controller.h"
+#include "fopdt_model.h"
 #include "../sensors/sensor_manager.h"
 
 class TemperatureController {
@@ -19,15 +20,31 @@ public:
         float averageTemp;
     };
 
+    // Control law. SMITH_PREDICTOR uses the FOPDT model identified online
+    // from heater output and temperature: feed-forward of the heater output
+    // that holds the setpoint, plus a PI on the temperature predicted one
+    // dead time ahead, its gains scheduled from the model (lambda tuning).
+    // It runs the plain PID until the model is valid.
+    enum class Strategy : uint8_t {
+        PID,
+        SMITH_PREDICTOR
+    };
+
+    // Closed-loop time constant of SMITH_PREDICTOR as a fraction of the
+    // model time constant, and never below MIN_RESPONSE_TIME
+    static constexpr float RESPONSE_RATIO = 0.25f;
+    static constexpr float MIN_RESPONSE_TIME = 120.0f;  // s
+
     TemperatureController(SensorManager& sensorManager) 
-        : pid(&input, &output, &setpoint, Kp, Ki, Kd, DIRECT),
-          sensorManager(sensorManager) {
-        lastControlAction = 0;
-        lastMeasurement = 0;
+        : sensorManager(sensorManager),
+          pid(Kp, Ki, Kd),
+          predictorPid(0, 0, 0) {
         controlInterval = 10000; // Start with 10 second interval
+        model.reset(controlInterval / 1000.0f);
         
         // Configure PID output range to match PWM resolution
-        pid.SetOutputLimits(0, PWM_MAX_DUTY);
+        pid.setOutputLimits(0, PWM_MAX_DUTY);
+        predictorPid.setAntiWindup(PIDController<>::AntiWindup::BACK_CALCULATION);
     }
 
     void begin() {
@@ -58,15 +75,15 @@ public:
         TC4->COUNT16.CTRLA.bit.ENABLE = 1;
         while (TC4->COUNT16.SYNCBUSY.bit.ENABLE);
 
-        pid.SetMode(AUTOMATIC);
-        pid.SetSampleTime(controlInterval);
+        pid.setMode(PIDController<>::Mode::AUTOMATIC, input);
     }
 
-    void setSetpoint(double newSetpoint) {
+    void setSetpoint(float newSetpoint) {
         setpoint = newSetpoint;
+        pid.setSetpoint(newSetpoint);
     }
 
-    double getSetpoint() const {
+    float getSetpoint() const {
         return setpoint;
     }
 
@@ -74,53 +91,121 @@ public:
         return lastReadings;
     }
 
-    double getCurrentTemperature() const {
+    float getCurrentTemperature() const {
         return input;
     }
 
-    double getHeaterOutput() const {
+    float getHeaterOutput() const {
         return output;
     }
 
     void setControlInterval(unsigned long interval) {
-        controlInterval = constrain(interval, 10000, 30000); // 10-30 seconds
-        pid.SetSampleTime(controlInterval);
+        controlInterval = constrain(interval, 10000UL, 30000UL); // 10-30 seconds
+        model.reset(controlInterval / 1000.0f);  // Identified at the control rate
     }
 
-    void setPIDTunings(double kp, double ki, double kd) {
-        pid.SetTunings(kp, ki, kd);
+    unsigned long getControlInterval() const {
+        return controlInterval;
     }
 
-    void update() {
-        unsigned long currentTime = millis();
-        
-        // Take measurement every second
-        if (currentTime - lastMeasurement >= 1000) {
-            input = readTemperatureSensor();
-            lastMeasurement = currentTime;
-        }
+    // Gains of the PID strategy, which SMITH_PREDICTOR also falls back to
+    void setPIDTunings(float kp, float ki, float kd) {
+        pid.setTunings(kp, ki, kd);
+    }
+
+    void setPIDTunings(float kp, float ki, float kd, Strategy newStrategy) {
+        setPIDTunings(kp, ki, kd);
+        setStrategy(newStrategy);
+    }
+
+    void setStrategy(Strategy newStrategy) {
+        strategy = newStrategy;
+    }
+
+    Strategy getStrategy() const {
+        return strategy;
+    }
+
+    // True while SMITH_PREDICTOR is in charge rather than falling back
+    bool isModelActive() const {
+        return modelActive;
+    }
 
-        // Control action based on control interval
-        if (currentTime - lastControlAction >= controlInterval) {
-            pid.Compute();
-            adjustHeatingJacket(output);
-            lastControlAction = currentTime;
+    const FOPDTModel& getModel() const {
+        return model;
+    }
+
+    // Relay auto-tune hooks (ControllerManager::startAutotune). While the
+    // tuner holds the loop, control() is not run and the tuner drives the
+    // heater through driveOutput() at the measurement rate.
+    const PIDController<>& getPID() const {
+        return pid;
+    }
+
+    float getProcessValue() const {
+        return input;
+    }
+
+    float getOutput() const {
+        return output;
+    }
+
+    void driveOutput(float value) {
+        output = constrain(value, 0, PWM_MAX_DUTY);
+        adjustHeatingJacket(output);
+    }
+
+    // Hand the heater back to the PID, carrying on from value without a bump
+    void resumeControl(float value) {
+        output = constrain(value, 0, PWM_MAX_DUTY);
+        modelActive = false;
+        handOver(false);
+    }
+
+    // Take a measurement; scheduled every second
+    void measure() {
+        input = readTemperatureSensor();
+    }
+
+    // Control action; scheduled every getControlInterval()
+    void control() {
+        float dt = controlInterval / 1000.0f;
+
+        // The output applied over the interval that just ended
+        model.update(input, output / PWM_MAX_DUTY);
+
+        bool useModel = strategy == Strategy::SMITH_PREDICTOR && model.isValid();
+        if (useModel != modelActive) {
+            handOver(useModel);
         }
+        output = useModel ? computePredictive(dt) : pid.compute(input, dt);
+        adjustHeatingJacket(output);
     }
 
 private:
     SensorManager& sensorManager;
-    double input, output, setpoint;
-    const double Kp = 2.0, Ki = 0.5, Kd = 0.1; // PID constants
-    PID pid;
-    unsigned long lastControlAction;
-    unsigned long lastMeasurement;
+    float input = 0, output = 0, setpoint = 0;
+    // PI in PWM counts per °C for the 5 L vessel's jacket (about 100 °C
+    // at full duty, 70 min lag, 1 min dead time): a response of about
+    // 15 min, with Ti = 2000 s so the cold feeds are taken back quickly
+    static constexpr float Kp = 200.0f, Ki = 0.1f, Kd = 0.0f;
+    PIDController<> pid;
+    PIDController<> predictorPid;   // Trims the feed-forward, in PWM counts
+    FOPDTModel model;
+    Strategy strategy = Strategy::PID;
+    bool modelActive = false;
     unsigned long controlInterval;
     TemperatureReadings lastReadings;
+    uint32_t lastSnapshotSequence = 0;
 
-    double readTemperatureSensor() {
-        // Get readings from sensor manager
-        SensorManager::SensorReadings readings = sensorManager.read();
+    float readTemperatureSensor() {
+        // Nothing new since the last measurement, keep the current value
+        if (!sensorManager.snapshotChanged(lastSnapshotSequence)) {
+            return input;
+        }
+
+        // Use the snapshot published by the sensor manager, no bus access here
+        const SensorManager::SensorReadings& readings = sensorManager.getSnapshot();
 
         // Update last readings structure
         lastReadings.phTemp = readings.ph_reading.temperature;
@@ -151,7 +236,42 @@ private:
         return lastReadings.averageTemp;
     }
 
-    void adjustHeatingJacket(double pwmValue) {
+    // Start the incoming controller from the current output
+    void handOver(bool toModel) {
+        modelActive = toModel;
+        if (toModel) {
+            predictorPid.setMode(PIDController<>::Mode::MANUAL, input);
+            predictorPid.setSetpoint(setpoint);
+            predictorPid.setOutputLimits(-PWM_MAX_DUTY, PWM_MAX_DUTY);
+            predictorPid.setManualOutput(output - feedForward());
+            predictorPid.setMode(PIDController<>::Mode::AUTOMATIC, model.predictAhead(input));
+        } else {
+            pid.setMode(PIDController<>::Mode::MANUAL, input);
+            pid.setManualOutput(output);
+            pid.setMode(PIDController<>::Mode::AUTOMATIC, input);
+        }
+    }
+
+    float feedForward() const {
+        return constrain(model.steadyStateInput(setpoint), 0.0f, 1.0f) * PWM_MAX_DUTY;
+    }
+
+    // PI on the predicted temperature around the feed-forward. The dead time
+    // is outside the loop, so lambda tuning on the lag alone:
+    //   Kc = tau / (K lambda), Ti = tau
+    float computePredictive(float dt) {
+        float tau = model.getTimeConstant();
+        float lambda = max(RESPONSE_RATIO * tau, MIN_RESPONSE_TIME);
+        float kc = tau / (model.getGain() * lambda) * PWM_MAX_DUTY;
+        predictorPid.setTunings(kc, kc / tau, 0);
+
+        float ff = feedForward();
+        predictorPid.setSetpoint(setpoint);
+        predictorPid.setOutputLimits(-ff, PWM_MAX_DUTY - ff);
+        return ff + predictorPid.compute(model.predictAhead(input), dt);
+    }
+
+    void adjustHeatingJacket(float pwmValue) {
         // Ensure PWM value is within bounds
         pwmValue = constrain(pwmValue, 0, PWM_MAX_DUTY);
         
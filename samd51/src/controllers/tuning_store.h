@@ -0,0 +1,93 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FlashStorage_SAMD.h>
+#include "link_protocol.h"
+
+// Where the tuning image starts in the EEPROM emulation; move it if other
+// settings are stored there
+#ifndef TUNING_STORE_ADDRESS
+#define TUNING_STORE_ADDRESS 0
+#endif
+
+// PID gains found by the relay auto-tuner, kept in the flash EEPROM
+// emulation (FlashStorage_SAMD) so a retune survives a reboot. The whole
+// image is one struct with a CRC-16 (the link's); a missing, older or
+// corrupt image reads as no stored gains, and the controllers keep their
+// compiled-in defaults. A flash page is erased on every commit, so only
+// save() writes, once per completed tune.
+class TuningStore {
+public:
+    static const uint8_t MAX_LOOPS = 4;
+
+    struct Record {
+        float kp;
+        float ki;
+        float kd;
+        float ultimateGain;
+        float ultimatePeriod;       // s
+        uint8_t rule;               // RelayAutotuner::Rule
+        uint8_t valid;
+    };
+
+    void begin() {
+        EEPROM.setCommitASAP(false);
+        EEPROM.get(TUNING_STORE_ADDRESS, image);
+        if (image.magic != MAGIC || image.version != VERSION || image.crc != checksum(image)) {
+            memset(&image, 0, sizeof(image));
+        }
+    }
+
+    // False if the loop has never been tuned
+    bool load(uint8_t loop, Record& record) const {
+        if (loop >= MAX_LOOPS || !image.records[loop].valid) return false;
+        record = image.records[loop];
+        return true;
+    }
+
+    bool save(uint8_t loop, const Record& record) {
+        if (loop >= MAX_LOOPS) return false;
+        image.records[loop] = record;
+        image.records[loop].valid = 1;
+        return commit();
+    }
+
+    // Back to the compiled-in gains on the next boot
+    bool erase(uint8_t loop) {
+        if (loop >= MAX_LOOPS || !image.records[loop].valid) return false;
+        image.records[loop] = {};
+        return commit();
+    }
+
+    uint32_t getWrites() const { return writes; }
+
+private:
+    static const uint16_t MAGIC = 0x5450;   // "PT"
+    static const uint8_t VERSION = 1;
+
+    struct __attribute__((packed)) Image {
+        uint16_t magic;
+        uint8_t version;
+        uint8_t count;
+        Record records[MAX_LOOPS];
+        uint16_t crc;
+    };
+
+    Image image = {};
+    uint32_t writes = 0;
+
+    static uint16_t checksum(const Image& image) {
+        return LinkProtocol::crc16((const uint8_t*)&image, offsetof(Image, crc));
+    }
+
+    bool commit() {
+        image.magic = MAGIC;
+        image.version = VERSION;
+        image.count = MAX_LOOPS;
+        image.crc = checksum(image);
+        EEPROM.put(TUNING_STORE_ADDRESS, image);
+        EEPROM.commit();
+        writes++;
+        return true;
+    }
+};
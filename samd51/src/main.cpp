@@ -8,23 +8,9 @@
 // Global objects
 SensorManager sensors;
 StepperController steppers;
-CommunicationManager comm;
 PWMController pwm;
 ControllerManager controllers(sensors);  // Pass sensors to controller manager
-
-// Function to update controllers with sensor readings
-void updateControllersWithSensorData(const SensorManager::SensorReadings& readings) {
-    if (readings.ph_reading.valid) {
-        controllers.getPHController().setCurrentValue(readings.ph_reading.pH);
-    }
-    
-    if (readings.do_reading.valid) {
-        controllers.getDOController().setCurrentValue(readings.do_reading.dissolvedOxygen);
-    }
-    
-    // Temperature is now handled directly by the TemperatureController
-    // No need to manually set it here
-}
+CommunicationManager comm(sensors, controllers);
 
 void setup() {
     Serial.begin(115200);
@@ -40,6 +26,14 @@ void setup() {
     pwm.begin();
     controllers.begin();
 
+    // Remaining subsystems run from the controller task table
+    controllers.addTask("steppers", [](void*) { steppers.update(); },
+                        nullptr, 10, 5, 10, ControllerManager::PRIORITY_ACTUATORS);
+    controllers.addTask("comm", [](void*) { comm.handleCommunication(); },
+                        nullptr, 1, 0, 5, ControllerManager::PRIORITY_BACKGROUND);
+    controllers.addTask("pwm", [](void*) { pwm.update(); },
+                        nullptr, 10, 7, 10, ControllerManager::PRIORITY_BACKGROUND);
+
     // Set initial setpoints
     controllers.getPHController().setSetpoint(7.0);
     controllers.getDOController().setSetpoint(40.0);
@@ -48,25 +42,7 @@ void setup() {
 }
 
 void loop() {
-    // Update all subsystems
-    sensors.update();
-    
-    // Get the latest sensor readings
-    const auto& readings = sensors.getLastValidReadings();
-    
-    // Update controllers with sensor data
-    updateControllersWithSensorData(readings);
-    
-    // Update control systems
-    steppers.update();
+    // Runs the next due task (sensors, controllers, communication, PWM),
+    // or sleeps until the next timer tick when nothing is due
     controllers.update();
-    
-    // Handle communication with RP2040
-    comm.handleCommunication();
-    
-    // Update PWM outputs
-    pwm.update();
-    
-    // Small delay to prevent tight looping
-    delay(1);
 }
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <Arduino.h>
+#include <math.h>
+#include "simulated_devices.h"
+
+// Lumped model of a stirred-tank bioreactor for closed-loop runs of the
+// firmware on the host. It reads the simulated actuators and writes the
+// simulated probes, integrating with a fixed STEP_SECONDS step as the
+// clock passes:
+//
+//   Jacket      Cj dTj/dt = P_heater - UAj (Tj - T) - UAloss (Tj - Tamb)
+//   Broth       Cb dT/dt  = UAj (Tj - T) - UAtop (T - Tamb) + q_heat X
+//   Oxygen      dDO/dt    = kLa (DO* - DO) - qO2 X f(DO)   (% air saturation)
+//               kLa       = kLa_ref (N / N_ref)^1.5 (Q / Q_ref)^0.5,  Q = air + O2
+//               DO*       = 100 yO2 / 0.21,  yO2 = (0.21 air + O2) / Q
+//   Growth      dX/dt     = mu_max X (1 - X / X_max) f(DO),  f(DO) = DO / (K_O2 + DO)
+//   pH          dpH/dt    = (m / t_mix - Y_acid dX/dt) / beta
+//               dm/dt     = (base - acid dosed) / V - m / t_mix
+//
+// where m is reagent dosed but not yet mixed into the bulk (mmol/L). Heater
+// power comes from the TC4 duty cycle, stirrer speed from the stirrer
+// TMC5130, air and O2 flow from the mass flow controller setpoints on the
+// DAC pins, acid and base dosing from the two dosing pump TMC5130s.
+// Parameters are typical of a 5 L bench vessel rather than a fitted one.
+class BioreactorPlant : public NativeHal::Device {
+public:
+    static constexpr float STEP_SECONDS = 0.1f;
+
+    // Register addresses of the first value each probe driver reads back
+    static const uint16_t DO_REGISTER = 2089 + 2;
+    static const uint16_t DO_TEMPERATURE_REGISTER = 2089 + 6;
+    static const uint16_t PH_REGISTER = 2409 + 2;
+    static const uint16_t PH_TEMPERATURE_REGISTER = 2409 + 6;
+    static const uint16_t BIOMASS_REGISTER = 3000;
+
+    struct Parameters {
+        float volume = 5.0f;                 // L
+        float ambient = 22.0f;               // °C
+        float heaterPower = 600.0f;          // W at full duty
+        float jacketCapacity = 2500.0f;      // J/K
+        float brothCapacity = 20900.0f;      // J/K, 5 L of water
+        float jacketTransfer = 40.0f;        // UA jacket to broth, W/K
+        float jacketLoss = 3.0f;             // UA jacket to room, W/K
+        float topLoss = 2.0f;                // UA broth to room, W/K
+        float metabolicHeat = 0.5f;          // W per (g/L) of biomass
+        float kLaReference = 30.0f;          // 1/h at the reference stirrer speed and gas flow
+        float stirrerReference = 300.0f;     // RPM
+        float stirrerMinimum = 20.0f;        // RPM equivalent of surface aeration
+        float gasReference = 1.0f;           // vvm
+        float gasMinimum = 0.02f;            // vvm equivalent of headspace exchange
+        uint8_t airFlowPin = A0;             // Mass flow controller setpoints
+        uint8_t oxygenFlowPin = A1;
+        float airFullScale = 2.0f;           // vvm at full scale
+        float oxygenFullScale = 1.0f;
+        float oxygenUptake = 600.0f;         // % saturation per hour per g/L
+        float growthRate = 0.12f;            // mu_max, 1/h
+        float maxBiomass = 12.0f;            // g/L
+        float oxygenHalfSaturation = 5.0f;   // % saturation
+        float acidYield = 3.0f;              // mmol of acid per g of biomass grown
+        float bufferCapacity = 20.0f;        // mmol/L per pH unit
+        float acidConcentration = 0.5f;      // mmol/mL
+        float baseConcentration = 0.5f;      // mmol/mL
+        float mixingTime = 15.0f;            // s
+        float pumpStepsPerMl = 51200.0f;     // Microsteps per mL of the dosing pumps
+        float sensorNoise = 0.0f;            // Relative amplitude of probe noise
+    };
+
+    struct State {
+        float temperature;        // Broth, °C
+        float jacketTemperature;  // °C
+        float dissolvedOxygen;    // % saturation
+        float biomass;            // g/L
+        float pH;
+        float acidDosed;          // mL since start
+        float baseDosed;          // mL since start
+        float unmixed;            // mmol/L of base (negative: acid) not yet mixed in
+    };
+
+    BioreactorPlant(ModbusSlave& doProbe, ModbusSlave& phProbe, ModbusSlave& biomassProbe,
+                    Max31865& pt100, Tmc5130& stirrer, Tmc5130& acidPump, Tmc5130& basePump)
+        : doProbe(doProbe), phProbe(phProbe), biomassProbe(biomassProbe),
+          pt100(pt100), stirrer(stirrer), acidPump(acidPump), basePump(basePump) {
+        state.temperature = params.ambient;
+        state.jacketTemperature = params.ambient;
+        state.dissolvedOxygen = 100.0f;
+        state.biomass = 0.5f;
+        state.pH = 7.2f;
+        state.acidDosed = 0;
+        state.baseDosed = 0;
+        state.unmixed = 0;
+    }
+
+    Parameters& parameters() { return params; }
+    const State& getState() const { return state; }
+    void setState(const State& newState) { state = newState; }
+
+    // Fresh media mixed into the broth; volume and heat capacity grow with it
+    void addMedia(float litres, float temperature) {
+        float added = litres / params.volume * params.brothCapacity;
+        state.temperature = (params.brothCapacity * state.temperature + added * temperature) /
+                            (params.brothCapacity + added);
+        state.biomass *= params.volume / (params.volume + litres);
+        params.brothCapacity += added;
+        params.volume += litres;
+        publish();
+    }
+
+    float getHeaterDuty() const {
+        uint32_t period = TC4->COUNT16.CC[0].reg + 1u;
+        float duty = (float)TC4->COUNT16.CC[1].reg / period;
+        return TC4->COUNT16.CTRLA.bit.ENABLE ? min(duty, 1.0f) : 0.0f;
+    }
+
+    // Stirrer driver velocity in microsteps/s as RPM (200 steps, 256 microsteps)
+    float getStirrerSpeed() const {
+        return fabsf(stirrer.getVelocity()) * 60.0f / (200 * 256);
+    }
+
+    // Mass flow controller setpoints, vvm
+    float getAirFlow() const { return flowSetpoint(params.airFlowPin, params.airFullScale); }
+    float getOxygenFlow() const { return flowSetpoint(params.oxygenFlowPin, params.oxygenFullScale); }
+
+    float getKla() const {
+        float n = max(getStirrerSpeed(), params.stirrerMinimum) / params.stirrerReference;
+        float q = max(getAirFlow() + getOxygenFlow(), params.gasMinimum) / params.gasReference;
+        return params.kLaReference * powf(n, 1.5f) * sqrtf(q);
+    }
+
+    // Saturation the inlet gas would bring the broth to, % of air saturation
+    float getSaturation() const {
+        float air = getAirFlow(), oxygen = getOxygenFlow();
+        if (air + oxygen <= 0) return 100.0f;
+        return 100.0f * (AIR_OXYGEN * air + oxygen) / (air + oxygen) / AIR_OXYGEN;
+    }
+
+    // Put the current state on the probes before the firmware first reads them
+    void begin() {
+        publish();
+    }
+
+    void advance(uint64_t nowMicros) override {
+        bool stepped = false;
+        while (nowMicros - lastStep >= STEP_MICROS) {
+            step(STEP_SECONDS);
+            lastStep += STEP_MICROS;
+            stepped = true;
+        }
+        if (stepped) publish();
+    }
+
+private:
+    static const uint64_t STEP_MICROS = (uint64_t)(STEP_SECONDS * 1e6f);
+    static constexpr float AIR_OXYGEN = 0.21f;
+
+    ModbusSlave& doProbe;
+    ModbusSlave& phProbe;
+    ModbusSlave& biomassProbe;
+    Max31865& pt100;
+    Tmc5130& stirrer;
+    Tmc5130& acidPump;
+    Tmc5130& basePump;
+
+    Parameters params;
+    State state;
+    uint64_t lastStep = 0;
+
+    void step(float dt) {
+        const float hours = dt / 3600.0f;
+
+        // Heat: heater into the jacket, jacket into the broth, both lose to the room
+        float heater = getHeaterDuty() * params.heaterPower;
+        float jacketToBroth = params.jacketTransfer * (state.jacketTemperature - state.temperature);
+        float jacketLoss = params.jacketLoss * (state.jacketTemperature - params.ambient);
+        float topLoss = params.topLoss * (state.temperature - params.ambient);
+        float metabolic = params.metabolicHeat * state.biomass;
+        state.jacketTemperature += (heater - jacketToBroth - jacketLoss) / params.jacketCapacity * dt;
+        state.temperature += (jacketToBroth - topLoss + metabolic) / params.brothCapacity * dt;
+
+        // Growth, slowed as oxygen runs out and as the culture approaches its limit
+        float oxygenFactor = state.dissolvedOxygen / (params.oxygenHalfSaturation + state.dissolvedOxygen);
+        float growth = params.growthRate * state.biomass * (1.0f - state.biomass / params.maxBiomass) * oxygenFactor;
+        state.biomass += growth * hours;
+
+        // Oxygen transfer against uptake, which follows the oxygen-limited activity
+        float uptake = params.oxygenUptake * state.biomass * oxygenFactor;
+        state.dissolvedOxygen += (getKla() * (getSaturation() - state.dissolvedOxygen) - uptake) * hours;
+        state.dissolvedOxygen = max(state.dissolvedOxygen, 0.0f);
+
+        // Acid from growth against the dosing pumps, whose reagent takes
+        // mixingTime to reach the bulk (and the probe)
+        float acid = params.acidYield * growth * hours;                         // mmol/L
+        float acidMl = fabsf(acidPump.getVelocity()) / params.pumpStepsPerMl * dt;
+        float baseMl = fabsf(basePump.getVelocity()) / params.pumpStepsPerMl * dt;
+        state.acidDosed += acidMl;
+        state.baseDosed += baseMl;
+        state.unmixed += (baseMl * params.baseConcentration - acidMl * params.acidConcentration) / params.volume;
+        float mixed = state.unmixed * min(dt / params.mixingTime, 1.0f);
+        state.unmixed -= mixed;
+        state.pH += (mixed - acid) / params.bufferCapacity;
+    }
+
+    float flowSetpoint(uint8_t pin, float fullScale) const {
+        float maxCode = (float)((1u << NativeHal::pwmResolution) - 1);
+        return min(NativeHal::pwmValue[pin] / maxCode, 1.0f) * fullScale;
+    }
+
+    float noisy(float value, float scale) const {
+        if (params.sensorNoise <= 0) return value;
+        return value + scale * params.sensorNoise * (random(2001) - 1000) / 1000.0f;
+    }
+
+    void publish() {
+        float temperature = noisy(state.temperature, 1.0f);
+        doProbe.setFloat(DO_REGISTER, noisy(state.dissolvedOxygen, 10.0f));
+        doProbe.setFloat(DO_TEMPERATURE_REGISTER, temperature);
+        phProbe.setFloat(PH_REGISTER, noisy(state.pH, 0.1f));
+        phProbe.setFloat(PH_TEMPERATURE_REGISTER, temperature);
+        biomassProbe.setFloat(BIOMASS_REGISTER, noisy(state.biomass, 0.5f));
+        pt100.setTemperature(temperature);
+    }
+};
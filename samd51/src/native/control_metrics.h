@@ -0,0 +1,76 @@
+#pragma once
+
+#include <math.h>
+
+// Performance of one control loop after a setpoint change, accumulated
+// from samples of the true process value:
+//
+//   IAE        integral of |setpoint - value| dt, in unit-seconds
+//   overshoot  largest excursion past the setpoint, % of the step size
+//   settling   time until the value last entered and then stayed within
+//              the band (2 % of the step, or tolerance if larger)
+//
+// A change of zero size (regulation) reports overshoot as 0 and settling
+// as the last time the band was left.
+class ControlMetrics {
+public:
+    explicit ControlMetrics(float tolerance = 0.0f) : tolerance(tolerance) {}
+
+    void begin(float setpoint, float value, float timeSeconds) {
+        this->setpoint = setpoint;
+        stepSize = setpoint - value;
+        start = timeSeconds;
+        lastOutside = timeSeconds;
+        iae = 0;
+        peak = 0;
+        lastTime = timeSeconds;
+        inBand = false;
+        active = true;
+    }
+
+    void sample(float value, float timeSeconds) {
+        if (!active) return;
+        float dt = timeSeconds - lastTime;
+        lastTime = timeSeconds;
+
+        float error = setpoint - value;
+        iae += fabsf(error) * dt;
+
+        // Positive once the value has passed the setpoint in the step's direction
+        float past = stepSize >= 0 ? value - setpoint : setpoint - value;
+        if (past > peak) peak = past;
+
+        inBand = fabsf(error) <= band();
+        if (!inBand) lastOutside = timeSeconds;
+    }
+
+    float getIae() const { return iae; }
+
+    float getOvershootPercent() const {
+        return fabsf(stepSize) > 0 ? 100.0f * peak / fabsf(stepSize) : 0.0f;
+    }
+
+    // Seconds from the setpoint change; negative if still outside the band
+    float getSettlingTime() const {
+        return inBand ? lastOutside - start : -1.0f;
+    }
+
+    float getSetpoint() const { return setpoint; }
+    float getStepSize() const { return stepSize; }
+
+private:
+    float tolerance;
+    float setpoint = 0;
+    float stepSize = 0;
+    float start = 0;
+    float lastOutside = 0;
+    float lastTime = 0;
+    float iae = 0;
+    float peak = 0;
+    bool inBand = false;
+    bool active = false;
+
+    float band() const {
+        return fmaxf(0.02f * fabsf(stepSize), tolerance);
+    }
+};
@@ -0,0 +1,37 @@
+// Host entry point for [env:native]: runs the acquisition and control
+// firmware in closed loop with a simulated bioreactor (bioreactor_plant.h),
+// faster than real time, and reports control performance for every
+// setpoint change in SCENARIO along with the scheduler statistics.
+//
+//   pio run -e native && .pio/build/native/program [hours] [--check] [--trace] [--smith]
+//                                                  [--autotune] [--eeprom file]
+//
+// --check makes the exit status 1 when a loop does worse than its bounds
+// in LOOPS, so a run can gate changes; --trace prints the plant state
+// every simulated hour; --smith runs temperature with the identified
+// model (TemperatureController::Strategy::SMITH_PREDICTOR); --autotune
+// starts with a relay auto-tune of the temperature loop and runs the rest
+// of the scenario on the gains it finds. The tuning store is kept in RAM
+// so runs repeat, unless --eeprom names a file to keep it in across runs.
+
+#include "simulation.h"
+
+int main(int argc, char** argv) {
+    SimulationOptions options;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--check") == 0) {
+            options.check = true;
+        } else if (strcmp(argv[i], "--trace") == 0) {
+            options.trace = true;
+        } else if (strcmp(argv[i], "--smith") == 0) {
+            options.smith = true;
+        } else if (strcmp(argv[i], "--autotune") == 0) {
+            options.autotune = true;
+        } else if (strcmp(argv[i], "--eeprom") == 0 && i + 1 < argc) {
+            options.eepromPath = argv[++i];
+        } else {
+            options.hours = atof(argv[i]);
+        }
+    }
+    return runSimulation(options);
+}
@@ -0,0 +1,281 @@
+#pragma once
+
+#include <Arduino.h>
+#include <math.h>
+#include "../sensors/rtd_conversion.h"
+#include "../controllers/stepper_controller.h"
+
+// Stand-ins for the chips on the SAMD51 board, for [env:native] builds.
+// Each one speaks the same wire protocol as the part it replaces, so the
+// drivers run unmodified; values are set from the host side.
+
+// Modbus RTU slave answering Read Holding Registers (0x03), as the
+// DO, pH and biomass probes do
+class ModbusSlave : public NativeHal::UartDevice {
+public:
+    static const uint16_t REGISTER_COUNT = 4096;
+
+    ModbusSlave(uint8_t address, uint32_t turnaroundMicros = 2000)
+        : address(address), turnaroundMicros(turnaroundMicros) {}
+
+    void setRegister(uint16_t reg, uint16_t value) {
+        if (reg < REGISTER_COUNT) registers[reg] = value;
+    }
+
+    // Low word first, as ModbusSensor::registersToFloat() expects
+    void setFloat(uint16_t reg, float value) {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        setRegister(reg, bits & 0xFFFF);
+        setRegister(reg + 1, bits >> 16);
+    }
+
+    // An offline slave ignores every request, so the master times out
+    void setOnline(bool online) { this->online = online; }
+
+    uint32_t getRequests() const { return requests; }
+
+    void receive(NativeHal::UartPort& port, uint8_t byte, uint64_t nowMicros) override {
+        // A silent interval of 3.5 characters starts a new frame
+        if (length > 0 && nowMicros - lastByte > port.charTimeMicros() * 7 / 2) length = 0;
+        lastByte = nowMicros;
+
+        if (length < sizeof(request)) request[length++] = byte;
+        if (length < sizeof(request)) return;
+        length = 0;
+        requests++;
+
+        if (!online || request[0] != address || request[1] != 0x03) return;
+        uint16_t crc = crc16(request, 6);
+        if (request[6] != (crc & 0xFF) || request[7] != (crc >> 8)) return;
+
+        uint16_t start = ((uint16_t)request[2] << 8) | request[3];
+        uint16_t count = ((uint16_t)request[4] << 8) | request[5];
+        if (count == 0 || count > 125) return;
+
+        uint8_t reply[5 + 2 * 125];
+        reply[0] = address;
+        reply[1] = 0x03;
+        reply[2] = count * 2;
+        for (uint16_t i = 0; i < count; i++) {
+            uint16_t value = start + i < REGISTER_COUNT ? registers[start + i] : 0;
+            reply[3 + 2 * i] = value >> 8;
+            reply[4 + 2 * i] = value & 0xFF;
+        }
+        crc = crc16(reply, 3 + 2 * count);
+        reply[3 + 2 * count] = crc & 0xFF;
+        reply[4 + 2 * count] = crc >> 8;
+
+        // The request is still on the wire when the last byte is queued
+        uint32_t requestTime = sizeof(request) * port.charTimeMicros();
+        port.deliver(reply, 5 + 2 * count, nowMicros, requestTime + turnaroundMicros);
+    }
+
+private:
+    uint8_t address;
+    uint32_t turnaroundMicros;
+    bool online = true;
+    uint16_t registers[REGISTER_COUNT] = {};
+    uint8_t request[8];
+    uint8_t length = 0;
+    uint64_t lastByte = 0;
+    uint32_t requests = 0;
+
+    static uint16_t crc16(const uint8_t* data, size_t length) {
+        uint16_t crc = 0xFFFF;
+        for (size_t i = 0; i < length; i++) {
+            crc ^= data[i];
+            for (uint8_t bit = 0; bit < 8; bit++) {
+                crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+            }
+        }
+        return crc;
+    }
+};
+
+// MAX31865 RTD front-end in automatic conversion mode: a new conversion
+// every 20 ms pulls DRDY low, reading the RTD registers releases it
+class Max31865 : public NativeHal::SpiDevice {
+public:
+    static const uint32_t CONVERSION_MICROS = 20000;
+
+    Max31865(uint8_t drdyPin) : drdyPin(drdyPin) {}
+
+    void setTemperature(float celsius) {
+        double resistance = PT100Conversion::resistanceAt(celsius);
+        double code = resistance / PT100Conversion::R_REF * PT100Conversion::ADC_FULL_SCALE;
+        rtdCode = code < 0 ? 0 : (code > 0x7FFF ? 0x7FFF : (uint16_t)lround(code));
+    }
+
+    // A non-zero fault status is latched at the next conversion
+    void setFault(uint8_t status) { pendingFault = status; }
+
+    void select() override {
+        address = -1;
+    }
+
+    uint8_t transfer(uint8_t mosi) override {
+        if (address < 0) {
+            writing = mosi & 0x80;
+            address = mosi & 0x7F;
+            return 0xFF;
+        }
+
+        uint8_t reg = address++ & 0x07;
+        if (writing) {
+            if (reg == REG_CONFIG) {
+                if (mosi & CONFIG_FAULT_CLEAR) registers[REG_FAULT_STATUS] = 0;
+                registers[REG_CONFIG] = mosi & ~CONFIG_FAULT_CLEAR;
+            } else if (reg >= REG_HIGH_THRESHOLD_MSB && reg <= REG_LOW_THRESHOLD_LSB) {
+                registers[reg] = mosi;
+            }
+            return 0xFF;
+        }
+
+        // Reading the RTD LSB completes the data read
+        if (reg == REG_RTD_LSB) NativeHal::setInput(drdyPin, HIGH);
+        return registers[reg];
+    }
+
+    void advance(uint64_t nowMicros) override {
+        if (!(registers[REG_CONFIG] & CONFIG_AUTO)) {
+            nextConversion = nowMicros + CONVERSION_MICROS;
+            return;
+        }
+        if (nowMicros < nextConversion) return;
+        nextConversion = nowMicros + CONVERSION_MICROS;
+
+        uint16_t rtd = rtdCode << 1;
+        if (pendingFault) {
+            registers[REG_FAULT_STATUS] = pendingFault;
+            rtd |= 0x01;
+            pendingFault = 0;
+        }
+        registers[REG_RTD_MSB] = rtd >> 8;
+        registers[REG_RTD_LSB] = rtd & 0xFF;
+
+        // Force an edge even if the last result was never read
+        NativeHal::setInput(drdyPin, HIGH);
+        NativeHal::setInput(drdyPin, LOW);
+    }
+
+private:
+    static const uint8_t REG_CONFIG = 0x00;
+    static const uint8_t REG_RTD_MSB = 0x01;
+    static const uint8_t REG_RTD_LSB = 0x02;
+    static const uint8_t REG_HIGH_THRESHOLD_MSB = 0x03;
+    static const uint8_t REG_LOW_THRESHOLD_LSB = 0x06;
+    static const uint8_t REG_FAULT_STATUS = 0x07;
+    static const uint8_t CONFIG_AUTO = 0x40;
+    static const uint8_t CONFIG_FAULT_CLEAR = 0x02;
+
+    uint8_t drdyPin;
+    uint8_t registers[8] = {};
+    uint16_t rtdCode = 0;
+    uint8_t pendingFault = 0;
+    int16_t address = -1;
+    bool writing = false;
+    uint64_t nextConversion = 0;
+};
+
+// TMC5130A motion controller on SPI. Registers take 40-bit datagrams; a
+// read is answered in the next datagram. Motion is simplified to a
+// constant-acceleration ramp towards VMAX (velocity modes) or XTARGET
+// (position mode). VMAX and VACTUAL are in the chip's units, converted
+// with fCLK; AMAX is taken as steps per second squared.
+class Tmc5130 : public NativeHal::SpiDevice {
+public:
+    int32_t getPosition() const { return (int32_t)lround(position); }
+    float getVelocity() const { return velocity; }
+    uint32_t getRegister(uint8_t addr) const { return registers[addr & 0x7F]; }
+    uint32_t getWrites() const { return writes; }
+
+    void select() override {
+        index = 0;
+        uint32_t data = readLatch;
+        reply[0] = status();
+        reply[1] = data >> 24;
+        reply[2] = data >> 16;
+        reply[3] = data >> 8;
+        reply[4] = data & 0xFF;
+    }
+
+    uint8_t transfer(uint8_t mosi) override {
+        if (index >= sizeof(datagram)) return 0;
+        datagram[index] = mosi;
+        return reply[index++];
+    }
+
+    void deselect() override {
+        if (index != sizeof(datagram)) return;
+        uint8_t addr = datagram[0] & 0x7F;
+        uint32_t data = ((uint32_t)datagram[1] << 24) | ((uint32_t)datagram[2] << 16) |
+                        ((uint32_t)datagram[3] << 8) | datagram[4];
+
+        if (datagram[0] & 0x80) {
+            registers[addr] = data;
+            writes++;
+            if (addr == TMC5130A_XACTUAL) position = (int32_t)data;
+        } else {
+            registers[TMC5130A_XACTUAL] = (uint32_t)getPosition();
+            registers[TMC5130A_VACTUAL] = (uint32_t)(int32_t)lround(velocity / velocityUnit()) & 0xFFFFFF;
+            readLatch = registers[addr];
+        }
+    }
+
+    void advance(uint64_t nowMicros) override {
+        float dt = (nowMicros - lastUpdate) / 1e6f;
+        lastUpdate = nowMicros;
+        if (dt <= 0) return;
+
+        uint8_t mode = registers[TMC5130A_RAMPMODE] & 0x03;
+        float vmax = registers[TMC5130A_VMAX] * velocityUnit();
+        float amax = registers[TMC5130A_AMAX] ? (float)registers[TMC5130A_AMAX] : 1000.0f;
+        float target;
+        if (mode == 0) {
+            // Position mode: slow down in time to stop on the target
+            float distance = (float)((int32_t)registers[TMC5130A_XTARGET] - position);
+            float stopping = sqrtf(2.0f * amax * fabsf(distance));
+            target = copysignf(min(vmax, stopping), distance);
+        } else {
+            target = mode == 2 ? -vmax : vmax;
+        }
+
+        float step = amax * dt;
+        velocity = fabsf(target - velocity) <= step ? target : velocity + copysignf(step, target - velocity);
+        position += velocity * dt;
+        if (mode == 0 && fabs((int32_t)registers[TMC5130A_XTARGET] - position) < 0.5) {
+            position = (int32_t)registers[TMC5130A_XTARGET];
+            velocity = 0;
+        }
+    }
+
+private:
+    uint32_t registers[128] = {};
+    uint8_t datagram[5];
+    uint8_t reply[5];
+    uint8_t index = 0;
+    uint32_t readLatch = 0;
+    uint32_t writes = 0;
+    double position = 0;        // Microsteps; a float stops counting small steps past 2^24
+    float velocity = 0;
+    uint64_t lastUpdate = 0;
+
+    // Steps per second of one velocity register count
+    static float velocityUnit() {
+        return StepperController::fromVelocityRegister(1);
+    }
+
+    uint8_t status() const {
+        uint8_t mode = registers[TMC5130A_RAMPMODE] & 0x03;
+        uint8_t raw = 0;
+        if (velocity == 0) raw |= TMC5130A_STATUS_STANDSTILL;
+        if (mode != 0 && velocity == (mode == 2 ? -1.0f : 1.0f) * registers[TMC5130A_VMAX] * velocityUnit()) {
+            raw |= TMC5130A_STATUS_VELOCITY_REACHED;
+        }
+        if (mode == 0 && getPosition() == (int32_t)registers[TMC5130A_XTARGET]) {
+            raw |= TMC5130A_STATUS_POSITION_REACHED;
+        }
+        return raw;
+    }
+};
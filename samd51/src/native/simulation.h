@@ -0,0 +1,316 @@
+#pragma once
+
+// The closed-loop run behind the native program (main.cpp) and the
+// test_closed_loop tests: the acquisition and control firmware against a
+// simulated bioreactor (bioreactor_plant.h), faster than real time, with
+// control performance reported for every setpoint change in SCENARIO along
+// with the scheduler statistics. Runs once per process; the firmware and
+// the simulated clock are globals.
+
+#include <Arduino.h>
+#include "../sensors/sensor_manager.h"
+#include "../controllers/controller_manager.h"
+#include "simulated_devices.h"
+#include "bioreactor_plant.h"
+#include "control_metrics.h"
+
+SensorManager sensors;
+ControllerManager controllers(sensors);
+
+ModbusSlave doProbe(3);
+ModbusSlave phProbe(4);
+ModbusSlave biomassProbe(5);
+Max31865 pt100(PT100_IRQ_1_PIN);
+Tmc5130 stirrerDriver;
+Tmc5130 pumpDriver;
+Tmc5130 acidPumpDriver;
+Tmc5130 basePumpDriver;
+BioreactorPlant plant(doProbe, phProbe, biomassProbe, pt100, stirrerDriver, acidPumpDriver, basePumpDriver);
+
+enum Loop : uint8_t {
+    LOOP_TEMPERATURE = 0,
+    LOOP_DISSOLVED_OXYGEN,
+    LOOP_PH,
+    LOOP_COUNT
+};
+
+// Regression bounds, checked for every step of a loop; 0 leaves a figure
+// unchecked. Settling is measured to the end of the step, so a loop that
+// has not settled by the next step fails. The temperature settling bound
+// allows for the warm-up from ambient with the heater at full duty, which
+// --smith (SMITH_TEMPERATURE) also runs on the PID while it identifies
+// the model; the predictor is held to less overshoot after that. The DO
+// settling bound allows for the start, where DO can fall no faster than
+// the culture takes it up. pH dosing starts with its buffer capacity
+// estimate at half the plant's, and between shots the culture's acid
+// takes pH to the edge of the deadband, which is most of its IAE.
+struct LoopInfo {
+    const char* name;
+    float tolerance;       // Settling band floor, process units
+    float maxIae;
+    float maxOvershoot;    // %
+    float maxSettling;     // s
+};
+
+static const LoopInfo LOOPS[LOOP_COUNT] = {
+    {"temperature", 0.2f, 20000.0f, 20.0f, 7200.0f},
+    {"dissolved_oxygen", 1.0f, 80000.0f, 5.0f, 7200.0f},
+    {"ph", 0.05f, 3000.0f, 25.0f, 1800.0f},
+};
+
+static const LoopInfo SMITH_TEMPERATURE = {"temperature", 0.2f, 20000.0f, 12.0f, 7200.0f};
+
+struct SetpointChange {
+    float hour;
+    Loop loop;
+    float value;
+};
+
+// A 48 h fed-batch: warm up from ambient, then a temperature shift for
+// production, a lower DO once the culture is dense and a pH shift late on
+static const SetpointChange SCENARIO[] = {
+    {0.0f, LOOP_TEMPERATURE, 37.0f},
+    {0.0f, LOOP_DISSOLVED_OXYGEN, 40.0f},
+    {0.0f, LOOP_PH, 7.0f},
+    {24.0f, LOOP_TEMPERATURE, 35.0f},
+    {30.0f, LOOP_DISSOLVED_OXYGEN, 30.0f},
+    {40.0f, LOOP_PH, 7.2f},
+};
+static const size_t SCENARIO_LENGTH = sizeof(SCENARIO) / sizeof(SCENARIO[0]);
+
+struct MediaAddition {
+    float hour;
+    float litres;
+    float temperature;
+};
+
+// Cold feeds, the disturbance the temperature loop handles worst
+static const MediaAddition FEEDS[] = {
+    {12.0f, 0.25f, 4.0f},
+    {36.0f, 0.25f, 4.0f},
+};
+static const size_t FEED_COUNT = sizeof(FEEDS) / sizeof(FEEDS[0]);
+
+ControlMetrics metrics[LOOP_COUNT] = {
+    ControlMetrics(LOOPS[LOOP_TEMPERATURE].tolerance),
+    ControlMetrics(LOOPS[LOOP_DISSOLVED_OXYGEN].tolerance),
+    ControlMetrics(LOOPS[LOOP_PH].tolerance),
+};
+bool metricsActive[LOOP_COUNT] = {};
+float metricsStartHour[LOOP_COUNT] = {};
+const char* metricsCause[LOOP_COUNT] = {};
+bool failed = false;
+bool smith = false;
+std::string eepromPath;
+
+const LoopInfo& loopInfo(Loop loop) {
+    return smith && loop == LOOP_TEMPERATURE ? SMITH_TEMPERATURE : LOOPS[loop];
+}
+
+void attachDevices() {
+    NativeHal::attachUartDevice(Serial1.port, &doProbe);
+    NativeHal::attachUartDevice(Serial2.port, &phProbe);
+    NativeHal::attachUartDevice(Serial3.port, &biomassProbe);
+    NativeHal::attachSpiDevice(&SPI, PT100_CS_1_PIN, &pt100);
+    NativeHal::attachSpiDevice(&SPI, ControllerPins::STIRRER_CS_PIN, &stirrerDriver);
+    NativeHal::attachSpiDevice(&SPI, ControllerPins::PUMP_CS_PIN, &pumpDriver);
+    NativeHal::attachSpiDevice(&SPI, ControllerPins::ACID_PUMP_CS_PIN, &acidPumpDriver);
+    NativeHal::attachSpiDevice(&SPI, ControllerPins::BASE_PUMP_CS_PIN, &basePumpDriver);
+    plant.parameters().airFlowPin = DO_AIR_FLOW_PIN;
+    plant.parameters().oxygenFlowPin = DO_OXYGEN_FLOW_PIN;
+    NativeHal::addDevice(&plant);
+    plant.begin();
+}
+
+float processValue(Loop loop) {
+    const BioreactorPlant::State& state = plant.getState();
+    switch (loop) {
+        case LOOP_TEMPERATURE: return state.temperature;
+        case LOOP_DISSOLVED_OXYGEN: return state.dissolvedOxygen;
+        default: return state.pH;
+    }
+}
+
+void applySetpoint(Loop loop, float value) {
+    switch (loop) {
+        case LOOP_TEMPERATURE: controllers.getTemperatureController().setSetpoint(value); break;
+        case LOOP_DISSOLVED_OXYGEN: controllers.getDOController().setSetpoint(value); break;
+        default: controllers.getPHController().setSetpoint(value); break;
+    }
+}
+
+bool exceeds(float value, float bound) {
+    return bound > 0 && value > bound;
+}
+
+// Print and check the metrics of the step that just ended
+void finishStep(Loop loop, bool check) {
+    if (!metricsActive[loop]) return;
+    const ControlMetrics& m = metrics[loop];
+    const LoopInfo& info = loopInfo(loop);
+
+    float settling = m.getSettlingTime();
+    bool bad = check && (exceeds(m.getIae(), info.maxIae) ||
+                         exceeds(m.getOvershootPercent(), info.maxOvershoot) ||
+                         (info.maxSettling > 0 && (settling < 0 || settling > info.maxSettling)));
+    failed |= bad;
+
+    Serial.printf("%-17s %6.1f h %-8s -> %7.2f  iae %10.1f  overshoot %6.1f %%  settling %s%8.0f s%s\n",
+                  info.name, metricsStartHour[loop], metricsCause[loop], m.getSetpoint(), m.getIae(),
+                  m.getOvershootPercent(),
+                  settling < 0 ? ">" : " ", settling < 0 ? (NativeHal::nowMicros / 1e6f) - metricsStartHour[loop] * 3600 : settling,
+                  bad ? "  FAIL" : "");
+}
+
+void beginStep(Loop loop, float setpoint, float now, const char* cause) {
+    metrics[loop].begin(setpoint, processValue(loop), now);
+    metricsActive[loop] = true;
+    metricsStartHour[loop] = now / 3600;
+    metricsCause[loop] = cause;
+}
+
+void printAutotune() {
+    const RelayAutotuner& tuner = controllers.getAutotuner();
+    if (tuner.getState() == RelayAutotuner::State::COMPLETE) {
+        RelayAutotuner::Gains gains = tuner.getGains(controllers.getAutotuneRule());
+        Serial.printf("temperature autotune complete after %u cycles: Ku %.1f, Pu %.0f s, amplitude %.3f C"
+                      " -> Kp %.2f Ki %.4f Kd %.1f\n",
+                      tuner.getCycles(), tuner.getUltimateGain(), tuner.getUltimatePeriod(),
+                      tuner.getAmplitude(), gains.kp, gains.ki, gains.kd);
+    } else {
+        Serial.printf("temperature autotune failed after %u cycles (reason %u)\n",
+                      tuner.getCycles(), (unsigned)tuner.getFailure());
+    }
+}
+
+void printModel() {
+    const TemperatureController& temperature = controllers.getTemperatureController();
+    const FOPDTModel& model = temperature.getModel();
+    Serial.printf("\ntemperature model %s%s: K %.1f C, tau %.0f s, theta %.0f s, y0 %.1f C, rms error %.4f C\n",
+                  model.isValid() ? "valid" : "not valid", temperature.isModelActive() ? ", in use" : "",
+                  model.getGain(), model.getTimeConstant(), model.getDeadTime(), model.getOffset(),
+                  model.getPredictionError());
+}
+
+void printTrace(float hour) {
+    const BioreactorPlant::State& state = plant.getState();
+    const FOPDTModel& model = controllers.getTemperatureController().getModel();
+    Serial.printf("%5.1f h  T %6.2f  Tj %6.2f  DO %5.1f  pH %5.2f  X %5.2f  heater %3.0f %%  stirrer %4.0f rpm"
+                  "  air %4.2f  O2 %4.2f vvm  model K %6.1f tau %5.0f theta %4.0f\n",
+                  hour, state.temperature, state.jacketTemperature, state.dissolvedOxygen, state.pH,
+                  state.biomass, plant.getHeaterDuty() * 100, plant.getStirrerSpeed(),
+                  plant.getAirFlow(), plant.getOxygenFlow(),
+                  model.getGain(), model.getTimeConstant(), model.getDeadTime());
+}
+
+void printDosing() {
+    const PHController& ph = controllers.getPHController();
+    const BioreactorPlant::State& state = plant.getState();
+    const DosingPump& acid = ph.getPump(PHController::ACID);
+    const DosingPump& base = ph.getPump(PHController::BASE);
+    Serial.printf("ph dosing: buffer capacity %.1f mmol/L/pH (plant %.1f)\n",
+                  ph.getBufferCapacity(), plant.parameters().bufferCapacity);
+    Serial.printf("  acid %3lu shots %7.2f mL (plant %7.2f mL), %6.1f mL left%s\n",
+                  (unsigned long)acid.getShots(), acid.getDispensed(), state.acidDosed, acid.getRemaining(),
+                  acid.isEmpty() ? ", empty" : "");
+    Serial.printf("  base %3lu shots %7.2f mL (plant %7.2f mL), %6.1f mL left%s\n",
+                  (unsigned long)base.getShots(), base.getDispensed(), state.baseDosed, base.getRemaining(),
+                  base.isEmpty() ? ", empty" : "");
+}
+
+void printSchedulerReport() {
+    const TaskScheduler& scheduler = controllers.getScheduler();
+    Serial.printf("\n%-12s %10s %9s %10s\n", "task", "runs", "overruns", "wcet_us");
+    for (uint8_t i = 0; i < scheduler.getTaskCount(); i++) {
+        const TaskScheduler::Task& task = scheduler.getTask(i);
+        Serial.printf("%-12s %10lu %9lu %10lu\n", task.name, (unsigned long)task.runs,
+                      (unsigned long)task.overruns, (unsigned long)task.wcetMicros);
+    }
+    Serial.printf("snapshots    %lu, system %s\n", (unsigned long)sensors.getSnapshotSequence(),
+                  controllers.isSystemSafe() ? "safe" : "unsafe");
+}
+
+struct SimulationOptions {
+    float hours = 48;
+    bool check = false;         // Fail when a loop does worse than its bounds in LOOPS
+    bool trace = false;         // Plant state every simulated hour
+    bool smith = false;         // Temperature on TemperatureController::Strategy::SMITH_PREDICTOR
+    bool autotune = false;      // Relay auto-tune of temperature first
+    std::string eepromPath;     // Tuning store file; empty keeps it in RAM
+};
+
+// 0 if every loop stayed within its bounds (always 0 without check)
+int runSimulation(const SimulationOptions& options) {
+    const float hours = options.hours;
+    const bool check = options.check;
+    const bool trace = options.trace;
+    const bool autotune = options.autotune;
+    smith = options.smith;
+    eepromPath = options.eepromPath;
+
+    EEPROM.path = eepromPath;
+    attachDevices();
+    if (!sensors.begin()) {
+        Serial.println("Failed to initialize sensors!");
+    }
+    controllers.begin();
+    if (smith) {
+        controllers.getTemperatureController().setStrategy(TemperatureController::Strategy::SMITH_PREDICTOR);
+    }
+
+    const uint64_t end = (uint64_t)(hours * 3600) * 1000000ULL;
+    uint64_t nextSample = 0;
+    uint32_t second = 0;
+    size_t nextChange = 0;
+    size_t nextFeed = 0;
+    bool tuning = false;
+
+    while (NativeHal::nowMicros < end) {
+        controllers.update();
+        if (NativeHal::nowMicros < nextSample) continue;
+
+        // Once per simulated second: scenario, metrics, trace
+        float now = second;
+        float hour = now / 3600;
+        while (nextChange < SCENARIO_LENGTH && SCENARIO[nextChange].hour <= hour) {
+            const SetpointChange& change = SCENARIO[nextChange++];
+            finishStep(change.loop, check);
+            applySetpoint(change.loop, change.value);
+            beginStep(change.loop, change.value, now, "setpoint");
+        }
+        if (autotune && second == 0) {
+            tuning = controllers.startAutotune(ControllerManager::TUNED_TEMPERATURE,
+                                               RelayAutotuner::Rule::TYREUS_LUYBEN);
+            metricsCause[LOOP_TEMPERATURE] = "autotune";
+        } else if (tuning && !controllers.getAutotuner().isRunning()) {
+            // Judge the tuned loop from where the relay test left it
+            tuning = false;
+            finishStep(LOOP_TEMPERATURE, false);
+            printAutotune();
+            beginStep(LOOP_TEMPERATURE, controllers.getTemperatureController().getSetpoint(), now, "tuned");
+        }
+        while (nextFeed < FEED_COUNT && FEEDS[nextFeed].hour <= hour) {
+            const MediaAddition& feed = FEEDS[nextFeed++];
+            finishStep(LOOP_TEMPERATURE, check);
+            plant.addMedia(feed.litres, feed.temperature);
+            beginStep(LOOP_TEMPERATURE, controllers.getTemperatureController().getSetpoint(), now, "feed");
+        }
+        for (uint8_t loop = 0; loop < LOOP_COUNT; loop++) {
+            metrics[loop].sample(processValue((Loop)loop), now);
+        }
+        if (trace && second % 3600 == 0) {
+            printTrace(hour);
+        }
+
+        second++;
+        nextSample = (uint64_t)second * 1000000ULL;
+    }
+
+    for (uint8_t loop = 0; loop < LOOP_COUNT; loop++) {
+        finishStep((Loop)loop, check);
+    }
+    printModel();
+    printDosing();
+    printSchedulerReport();
+    return failed ? 1 : 0;
+}
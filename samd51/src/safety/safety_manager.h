@@ -1,16 +1,22 @@
 #pragma once
 
 #include <Arduino.h>
+#include "../sensors/sensor_manager.h"
 
 class SafetyManager {
 public:
+    SafetyManager(SensorManager& sensorManager) : sensorManager(sensorManager) {}
+
     void begin() {
         lastCheck = 0;
         alarmConfirmationStart = 0;
         alarmActive = false;
+        lastSnapshotTime = millis();
     }
 
     bool isSystemSafe() {
+        if (emergencyStopped) return false;
+
         unsigned long currentTime = millis();
         
         // Check safety every second
@@ -44,13 +50,41 @@ public:
         initiateEmergencyShutdown();
     }
 
+    // Latched until clearEmergencyStop(); the system reports unsafe meanwhile
+    void triggerEmergencyStop() {
+        emergencyStopped = true;
+        initiateEmergencyShutdown();
+    }
+
+    void clearEmergencyStop() {
+        emergencyStopped = false;
+    }
+
+    bool isEmergencyStopped() const {
+        return emergencyStopped;
+    }
+
 private:
+    static const unsigned long SNAPSHOT_TIMEOUT = 5000; // Sensor data older than this is stale
+
+    SensorManager& sensorManager;
+    uint32_t lastSnapshotSequence = 0;
+    unsigned long lastSnapshotTime = 0;
     unsigned long lastCheck;
     unsigned long alarmConfirmationStart;
     bool alarmActive;
+    bool emergencyStopped = false;
 
     bool checkAllSafetySystems() {
-        // TODO: Implement actual safety checks
+        // Acquisition must keep publishing snapshots
+        unsigned long currentTime = millis();
+        if (sensorManager.snapshotChanged(lastSnapshotSequence)) {
+            lastSnapshotTime = currentTime;
+        } else if (currentTime - lastSnapshotTime >= SNAPSHOT_TIMEOUT) {
+            return false;
+        }
+
+        // TODO: Implement limit checks against sensorManager.getSnapshot()
         // - Check temperature limits
         // - Check pressure limits
         // - Check pH limits
@@ -14,20 +14,42 @@ public:
     BiomassSensor(HardwareSerial* serialPort, uint8_t addr = 5) 
         : ModbusSensor(serialPort, addr) {}
 
-    BiomassReading read() {
-        BiomassReading result = {0.0f, 0.0f, 0.0f, false};
-        if (!initialized) return result;
+    // Issue the request for the biomass measurement registers; the reply is collected by poll()
+    bool startRead() {
+        return requestHoldingRegisters(3000, 12);
+    }
 
-        // Read biomass measurement registers
-        uint16_t registers[12];
-        if (modbus.readHoldingRegisters(slaveAddr, 3000, registers, 12)) {
+    // Returns true once the pending transaction has finished, successfully or not
+    bool poll() {
+        TransactionState state = pollTransaction();
+        if (state != TransactionState::DONE && state != TransactionState::FAILED) {
+            return false;
+        }
+
+        BiomassReading result = {0.0f, 0.0f, 0.0f, false};
+        if (state == TransactionState::DONE) {
             // Convert registers to float values
             result.density = registersToFloat(registers[0], registers[1]);
             result.scattered_light = registersToFloat(registers[4], registers[5]);
             result.transmitted_light = registersToFloat(registers[8], registers[9]);
             result.valid = true;
         }
+        lastReading = result;
+        releaseTransaction();
+        return true;
+    }
 
-        return result;
+    BiomassReading getReading() const {
+        return lastReading;
     }
+
+    // Blocking convenience wrapper around startRead()/poll()
+    BiomassReading read() {
+        if (!startRead()) return BiomassReading{0.0f, 0.0f, 0.0f, false};
+        while (!poll()) {}
+        return lastReading;
+    }
+
+private:
+    BiomassReading lastReading = {0.0f, 0.0f, 0.0f, false};
 };
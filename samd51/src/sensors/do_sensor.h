@@ -13,19 +13,41 @@ public:
     DOSensor(HardwareSerial* serialPort, uint8_t addr = 3) 
         : ModbusSensor(serialPort, addr) {}
 
-    DOReading read() {
-        DOReading result = {0.0f, 0.0f, false};
-        if (!initialized) return result;
+    // Issue the request for the DO and temperature registers; the reply is collected by poll()
+    bool startRead() {
+        return requestHoldingRegisters(2089, 10);
+    }
 
-        // Read DO and temperature registers
-        uint16_t registers[10];
-        if (modbus.readHoldingRegisters(slaveAddr, 2089, registers, 10)) {
+    // Returns true once the pending transaction has finished, successfully or not
+    bool poll() {
+        TransactionState state = pollTransaction();
+        if (state != TransactionState::DONE && state != TransactionState::FAILED) {
+            return false;
+        }
+
+        DOReading result = {0.0f, 0.0f, false};
+        if (state == TransactionState::DONE) {
             // Convert registers to float values
             result.dissolvedOxygen = registersToFloat(registers[2], registers[3]);
             result.temperature = registersToFloat(registers[6], registers[7]);
             result.valid = true;
         }
+        lastReading = result;
+        releaseTransaction();
+        return true;
+    }
 
-        return result;
+    DOReading getReading() const {
+        return lastReading;
     }
+
+    // Blocking convenience wrapper around startRead()/poll()
+    DOReading read() {
+        if (!startRead()) return DOReading{0.0f, 0.0f, false};
+        while (!poll()) {}
+        return lastReading;
+    }
+
+private:
+    DOReading lastReading = {0.0f, 0.0f, false};
 };
@@ -1,15 +1,38 @@
 #pragma once
 
 #include <Arduino.h>
-#include <ModbusRTU.h>
 
+// Minimal non-blocking Modbus RTU master for a single slave on a dedicated UART.
+// A transaction is started with requestHoldingRegisters() and then advanced by
+// calling pollTransaction() from the main loop until it reports DONE or FAILED.
+// Nothing in here waits on the bus, so several sensors on independent UARTs can
+// have their requests in flight at the same time.
 class ModbusSensor {
+public:
+    enum class TransactionState {
+        IDLE,
+        TRANSMITTING,
+        RECEIVING,
+        DONE,
+        FAILED
+    };
+
+    static const uint32_t BAUD_RATE = 19200;
+    static const int8_t DEFAULT_DE_PIN = 1;                // DE/RE pin for RS485
+    static const unsigned long RESPONSE_TIMEOUT_MS = 100;
+
 protected:
-    ModbusRTU modbus;
+    static const uint8_t MAX_REGISTERS = 12;
+    static const uint8_t FUNC_READ_HOLDING_REGISTERS = 0x03;
+
     uint8_t slaveAddr;
     HardwareSerial* serial;
+    int8_t dePin;
     bool initialized;
 
+    // Holds the register payload of the last successful transaction
+    uint16_t registers[MAX_REGISTERS];
+
     // Helper function to convert two 16-bit registers to float
     float registersToFloat(uint16_t reg1, uint16_t reg2) {
         uint32_t combined = ((uint32_t)reg2 << 16) | reg1;
@@ -18,14 +41,87 @@ protected:
         return result;
     }
 
+    // Queue a read request on the UART and return immediately
+    bool requestHoldingRegisters(uint16_t startRegister, uint8_t count) {
+        if (!initialized || isBusy() || count == 0 || count > MAX_REGISTERS) {
+            return false;
+        }
+
+        // Drop anything left over from a previous, timed-out response
+        while (serial->available()) {
+            serial->read();
+        }
+
+        uint8_t frame[8];
+        frame[0] = slaveAddr;
+        frame[1] = FUNC_READ_HOLDING_REGISTERS;
+        frame[2] = startRegister >> 8;
+        frame[3] = startRegister & 0xFF;
+        frame[4] = 0;
+        frame[5] = count;
+        uint16_t crc = crc16(frame, 6);
+        frame[6] = crc & 0xFF;
+        frame[7] = crc >> 8;
+
+        if (dePin >= 0) digitalWrite(dePin, HIGH);
+        serial->write(frame, sizeof(frame));
+
+        // The UART drains its TX buffer in the background; work out when the
+        // last stop bit has left so the driver can be released without flush()
+        txStart = micros();
+        txDuration = charTimeMicros() * sizeof(frame) + charTimeMicros();
+        expectedRegisters = count;
+        rxLength = 0;
+        state = TransactionState::TRANSMITTING;
+        return true;
+    }
+
+    // Advance the transaction without blocking; returns the new state
+    TransactionState pollTransaction() {
+        switch (state) {
+            case TransactionState::TRANSMITTING:
+                if (micros() - txStart >= txDuration) {
+                    if (dePin >= 0) digitalWrite(dePin, LOW);
+                    rxStart = millis();
+                    state = TransactionState::RECEIVING;
+                }
+                break;
+
+            case TransactionState::RECEIVING:
+                while (serial->available() && rxLength < sizeof(rxFrame)) {
+                    rxFrame[rxLength++] = serial->read();
+                }
+                if (responseComplete()) {
+                    state = parseResponse() ? TransactionState::DONE : TransactionState::FAILED;
+                } else if (millis() - rxStart >= RESPONSE_TIMEOUT_MS) {
+                    state = TransactionState::FAILED;
+                }
+                break;
+
+            default:
+                break;
+        }
+        return state;
+    }
+
+    // Hand the finished transaction back so the next request can be issued
+    void releaseTransaction() {
+        if (state == TransactionState::DONE || state == TransactionState::FAILED) {
+            state = TransactionState::IDLE;
+        }
+    }
+
 public:
-    ModbusSensor(HardwareSerial* serialPort, uint8_t addr) 
-        : serial(serialPort), slaveAddr(addr), initialized(false) {}
+    ModbusSensor(HardwareSerial* serialPort, uint8_t addr, int8_t dePin = DEFAULT_DE_PIN)
+        : slaveAddr(addr), serial(serialPort), dePin(dePin), initialized(false) {}
 
     bool begin() {
-        serial->begin(19200, SERIAL_8N2);
-        modbus.begin(serial, 1); // DE/RE pin for RS485
-        modbus.master();
+        serial->begin(BAUD_RATE, SERIAL_8N2);
+        if (dePin >= 0) {
+            pinMode(dePin, OUTPUT);
+            digitalWrite(dePin, LOW);
+        }
+        state = TransactionState::IDLE;
         initialized = true;
         return true;
     }
@@ -33,4 +129,64 @@ public:
     bool isInitialized() const {
         return initialized;
     }
+
+    bool isBusy() const {
+        return state == TransactionState::TRANSMITTING || state == TransactionState::RECEIVING;
+    }
+
+    TransactionState getTransactionState() const {
+        return state;
+    }
+
+private:
+    TransactionState state = TransactionState::IDLE;
+    uint8_t expectedRegisters = 0;
+    uint8_t rxFrame[5 + 2 * MAX_REGISTERS];
+    uint8_t rxLength = 0;
+    unsigned long txStart = 0;
+    unsigned long txDuration = 0;
+    unsigned long rxStart = 0;
+
+    // 11 bits per character with 8N2 framing
+    static unsigned long charTimeMicros() {
+        return (11UL * 1000000UL + BAUD_RATE - 1) / BAUD_RATE;
+    }
+
+    bool responseComplete() const {
+        if (rxLength < 3) return false;
+        if (rxFrame[1] & 0x80) return rxLength >= 5;   // Exception response
+        return rxLength >= 5 + rxFrame[2];
+    }
+
+    bool parseResponse() {
+        if (rxFrame[0] != slaveAddr || rxFrame[1] != FUNC_READ_HOLDING_REGISTERS) {
+            return false;
+        }
+
+        uint8_t byteCount = rxFrame[2];
+        if (byteCount != 2 * expectedRegisters) {
+            return false;
+        }
+
+        uint16_t crc = crc16(rxFrame, 3 + byteCount);
+        if (rxFrame[3 + byteCount] != (crc & 0xFF) || rxFrame[4 + byteCount] != (crc >> 8)) {
+            return false;
+        }
+
+        for (uint8_t i = 0; i < expectedRegisters; i++) {
+            registers[i] = ((uint16_t)rxFrame[3 + 2 * i] << 8) | rxFrame[4 + 2 * i];
+        }
+        return true;
+    }
+
+    static uint16_t crc16(const uint8_t* data, size_t length) {
+        uint16_t crc = 0xFFFF;
+        for (size_t i = 0; i < length; i++) {
+            crc ^= data[i];
+            for (uint8_t bit = 0; bit < 8; bit++) {
+                crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+            }
+        }
+        return crc;
+    }
 };
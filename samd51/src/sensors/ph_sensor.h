@@ -13,19 +13,41 @@ public:
     PHSensor(HardwareSerial* serialPort, uint8_t addr = 4) 
         : ModbusSensor(serialPort, addr) {}
 
-    PHReading read() {
-        PHReading result = {0.0f, 0.0f, false};
-        if (!initialized) return result;
+    // Issue the request for the pH and temperature registers; the reply is collected by poll()
+    bool startRead() {
+        return requestHoldingRegisters(2409, 10);
+    }
 
-        // Read pH and temperature registers
-        uint16_t registers[10];
-        if (modbus.readHoldingRegisters(slaveAddr, 2409, registers, 10)) {
+    // Returns true once the pending transaction has finished, successfully or not
+    bool poll() {
+        TransactionState state = pollTransaction();
+        if (state != TransactionState::DONE && state != TransactionState::FAILED) {
+            return false;
+        }
+
+        PHReading result = {0.0f, 0.0f, false};
+        if (state == TransactionState::DONE) {
             // Convert registers to float values
             result.pH = registersToFloat(registers[2], registers[3]);
             result.temperature = registersToFloat(registers[6], registers[7]);
             result.valid = true;
         }
+        lastReading = result;
+        releaseTransaction();
+        return true;
+    }
 
-        return result;
+    PHReading getReading() const {
+        return lastReading;
     }
+
+    // Blocking convenience wrapper around startRead()/poll()
+    PHReading read() {
+        if (!startRead()) return PHReading{0.0f, 0.0f, false};
+        while (!poll()) {}
+        return lastReading;
+    }
+
+private:
+    PHReading lastReading = {0.0f, 0.0f, false};
 };
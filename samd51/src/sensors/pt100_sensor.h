@@ -2,6 +2,8 @@
 
 #include <Arduino.h>
 #include <SPI.h>
+#include "spsc_ring.h"
+#include "rtd_conversion.h"
 
 class PT100Sensor {
 public:
@@ -18,15 +20,40 @@ public:
         bool valid;
     };
 
+    enum class AcquisitionMode {
+        POLLED,         // read() performs the SPI transactions itself
+        DRDY_INTERRUPT  // DRDY falling edges trigger burst reads from an ISR
+    };
+
+    // One filtered conversion as queued by the DRDY ISR
+    struct Sample {
+        uint16_t rtd;          // Filtered 15-bit RTD code
+        uint8_t fault_code;
+        unsigned long timestamp;
+    };
+
     PT100Sensor(uint8_t cs1, uint8_t cs2, uint8_t cs3, uint8_t drdy1, uint8_t drdy2, uint8_t drdy3)
         : cs_pins{cs1, cs2, cs3}
         , drdy_pins{drdy1, drdy2, drdy3}
         , initialized(false) {}
 
-    bool begin() {
+    bool begin(AcquisitionMode acquisitionMode = AcquisitionMode::POLLED) {
         SPI.begin();
-        
+        mode = acquisitionMode;
+
+        // Channels sharing a chip select are the same MAX31865
         for(int i = 0; i < 3; i++) {
+            device_of[i] = i;
+            for(int j = 0; j < i; j++) {
+                if (cs_pins[j] == cs_pins[i]) {
+                    device_of[i] = device_of[j];
+                    break;
+                }
+            }
+        }
+
+        for(int i = 0; i < 3; i++) {
+            if (!isDevice(i)) continue;
             pinMode(cs_pins[i], OUTPUT);
             digitalWrite(cs_pins[i], HIGH);
             pinMode(drdy_pins[i], INPUT);
@@ -34,14 +61,20 @@ public:
 
         // Configure each MAX31865
         for(int i = 0; i < 3; i++) {
-            // Set to 4-wire mode, automatic bias on, 50Hz filter
-            writeRegister(i, 0x00, 0xC3);
-            
+            if (!isDevice(i)) continue;
+
+            // Set to 4-wire mode, automatic bias on, continuous conversion, 50Hz filter
+            writeRegister(i, REG_CONFIG, CONFIG_AUTO_50HZ);
+
             // Set RTD high and low threshold - optional
             writeRegister(i, 0x03, 0xFF); // High threshold
             writeRegister(i, 0x04, 0x00); // Low threshold
         }
 
+        if (mode == AcquisitionMode::DRDY_INTERRUPT) {
+            attachDataReadyInterrupts();
+        }
+
         initialized = true;
         return true;
     }
@@ -57,7 +90,13 @@ public:
 
         bool any_valid = false;
         for(int i = 0; i < 3; i++) {
-            readings.sensors[i] = readSensor(i);
+            if (!isDevice(i)) {
+                readings.sensors[i] = readings.sensors[device_of[i]];
+            } else if (mode == AcquisitionMode::DRDY_INTERRUPT) {
+                readings.sensors[i] = drainSamples(i);
+            } else {
+                readings.sensors[i] = readSensor(i);
+            }
             if (readings.sensors[i].valid) {
                 any_valid = true;
             }
@@ -67,10 +106,137 @@ public:
         return readings;
     }
 
+    // Move the conversions the DRDY ISRs queued into the latest reading
+    // (DRDY_INTERRUPT mode only). Call on every loop pass: the ring only
+    // has to cover the time the loop spends elsewhere, not a whole sweep.
+    void service() {
+        if (!initialized || mode != AcquisitionMode::DRDY_INTERRUPT) return;
+        for(int i = 0; i < 3; i++) {
+            if (isDevice(i)) drainSamples(i);
+        }
+    }
+
+    // Conversions dropped because service() was not called for a ring's worth of them
+    uint32_t getOverflowCount(uint8_t sensor_idx) const {
+        return samples[device_of[sensor_idx]].overflows();
+    }
+
 private:
+    static const uint8_t REG_CONFIG = 0x00;
+    static const uint8_t REG_RTD_MSB = 0x01;
+    static const uint8_t REG_FAULT_STATUS = 0x07;
+    static const uint8_t CONFIG_AUTO_50HZ = 0xC3;    // VBIAS | auto convert | fault clear | 50Hz
+    static const uint8_t FILTER_SHIFT = 2;           // EMA weight of 1/4 per conversion
+    static const unsigned long DRDY_STALL_MS = 200;  // Service a channel by hand if DRDY stays low
+
     uint8_t cs_pins[3];
     uint8_t drdy_pins[3];
+    uint8_t device_of[3];
     bool initialized;
+    AcquisitionMode mode = AcquisitionMode::POLLED;
+
+    // Written by the DRDY ISRs only
+    uint32_t filtered_rtd[3] = {0, 0, 0};   // Q4 fixed point
+    bool filter_primed[3] = {false, false, false};
+
+    // Burst buffers between the DRDY ISRs and service(). At the 50 Hz
+    // auto-convert rate 16 entries cover ~320 ms of the loop being busy
+    // elsewhere (an SD write, a long control task) without a loss.
+    SpscRing<Sample, 16> samples[3];
+    PT100Reading latest[3] = {};
+    unsigned long latest_time[3] = {0, 0, 0};
+
+    // The DRDY trampolines need to find the driver; there is only one front-end
+    static PT100Sensor*& instance() {
+        static PT100Sensor* sensor = nullptr;
+        return sensor;
+    }
+
+    bool isDevice(uint8_t sensor_idx) const {
+        return device_of[sensor_idx] == sensor_idx;
+    }
+
+    static void onDataReady0() { instance()->serviceDataReady(0); }
+    static void onDataReady1() { instance()->serviceDataReady(1); }
+    static void onDataReady2() { instance()->serviceDataReady(2); }
+
+    void attachDataReadyInterrupts() {
+        instance() = this;
+
+        for(int i = 0; i < 3; i++) {
+            if (!isDevice(i)) continue;
+
+            // Mask this DRDY line while other drivers own the shared SPI bus
+            SPI.usingInterrupt(digitalPinToInterrupt(drdy_pins[i]));
+            attachDataReadyInterrupt(i);
+        }
+    }
+
+    void attachDataReadyInterrupt(uint8_t sensor_idx) {
+        static void (*const handlers[3])() = {onDataReady0, onDataReady1, onDataReady2};
+        attachInterrupt(digitalPinToInterrupt(drdy_pins[sensor_idx]), handlers[sensor_idx], FALLING);
+    }
+
+    // One burst read of RTD MSB/LSB through the fault status register, then filter and queue
+    void serviceDataReady(uint8_t sensor_idx) {
+        uint8_t burst[7];
+        readBurst(sensor_idx, REG_RTD_MSB, burst, sizeof(burst));
+
+        uint16_t rtd = ((uint16_t)burst[0] << 8) | burst[1];
+        uint8_t fault_status = burst[REG_FAULT_STATUS - REG_RTD_MSB];
+
+        Sample sample;
+        sample.timestamp = millis();
+        if ((rtd & 0x01) || fault_status) {
+            // Re-writing the configuration clears the latched fault
+            writeRegister(sensor_idx, REG_CONFIG, CONFIG_AUTO_50HZ);
+            sample.rtd = 0;
+            sample.fault_code = fault_status ? fault_status : 0xFF;
+            filter_primed[sensor_idx] = false;
+        } else {
+            uint32_t code = (uint32_t)(rtd >> 1) << 4;
+            if (!filter_primed[sensor_idx]) {
+                filtered_rtd[sensor_idx] = code;
+                filter_primed[sensor_idx] = true;
+            } else {
+                filtered_rtd[sensor_idx] += ((int32_t)code - (int32_t)filtered_rtd[sensor_idx]) >> FILTER_SHIFT;
+            }
+            sample.rtd = filtered_rtd[sensor_idx] >> 4;
+            sample.fault_code = 0;
+        }
+        samples[sensor_idx].push(sample);
+    }
+
+    // Collapse everything the ISR queued since the last call into the newest reading
+    PT100Reading drainSamples(uint8_t sensor_idx) {
+        Sample sample;
+        bool received = false;
+        while (samples[sensor_idx].pop(sample)) {
+            latest[sensor_idx] = sampleToReading(sample);
+            latest_time[sensor_idx] = sample.timestamp;
+            received = true;
+        }
+
+        // A missed edge leaves DRDY low forever; read the channel once by hand to re-arm it
+        if (!received && millis() - latest_time[sensor_idx] >= DRDY_STALL_MS
+                && digitalRead(drdy_pins[sensor_idx]) == LOW) {
+            detachInterrupt(digitalPinToInterrupt(drdy_pins[sensor_idx]));
+            serviceDataReady(sensor_idx);
+            attachDataReadyInterrupt(sensor_idx);
+            return drainSamples(sensor_idx);
+        }
+
+        return latest[sensor_idx];
+    }
+
+    PT100Reading sampleToReading(const Sample& sample) const {
+        PT100Reading reading;
+        reading.fault = sample.fault_code != 0;
+        reading.fault_code = sample.fault_code;
+        reading.valid = !reading.fault;
+        reading.temperature = reading.valid ? rtdToTemperature(sample.rtd) : 0.0f;
+        return reading;
+    }
 
     void writeRegister(uint8_t sensor_idx, uint8_t reg, uint8_t value) {
         digitalWrite(cs_pins[sensor_idx], LOW);
@@ -81,49 +247,48 @@ private:
         digitalWrite(cs_pins[sensor_idx], HIGH);
     }
 
-    uint8_t readRegister(uint8_t sensor_idx, uint8_t reg) {
-        digitalWrite(cs_pins[sensor_idx], LOW);
+    // Read consecutive registers in a single transaction; the MAX31865 auto-increments
+    void readBurst(uint8_t sensor_idx, uint8_t reg, uint8_t* data, uint8_t length) {
         SPI.beginTransaction(SPISettings(2000000, MSBFIRST, SPI_MODE3));
+        digitalWrite(cs_pins[sensor_idx], LOW);
         SPI.transfer(reg & 0x7F); // Clear write bit
-        uint8_t value = SPI.transfer(0xFF);
-        SPI.endTransaction();
+        for(uint8_t i = 0; i < length; i++) {
+            data[i] = SPI.transfer(0xFF);
+        }
         digitalWrite(cs_pins[sensor_idx], HIGH);
-        return value;
+        SPI.endTransaction();
     }
 
     PT100Reading readSensor(uint8_t sensor_idx) {
         PT100Reading reading;
         reading.valid = false;
         reading.fault = false;
+        reading.fault_code = 0;
 
-        // Read temperature registers
-        digitalWrite(cs_pins[sensor_idx], LOW);
-        SPI.beginTransaction(SPISettings(2000000, MSBFIRST, SPI_MODE3));
-        SPI.transfer(0x01 & 0x7F); // Start at register 1
-        uint16_t rtd = (SPI.transfer(0xFF) << 8);
-        rtd |= SPI.transfer(0xFF);
-        SPI.endTransaction();
-        digitalWrite(cs_pins[sensor_idx], HIGH);
+        // Read temperature and fault status registers in one go
+        uint8_t burst[7];
+        readBurst(sensor_idx, REG_RTD_MSB, burst, sizeof(burst));
+        uint16_t rtd = ((uint16_t)burst[0] << 8) | burst[1];
 
         // Check fault status
-        uint8_t fault_status = readRegister(sensor_idx, 0x07);
-        if (fault_status) {
+        uint8_t fault_status = burst[REG_FAULT_STATUS - REG_RTD_MSB];
+        if (fault_status || (rtd & 0x01)) {
+            writeRegister(sensor_idx, REG_CONFIG, CONFIG_AUTO_50HZ);
             reading.fault = true;
-            reading.fault_code = fault_status;
+            reading.fault_code = fault_status ? fault_status : 0xFF;
             return reading;
         }
 
         // Remove fault bit
         rtd >>= 1;
 
-        // Convert RTD value to temperature
-        // For PT100: R(t) = R0(1 + At + Bt^2)
-        // where R0 = 100Ω, A = 3.9083e-3, B = -5.775e-7
-        float resistance = rtd * 400.0 / 32768.0; // Reference resistor is 400Ω
-        float temp = ((resistance / 100.0) - 1.0) / 0.00385; // Simplified calculation
-
-        reading.temperature = temp;
+        reading.temperature = rtdToTemperature(rtd);
         reading.valid = true;
         return reading;
     }
+
+    static float rtdToTemperature(uint16_t rtd) {
+        // Full Callendar-Van Dusen curve from the precomputed code table
+        return PT100Conversion::codeToTemperature(rtd);
+    }
 };
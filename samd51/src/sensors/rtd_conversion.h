@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+
+// PT100 resistance/temperature conversion per IEC 60751 (Callendar-Van Dusen).
+//   T >= 0 °C: R(T) = R0 (1 + A T + B T^2)
+//   T <  0 °C: R(T) = R0 (1 + A T + B T^2 + C (T - 100) T^3)
+// The closed-form inverse is evaluated at compile time to build a table
+// indexed by the MAX31865 ADC code, so a conversion at run time is one
+// table lookup and a linear interpolation.
+namespace PT100Conversion {
+    constexpr double R0 = 100.0;          // Nominal resistance at 0 °C
+    constexpr double R_REF = 400.0;       // MAX31865 reference resistor
+    constexpr double A = 3.9083e-3;
+    constexpr double B = -5.775e-7;
+    constexpr double C = -4.183e-12;
+    constexpr uint32_t ADC_FULL_SCALE = 32768;  // 15-bit RTD code
+
+    constexpr double codeToResistance(double code) {
+        return code * R_REF / ADC_FULL_SCALE;
+    }
+
+    constexpr double resistanceAt(double t) {
+        return t >= 0.0
+            ? R0 * (1.0 + A * t + B * t * t)
+            : R0 * (1.0 + A * t + B * t * t + C * (t - 100.0) * t * t * t);
+    }
+
+    // Newton's method, usable in constant expressions
+    constexpr double sqrtNewton(double x) {
+        if (x <= 0.0) return 0.0;
+        double guess = x > 1.0 ? x : 1.0;
+        for (int i = 0; i < 64; i++) {
+            double next = 0.5 * (guess + x / guess);
+            if (next == guess) break;
+            guess = next;
+        }
+        return guess;
+    }
+
+    // Exact inverse of resistanceAt(); the sub-zero branch refines the
+    // quadratic solution with Newton iterations on the full C-term equation
+    constexpr double temperatureFromResistance(double r) {
+        double t = (-A + sqrtNewton(A * A - 4.0 * B * (1.0 - r / R0))) / (2.0 * B);
+        if (r >= R0) return t;
+
+        for (int i = 0; i < 16; i++) {
+            double f = resistanceAt(t) - r;
+            double df = R0 * (A + 2.0 * B * t + C * (4.0 * t * t * t - 300.0 * t * t));
+            double step = f / df;
+            t -= step;
+            if (step < 1e-9 && step > -1e-9) break;
+        }
+        return t;
+    }
+
+    constexpr uint8_t SEGMENT_BITS = 7;                        // 128 codes (~1.6 Ω) per segment
+    constexpr uint32_t SEGMENT_SIZE = 1UL << SEGMENT_BITS;
+    constexpr uint32_t TABLE_SEGMENTS = ADC_FULL_SCALE / SEGMENT_SIZE;
+
+    struct Table {
+        float temperature[TABLE_SEGMENTS + 1];
+
+        constexpr Table() : temperature() {
+            for (uint32_t i = 0; i <= TABLE_SEGMENTS; i++) {
+                temperature[i] = static_cast<float>(
+                    temperatureFromResistance(codeToResistance(i * SEGMENT_SIZE)));
+            }
+        }
+    };
+
+    // Lives in flash; 257 entries
+    constexpr Table TABLE{};
+
+    // ADC code (fault bit already removed) to temperature in °C
+    inline float codeToTemperature(uint16_t code) {
+        uint32_t index = code >> SEGMENT_BITS;
+        if (index >= TABLE_SEGMENTS) {
+            return TABLE.temperature[TABLE_SEGMENTS];
+        }
+        float fraction = (code & (SEGMENT_SIZE - 1)) * (1.0f / SEGMENT_SIZE);
+        float lower = TABLE.temperature[index];
+        return lower + (TABLE.temperature[index + 1] - lower) * fraction;
+    }
+}
@@ -5,6 +5,27 @@
 #include "biomass_sensor.h"
 #include "pt100_sensor.h"
 
+// PT100 front-end wiring; override from build_flags when the board routes
+// each MAX31865 to its own chip select and DRDY line
+#ifndef PT100_CS_1_PIN
+#define PT100_CS_1_PIN 13
+#endif
+#ifndef PT100_CS_2_PIN
+#define PT100_CS_2_PIN 13
+#endif
+#ifndef PT100_CS_3_PIN
+#define PT100_CS_3_PIN 13
+#endif
+#ifndef PT100_IRQ_1_PIN
+#define PT100_IRQ_1_PIN 18
+#endif
+#ifndef PT100_IRQ_2_PIN
+#define PT100_IRQ_2_PIN 18
+#endif
+#ifndef PT100_IRQ_3_PIN
+#define PT100_IRQ_3_PIN 18
+#endif
+
 class SensorManager {
 public:
     struct SensorReadings {
@@ -29,35 +50,24 @@ public:
         success &= doSensor.begin();
         success &= phSensor.begin();
         success &= biomassSensor.begin();
-        success &= pt100Sensor.begin();
+        success &= pt100Sensor.begin(PT100Sensor::AcquisitionMode::DRDY_INTERRUPT);
         return success;
     }
 
-    SensorReadings read() {
-        SensorReadings readings;
-        readings.timestamp = millis();
-        
-        // Read all sensors
-        readings.do_reading = doSensor.read();
-        readings.ph_reading = phSensor.read();
-        readings.biomass_reading = biomassSensor.read();
-        readings.pt100_reading = pt100Sensor.read();
-        
-        lastReadTime = readings.timestamp;
-        return readings;
-    }
-
-    // Update function to be called in the main loop
+    // Update function to be called in the main loop; never waits on the bus
     void update() {
         unsigned long currentTime = millis();
+        pt100Sensor.service();
         
-        // Read sensors every second
-        if (currentTime - lastReadTime >= 1000) {
-            SensorReadings readings = read();
-            
-            // Store the readings in the circular buffer
-            readings_buffer[buffer_index] = readings;
-            buffer_index = (buffer_index + 1) % BUFFER_SIZE;
+        // Start a new sweep every second
+        if (!sweepActive && currentTime - lastReadTime >= 1000) {
+            startSweep(currentTime);
+        }
+
+        // Collect replies as they arrive and publish once all probes answered
+        if (sweepActive && pollSweep()) {
+            SensorReadings readings = completeSweep();
+            publishSnapshot(readings);
             
             // Update the last valid readings if the new readings are valid
             if (readings.do_reading.valid) last_valid_readings.do_reading = readings.do_reading;
@@ -71,13 +81,34 @@ public:
         return last_valid_readings;
     }
 
+    // Latest complete sweep. Controllers read this instead of touching the
+    // buses, so every probe is acquired exactly once per cycle.
+    const SensorReadings& getSnapshot() const {
+        return snapshots[front_snapshot];
+    }
+
+    // Incremented every time a new snapshot is published
+    uint32_t getSnapshotSequence() const {
+        return snapshot_sequence;
+    }
+
+    // Returns true if a snapshot was published since lastSeenSequence and
+    // records the current sequence so the next call only reports newer ones
+    bool snapshotChanged(uint32_t& lastSeenSequence) const {
+        if (lastSeenSequence == snapshot_sequence) {
+            return false;
+        }
+        lastSeenSequence = snapshot_sequence;
+        return true;
+    }
+
 private:
-    static const uint8_t PT100_CS_1 = 13;  // PT100_CS_1 from schematic
-    static const uint8_t PT100_CS_2 = 13;  // PT100_CS_2 from schematic
-    static const uint8_t PT100_CS_3 = 13;  // PT100_CS_3 from schematic
-    static const uint8_t PT100_IRQ_1 = 18; // PT100_IRQ_1 from schematic
-    static const uint8_t PT100_IRQ_2 = 18; // PT100_IRQ_2 from schematic
-    static const uint8_t PT100_IRQ_3 = 18; // PT100_IRQ_3 from schematic
+    static const uint8_t PT100_CS_1 = PT100_CS_1_PIN;   // PT100_CS_1 from schematic
+    static const uint8_t PT100_CS_2 = PT100_CS_2_PIN;   // PT100_CS_2 from schematic
+    static const uint8_t PT100_CS_3 = PT100_CS_3_PIN;   // PT100_CS_3 from schematic
+    static const uint8_t PT100_IRQ_1 = PT100_IRQ_1_PIN; // PT100_IRQ_1 from schematic
+    static const uint8_t PT100_IRQ_2 = PT100_IRQ_2_PIN; // PT100_IRQ_2 from schematic
+    static const uint8_t PT100_IRQ_3 = PT100_IRQ_3_PIN; // PT100_IRQ_3 from schematic
 
     DOSensor doSensor;
     PHSensor phSensor;
@@ -85,8 +116,64 @@ private:
     PT100Sensor pt100Sensor;
     unsigned long lastReadTime;
 
-    static const size_t BUFFER_SIZE = 60; // Store 1 minute of readings
-    SensorReadings readings_buffer[BUFFER_SIZE];
-    size_t buffer_index = 0;
+    // Modbus sweep bookkeeping, one bit per probe
+    static const uint8_t PROBE_DO = 0x01;
+    static const uint8_t PROBE_PH = 0x02;
+    static const uint8_t PROBE_BIOMASS = 0x04;
+    bool sweepActive = false;
+    uint8_t sweepStarted = 0;
+    uint8_t sweepPending = 0;
+    unsigned long sweepTimestamp = 0;
+
     SensorReadings last_valid_readings;
+
+    // Double-buffered snapshot; the back buffer is filled before it is made current
+    SensorReadings snapshots[2] = {};
+    uint8_t front_snapshot = 0;
+    uint32_t snapshot_sequence = 0;
+
+    void publishSnapshot(const SensorReadings& readings) {
+        uint8_t back = front_snapshot ^ 1;
+        snapshots[back] = readings;
+        front_snapshot = back;
+        snapshot_sequence++;
+    }
+
+    // Issue all three Modbus requests at once; each probe sits on its own UART
+    void startSweep(unsigned long timestamp) {
+        sweepStarted = 0;
+        if (doSensor.startRead()) sweepStarted |= PROBE_DO;
+        if (phSensor.startRead()) sweepStarted |= PROBE_PH;
+        if (biomassSensor.startRead()) sweepStarted |= PROBE_BIOMASS;
+        sweepPending = sweepStarted;
+        sweepTimestamp = timestamp;
+        lastReadTime = timestamp;
+        sweepActive = true;
+    }
+
+    // Returns true when every outstanding request has completed or timed out
+    bool pollSweep() {
+        if ((sweepPending & PROBE_DO) && doSensor.poll()) sweepPending &= ~PROBE_DO;
+        if ((sweepPending & PROBE_PH) && phSensor.poll()) sweepPending &= ~PROBE_PH;
+        if ((sweepPending & PROBE_BIOMASS) && biomassSensor.poll()) sweepPending &= ~PROBE_BIOMASS;
+        return sweepPending == 0;
+    }
+
+    SensorReadings completeSweep() {
+        SensorReadings readings;
+        readings.timestamp = sweepTimestamp;
+
+        readings.do_reading = (sweepStarted & PROBE_DO)
+            ? doSensor.getReading() : DOSensor::DOReading{0.0f, 0.0f, false};
+        readings.ph_reading = (sweepStarted & PROBE_PH)
+            ? phSensor.getReading() : PHSensor::PHReading{0.0f, 0.0f, false};
+        readings.biomass_reading = (sweepStarted & PROBE_BIOMASS)
+            ? biomassSensor.getReading() : BiomassSensor::BiomassReading{0.0f, 0.0f, 0.0f, false};
+
+        // PT100 conversions are drained by update() as they arrive; this takes the newest
+        readings.pt100_reading = pt100Sensor.read();
+
+        sweepActive = false;
+        return readings;
+    }
 };
@@ -0,0 +1,23 @@
+// The 48 h closed-loop scenario of the native program, run as
+// `program --check`: every setpoint step and feed of every loop has to
+// stay within its bounds in LOOPS (src/native/simulation.h)
+//
+//   pio test -e native -f test_closed_loop
+
+#include <unity.h>
+#include "native/simulation.h"
+
+void setUp() {}
+void tearDown() {}
+
+void test_pid_scenario_within_bounds() {
+    SimulationOptions options;
+    options.check = true;
+    TEST_ASSERT_EQUAL(0, runSimulation(options));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_pid_scenario_within_bounds);
+    return UNITY_END();
+}
@@ -0,0 +1,24 @@
+// The 48 h closed-loop scenario with temperature on the Smith predictor,
+// run as `program --smith --check`; its own process, because the
+// simulation runs once per process
+//
+//   pio test -e native -f test_closed_loop_smith
+
+#include <unity.h>
+#include "native/simulation.h"
+
+void setUp() {}
+void tearDown() {}
+
+void test_smith_scenario_within_bounds() {
+    SimulationOptions options;
+    options.check = true;
+    options.smith = true;
+    TEST_ASSERT_EQUAL(0, runSimulation(options));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_smith_scenario_within_bounds);
+    return UNITY_END();
+}
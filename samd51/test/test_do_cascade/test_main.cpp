@@ -0,0 +1,107 @@
+// DOController's split-range demand: the demand worked back from the
+// actuators (what a limit change or a priority change re-seeds the PID
+// from) is the demand that set them, in either cascade order
+//
+//   pio test -e native -f test_do_cascade
+
+#include <unity.h>
+#include "controllers/do_controller.h"
+
+static SensorManager sensors;
+
+struct Actuators {
+    float stirrer;
+    float air;
+    float oxygen;
+};
+
+static Actuators actuators(const DOController& controller) {
+    return {controller.getRequiredStirrerSpeed(), controller.getAirFlow(), controller.getOxygenFlow()};
+}
+
+// Demand from the actuators, through the rebase setLimits() does
+static float demandFromActuators(DOController& controller) {
+    controller.setLimits(controller.getLimits());
+    return controller.getOutput();
+}
+
+static void assertRoundTrip(DOController::CascadePriority priority) {
+    DOController controller(sensors);
+    controller.begin();
+    controller.setCascadePriority(priority);
+
+    // Every 0.5 %, which lands on both segment boundaries (100/3 rounded
+    // either way) and the ends
+    for (float demand = 0; demand <= 100.0f; demand += 0.5f) {
+        controller.driveOutput(demand);
+        Actuators before = actuators(controller);
+
+        TEST_ASSERT_FLOAT_WITHIN(1e-3f, demand, demandFromActuators(controller));
+        Actuators after = actuators(controller);
+        TEST_ASSERT_FLOAT_WITHIN(1e-3f, before.stirrer, after.stirrer);
+        TEST_ASSERT_FLOAT_WITHIN(1e-5f, before.air, after.air);
+        TEST_ASSERT_FLOAT_WITHIN(1e-5f, before.oxygen, after.oxygen);
+    }
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_round_trip_stirrer_first() {
+    assertRoundTrip(DOController::CascadePriority::STIRRER_FIRST);
+}
+
+void test_round_trip_gas_first() {
+    assertRoundTrip(DOController::CascadePriority::GAS_FIRST);
+}
+
+// The segments fill in the priority order
+void test_segment_order() {
+    DOController controller(sensors);
+    controller.begin();
+    const DOController::Limits& limits = controller.getLimits();
+
+    controller.driveOutput(50.0f);
+    TEST_ASSERT_EQUAL_FLOAT(limits.stirrerMax, controller.getRequiredStirrerSpeed());
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, (limits.airMin + limits.airMax) / 2, controller.getAirFlow());
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, controller.getOxygenFlow());
+
+    controller.setCascadePriority(DOController::CascadePriority::GAS_FIRST);
+    controller.driveOutput(50.0f);
+    TEST_ASSERT_EQUAL_FLOAT(limits.airMax, controller.getAirFlow());
+    TEST_ASSERT_FLOAT_WITHIN(1e-2f, (limits.stirrerMin + limits.stirrerMax) / 2, controller.getRequiredStirrerSpeed());
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, controller.getOxygenFlow());
+
+    controller.driveOutput(100.0f);
+    TEST_ASSERT_EQUAL_FLOAT(limits.oxygenMax, controller.getOxygenFlow());
+}
+
+// A lower stirrer ceiling while air is in use pulls the stirrer down to
+// it and leaves the gas where it was
+void test_lower_ceiling_keeps_the_gas() {
+    for (DOController::CascadePriority priority : {DOController::CascadePriority::STIRRER_FIRST,
+                                                   DOController::CascadePriority::GAS_FIRST}) {
+        DOController controller(sensors);
+        controller.begin();
+        controller.setCascadePriority(priority);
+        controller.driveOutput(80.0f);
+        Actuators before = actuators(controller);
+
+        DOController::Limits limits = controller.getLimits();
+        limits.stirrerMax = 600.0f;
+        controller.setLimits(limits);
+        TEST_ASSERT_EQUAL_FLOAT(600.0f, controller.getRequiredStirrerSpeed());
+        TEST_ASSERT_EQUAL_FLOAT(before.air, controller.getAirFlow());
+        TEST_ASSERT_EQUAL_FLOAT(before.oxygen, controller.getOxygenFlow());
+        TEST_ASSERT_FLOAT_WITHIN(1e-3f, 80.0f, controller.getOutput());
+    }
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip_stirrer_first);
+    RUN_TEST(test_round_trip_gas_first);
+    RUN_TEST(test_segment_order);
+    RUN_TEST(test_lower_ceiling_keeps_the_gas);
+    return UNITY_END();
+}
@@ -0,0 +1,172 @@
+// FOPDTModel against a plant that is exactly first order plus dead time:
+// the gain, time constant, dead time and offset it identifies, the
+// predictions the Smith predictor and feed-forward take from it, and a
+// cold feed that must not be learned as plant behaviour
+//
+//   pio test -e native -f test_fopdt_model
+
+#include <unity.h>
+#include <math.h>
+#include "controllers/fopdt_model.h"
+
+// A jacketed vessel on the temperature controller's scale: 25 °C rise at
+// full heat over 20 °C ambient, 10 min time constant, 40 s transport
+// delay, sampled every 10 s
+static const float SAMPLE_TIME = 10.0f;
+static const float GAIN = 25.0f;
+static const float TIME_CONSTANT = 600.0f;
+static const uint8_t DELAY = 4;
+static const float AMBIENT = 20.0f;
+
+class Plant {
+public:
+    explicit Plant(float noise = 0.0f) : noise(noise) {
+        for (float& u : pending) u = 0;
+    }
+
+    // The output at the end of a period with input u applied over it
+    float step(float u) {
+        const float a = expf(-SAMPLE_TIME / TIME_CONSTANT);
+        float delayed = pending[DELAY - 1];
+        for (uint8_t i = DELAY - 1; i > 0; i--) pending[i] = pending[i - 1];
+        pending[0] = u;
+        y = a * y + (1 - a) * (GAIN * delayed + AMBIENT);
+        return measured();
+    }
+
+    float measured() { return y + noise * (uniform() - 0.5f) * 2; }
+    float trueOutput() const { return y; }
+    void disturb(float change) { y += change; }
+
+private:
+    float y = AMBIENT;
+    float pending[DELAY];
+    float noise;
+    uint32_t state = 12345;
+
+    float uniform() {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) / 16777216.0f;
+    }
+};
+
+// Input held at a random level in [0.2, 0.8] for 10 to 40 samples at a time
+class TestSignal {
+public:
+    float next() {
+        if (hold == 0) {
+            state = state * 1103515245u + 12345u;
+            level = 0.2f + 0.6f * ((state >> 16) & 0xFF) / 255.0f;
+            hold = 10 + (state >> 24) % 31;
+        }
+        hold--;
+        return level;
+    }
+
+private:
+    uint32_t state = 1;
+    float level = 0;
+    uint16_t hold = 0;
+};
+
+static void identify(FOPDTModel& model, Plant& plant, uint16_t samples) {
+    TestSignal signal;
+    for (uint16_t k = 0; k < samples; k++) {
+        float u = signal.next();
+        model.update(plant.step(u), u);
+    }
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_identifies_the_plant() {
+    FOPDTModel model(SAMPLE_TIME);
+    model.setDeadZone(0.0f);
+    Plant plant;
+    identify(model, plant, 1500);
+
+    TEST_ASSERT_TRUE(model.isValid());
+    TEST_ASSERT_EQUAL(DELAY, model.getDelaySamples());
+    TEST_ASSERT_FLOAT_WITHIN(DELAY * SAMPLE_TIME * 0.01f, DELAY * SAMPLE_TIME, model.getDeadTime());
+    TEST_ASSERT_FLOAT_WITHIN(GAIN * 0.02f, GAIN, model.getGain());
+    TEST_ASSERT_FLOAT_WITHIN(TIME_CONSTANT * 0.02f, TIME_CONSTANT, model.getTimeConstant());
+    TEST_ASSERT_FLOAT_WITHIN(0.2f, AMBIENT, model.getOffset());
+}
+
+// ±0.05 °C of sensor noise, about what the PT100 front end gives
+void test_identifies_the_plant_through_noise() {
+    FOPDTModel model(SAMPLE_TIME);
+    model.setDeadZone(0.05f);
+    Plant plant(0.05f);
+    identify(model, plant, 3000);
+
+    TEST_ASSERT_TRUE(model.isValid());
+    TEST_ASSERT_EQUAL(DELAY, model.getDelaySamples());
+    TEST_ASSERT_FLOAT_WITHIN(GAIN * 0.1f, GAIN, model.getGain());
+    TEST_ASSERT_FLOAT_WITHIN(TIME_CONSTANT * 0.15f, TIME_CONSTANT, model.getTimeConstant());
+    TEST_ASSERT_FLOAT_WITHIN(1.0f, AMBIENT, model.getOffset());
+    TEST_ASSERT_LESS_THAN(0.1f, model.getPredictionError());
+}
+
+// predictAhead() is what the plant will read DELAY samples from now, and
+// steadyStateInput() the input that holds an output
+void test_predictions_match_the_plant() {
+    FOPDTModel model(SAMPLE_TIME);
+    model.setDeadZone(0.0f);
+    Plant plant;
+    identify(model, plant, 1500);
+
+    float predicted = model.predictAhead(plant.trueOutput());
+    for (uint8_t i = 0; i < DELAY; i++) {
+        plant.step(0.5f);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, predicted, plant.trueOutput());
+
+    float hold = model.steadyStateInput(37.0f);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, (37.0f - AMBIENT) / GAIN, hold);
+    for (uint16_t i = 0; i < 1000; i++) {
+        plant.step(hold);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(0.2f, 37.0f, plant.trueOutput());
+}
+
+// A cold media addition drops the temperature faster than the heater can
+// explain; the model is left as it was
+void test_cold_feed_is_not_learned() {
+    FOPDTModel model(SAMPLE_TIME);
+    model.setDeadZone(0.0f);
+    Plant plant;
+    identify(model, plant, 1500);
+    float gain = model.getGain();
+    float timeConstant = model.getTimeConstant();
+
+    plant.disturb(-3.0f);
+    for (uint16_t k = 0; k < FOPDTModel::HOLD_OFF_SAMPLES + 20; k++) {
+        model.update(plant.step(0.5f), 0.5f);
+    }
+    TEST_ASSERT_TRUE(model.isValid());
+    TEST_ASSERT_FLOAT_WITHIN(gain * 0.02f, gain, model.getGain());
+    TEST_ASSERT_FLOAT_WITHIN(timeConstant * 0.02f, timeConstant, model.getTimeConstant());
+}
+
+// A constant input says nothing about the gain: the vessel sits at
+// ambient with the heater off and only the sensor noise moves
+void test_not_valid_without_excitation() {
+    FOPDTModel model(SAMPLE_TIME);
+    Plant plant(0.05f);
+    for (uint16_t k = 0; k < 1000; k++) {
+        model.update(plant.step(0.0f), 0.0f);
+    }
+    TEST_ASSERT_FALSE(model.isValid());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_identifies_the_plant);
+    RUN_TEST(test_identifies_the_plant_through_noise);
+    RUN_TEST(test_predictions_match_the_plant);
+    RUN_TEST(test_cold_feed_is_not_learned);
+    RUN_TEST(test_not_valid_without_excitation);
+    return UNITY_END();
+}
@@ -0,0 +1,236 @@
+// DosingPump and PHController's ADAPTIVE strategy against simulated
+// TMC5130s and a pH probe on a buffered broth: shot volume and duration,
+// reservoir accounting, the buffer capacity learnFromShot() arrives at,
+// and a reservoir marked empty when its shots stop moving the pH
+//
+//   pio test -e native -f test_ph_dosing
+
+#include <unity.h>
+#include "controllers/controller_manager.h"
+#include "native/simulated_devices.h"
+
+static const uint8_t ACID_CS = ControllerPins::ACID_PUMP_CS_PIN;
+static const uint8_t BASE_CS = ControllerPins::BASE_PUMP_CS_PIN;
+static const uint16_t PH_REGISTER = 2409 + 2;
+
+static ModbusSlave doProbe(3);
+static ModbusSlave phProbe(4);
+static ModbusSlave biomassProbe(5);
+static Tmc5130 acidDriver;
+static Tmc5130 baseDriver;
+
+// A broth whose pH moves by the reagent that reached it over
+// bufferCapacity, less what the culture makes; mixing is instant
+struct Broth {
+    double pH = 6.8;                    // A millisecond of drift is below a float's resolution
+    float bufferCapacity = 40.0f;       // mmol/L per pH
+    float volume = 5.0f;                // L
+    float concentration = 0.5f;         // mmol/mL, both reagents
+    float drift = 0;                    // pH/s
+    bool baseBlocked = false;           // The base line delivers nothing
+
+    void step(float dt) {
+        float acidMl = acidDriver.getVelocity() * dt / 51200.0f;
+        float baseMl = baseBlocked ? 0 : baseDriver.getVelocity() * dt / 51200.0f;
+        pH += (baseMl - acidMl) * concentration / volume / bufferCapacity + drift * dt;
+        phProbe.setFloat(PH_REGISTER, pH);
+    }
+};
+
+static Broth broth;
+
+static void advance(uint32_t ms) {
+    for (uint32_t i = 0; i < ms; i++) {
+        broth.step(0.001f);
+        NativeHal::advance(1000);
+    }
+}
+
+// Run a shot to the end, accounting every 100 ms; returns how long it took in ms
+static uint32_t runShot(DosingPump& pump) {
+    uint32_t elapsed = 0;
+    pump.flush();
+    while (pump.isBusy() && elapsed < 600000) {
+        advance(100);
+        elapsed += 100;
+        pump.update();
+    }
+    return elapsed;
+}
+
+// The control loop as ControllerManager schedules it
+struct Rig {
+    SensorManager sensors;
+    DosingPump acid{ACID_CS, ControllerPins::ACID_PUMP_EN_PIN};
+    DosingPump base{BASE_CS, ControllerPins::BASE_PUMP_EN_PIN};
+    PHController ph{sensors, acid, base};
+
+    Rig() {
+        sensors.begin();
+        acid.begin();
+        base.begin();
+        ph.begin();
+        ph.setSetpoint(7.0f);
+    }
+
+    void run(uint32_t seconds) {
+        for (uint32_t s = 0; s < seconds; s++) {
+            for (uint8_t i = 0; i < 100; i++) {
+                sensors.update();
+                advance(10);
+            }
+            ph.measure();
+            ph.control();
+            acid.flush();
+            base.flush();
+        }
+    }
+};
+
+void setUp() {
+    acidDriver = Tmc5130();
+    baseDriver = Tmc5130();
+    broth = Broth();
+    phProbe.setFloat(PH_REGISTER, broth.pH);
+}
+
+void tearDown() {}
+
+// The shot is the volume asked for, delivered at the configured flow
+// rate: two shots differ in length by their difference in volume over
+// the flow rate, the ramps at either end being the same
+void test_shot_volume_and_flow_rate() {
+    DosingPump pump(ACID_CS, ControllerPins::ACID_PUMP_EN_PIN);
+    pump.begin();
+    const DosingPump::Config& config = pump.getConfig();
+
+    TEST_ASSERT_TRUE(pump.dose(2.0f));
+    TEST_ASSERT_FALSE(pump.dose(1.0f));
+    uint32_t shortShot = runShot(pump);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 2.0f, pump.getLastShot());
+
+    TEST_ASSERT_TRUE(pump.dose(4.0f));
+    uint32_t longShot = runShot(pump);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 4.0f, pump.getLastShot());
+    TEST_ASSERT_FLOAT_WITHIN(200.0f, 2.0f / config.flowRate * 1000, (float)(longShot - shortShot));
+
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 6.0f, pump.getDispensed());
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, config.reservoirVolume - 6.0f, pump.getRemaining());
+    TEST_ASSERT_EQUAL(2, pump.getShots());
+}
+
+// Shots never take the reservoir below its reserve; an empty reservoir
+// refuses shots until it is refilled
+void test_reservoir_accounting() {
+    DosingPump pump(ACID_CS, ControllerPins::ACID_PUMP_EN_PIN);
+    pump.begin();
+    const DosingPump::Config& config = pump.getConfig();
+    pump.refill(config.reserveVolume + 3.0f);
+    TEST_ASSERT_FALSE(pump.isEmpty());
+
+    TEST_ASSERT_TRUE(pump.dose(5.0f));
+    runShot(pump);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 3.0f, pump.getLastShot());
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, config.reserveVolume, pump.getRemaining());
+    TEST_ASSERT_TRUE(pump.isEmpty());
+    TEST_ASSERT_FALSE(pump.dose(1.0f));
+
+    pump.refill(100.0f);
+    TEST_ASSERT_FALSE(pump.isEmpty());
+    TEST_ASSERT_TRUE(pump.dose(1.0f));
+    runShot(pump);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 99.0f, pump.getRemaining());
+
+    // A refill past the reservoir is what the reservoir holds
+    pump.refill(2 * config.reservoirVolume);
+    TEST_ASSERT_EQUAL_FLOAT(config.reservoirVolume, pump.getRemaining());
+}
+
+// A stopped shot ramps down without running backwards, which would pull
+// reagent back out of the vessel, and counts what the motor made, not
+// what was asked for. The next shot starts from where it stopped.
+void test_stopped_shot_counts_what_moved() {
+    DosingPump pump(ACID_CS, ControllerPins::ACID_PUMP_EN_PIN);
+    pump.begin();
+    float before = pump.getRemaining();
+
+    TEST_ASSERT_TRUE(pump.dose(5.0f));
+    pump.flush();
+    advance(5000);
+    pump.stop();
+    int32_t furthest = acidDriver.getPosition();
+    for (uint32_t elapsed = 0; pump.isBusy() && elapsed < 10000; elapsed++) {
+        advance(1);
+        TEST_ASSERT_GREATER_OR_EQUAL(0.0f, acidDriver.getVelocity());
+        furthest = max(furthest, acidDriver.getPosition());
+        if (elapsed % 100 == 0) pump.update();
+    }
+    TEST_ASSERT_FALSE(pump.isBusy());
+    advance(1000);
+    TEST_ASSERT_EQUAL(furthest, acidDriver.getPosition());
+    TEST_ASSERT_EQUAL(0, acidDriver.getRegister(TMC5130A_RAMPMODE));
+    TEST_ASSERT_EQUAL(furthest, (int32_t)acidDriver.getRegister(TMC5130A_XTARGET));
+
+    float delivered = pump.getLastShot();
+    TEST_ASSERT_GREATER_THAN(0.0f, delivered);
+    TEST_ASSERT_LESS_THAN(5.0f, delivered);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, acidDriver.getPosition() / pump.getConfig().stepsPerMl, pump.getDispensed());
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, before - delivered, pump.getRemaining());
+
+    TEST_ASSERT_TRUE(pump.dose(1.0f));
+    runShot(pump);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 1.0f, pump.getLastShot());
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, before - delivered - 1.0f, pump.getRemaining());
+}
+
+// Shots against a culture making acid teach the controller the broth's
+// buffer capacity, from a starting guess four times too low
+void test_learns_buffer_capacity() {
+    broth.drift = -0.00002f;
+    Rig rig;
+    float initial = rig.ph.getBufferCapacity();
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, rig.ph.getDosingConfig().initialBufferCapacity, initial);
+
+    rig.run(2 * 3600);
+    TEST_ASSERT_GREATER_THAN(5, rig.base.getShots());
+    TEST_ASSERT_FLOAT_WITHIN(broth.bufferCapacity * 0.05f, broth.bufferCapacity, rig.ph.getBufferCapacity());
+    TEST_ASSERT_FLOAT_WITHIN(2 * rig.ph.getDosingConfig().deadband, 7.0f, broth.pH);
+    TEST_ASSERT_FALSE(rig.base.isEmpty());
+
+    // Everything dosed came out of the reservoir
+    const DosingPump::Config& config = rig.base.getConfig();
+    TEST_ASSERT_FLOAT_WITHIN(1e-2f, config.reservoirVolume - rig.base.getDispensed(), rig.base.getRemaining());
+}
+
+// A base line that delivers nothing is marked empty after
+// NO_RESPONSE_SHOTS shots, and refilling it lets shots resume
+void test_no_response_marks_reservoir_empty() {
+    broth.baseBlocked = true;
+    Rig rig;
+    rig.run(1800);
+    TEST_ASSERT_TRUE(rig.base.isEmpty());
+    TEST_ASSERT_EQUAL(PHController::NO_RESPONSE_SHOTS, rig.base.getShots());
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, rig.ph.getDosingConfig().initialBufferCapacity, rig.ph.getBufferCapacity());
+
+    broth.baseBlocked = false;
+    rig.ph.refillReservoir(PHController::BASE, rig.base.getConfig().reservoirVolume);
+    rig.run(600);
+    TEST_ASSERT_FALSE(rig.base.isEmpty());
+    TEST_ASSERT_GREATER_THAN(PHController::NO_RESPONSE_SHOTS, rig.base.getShots());
+}
+
+int main(int argc, char** argv) {
+    NativeHal::attachUartDevice(Serial1.port, &doProbe);
+    NativeHal::attachUartDevice(Serial2.port, &phProbe);
+    NativeHal::attachUartDevice(Serial3.port, &biomassProbe);
+    NativeHal::attachSpiDevice(&SPI, ACID_CS, &acidDriver);
+    NativeHal::attachSpiDevice(&SPI, BASE_CS, &baseDriver);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_shot_volume_and_flow_rate);
+    RUN_TEST(test_reservoir_accounting);
+    RUN_TEST(test_stopped_shot_counts_what_moved);
+    RUN_TEST(test_learns_buffer_capacity);
+    RUN_TEST(test_no_response_marks_reservoir_empty);
+    return UNITY_END();
+}
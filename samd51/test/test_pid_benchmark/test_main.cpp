@@ -0,0 +1,154 @@
+// Cost of PIDController<float>::compute() against the PID_v1 Compute() it
+// replaced. On the SAMD51 (`pio test -e samd51 -f test_pid_benchmark`)
+// it counts DWT cycles; on the host (`pio test -e native`) it times
+// nanoseconds per call. Either way it only reports the two figures: none
+// have been taken on the board yet, so there is no bound to hold it to.
+
+#include <unity.h>
+#include <stdio.h>
+#include "controllers/pid_controller.h"
+
+#ifndef ARDUINO_ARCH_SAMD
+#include <chrono>
+#endif
+
+void setUp() {}
+void tearDown() {}
+
+// PID_v1 1.2.1 Compute(), kept as the reference: double state, pointers to
+// the caller's variables, proportional on error, integral clamped to the
+// output limits
+class LegacyPID {
+public:
+    LegacyPID(double* input, double* output, double* setpoint, double kp, double ki, double kd)
+        : input_(input), output_(output), setpoint_(setpoint) {
+        double sampleTimeSec = sampleTime_ / 1000.0;
+        kp_ = kp;
+        ki_ = ki * sampleTimeSec;
+        kd_ = kd / sampleTimeSec;
+    }
+
+    bool compute(unsigned long now) {
+        unsigned long timeChange = now - lastTime_;
+        if (timeChange < sampleTime_) return false;
+
+        double input = *input_;
+        double error = *setpoint_ - input;
+        double dInput = input - lastInput_;
+        outputSum_ += ki_ * error;
+        if (outputSum_ > outMax_) outputSum_ = outMax_;
+        else if (outputSum_ < outMin_) outputSum_ = outMin_;
+
+        double output = kp_ * error + outputSum_ - kd_ * dInput;
+        if (output > outMax_) output = outMax_;
+        else if (output < outMin_) output = outMin_;
+        *output_ = output;
+        lastInput_ = input;
+        lastTime_ = now;
+        return true;
+    }
+
+private:
+    double* input_;
+    double* output_;
+    double* setpoint_;
+    double kp_, ki_, kd_;
+    double outputSum_ = 0, lastInput_ = 0;
+    double outMin_ = 0, outMax_ = 255;
+    unsigned long sampleTime_ = 100;
+    unsigned long lastTime_ = 0;
+};
+
+#ifdef ARDUINO_ARCH_SAMD
+static const uint32_t ITERATIONS = 10000;
+
+static void startCounter() {
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+static uint32_t counter() {
+    return DWT->CYCCNT;
+}
+#else
+static const uint32_t ITERATIONS = 10000000;
+
+static void startCounter() {}
+
+static uint32_t counter() {
+    using namespace std::chrono;
+    return (uint32_t)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+// A slow ramp with a wobble, so neither path sees a constant input
+static inline float processValue(uint32_t i) {
+    return 30.0f + (i & 1023) * 0.01f - ((i >> 3) & 7) * 0.05f;
+}
+
+static float legacyCost() {
+    double input = 0, output = 0, setpoint = 37.0;
+    LegacyPID pid(&input, &output, &setpoint, 2.0, 0.5, 1.0);
+    volatile double sink = 0;
+
+    uint32_t start = counter();
+    for (uint32_t i = 0; i < ITERATIONS; i++) {
+        input = processValue(i);
+        pid.compute((i + 1) * 100UL);
+        sink = output;
+    }
+    uint32_t elapsed = counter() - start;
+    (void)sink;
+    return (float)elapsed / ITERATIONS;
+}
+
+static float floatCost() {
+    PIDController<> pid(2.0f, 0.5f, 1.0f);
+    pid.setOutputLimits(0, 255);
+    pid.setSetpoint(37.0f);
+    pid.setMode(PIDController<>::Mode::AUTOMATIC, 30.0f);
+    volatile float sink = 0;
+
+    uint32_t start = counter();
+    for (uint32_t i = 0; i < ITERATIONS; i++) {
+        sink = pid.compute(processValue(i), 0.1f);
+    }
+    uint32_t elapsed = counter() - start;
+    (void)sink;
+    return (float)elapsed / ITERATIONS;
+}
+
+void test_compute_cost() {
+    startCounter();
+    float legacy = legacyCost();
+    float current = floatCost();
+
+    char line[96];
+#ifdef ARDUINO_ARCH_SAMD
+    snprintf(line, sizeof(line), "PID_v1 %.0f cycles/call, PIDController<float> %.0f cycles/call", legacy, current);
+#else
+    snprintf(line, sizeof(line), "PID_v1 %.1f ns/call, PIDController<float> %.1f ns/call", legacy, current);
+#endif
+    TEST_MESSAGE(line);
+    TEST_ASSERT_GREATER_THAN(0, current);
+}
+
+static int runTests() {
+    UNITY_BEGIN();
+    RUN_TEST(test_compute_cost);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO_ARCH_SAMD
+void setup() {
+    delay(2000);    // Let the host open the serial port
+    runTests();
+}
+
+void loop() {}
+#else
+int main(int argc, char** argv) {
+    return runTests();
+}
+#endif
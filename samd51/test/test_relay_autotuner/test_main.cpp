@@ -0,0 +1,216 @@
+// RelayAutotuner on an integrator with dead time, whose relay cycle is
+// known in closed form: Pu and the amplitude it measures, the Ku taken
+// from them, the cycles record() will not accept, the failures, and the
+// gain rules applied to the result
+//
+//   pio test -e native -f test_relay_autotuner
+
+#include <unity.h>
+#include <math.h>
+#include "controllers/controller_manager.h"
+
+// A level or pH-like process: the value moves at RATE per unit of output
+// above NEUTRAL, DELAY after the output changes. Sampled every 100 ms.
+static const uint32_t SAMPLE_MS = 100;
+static const float RATE = 0.01f;            // Process units per s per output unit
+static const float DELAY = 20.0f;           // s
+static const float NEUTRAL = 50.0f;
+static const float SETPOINT = 10.0f;
+static const float RELAY = 10.0f;           // Relay amplitude d
+static const float HYSTERESIS = 0.2f;
+
+class Plant {
+public:
+    explicit Plant(float neutral = NEUTRAL, float rate = RATE) : neutral(neutral), rate(rate) {
+        setDelay(DELAY);
+    }
+
+    void setDelay(float seconds) { delaySamples = (uint16_t)(seconds * 1000 / SAMPLE_MS); }
+
+    float step(float u) {
+        history[head] = u;
+        float delayed = history[(head + HISTORY - delaySamples) % HISTORY];
+        head = (head + 1) % HISTORY;
+        y += rate * (delayed - neutral) * SAMPLE_MS / 1000.0f;
+        return y;
+    }
+
+    float y = SETPOINT - 1.0f;
+
+private:
+    static const uint16_t HISTORY = 1024;
+    float history[HISTORY] = {};
+    uint16_t head = 0;
+    uint16_t delaySamples = 0;
+    float neutral;
+    float rate;
+};
+
+// Relay half-cycles last DELAY plus the time to cross the hysteresis band
+static const float EXPECTED_PERIOD = 4 * DELAY + 4 * HYSTERESIS / (RATE * RELAY);
+static const float EXPECTED_AMPLITUDE = HYSTERESIS + RATE * RELAY * DELAY;
+
+static void startTune(RelayAutotuner& tuner, uint32_t timeoutMs, bool reverse = false) {
+    tuner.start(SETPOINT, NEUTRAL, RELAY, HYSTERESIS, 0, 100, reverse, timeoutMs, 0);
+}
+
+// Run until the tune ends or limitMs passes; returns the time it took
+static uint32_t run(RelayAutotuner& tuner, Plant& plant, uint32_t limitMs, bool reverse = false) {
+    float u = NEUTRAL;
+    uint32_t now = 0;
+    for (; now < limitMs && tuner.isRunning(); now += SAMPLE_MS) {
+        float y = plant.step(u);
+        u = tuner.update(reverse ? 2 * SETPOINT - y : y, now);
+    }
+    return now;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_gain_rules() {
+    const float ku = 2.0f, pu = 100.0f;
+    struct Expected {
+        RelayAutotuner::Rule rule;
+        float kp, ti, td;
+    };
+    const Expected TABLE[] = {
+        {RelayAutotuner::Rule::ZIEGLER_NICHOLS,    0.6f * ku,  0.5f * pu,  pu / 8},
+        {RelayAutotuner::Rule::ZIEGLER_NICHOLS_PI, 0.45f * ku, pu / 1.2f,  0},
+        {RelayAutotuner::Rule::TYREUS_LUYBEN,      ku / 2.2f,  2.2f * pu,  pu / 6.3f},
+        {RelayAutotuner::Rule::PESSEN_INTEGRAL,    0.7f * ku,  0.4f * pu,  0.15f * pu},
+        {RelayAutotuner::Rule::SOME_OVERSHOOT,     ku / 3,     0.5f * pu,  pu / 3},
+        {RelayAutotuner::Rule::NO_OVERSHOOT,       0.2f * ku,  0.5f * pu,  pu / 3},
+    };
+    for (const Expected& expected : TABLE) {
+        RelayAutotuner::Gains gains = RelayAutotuner::gainsFor(expected.rule, ku, pu);
+        TEST_ASSERT_FLOAT_WITHIN(1e-5f, expected.kp, gains.kp);
+        TEST_ASSERT_FLOAT_WITHIN(1e-6f, expected.kp / expected.ti, gains.ki);
+        TEST_ASSERT_FLOAT_WITHIN(1e-4f, expected.kp * expected.td, gains.kd);
+    }
+
+    // A period of zero gives no integral action rather than a division by zero
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, RelayAutotuner::gainsFor(RelayAutotuner::Rule::ZIEGLER_NICHOLS, ku, 0).ki);
+}
+
+void test_measures_the_limit_cycle() {
+    RelayAutotuner tuner;
+    Plant plant;
+    startTune(tuner, 3600000);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, tuner.getGains(RelayAutotuner::Rule::ZIEGLER_NICHOLS).kp);
+
+    run(tuner, plant, 3600000);
+    TEST_ASSERT_EQUAL(RelayAutotuner::State::COMPLETE, tuner.getState());
+    // The approach, then CONSISTENT_CYCLES that agree
+    TEST_ASSERT_EQUAL(1 + RelayAutotuner::CONSISTENT_CYCLES, tuner.getCycles());
+    TEST_ASSERT_FLOAT_WITHIN(EXPECTED_PERIOD * 0.01f, EXPECTED_PERIOD, tuner.getUltimatePeriod());
+    TEST_ASSERT_FLOAT_WITHIN(EXPECTED_AMPLITUDE * 0.02f, EXPECTED_AMPLITUDE, tuner.getAmplitude());
+
+    float a = tuner.getAmplitude();
+    float ku = 4 * RELAY / (PI * sqrtf(a * a - HYSTERESIS * HYSTERESIS));
+    TEST_ASSERT_FLOAT_WITHIN(ku * 1e-4f, ku, tuner.getUltimateGain());
+
+    RelayAutotuner::Gains gains = tuner.getGains(RelayAutotuner::Rule::TYREUS_LUYBEN);
+    RelayAutotuner::Gains expected = RelayAutotuner::gainsFor(RelayAutotuner::Rule::TYREUS_LUYBEN,
+                                                              tuner.getUltimateGain(), tuner.getUltimatePeriod());
+    TEST_ASSERT_EQUAL_FLOAT(expected.kp, gains.kp);
+    TEST_ASSERT_EQUAL_FLOAT(expected.ki, gains.ki);
+    TEST_ASSERT_EQUAL_FLOAT(expected.kd, gains.kd);
+}
+
+// A reverse-acting loop (cooling, acid dosing) gives the same cycle
+void test_reverse_acting() {
+    RelayAutotuner tuner;
+    Plant plant;
+    startTune(tuner, 3600000, true);
+    run(tuner, plant, 3600000, true);
+    TEST_ASSERT_EQUAL(RelayAutotuner::State::COMPLETE, tuner.getState());
+    TEST_ASSERT_FLOAT_WITHIN(EXPECTED_PERIOD * 0.01f, EXPECTED_PERIOD, tuner.getUltimatePeriod());
+    TEST_ASSERT_FLOAT_WITHIN(EXPECTED_AMPLITUDE * 0.02f, EXPECTED_AMPLITUDE, tuner.getAmplitude());
+}
+
+// A load the starting bias does not match makes the half-periods unequal;
+// the bias is walked over to it and the cycle measured from there
+void test_bias_follows_the_load() {
+    RelayAutotuner tuner;
+    Plant plant(NEUTRAL + 3.0f);
+    startTune(tuner, 3600000);
+    run(tuner, plant, 3600000);
+    TEST_ASSERT_EQUAL(RelayAutotuner::State::COMPLETE, tuner.getState());
+    TEST_ASSERT_FLOAT_WITHIN(0.3f, NEUTRAL + 3.0f, tuner.getBias());
+    TEST_ASSERT_FLOAT_WITHIN(EXPECTED_PERIOD * RelayAutotuner::TOLERANCE, EXPECTED_PERIOD, tuner.getUltimatePeriod());
+}
+
+// record() only takes cycles that agree: with the dead time changing
+// every cycle the tune runs out of cycles well before its timeout
+void test_inconsistent_cycles_are_not_recorded() {
+    RelayAutotuner tuner;
+    Plant plant;
+    startTune(tuner, 12UL * 3600000);
+
+    float u = NEUTRAL;
+    bool wasHigh = false;
+    bool longDelay = false;
+    uint32_t now = 0;
+    for (; tuner.isRunning() && now < 12UL * 3600000; now += SAMPLE_MS) {
+        bool high = u > NEUTRAL;
+        if (high && !wasHigh) {
+            longDelay = !longDelay;
+            plant.setDelay(longDelay ? 1.5f * DELAY : DELAY);
+        }
+        wasHigh = high;
+        u = tuner.update(plant.step(u), now);
+    }
+    TEST_ASSERT_EQUAL(RelayAutotuner::State::FAILED, tuner.getState());
+    TEST_ASSERT_EQUAL(RelayAutotuner::Failure::TIMEOUT, tuner.getFailure());
+    TEST_ASSERT_EQUAL(RelayAutotuner::MAX_CYCLES, tuner.getCycles());
+    TEST_ASSERT_LESS_THAN(3600000UL, now);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, tuner.getUltimateGain());
+}
+
+// Too short a timeout for the cycles to settle
+void test_timeout() {
+    RelayAutotuner tuner;
+    Plant plant;
+    uint32_t timeout = (uint32_t)(3 * EXPECTED_PERIOD * 1000);
+    startTune(tuner, timeout);
+    uint32_t took = run(tuner, plant, 3600000);
+    TEST_ASSERT_EQUAL(RelayAutotuner::Failure::TIMEOUT, tuner.getFailure());
+    TEST_ASSERT_LESS_THAN(RelayAutotuner::MAX_CYCLES, tuner.getCycles());
+    TEST_ASSERT_UINT32_WITHIN(2 * SAMPLE_MS, timeout, took);
+    TEST_ASSERT_EQUAL_FLOAT(NEUTRAL, tuner.update(SETPOINT, took));
+}
+
+// An output that does not move the process (a pump with no reagent) is
+// given up on after half the timeout
+void test_no_oscillation() {
+    RelayAutotuner tuner;
+    Plant plant(NEUTRAL, 0.0f);
+    startTune(tuner, 600000);
+    uint32_t took = run(tuner, plant, 3600000);
+    TEST_ASSERT_EQUAL(RelayAutotuner::Failure::NO_OSCILLATION, tuner.getFailure());
+    TEST_ASSERT_UINT32_WITHIN(2 * SAMPLE_MS, 300000, took);
+}
+
+// The pressure loop has no transducer or valve yet; the tune is refused
+// and the link NACKs it
+void test_pressure_loop_refused() {
+    SensorManager sensors;
+    ControllerManager controllers(sensors);
+    TEST_ASSERT_FALSE(controllers.startAutotune(ControllerManager::TUNED_PRESSURE, RelayAutotuner::Rule::ZIEGLER_NICHOLS));
+    TEST_ASSERT_FALSE(controllers.isAutotuning(ControllerManager::TUNED_PRESSURE));
+    TEST_ASSERT_TRUE(controllers.startAutotune(ControllerManager::TUNED_TEMPERATURE, RelayAutotuner::Rule::ZIEGLER_NICHOLS));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_gain_rules);
+    RUN_TEST(test_measures_the_limit_cycle);
+    RUN_TEST(test_reverse_acting);
+    RUN_TEST(test_bias_follows_the_load);
+    RUN_TEST(test_inconsistent_cycles_are_not_recorded);
+    RUN_TEST(test_timeout);
+    RUN_TEST(test_no_oscillation);
+    RUN_TEST(test_pressure_loop_refused);
+    return UNITY_END();
+}
@@ -0,0 +1,74 @@
+// PT100 code table against the closed-form Callendar-Van Dusen curve
+//
+//   pio test -e native -f test_rtd_conversion
+
+#include <unity.h>
+#include <math.h>
+#include "sensors/rtd_conversion.h"
+
+using namespace PT100Conversion;
+
+void setUp() {}
+void tearDown() {}
+
+// First code at or above a temperature
+static uint32_t codeAt(double t) {
+    return (uint32_t)ceil(resistanceAt(t) * ADC_FULL_SCALE / R_REF);
+}
+
+// Largest |table - closed form| over every code in [from, to] °C
+static double maxTableError(double from, double to) {
+    double worst = 0;
+    for (uint32_t code = codeAt(from); code <= codeAt(to) && code < ADC_FULL_SCALE; code++) {
+        double exact = temperatureFromResistance(codeToResistance(code));
+        double error = fabs(codeToTemperature((uint16_t)code) - exact);
+        if (error > worst) worst = error;
+    }
+    return worst;
+}
+
+// IEC 60751 table values
+void test_curve_matches_standard() {
+    TEST_ASSERT_DOUBLE_WITHIN(1e-9, 100.0, resistanceAt(0));
+    TEST_ASSERT_DOUBLE_WITHIN(0.0001, 138.5055, resistanceAt(100));
+    TEST_ASSERT_DOUBLE_WITHIN(0.0001, 175.8560, resistanceAt(200));
+    TEST_ASSERT_DOUBLE_WITHIN(0.0001, 60.2558, resistanceAt(-100));
+    TEST_ASSERT_DOUBLE_WITHIN(0.0001, 18.5201, resistanceAt(-200));
+}
+
+void test_inverse_round_trips() {
+    for (double t = -200; t <= 850; t += 0.5) {
+        TEST_ASSERT_DOUBLE_WITHIN(1e-6, t, temperatureFromResistance(resistanceAt(t)));
+    }
+}
+
+void test_table_across_full_range() {
+    TEST_ASSERT_LESS_THAN(0.0015, maxTableError(-200, 850));
+}
+
+void test_table_across_process_range() {
+    TEST_ASSERT_LESS_THAN(0.0007, maxTableError(-50, 150));
+}
+
+void test_table_hits_segment_ends_exactly() {
+    for (uint32_t i = 0; i < TABLE_SEGMENTS; i++) {
+        double exact = temperatureFromResistance(codeToResistance(i * SEGMENT_SIZE));
+        TEST_ASSERT_FLOAT_WITHIN(1e-4, exact, codeToTemperature((uint16_t)(i * SEGMENT_SIZE)));
+    }
+}
+
+void test_top_code_stays_in_table() {
+    TEST_ASSERT_FLOAT_WITHIN(0.002, temperatureFromResistance(codeToResistance(ADC_FULL_SCALE - 1)),
+                             codeToTemperature(ADC_FULL_SCALE - 1));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_curve_matches_standard);
+    RUN_TEST(test_inverse_round_trips);
+    RUN_TEST(test_table_across_full_range);
+    RUN_TEST(test_table_across_process_range);
+    RUN_TEST(test_table_hits_segment_ends_exactly);
+    RUN_TEST(test_top_code_stays_in_table);
+    return UNITY_END();
+}
@@ -0,0 +1,342 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Binary frame format for the SPI link between the SAMD51 (slave) and the
+// RP2040 (master). Both firmwares include this header so the layout can
+// only change in one place.
+//
+// Every SPI transaction exchanges exactly one FRAME_SIZE frame in each
+// direction:
+//
+//   offset 0  sync      0xA5
+//          1  version   PROTOCOL_VERSION
+//          2  type      MessageType
+//          3  sequence  per-sender counter, wraps at 255; RP2040 commands
+//                       take theirs from a second counter (see below)
+//          4  length    payload bytes that follow the header
+//          5  session   RP2040 commands: a number picked at boot (see
+//                       below); 0 in every other frame
+//          6  payload   fixed-layout struct, zero padded to MAX_PAYLOAD
+//         62  crc       CRC-16/CCITT-FALSE over bytes 0..61, little endian
+//
+// The RP2040's polls wrap the sequence every few seconds, so commands are
+// numbered from a counter of their own: the SAMD51 recognises a
+// retransmission by type, sequence and session matching the last command
+// it applied, and consecutive commands must never collide on those. The
+// command counter restarts when the RP2040 reboots, which the SAMD51 does
+// not see; the session, random and never 0, keeps the first command after
+// a reboot from matching the last one before it.
+//
+// Payloads are packed little-endian structs; both MCUs are little-endian
+// Cortex-M parts so they are copied in and out with memcpy.
+namespace LinkProtocol {
+    constexpr uint8_t SYNC = 0xA5;
+    constexpr uint8_t PROTOCOL_VERSION = 2;
+    constexpr size_t FRAME_SIZE = 64;
+    constexpr size_t HEADER_SIZE = 6;
+    constexpr size_t CRC_SIZE = 2;
+    constexpr size_t MAX_PAYLOAD = FRAME_SIZE - HEADER_SIZE - CRC_SIZE;
+
+    enum MessageType : uint8_t {
+        MSG_IDLE = 0,          // Nothing to say; keeps the clock running
+        MSG_SNAPSHOT = 1,      // SAMD51 -> RP2040
+        MSG_SETPOINTS = 2,     // RP2040 -> SAMD51
+        MSG_MODE_CHANGE = 3,   // RP2040 -> SAMD51
+        MSG_CALIBRATION = 4,   // RP2040 -> SAMD51
+        MSG_ALARM = 5,         // SAMD51 -> RP2040
+        MSG_ACK = 6,           // Either direction
+        MSG_AUTOTUNE = 7,      // RP2040 -> SAMD51
+        MSG_AUTOTUNE_STATUS = 8  // SAMD51 -> RP2040
+    };
+
+    enum ControlLoop : uint8_t {
+        LOOP_TEMPERATURE = 0,
+        LOOP_PH = 1,
+        LOOP_DISSOLVED_OXYGEN = 2,
+        LOOP_STIRRING = 3,
+        LOOP_FEEDING = 4,
+        LOOP_PRESSURE = 5
+    };
+
+    enum ControlMode : uint8_t {
+        MODE_OFF = 0,
+        MODE_AUTO = 1,
+        MODE_MANUAL = 2
+    };
+
+    enum AckStatus : uint8_t {
+        ACK_OK = 0,
+        ACK_REJECTED = 1,
+        ACK_UNSUPPORTED = 2
+    };
+
+    enum AutotuneAction : uint8_t {
+        AUTOTUNE_START = 0,
+        AUTOTUNE_ABORT = 1
+    };
+
+    // Same order as RelayAutotuner::Rule on the SAMD51
+    enum AutotuneRule : uint8_t {
+        RULE_ZIEGLER_NICHOLS = 0,
+        RULE_ZIEGLER_NICHOLS_PI = 1,
+        RULE_TYREUS_LUYBEN = 2,
+        RULE_PESSEN_INTEGRAL = 3,
+        RULE_SOME_OVERSHOOT = 4,
+        RULE_NO_OVERSHOOT = 5
+    };
+
+    // Same order as RelayAutotuner::State and RelayAutotuner::Failure
+    enum AutotuneState : uint8_t {
+        AUTOTUNE_IDLE = 0,
+        AUTOTUNE_RUNNING = 1,
+        AUTOTUNE_COMPLETE = 2,
+        AUTOTUNE_FAILED = 3
+    };
+
+    enum AutotuneFailure : uint8_t {
+        AUTOTUNE_FAILURE_NONE = 0,
+        AUTOTUNE_FAILURE_TIMEOUT = 1,
+        AUTOTUNE_FAILURE_NO_OSCILLATION = 2,
+        AUTOTUNE_FAILURE_ABORTED = 3
+    };
+
+    // Bits in Snapshot::validMask
+    enum SnapshotValid : uint16_t {
+        VALID_PH = 1 << 0,
+        VALID_DISSOLVED_OXYGEN = 1 << 1,
+        VALID_TEMPERATURE = 1 << 2,
+        VALID_PRESSURE = 1 << 3,
+        VALID_BIOMASS = 1 << 4,
+        VALID_PT100_1 = 1 << 5,
+        VALID_PT100_2 = 1 << 6,
+        VALID_PT100_3 = 1 << 7
+    };
+
+    // Bits in Snapshot::statusFlags
+    enum SnapshotStatus : uint16_t {
+        STATUS_SYSTEM_SAFE = 1 << 0,
+        STATUS_HEATER_ON = 1 << 1,
+        STATUS_STIRRER_ON = 1 << 2,
+        STATUS_PUMP_ON = 1 << 3
+    };
+
+    // Alarm::code values
+    enum AlarmCode : uint16_t {
+        ALARM_SAFETY_INTERLOCK = 1,        // Safety manager shut the controllers down
+        ALARM_ACID_RESERVOIR_EMPTY = 2,    // pH dosing is out of acid; value is mL left
+        ALARM_BASE_RESERVOIR_EMPTY = 3     // pH dosing is out of base; value is mL left
+    };
+
+#pragma pack(push, 1)
+    struct FrameHeader {
+        uint8_t sync;
+        uint8_t version;
+        uint8_t type;
+        uint8_t sequence;
+        uint8_t length;
+        uint8_t session;
+    };
+
+    struct Snapshot {
+        uint32_t timestamp;        // SAMD51 millis() of the sensor sweep
+        float ph;
+        float dissolvedOxygen;     // % saturation
+        float temperature;         // °C, controller input
+        float pressure;
+        float biomass;
+        float pt100[3];            // °C
+        float stirrerSpeed;        // RPM
+        float heaterOutput;        // PWM duty, 0-4095
+        uint16_t validMask;
+        uint16_t statusFlags;
+    };
+
+    struct Setpoints {
+        float ph;
+        float dissolvedOxygen;
+        float temperature;
+        float pressure;
+        float stirrerSpeed;
+        int32_t pumpSpeed;
+    };
+
+    struct ModeChange {
+        uint8_t loop;              // ControlLoop
+        uint8_t mode;              // ControlMode
+        float manualOutput;        // Used when mode == MODE_MANUAL
+    };
+
+    struct Calibration {
+        uint8_t sensor;
+        uint8_t action;
+        float value;
+    };
+
+    struct Alarm {
+        uint32_t timestamp;
+        uint16_t code;
+        uint8_t severity;
+        uint8_t active;
+        float value;
+    };
+
+    struct AutotuneCommand {
+        uint8_t loop;              // ControlLoop
+        uint8_t action;            // AutotuneAction
+        uint8_t rule;              // AutotuneRule, for AUTOTUNE_START
+        float amplitude;           // Relay swing, fraction of the output range; 0 for the loop default
+        float hysteresis;          // Process units; 0 for the loop default
+    };
+
+    // Sent when a tune starts, completes a cycle and ends
+    struct AutotuneStatus {
+        uint32_t timestamp;        // SAMD51 millis()
+        uint8_t loop;              // ControlLoop
+        uint8_t state;             // AutotuneState
+        uint8_t rule;              // AutotuneRule
+        uint8_t cycles;            // Relay cycles so far
+        uint8_t failure;           // AutotuneFailure
+        float setpoint;
+        float ultimateGain;        // Output units per process unit; 0 until complete
+        float ultimatePeriod;      // s
+        float amplitude;           // Process units
+        float kp;                  // Applied and stored gains; 0 unless complete
+        float ki;
+        float kd;
+    };
+
+    struct Ack {
+        uint8_t type;              // MessageType being acknowledged
+        uint8_t sequence;          // Its sequence number
+        uint8_t status;            // AckStatus
+    };
+#pragma pack(pop)
+
+    static_assert(sizeof(FrameHeader) == HEADER_SIZE, "FrameHeader layout changed");
+    static_assert(sizeof(Snapshot) <= MAX_PAYLOAD, "Snapshot does not fit in a frame");
+    static_assert(sizeof(Setpoints) <= MAX_PAYLOAD, "Setpoints does not fit in a frame");
+    static_assert(sizeof(ModeChange) <= MAX_PAYLOAD, "ModeChange does not fit in a frame");
+    static_assert(sizeof(Calibration) <= MAX_PAYLOAD, "Calibration does not fit in a frame");
+    static_assert(sizeof(Alarm) <= MAX_PAYLOAD, "Alarm does not fit in a frame");
+    static_assert(sizeof(Ack) <= MAX_PAYLOAD, "Ack does not fit in a frame");
+    static_assert(sizeof(AutotuneCommand) <= MAX_PAYLOAD, "AutotuneCommand does not fit in a frame");
+    static_assert(sizeof(AutotuneStatus) <= MAX_PAYLOAD, "AutotuneStatus does not fit in a frame");
+
+    enum DecodeResult : uint8_t {
+        DECODE_OK = 0,
+        DECODE_EMPTY,          // Bus idle (all 0x00 or 0xFF)
+        DECODE_BAD_SYNC,
+        DECODE_BAD_VERSION,
+        DECODE_BAD_LENGTH,
+        DECODE_BAD_CRC
+    };
+
+    // CRC-16/CCITT-FALSE: poly 0x1021, init 0xFFFF, no reflection
+    inline uint16_t crc16(const uint8_t* data, size_t length) {
+        uint16_t crc = 0xFFFF;
+        for (size_t i = 0; i < length; i++) {
+            crc ^= (uint16_t)data[i] << 8;
+            for (uint8_t bit = 0; bit < 8; bit++) {
+                crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+            }
+        }
+        return crc;
+    }
+
+    // Build a complete frame; always writes FRAME_SIZE bytes
+    inline size_t encodeFrame(uint8_t* frame, uint8_t type, uint8_t sequence,
+                              const void* payload, uint8_t length, uint8_t session = 0) {
+        if (length > MAX_PAYLOAD) {
+            length = 0;
+            type = MSG_IDLE;
+        }
+
+        FrameHeader header = {SYNC, PROTOCOL_VERSION, type, sequence, length, session};
+        memcpy(frame, &header, HEADER_SIZE);
+        memset(frame + HEADER_SIZE, 0, MAX_PAYLOAD);
+        if (length) {
+            memcpy(frame + HEADER_SIZE, payload, length);
+        }
+
+        uint16_t crc = crc16(frame, FRAME_SIZE - CRC_SIZE);
+        frame[FRAME_SIZE - 2] = crc & 0xFF;
+        frame[FRAME_SIZE - 1] = crc >> 8;
+        return FRAME_SIZE;
+    }
+
+    template <typename T>
+    size_t encode(uint8_t* frame, MessageType type, uint8_t sequence, const T& payload) {
+        static_assert(sizeof(T) <= MAX_PAYLOAD, "Payload does not fit in a frame");
+        return encodeFrame(frame, type, sequence, &payload, sizeof(T));
+    }
+
+    inline size_t encodeIdle(uint8_t* frame, uint8_t sequence) {
+        return encodeFrame(frame, MSG_IDLE, sequence, nullptr, 0);
+    }
+
+    // Validate a received frame and extract its header
+    inline DecodeResult decodeFrame(const uint8_t* frame, FrameHeader& header) {
+        if (frame[0] != SYNC) {
+            bool idle = true;
+            for (size_t i = 0; i < HEADER_SIZE && idle; i++) {
+                idle = frame[i] == 0x00 || frame[i] == 0xFF;
+            }
+            return idle ? DECODE_EMPTY : DECODE_BAD_SYNC;
+        }
+
+        memcpy(&header, frame, HEADER_SIZE);
+        if (header.version != PROTOCOL_VERSION) return DECODE_BAD_VERSION;
+        if (header.length > MAX_PAYLOAD) return DECODE_BAD_LENGTH;
+
+        uint16_t crc = crc16(frame, FRAME_SIZE - CRC_SIZE);
+        uint16_t received = frame[FRAME_SIZE - 2] | ((uint16_t)frame[FRAME_SIZE - 1] << 8);
+        return crc == received ? DECODE_OK : DECODE_BAD_CRC;
+    }
+
+    // Copy the payload of a decoded frame into T if its length matches
+    template <typename T>
+    bool decodePayload(const uint8_t* frame, const FrameHeader& header, T& payload) {
+        if (header.length != sizeof(T)) return false;
+        memcpy(&payload, frame + HEADER_SIZE, sizeof(T));
+        return true;
+    }
+
+    // Counts frames lost between two received sequence numbers
+    class SequenceTracker {
+    public:
+        // Returns the number of frames skipped since the previous one.
+        // A repeated sequence number is a retransmission and is not a loss.
+        uint8_t update(uint8_t sequence) {
+            uint8_t missed = 0;
+            if (synced_ && sequence == last_) {
+                duplicates_++;
+                return 0;
+            }
+            if (synced_) {
+                missed = (uint8_t)(sequence - last_ - 1);
+                lost_ += missed;
+            }
+            last_ = sequence;
+            synced_ = true;
+            received_++;
+            return missed;
+        }
+
+        // True if sequence is the last one counted: the same frame again
+        bool isRepeat(uint8_t sequence) const { return synced_ && sequence == last_; }
+
+        uint32_t received() const { return received_; }
+        uint32_t lost() const { return lost_; }
+        uint32_t duplicates() const { return duplicates_; }
+
+    private:
+        uint8_t last_ = 0;
+        bool synced_ = false;
+        uint32_t received_ = 0;
+        uint32_t lost_ = 0;
+        uint32_t duplicates_ = 0;
+    };
+}
@@ -0,0 +1,275 @@
+#pragma once
+
+// Arduino API for [env:native] builds. Only what the firmwares use is
+// here; hardware behaviour lives in native_hal.h, which tests and
+// simulators drive directly.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <algorithm>
+#include <string>
+#include "native_hal.h"
+#include "samd51_registers.h"
+
+using std::min;
+using std::max;
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+#define INPUT_PULLDOWN 0x3
+
+#define CHANGE 2
+#define FALLING 3
+#define RISING 4
+
+#define LSBFIRST 0
+#define MSBFIRST 1
+
+#define DEC 10
+#define HEX 16
+#define BIN 2
+
+#define PROGMEM
+#define F(string) (string)
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+
+#define PI 3.1415926535897932384626433832795
+
+// A0 and A1 are the SAMD51 DAC outputs; the numbers only need to be distinct here
+#define A0 14
+#define A1 15
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#define SERIAL_8N1 0x13
+#define SERIAL_8N2 0x33
+#define SERIAL_8E1 0x12
+#define SERIAL_8O1 0x11
+
+inline unsigned long micros() { return (unsigned long)(uint32_t)NativeHal::nowMicros; }
+inline unsigned long millis() { return (unsigned long)(uint32_t)(NativeHal::nowMicros / 1000); }
+inline void delayMicroseconds(unsigned int us) { NativeHal::advance(us); }
+inline void delay(unsigned long ms) { NativeHal::advance((uint64_t)ms * 1000); }
+inline void yield() {}
+
+inline void noInterrupts() { __disable_irq(); }
+inline void interrupts() { __enable_irq(); }
+
+inline void pinMode(uint8_t pin, uint8_t mode) {
+    NativeHal::pinModes[pin] = mode;
+    if (mode == INPUT_PULLUP) NativeHal::pinLevel[pin] = HIGH;
+}
+
+// Chip-select edges select and release the SPI devices attached to the pin
+inline void digitalWrite(uint8_t pin, uint8_t value) {
+    uint8_t level = value ? HIGH : LOW;
+    if (NativeHal::pinLevel[pin] == level) return;
+    NativeHal::pinLevel[pin] = level;
+    for (const NativeHal::SpiAttachment& attachment : NativeHal::spiDevices) {
+        if (attachment.csPin != pin) continue;
+        if (level == LOW) {
+            attachment.device->select();
+        } else {
+            attachment.device->deselect();
+        }
+    }
+}
+
+inline int digitalRead(uint8_t pin) { return NativeHal::pinLevel[pin]; }
+
+inline void analogWriteResolution(int bits) { NativeHal::pwmResolution = bits; }
+inline void analogWrite(uint8_t pin, int value) { NativeHal::pwmValue[pin] = value < 0 ? 0 : value; }
+inline int analogRead(uint8_t pin) { (void)pin; return 0; }
+
+inline int digitalPinToInterrupt(uint8_t pin) { return pin; }
+
+inline void attachInterrupt(int interrupt, void (*isr)(), int mode) {
+    NativeHal::pinIsr[interrupt] = isr;
+    NativeHal::pinIsrMode[interrupt] = mode;
+}
+
+inline void detachInterrupt(int interrupt) {
+    NativeHal::pinIsr[interrupt] = nullptr;
+    NativeHal::pendingPinIsrs &= ~(1ULL << interrupt);
+}
+
+// Deterministic across runs unless randomSeed() is called
+inline uint32_t& nativeRandomState() {
+    static uint32_t state = 2463534242UL;
+    return state;
+}
+
+inline void randomSeed(unsigned long seed) { nativeRandomState() = seed ? seed : 1; }
+
+inline long random(long howBig) {
+    if (howBig <= 0) return 0;
+    uint32_t& x = nativeRandomState();
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x % howBig;
+}
+
+inline long random(long howSmall, long howBig) {
+    return howSmall >= howBig ? howSmall : howSmall + random(howBig - howSmall);
+}
+
+class String {
+public:
+    String(const char* text = "") : value(text ? text : "") {}
+    String(const std::string& text) : value(text) {}
+
+    const char* c_str() const { return value.c_str(); }
+    unsigned int length() const { return value.length(); }
+
+    String& operator+=(const String& other) { value += other.value; return *this; }
+    String& operator+=(const char* other) { value += other; return *this; }
+    String& operator+=(char other) { value += other; return *this; }
+    bool concat(const char* other) { value += other; return true; }
+    bool operator==(const String& other) const { return value == other.value; }
+    bool operator==(const char* other) const { return value == other; }
+    friend String operator+(String left, const String& right) { return left += right; }
+
+private:
+    std::string value;
+};
+
+// What String's operator+ returns on the Arduino cores; ArduinoJson adapts both
+class StringSumHelper : public String {
+public:
+    using String::String;
+};
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t byte) = 0;
+
+    virtual size_t write(const uint8_t* buffer, size_t size) {
+        size_t written = 0;
+        while (size--) written += write(*buffer++);
+        return written;
+    }
+
+    size_t write(const char* text) { return text ? write((const uint8_t*)text, strlen(text)) : 0; }
+    size_t write(const char* buffer, size_t size) { return write((const uint8_t*)buffer, size); }
+
+    virtual int availableForWrite() { return 0; }
+    virtual void flush() {}
+
+    size_t print(const char* text) { return write(text); }
+    size_t print(const String& text) { return write(text.c_str()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int n, int base = DEC) { return print((long)n, base); }
+    size_t print(unsigned int n, int base = DEC) { return print((unsigned long)n, base); }
+    size_t print(long n, int base = DEC) { return base == DEC ? printf("%ld", n) : print((unsigned long)n, base); }
+
+    size_t print(unsigned long n, int base = DEC) {
+        if (base == HEX) return printf("%lX", n);
+        if (base != BIN) return printf("%lu", n);
+        char digits[33];
+        int length = 0;
+        do {
+            digits[length++] = '0' + (n & 1);
+            n >>= 1;
+        } while (n);
+        std::reverse(digits, digits + length);
+        return write((const uint8_t*)digits, length);
+    }
+
+    size_t print(double n, int digits = 2) { return printf("%.*f", digits, n); }
+
+    size_t println() { return write("\r\n"); }
+    template <typename T>
+    size_t println(const T& value) { return print(value) + println(); }
+    template <typename T>
+    size_t println(const T& value, int format) { return print(value, format) + println(); }
+
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+        char buffer[256];
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+        if (length < 0) return 0;
+        return write((const uint8_t*)buffer, std::min((size_t)length, sizeof(buffer) - 1));
+    }
+};
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+};
+
+// USB console; output goes to stdout, input is never available
+class NativeConsole : public Stream {
+public:
+    void begin(unsigned long baud) { (void)baud; }
+    void end() {}
+    operator bool() const { return true; }
+
+    size_t write(uint8_t byte) override { return fputc(byte, stdout) == EOF ? 0 : 1; }
+    size_t write(const uint8_t* buffer, size_t size) override { return fwrite(buffer, 1, size, stdout); }
+    using Print::write;
+    int availableForWrite() override { return 4096; }
+    void flush() override { fflush(stdout); }
+
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+};
+
+// Hardware UART; the far end is whatever UartDevice is attached to port
+class HardwareSerial : public Stream {
+public:
+    NativeHal::UartPort port;
+
+    void begin(unsigned long baud, uint16_t config = SERIAL_8N1) {
+        port.baud = baud;
+        // Start bit, eight data bits, parity and one or two stop bits
+        port.bitsPerChar = 10 + ((config & 0x30) == 0x30 ? 1 : 0) + ((config & 0x03) != 0x03 ? 1 : 0);
+    }
+
+    void end() {}
+    operator bool() const { return true; }
+
+    size_t write(uint8_t byte) override {
+        if (port.peer) port.peer->receive(port, byte, NativeHal::nowMicros);
+        return 1;
+    }
+    using Print::write;
+
+    int availableForWrite() override { return 256; }
+    int available() override { return port.available(NativeHal::nowMicros); }
+    int read() override { return port.read(NativeHal::nowMicros); }
+    int peek() override { return port.peek(NativeHal::nowMicros); }
+};
+
+inline NativeConsole Serial;
+inline HardwareSerial Serial1;
+inline HardwareSerial Serial2;
+inline HardwareSerial Serial3;
+
+// arduino-pico's chip object; the host heap has no fixed size, and the
+// ring oscillator's random bits come from random()
+class NativeRp2040 {
+public:
+    size_t getTotalHeap() const { return 0; }
+    uint32_t hwrand32() { return (uint32_t)random(0x7FFFFFFF); }
+};
+
+inline NativeRp2040 rp2040;
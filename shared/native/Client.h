@@ -0,0 +1,16 @@
+#pragma once
+
+#include "Arduino.h"
+
+// Arduino's abstract TCP client, as libraries written against any network
+// stack take it
+class Client : public Stream {
+public:
+    virtual int connect(const char* host, uint16_t port) = 0;
+    virtual uint8_t connected() = 0;
+    virtual void stop() = 0;
+    virtual operator bool() = 0;
+    virtual int read(uint8_t* buffer, size_t size) = 0;
+    using Stream::read;
+    using Print::write;
+};
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "Arduino.h"
+#include "Client.h"
+#include <deque>
+#include <string>
+#include <vector>
+
+// Ethernet client for [env:native] builds. There is no network: each
+// host and port a test wants to reach is served by a NativeHal::TcpServer
+// stand-in attached with attachTcpServer(), one connection at a time.
+// A connect() nobody answers, or one the server refuses, takes the
+// client's connection timeout of simulated time, as the W5500 does.
+
+namespace NativeHal {
+    class TcpServer {
+    public:
+        virtual ~TcpServer() {}
+
+        // A client is connecting; false refuses it
+        virtual bool accept() { return true; }
+
+        // Bytes the client wrote
+        virtual void receive(const uint8_t* data, size_t length) = 0;
+
+        // The client closed its end
+        virtual void disconnected() {}
+
+        // Server side of the connection
+        void send(const uint8_t* data, size_t length) { toClient.insert(toClient.end(), data, data + length); }
+        void send(const char* text) { send((const uint8_t*)text, strlen(text)); }
+        void close() { open = false; }
+
+        bool open = false;
+        std::deque<uint8_t> toClient;
+        size_t window = 2048;       // Free space the client sees in its socket's send buffer
+    };
+
+    struct TcpRoute {
+        std::string host;
+        uint16_t port;
+        TcpServer* server;
+    };
+
+    inline std::vector<TcpRoute> tcpServers;
+
+    inline void attachTcpServer(const char* host, uint16_t port, TcpServer* server) {
+        tcpServers.push_back({host, port, server});
+    }
+
+    inline TcpServer* findTcpServer(const char* host, uint16_t port) {
+        for (const TcpRoute& route : tcpServers) {
+            if (route.port == port && route.host == host) return route.server;
+        }
+        return nullptr;
+    }
+}
+
+class EthernetClient : public Client {
+public:
+    void setConnectionTimeout(uint16_t timeout) { connectionTimeout = timeout; }
+
+    int connect(const char* host, uint16_t port) override {
+        stop();
+        NativeHal::TcpServer* target = NativeHal::findTcpServer(host, port);
+        if (!target || !target->accept()) {
+            NativeHal::advance((uint64_t)connectionTimeout * 1000);
+            return 0;
+        }
+        server = target;
+        server->open = true;
+        server->toClient.clear();
+        return 1;
+    }
+
+    uint8_t connected() override {
+        return server && (server->open || !server->toClient.empty());
+    }
+
+    void stop() override {
+        if (!server) return;
+        if (server->open) {
+            server->open = false;
+            server->disconnected();
+        }
+        server->toClient.clear();
+        server = nullptr;
+    }
+
+    operator bool() override { return server != nullptr; }
+
+    size_t write(uint8_t byte) override { return write(&byte, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override {
+        if (!server || !server->open) return 0;
+        server->receive(buffer, size);
+        return size;
+    }
+    using Print::write;
+
+    int availableForWrite() override { return server && server->open ? server->window : 0; }
+
+    int available() override { return server ? server->toClient.size() : 0; }
+
+    int read() override {
+        if (!server || server->toClient.empty()) return -1;
+        uint8_t byte = server->toClient.front();
+        server->toClient.pop_front();
+        return byte;
+    }
+
+    int read(uint8_t* buffer, size_t size) override {
+        size_t count = 0;
+        while (count < size && available()) buffer[count++] = read();
+        return count;
+    }
+
+    int peek() override {
+        if (!server || server->toClient.empty()) return -1;
+        return server->toClient.front();
+    }
+
+private:
+    NativeHal::TcpServer* server = nullptr;
+    uint16_t connectionTimeout = 1000;
+};
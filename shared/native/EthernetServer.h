@@ -0,0 +1,15 @@
+#pragma once
+
+#include "Ethernet.h"
+
+// Listening socket for [env:native] builds; nothing ever connects to it
+class EthernetServer {
+public:
+    explicit EthernetServer(uint16_t port) : port(port) {}
+
+    void begin() {}
+    EthernetClient available() { return EthernetClient(); }
+
+private:
+    uint16_t port;
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "Arduino.h"
+
+// FlashStorage_SAMD EEPROM emulation for [env:native] builds, backed by a
+// file on the host (./eeprom.bin unless EEPROMClass::path is changed
+// before first use; an empty path keeps it in RAM only). As on the chip,
+// writes only reach the file on commit(), and a file that was never
+// committed reads as erased flash.
+
+#ifndef EEPROM_EMULATION_SIZE
+#define EEPROM_EMULATION_SIZE 1024
+#endif
+
+class EEPROMClass {
+public:
+    std::string path = "eeprom.bin";
+
+    uint8_t read(int address) {
+        init();
+        return inRange(address, 1) ? data[address] : 0xFF;
+    }
+
+    void write(int address, uint8_t value) {
+        update(address, value);
+    }
+
+    void update(int address, uint8_t value) {
+        init();
+        if (!inRange(address, 1) || data[address] == value) return;
+        data[address] = value;
+        dirty = true;
+        if (commitASAP) commit();
+    }
+
+    template <typename T>
+    T& get(int address, T& value) {
+        init();
+        if (inRange(address, sizeof(T))) memcpy((void*)&value, data + address, sizeof(T));
+        return value;
+    }
+
+    template <typename T>
+    const T& put(int address, const T& value) {
+        init();
+        if (!inRange(address, sizeof(T))) return value;
+        if (memcmp(data + address, &value, sizeof(T)) != 0) {
+            memcpy(data + address, &value, sizeof(T));
+            dirty = true;
+        }
+        if (commitASAP) commit();
+        return value;
+    }
+
+    void commit() {
+        init();
+        if (!dirty) return;
+        if (!path.empty()) {
+            FILE* file = fopen(path.c_str(), "wb");
+            if (!file) return;
+            fwrite(data, 1, sizeof(data), file);
+            fclose(file);
+        }
+        dirty = false;
+        valid = true;
+        commits++;
+    }
+
+    // True once the emulated flash holds committed data
+    bool isValid() {
+        init();
+        return valid;
+    }
+
+    void setCommitASAP(bool value = true) { commitASAP = value; }
+    bool getCommitASAP() const { return commitASAP; }
+    uint16_t length() const { return EEPROM_EMULATION_SIZE; }
+
+    uint32_t getCommits() const { return commits; }
+
+private:
+    uint8_t data[EEPROM_EMULATION_SIZE];
+    bool initialized = false;
+    bool valid = false;
+    bool dirty = false;
+    bool commitASAP = true;
+    uint32_t commits = 0;
+
+    bool inRange(int address, size_t size) const {
+        return address >= 0 && (size_t)address + size <= sizeof(data);
+    }
+
+    void init() {
+        if (initialized) return;
+        initialized = true;
+        memset(data, 0xFF, sizeof(data));
+        FILE* file = path.empty() ? nullptr : fopen(path.c_str(), "rb");
+        if (file) {
+            valid = fread(data, 1, sizeof(data), file) == sizeof(data);
+            fclose(file);
+        }
+    }
+};
+
+inline EEPROMClass EEPROM;
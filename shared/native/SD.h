@@ -0,0 +1,150 @@
+#pragma once
+
+#include "Arduino.h"
+#include <memory>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+
+// SD card backed by a directory on the host, ./sd unless SDClass::root is
+// changed before begin(). Files written here can be inspected or fed to the
+// host-side tools directly.
+
+// Open flags as arduino-libraries/SD takes them; it has no stdio modes
+#ifndef O_READ
+#define O_READ   ((uint8_t)0x01)
+#define O_WRITE  ((uint8_t)0x02)
+#define O_APPEND ((uint8_t)0x04)
+#define O_CREAT  ((uint8_t)0x10)
+#define O_TRUNC  ((uint8_t)0x40)
+#endif
+
+#define FILE_READ O_READ
+#define FILE_WRITE (O_READ | O_WRITE | O_CREAT | O_APPEND)
+
+class File : public Stream {
+public:
+    File() {}
+    File(FILE* handle, const std::string& path)
+        : handle(handle, fclose), path(path) {}
+
+    explicit operator bool() const { return handle != nullptr; }
+
+    size_t write(uint8_t byte) override { return write(&byte, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override {
+        return handle ? fwrite(buffer, 1, size, handle.get()) : 0;
+    }
+    using Print::write;
+
+    int read() override {
+        uint8_t byte;
+        return read(&byte, 1) == 1 ? byte : -1;
+    }
+
+    int read(uint8_t* buffer, size_t size) {
+        return handle ? fread(buffer, 1, size, handle.get()) : 0;
+    }
+
+    int peek() override {
+        if (!handle) return -1;
+        int c = fgetc(handle.get());
+        if (c != EOF) ungetc(c, handle.get());
+        return c == EOF ? -1 : c;
+    }
+
+    int available() override {
+        if (!handle) return 0;
+        long remaining = (long)size() - (long)position();
+        return remaining > 0 ? remaining : 0;
+    }
+
+    void flush() override {
+        if (handle) fflush(handle.get());
+    }
+
+    bool seek(uint32_t position) {
+        return handle && fseek(handle.get(), position, SEEK_SET) == 0;
+    }
+
+    uint32_t position() const {
+        return handle ? ftell(handle.get()) : 0;
+    }
+
+    uint32_t size() const {
+        if (!handle) return 0;
+        fflush(handle.get());
+        struct stat info;
+        return fstat(fileno(handle.get()), &info) == 0 ? info.st_size : 0;
+    }
+
+    void close() { handle.reset(); }
+
+    const char* name() const {
+        size_t slash = path.rfind('/');
+        return path.c_str() + (slash == std::string::npos ? 0 : slash + 1);
+    }
+
+private:
+    // Copies share the handle, as copies of an SD File do
+    std::shared_ptr<FILE> handle;
+    std::string path;
+};
+
+class SDClass {
+public:
+    std::string root = "sd";
+
+    bool begin(uint8_t csPin = 0) {
+        (void)csPin;
+        ::mkdir(root.c_str(), 0777);
+        struct stat info;
+        ready = stat(root.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+        return ready;
+    }
+
+    // FILE_WRITE appends and can read back; O_WRITE without O_APPEND
+    // writes in place, as on the card
+    File open(const char* path, uint8_t mode = FILE_READ) {
+        if (!ready) return File();
+        std::string full = hostPath(path);
+        const char* stdioMode = "rb";
+        if (mode & O_WRITE) {
+            struct stat info;
+            bool exists = stat(full.c_str(), &info) == 0;
+            if (!exists && !(mode & O_CREAT)) return File();
+            if (mode & O_APPEND) {
+                stdioMode = "a+b";
+            } else {
+                stdioMode = exists && !(mode & O_TRUNC) ? "r+b" : "w+b";
+            }
+        }
+        FILE* handle = fopen(full.c_str(), stdioMode);
+        return handle ? File(handle, full) : File();
+    }
+
+    bool exists(const char* path) {
+        struct stat info;
+        return ready && stat(hostPath(path).c_str(), &info) == 0;
+    }
+
+    bool mkdir(const char* path) {
+        return ready && ::mkdir(hostPath(path).c_str(), 0777) == 0;
+    }
+
+    bool remove(const char* path) {
+        return ready && ::unlink(hostPath(path).c_str()) == 0;
+    }
+
+    bool rmdir(const char* path) {
+        return ready && ::rmdir(hostPath(path).c_str()) == 0;
+    }
+
+private:
+    bool ready = false;
+
+    std::string hostPath(const char* path) const {
+        return root + (path[0] == '/' ? "" : "/") + path;
+    }
+};
+
+inline SDClass SD;
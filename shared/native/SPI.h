@@ -0,0 +1,109 @@
+#pragma once
+
+#include "Arduino.h"
+
+#define SPI_MODE0 0x00
+#define SPI_MODE1 0x04
+#define SPI_MODE2 0x08
+#define SPI_MODE3 0x0C
+
+class SPISettings {
+public:
+    SPISettings(uint32_t clock = 4000000, uint8_t bitOrder = MSBFIRST, uint8_t dataMode = SPI_MODE0)
+        : clock(clock), bitOrder(bitOrder), dataMode(dataMode) {}
+
+    uint32_t clock;
+    uint8_t bitOrder;
+    uint8_t dataMode;
+};
+
+// SPI master. Each byte goes to the SpiDevice attached to this bus whose
+// chip select is low (0xFF comes back when none is) and advances the
+// simulated clock by its time on the wire at the transaction's clock rate.
+// The asynchronous transfers of the RP2040 core complete immediately.
+class SPIClass {
+public:
+    void begin() { started = true; }
+    void end() { started = false; }
+
+    void beginTransaction(const SPISettings& settings) {
+        current = settings;
+        inTransaction = true;
+    }
+
+    void endTransaction() { inTransaction = false; }
+
+    void usingInterrupt(int interrupt) { (void)interrupt; }
+    void notUsingInterrupt(int interrupt) { (void)interrupt; }
+
+    // RP2040 pin assignment
+    bool setSCK(uint8_t pin) { (void)pin; return true; }
+    bool setTX(uint8_t pin) { (void)pin; return true; }
+    bool setRX(uint8_t pin) { (void)pin; return true; }
+
+    uint8_t transfer(uint8_t data) {
+        uint8_t reply = exchange(data);
+        spend(1);
+        return reply;
+    }
+
+    uint16_t transfer16(uint16_t data) {
+        uint16_t high = exchange(data >> 8);
+        uint16_t low = exchange(data & 0xFF);
+        spend(2);
+        return (high << 8) | low;
+    }
+
+    // In place, as on every Arduino core
+    void transfer(void* buffer, size_t count) {
+        uint8_t* bytes = static_cast<uint8_t*>(buffer);
+        for (size_t i = 0; i < count; i++) {
+            bytes[i] = exchange(bytes[i]);
+        }
+        spend(count);
+    }
+
+    // SAMD core block transfer; either buffer may be null
+    void transfer(const void* txBuffer, void* rxBuffer, size_t count, bool block = true) {
+        (void)block;
+        const uint8_t* tx = static_cast<const uint8_t*>(txBuffer);
+        uint8_t* rx = static_cast<uint8_t*>(rxBuffer);
+        for (size_t i = 0; i < count; i++) {
+            uint8_t reply = exchange(tx ? tx[i] : 0xFF);
+            if (rx) rx[i] = reply;
+        }
+        spend(count);
+    }
+
+    // RP2040 core DMA transfer
+    bool transferAsync(const void* txBuffer, void* rxBuffer, size_t count) {
+        transfer(txBuffer, rxBuffer, count, true);
+        return true;
+    }
+
+    bool finishedAsync() { return true; }
+    void abortAsync() {}
+
+    // Bytes exchanged since start-up, for tests that count bus traffic
+    uint32_t getBytesTransferred() const { return bytesTransferred; }
+
+private:
+    SPISettings current;
+    bool started = false;
+    bool inTransaction = false;
+    uint32_t bytesTransferred = 0;
+
+    uint8_t exchange(uint8_t data) {
+        bytesTransferred++;
+        NativeHal::SpiDevice* device = NativeHal::selectedSpiDevice(this);
+        return device ? device->transfer(data) : 0xFF;
+    }
+
+    void spend(size_t count) {
+        uint32_t clock = current.clock ? current.clock : 4000000;
+        NativeHal::advance(((uint64_t)count * 8 * 1000000ULL + clock - 1) / clock);
+    }
+};
+
+inline SPIClass SPI;
+inline SPIClass SPI1;
@@ -0,0 +1,240 @@
+#pragma once
+
+#include "Arduino.h"
+#include "Client.h"
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// arduino-pico WebServer for [env:native] builds. There is no socket: a
+// test hands a NativeHal::HttpRequest to serve() and gets back the bytes
+// the client would have read. Responses are put together the way the
+// real server does it, header block in a String included, so a test can
+// count what a handler costs in heap.
+
+enum HTTPMethod { HTTP_ANY, HTTP_GET, HTTP_HEAD, HTTP_POST, HTTP_PUT, HTTP_PATCH, HTTP_DELETE, HTTP_OPTIONS };
+
+#define CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+#define CONTENT_LENGTH_NOT_SET ((size_t)-2)
+
+class WebServer;
+
+namespace NativeHal {
+    struct HttpRequest {
+        HTTPMethod method;
+        std::string uri;
+        std::vector<std::pair<std::string, std::string>> args;      // "plain" holds the body
+        std::vector<std::pair<std::string, std::string>> headers;
+    };
+
+    // Written to by the server; the client can keep it after the request
+    struct HttpConnection {
+        std::string* response = nullptr;
+        bool open = false;
+    };
+
+    // The server begin() was last called on
+    inline WebServer* webServer = nullptr;
+}
+
+// The connection of the request being served, which a handler may keep
+class WiFiClient : public Client {
+public:
+    WiFiClient() {}
+    explicit WiFiClient(NativeHal::HttpConnection* connection) : connection(connection) {}
+
+    int connect(const char* host, uint16_t port) override {
+        (void)host;
+        (void)port;
+        return 0;
+    }
+    uint8_t connected() override { return connection && connection->open; }
+    void stop() override {
+        if (connection) connection->open = false;
+    }
+    operator bool() override { return connected(); }
+
+    size_t write(uint8_t byte) override { return write(&byte, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override {
+        if (!connected()) return 0;
+        connection->response->append((const char*)buffer, size);
+        return size;
+    }
+    using Print::write;
+    int availableForWrite() override { return connected() ? 2048 : 0; }
+
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int read(uint8_t* buffer, size_t size) override {
+        (void)buffer;
+        (void)size;
+        return 0;
+    }
+    int peek() override { return -1; }
+
+private:
+    NativeHal::HttpConnection* connection = nullptr;
+};
+
+class WebServer {
+public:
+    typedef std::function<void()> Handler;
+
+    explicit WebServer(int port = 80) { (void)port; }
+
+    void begin() { NativeHal::webServer = this; }
+    void handleClient() {}
+
+    void on(const char* uri, HTTPMethod method, Handler handler) {
+        routes.push_back({uri, method, handler});
+    }
+
+    void collectHeaders(const char* headerKeys[], size_t count) {
+        collected.assign(headerKeys, headerKeys + count);
+    }
+
+    // Run the handler for request; the response is appended to response
+    void serve(const NativeHal::HttpRequest& request, std::string& response) {
+        current = &request;
+        connection.response = &response;
+        connection.open = true;
+        contentLength = CONTENT_LENGTH_NOT_SET;
+        chunked = false;
+        responseHeaders = String();
+
+        const Route* route = nullptr;
+        for (const Route& candidate : routes) {
+            if (candidate.uri == request.uri && (candidate.method == HTTP_ANY || candidate.method == request.method)) {
+                route = &candidate;
+                break;
+            }
+        }
+        if (route) {
+            route->handler();
+        } else {
+            send(404, "text/plain", "Not found");
+        }
+        current = nullptr;
+    }
+
+    void send(int code, const char* contentType = nullptr, const String& content = String()) {
+        sendHeaderBlock(code, contentType, content.length());
+        write(content.c_str(), content.length());
+    }
+
+    void send(int code, const char* contentType, const char* content) {
+        size_t length = content ? strlen(content) : 0;
+        sendHeaderBlock(code, contentType, length);
+        write(content, length);
+    }
+
+    void sendHeader(const String& name, const String& value, bool first = false) {
+        String line = name;
+        line += ": ";
+        line += value;
+        line += "\r\n";
+        if (first) {
+            responseHeaders = line + responseHeaders;
+        } else {
+            responseHeaders += line;
+        }
+    }
+
+    void setContentLength(size_t length) { contentLength = length; }
+
+    void sendContent(const char* content, size_t length) {
+        if (chunked) {
+            char size[12];
+            int sizeLength = snprintf(size, sizeof(size), "%zx\r\n", length);
+            write(size, sizeLength);
+        }
+        write(content, length);
+        if (chunked) {
+            write("\r\n", 2);
+            if (length == 0) chunked = false;
+        }
+    }
+    void sendContent(const char* content) { sendContent(content, strlen(content)); }
+    void sendContent(const String& content) { sendContent(content.c_str(), content.length()); }
+
+    String header(const char* name) const { return find(current ? &current->headers : nullptr, name); }
+    bool hasHeader(const char* name) const { return has(current ? &current->headers : nullptr, name); }
+    String arg(const char* name) const { return find(current ? &current->args : nullptr, name); }
+    bool hasArg(const char* name) const { return has(current ? &current->args : nullptr, name); }
+
+    WiFiClient client() { return WiFiClient(&connection); }
+
+private:
+    typedef std::vector<std::pair<std::string, std::string>> Fields;
+
+    struct Route {
+        std::string uri;
+        HTTPMethod method;
+        Handler handler;
+    };
+
+    std::vector<Route> routes;
+    std::vector<std::string> collected;
+    const NativeHal::HttpRequest* current = nullptr;
+    NativeHal::HttpConnection connection;
+    size_t contentLength = CONTENT_LENGTH_NOT_SET;
+    bool chunked = false;
+    String responseHeaders;
+
+    static const char* reason(int code) {
+        switch (code) {
+            case 200: return "OK";
+            case 202: return "Accepted";
+            case 304: return "Not Modified";
+            case 400: return "Bad Request";
+            case 404: return "Not Found";
+            case 503: return "Service Unavailable";
+            default: return "";
+        }
+    }
+
+    // Status line and headers, built in one String as the real server does
+    void sendHeaderBlock(int code, const char* contentType, size_t length) {
+        char status[48];
+        snprintf(status, sizeof(status), "HTTP/1.1 %d %s\r\n", code, reason(code));
+        String block = status;
+        sendHeader("Content-Type", contentType ? contentType : "text/html", true);
+        if (contentLength == CONTENT_LENGTH_UNKNOWN) {
+            chunked = true;
+            sendHeader("Accept-Ranges", "none");
+            sendHeader("Transfer-Encoding", "chunked");
+        } else {
+            char digits[12];
+            snprintf(digits, sizeof(digits), "%zu", contentLength == CONTENT_LENGTH_NOT_SET ? length : contentLength);
+            sendHeader("Content-Length", digits);
+        }
+        sendHeader("Connection", "close");
+        block += responseHeaders;
+        block += "\r\n";
+        responseHeaders = String();
+        contentLength = CONTENT_LENGTH_NOT_SET;
+        write(block.c_str(), block.length());
+    }
+
+    void write(const char* data, size_t length) {
+        if (connection.open && length) connection.response->append(data, length);
+    }
+
+    bool has(const Fields* fields, const char* name) const {
+        if (!fields) return false;
+        for (const auto& field : *fields) {
+            if (field.first == name) return true;
+        }
+        return false;
+    }
+
+    String find(const Fields* fields, const char* name) const {
+        if (fields) {
+            for (const auto& field : *fields) {
+                if (field.first == name) return String(field.second);
+            }
+        }
+        return String();
+    }
+};
@@ -0,0 +1,282 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <deque>
+#include <vector>
+
+// Hardware model behind the host-native Arduino shim ([env:native]).
+//
+// Time is simulated: the clock only moves when the firmware sleeps (WFI,
+// delay), when a bus transfer takes time, or when a test or simulator calls
+// advance(). Everything is therefore deterministic and can run faster than
+// real time. Periodic timer interrupts (see samd51_registers.h) fire as the
+// clock passes them, and attached devices are stepped whenever it moves.
+//
+// Peripherals are replaced by Device objects that a test or simulator
+// attaches: SpiDevice per chip-select pin, UartDevice per serial port.
+// GPIO outputs, PWM duty and pin interrupts are plain state that can be
+// inspected and driven from the host side.
+namespace NativeHal {
+    static const uint8_t MAX_PINS = 64;
+    static const uint8_t MAX_TIMERS = 8;
+
+    // Anything that acts on its own as time passes
+    class Device {
+    public:
+        virtual ~Device() {}
+        virtual void advance(uint64_t nowMicros) { (void)nowMicros; }
+    };
+
+    // SPI slave, selected while its chip-select pin is low
+    class SpiDevice : public Device {
+    public:
+        virtual void select() {}
+        virtual uint8_t transfer(uint8_t mosi) = 0;
+        virtual void deselect() {}
+    };
+
+    class UartPort;
+
+    // Peer on the far end of a UART, e.g. a Modbus slave
+    class UartDevice : public Device {
+    public:
+        virtual void receive(UartPort& port, uint8_t byte, uint64_t nowMicros) = 0;
+    };
+
+    // One UART as seen from the wire. Bytes sent by a device become
+    // readable one character time apart, after the given turnaround.
+    class UartPort {
+    public:
+        uint32_t baud = 9600;
+        uint8_t bitsPerChar = 10;
+        UartDevice* peer = nullptr;
+
+        void deliver(const uint8_t* data, size_t length, uint64_t nowMicros, uint32_t turnaroundMicros = 0);
+
+        size_t available(uint64_t nowMicros) const {
+            size_t count = 0;
+            for (const Pending& pending : rx) {
+                if (pending.readyAt > nowMicros) break;
+                count++;
+            }
+            return count;
+        }
+
+        int read(uint64_t nowMicros) {
+            if (rx.empty() || rx.front().readyAt > nowMicros) return -1;
+            uint8_t byte = rx.front().byte;
+            rx.pop_front();
+            return byte;
+        }
+
+        int peek(uint64_t nowMicros) const {
+            if (rx.empty() || rx.front().readyAt > nowMicros) return -1;
+            return rx.front().byte;
+        }
+
+        uint32_t charTimeMicros() const {
+            return ((uint64_t)bitsPerChar * 1000000ULL + baud - 1) / baud;
+        }
+
+    private:
+        struct Pending {
+            uint64_t readyAt;
+            uint8_t byte;
+        };
+        std::deque<Pending> rx;
+    };
+
+    struct Timer {
+        void (*handler)() = nullptr;
+        uint64_t periodMicros = 0;
+        uint64_t next = 0;
+    };
+
+    struct SpiAttachment {
+        uint8_t csPin;
+        SpiDevice* device;
+        const void* bus;
+    };
+
+    inline uint64_t nowMicros = 0;
+    inline bool advancing = false;
+    inline bool interruptsEnabled = true;
+
+    inline uint8_t pinLevel[MAX_PINS] = {};
+    inline uint8_t pinModes[MAX_PINS] = {};
+    inline uint32_t pwmValue[MAX_PINS] = {};
+    inline uint8_t pwmResolution = 8;
+    inline void (*pinIsr[MAX_PINS])() = {};
+    inline uint8_t pinIsrMode[MAX_PINS] = {};
+    inline uint64_t pendingPinIsrs = 0;
+
+    inline Timer timers[MAX_TIMERS];
+    inline uint32_t pendingTimers = 0;
+
+    inline std::vector<Device*> devices;
+    inline std::vector<SpiAttachment> spiDevices;
+    inline std::vector<void (*)()> syncHooks;
+
+    // Register models call this to re-read their configuration before time moves
+    inline void addSyncHook(void (*hook)()) {
+        syncHooks.push_back(hook);
+    }
+
+    inline void addDevice(Device* device) {
+        devices.push_back(device);
+    }
+
+    // Chip selects idle high, as with the pull-ups on the board
+    inline void attachSpiDevice(const void* bus, uint8_t csPin, SpiDevice* device) {
+        pinLevel[csPin] = 1;
+        spiDevices.push_back({csPin, device, bus});
+        addDevice(device);
+    }
+
+    inline void attachUartDevice(UartPort& port, UartDevice* device) {
+        port.peer = device;
+        addDevice(device);
+    }
+
+    // Device on the given bus whose chip select is currently low
+    inline SpiDevice* selectedSpiDevice(const void* bus) {
+        for (const SpiAttachment& attachment : spiDevices) {
+            if (attachment.bus == bus && pinLevel[attachment.csPin] == 0) return attachment.device;
+        }
+        return nullptr;
+    }
+
+    // Start, stop or retime a periodic interrupt; the phase restarts on any change
+    inline void setTimer(uint8_t id, uint64_t periodMicros, void (*handler)()) {
+        Timer& timer = timers[id];
+        if (timer.periodMicros == periodMicros && timer.handler == handler) return;
+        timer.periodMicros = periodMicros;
+        timer.handler = handler;
+        timer.next = nowMicros + periodMicros;
+    }
+
+    inline void runPinIsr(uint8_t pin) {
+        if (!interruptsEnabled) {
+            pendingPinIsrs |= 1ULL << pin;
+            return;
+        }
+        pinIsr[pin]();
+    }
+
+    inline void runTimer(uint8_t id) {
+        if (!interruptsEnabled) {
+            pendingTimers |= 1UL << id;
+            return;
+        }
+        timers[id].handler();
+    }
+
+    // Deliver whatever was held back while interrupts were masked
+    inline void runPendingInterrupts() {
+        while (interruptsEnabled && (pendingPinIsrs || pendingTimers)) {
+            for (uint8_t id = 0; id < MAX_TIMERS; id++) {
+                if (pendingTimers & (1UL << id)) {
+                    pendingTimers &= ~(1UL << id);
+                    if (timers[id].handler) timers[id].handler();
+                }
+            }
+            for (uint8_t pin = 0; pin < MAX_PINS; pin++) {
+                if (pendingPinIsrs & (1ULL << pin)) {
+                    pendingPinIsrs &= ~(1ULL << pin);
+                    if (pinIsr[pin]) pinIsr[pin]();
+                }
+            }
+        }
+    }
+
+    // Drive a pin from the outside world; fires an attached interrupt whose
+    // mode (Arduino CHANGE = 2, FALLING = 3, RISING = 4) matches the edge
+    inline void setInput(uint8_t pin, uint8_t level) {
+        uint8_t previous = pinLevel[pin];
+        pinLevel[pin] = level ? 1 : 0;
+        if (!pinIsr[pin] || previous == pinLevel[pin]) return;
+
+        uint8_t mode = pinIsrMode[pin];
+        if (mode == 2 || (mode == 3 && !level) || (mode == 4 && level)) {
+            runPinIsr(pin);
+        }
+    }
+
+    // Move the clock to time, firing timers and stepping devices on the way.
+    // Calls made from inside a timer handler or device only move the clock.
+    inline void advanceTo(uint64_t time) {
+        if (time < nowMicros) return;
+        if (advancing) {
+            nowMicros = time;
+            return;
+        }
+        advancing = true;
+        for (void (*hook)() : syncHooks) hook();
+
+        while (true) {
+            int8_t due = -1;
+            for (uint8_t id = 0; id < MAX_TIMERS; id++) {
+                const Timer& timer = timers[id];
+                if (timer.handler && timer.periodMicros && timer.next <= time &&
+                    (due < 0 || timer.next < timers[due].next)) {
+                    due = id;
+                }
+            }
+            if (due < 0) break;
+
+            // Work done by earlier handlers may already have pushed the clock further
+            if (timers[due].next > nowMicros) nowMicros = timers[due].next;
+            timers[due].next += timers[due].periodMicros;
+            for (Device* device : devices) device->advance(nowMicros);
+            runTimer(due);
+        }
+
+        if (time > nowMicros) nowMicros = time;
+        for (Device* device : devices) device->advance(nowMicros);
+        advancing = false;
+    }
+
+    inline void advance(uint64_t micros) {
+        advanceTo(nowMicros + micros);
+    }
+
+    // WFI: sleep until the next timer interrupt, or 1 ms if none is running
+    inline void waitForInterrupt() {
+        for (void (*hook)() : syncHooks) hook();
+        uint64_t wake = nowMicros + 1000;
+        for (const Timer& timer : timers) {
+            if (timer.handler && timer.periodMicros && timer.next < wake) wake = timer.next;
+        }
+        advanceTo(wake > nowMicros ? wake : nowMicros + 1);
+    }
+
+    // Back to power-on state; attached devices are forgotten, not deleted
+    inline void reset() {
+        nowMicros = 0;
+        advancing = false;
+        interruptsEnabled = true;
+        for (uint8_t pin = 0; pin < MAX_PINS; pin++) {
+            pinLevel[pin] = 0;
+            pinModes[pin] = 0;
+            pwmValue[pin] = 0;
+            pinIsr[pin] = nullptr;
+            pinIsrMode[pin] = 0;
+        }
+        pwmResolution = 8;
+        pendingPinIsrs = 0;
+        pendingTimers = 0;
+        for (Timer& timer : timers) timer = Timer();
+        devices.clear();
+        spiDevices.clear();
+    }
+
+    inline void UartPort::deliver(const uint8_t* data, size_t length, uint64_t now, uint32_t turnaroundMicros) {
+        uint64_t readyAt = now + turnaroundMicros;
+        if (!rx.empty() && rx.back().readyAt > readyAt) readyAt = rx.back().readyAt;
+        for (size_t i = 0; i < length; i++) {
+            readyAt += charTimeMicros();
+            rx.push_back({readyAt, data[i]});
+        }
+    }
+}
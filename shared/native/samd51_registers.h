@@ -0,0 +1,206 @@
+#pragma once
+
+#include <stdint.h>
+#include "native_hal.h"
+
+// Just enough of the SAMD51 register file for the drivers that program
+// timers directly (TaskScheduler on TC3, the heater PWM on TC4). Registers
+// are plain memory; a TC whose MC0 interrupt is enabled in the TC and the
+// NVIC runs its TCn_Handler from the simulated clock at the rate set by
+// CC0 and the prescaler. Compare values can be read back to observe PWM.
+
+#ifndef F_CPU
+#define F_CPU 120000000UL
+#endif
+
+// Defined by whichever firmware header owns the timer
+extern "C" void TC0_Handler(void) __attribute__((weak));
+extern "C" void TC1_Handler(void) __attribute__((weak));
+extern "C" void TC2_Handler(void) __attribute__((weak));
+extern "C" void TC3_Handler(void) __attribute__((weak));
+extern "C" void TC4_Handler(void) __attribute__((weak));
+extern "C" void TC5_Handler(void) __attribute__((weak));
+
+namespace NativeSamd {
+    static const uint8_t TC_COUNT = 6;
+
+    struct TcCount16 {
+        union {
+            struct {
+                uint32_t SWRST : 1;
+                uint32_t ENABLE : 1;
+                uint32_t MODE : 2;
+                uint32_t PRESCSYNC : 2;
+                uint32_t RUNSTDBY : 1;
+                uint32_t ONDEMAND : 1;
+                uint32_t PRESCALER : 3;
+            } bit;
+            uint32_t reg;
+        } CTRLA;
+        struct { uint8_t reg; } INTENCLR;
+        struct { uint8_t reg; } INTENSET;
+        struct { uint8_t reg; } INTFLAG;
+        struct { uint8_t reg; } WAVE;
+        union {
+            struct {
+                uint32_t SWRST : 1;
+                uint32_t ENABLE : 1;
+                uint32_t CTRLB : 1;
+                uint32_t STATUS : 1;
+                uint32_t COUNT : 1;
+                uint32_t PER : 1;
+                uint32_t CC0 : 1;
+                uint32_t CC1 : 1;
+            } bit;
+            uint32_t reg;
+        } SYNCBUSY;
+        struct { uint16_t reg; } COUNT;
+        struct { uint16_t reg; } CC[2];
+    };
+
+    struct Tc {
+        TcCount16 COUNT16;
+    };
+
+    struct Gclk {
+        struct { uint32_t reg; } PCHCTRL[48];
+        struct { uint32_t reg; } SYNCBUSY;
+    };
+
+    inline Tc tc[TC_COUNT] = {};
+    inline Gclk gclk = {};
+    inline bool irqEnabled[256] = {};
+    inline uint8_t irqPriority[256] = {};
+
+    inline void (*tcHandler(uint8_t index))() {
+        switch (index) {
+            case 0: return TC0_Handler;
+            case 1: return TC1_Handler;
+            case 2: return TC2_Handler;
+            case 3: return TC3_Handler;
+            case 4: return TC4_Handler;
+            default: return TC5_Handler;
+        }
+    }
+
+    // Re-derive each TC's interrupt rate from its registers
+    inline void syncTimers() {
+        static const uint16_t DIVIDERS[8] = {1, 2, 4, 8, 16, 64, 256, 1024};
+        for (uint8_t i = 0; i < TC_COUNT; i++) {
+            const TcCount16& count16 = tc[i].COUNT16;
+            void (*handler)() = tcHandler(i);
+            bool running = count16.CTRLA.bit.ENABLE && (count16.INTENSET.reg & 0x10) &&
+                           irqEnabled[107 + i] && handler;
+            uint64_t period = (uint64_t)(count16.CC[0].reg + 1) * DIVIDERS[count16.CTRLA.bit.PRESCALER] *
+                              1000000ULL / F_CPU;
+            NativeHal::setTimer(i, running ? (period ? period : 1) : 0, running ? handler : nullptr);
+        }
+    }
+
+    inline const bool registered = (NativeHal::addSyncHook(syncTimers), true);
+
+    inline void reset() {
+        for (Tc& instance : tc) instance = Tc();
+        gclk = Gclk();
+        for (bool& enabled : irqEnabled) enabled = false;
+    }
+}
+
+#define GCLK (&NativeSamd::gclk)
+#define TC0 (&NativeSamd::tc[0])
+#define TC1 (&NativeSamd::tc[1])
+#define TC2 (&NativeSamd::tc[2])
+#define TC3 (&NativeSamd::tc[3])
+#define TC4 (&NativeSamd::tc[4])
+#define TC5 (&NativeSamd::tc[5])
+
+#define TC0_GCLK_ID 9
+#define TC1_GCLK_ID 9
+#define TC2_GCLK_ID 26
+#define TC3_GCLK_ID 26
+#define TC4_GCLK_ID 30
+#define TC5_GCLK_ID 30
+
+#define GCLK_PCHCTRL_GEN_GCLK0_Val 0x0
+#define GCLK_PCHCTRL_CHEN (1UL << 6)
+
+#define TC_CTRLA_SWRST (1UL << 0)
+#define TC_CTRLA_ENABLE (1UL << 1)
+#define TC_CTRLA_MODE_COUNT16 (0x0UL << 2)
+#define TC_CTRLA_MODE_COUNT8 (0x1UL << 2)
+#define TC_CTRLA_MODE_COUNT32 (0x2UL << 2)
+#define TC_CTRLA_PRESCSYNC_GCLK (0x0UL << 4)
+#define TC_CTRLA_PRESCSYNC_PRESC (0x1UL << 4)
+#define TC_CTRLA_PRESCSYNC_RESYNC (0x2UL << 4)
+#define TC_CTRLA_PRESCALER_DIV1 (0x0UL << 8)
+#define TC_CTRLA_PRESCALER_DIV2 (0x1UL << 8)
+#define TC_CTRLA_PRESCALER_DIV4 (0x2UL << 8)
+#define TC_CTRLA_PRESCALER_DIV8 (0x3UL << 8)
+#define TC_CTRLA_PRESCALER_DIV16 (0x4UL << 8)
+#define TC_CTRLA_PRESCALER_DIV64 (0x5UL << 8)
+#define TC_CTRLA_PRESCALER_DIV256 (0x6UL << 8)
+#define TC_CTRLA_PRESCALER_DIV1024 (0x7UL << 8)
+
+#define TC_WAVE_WAVEGEN_NFRQ 0x0
+#define TC_WAVE_WAVEGEN_MFRQ 0x1
+#define TC_WAVE_WAVEGEN_NPWM 0x2
+#define TC_WAVE_WAVEGEN_MPWM 0x3
+
+#define TC_INTENSET_OVF (1U << 0)
+#define TC_INTENSET_MC0 (1U << 4)
+#define TC_INTENSET_MC1 (1U << 5)
+#define TC_INTFLAG_OVF (1U << 0)
+#define TC_INTFLAG_MC0 (1U << 4)
+#define TC_INTFLAG_MC1 (1U << 5)
+
+typedef enum {
+    TC0_IRQn = 107,
+    TC1_IRQn = 108,
+    TC2_IRQn = 109,
+    TC3_IRQn = 110,
+    TC4_IRQn = 111,
+    TC5_IRQn = 112
+} IRQn_Type;
+
+inline void NVIC_EnableIRQ(IRQn_Type irq) { NativeSamd::irqEnabled[irq] = true; }
+inline void NVIC_DisableIRQ(IRQn_Type irq) { NativeSamd::irqEnabled[irq] = false; }
+inline void NVIC_SetPriority(IRQn_Type irq, uint32_t priority) { NativeSamd::irqPriority[irq] = priority; }
+inline void NVIC_ClearPendingIRQ(IRQn_Type irq) { (void)irq; }
+
+inline void __WFI() { NativeHal::waitForInterrupt(); }
+
+inline void __disable_irq() { NativeHal::interruptsEnabled = false; }
+
+inline void __enable_irq() {
+    NativeHal::interruptsEnabled = true;
+    NativeHal::runPendingInterrupts();
+}
+
+// Pin multiplexing has nothing to model on the host
+typedef enum {
+    PIO_NOT_A_PIN = -1,
+    PIO_EXTINT = 0,
+    PIO_ANALOG,
+    PIO_SERCOM,
+    PIO_SERCOM_ALT,
+    PIO_TIMER,
+    PIO_TIMER_ALT,
+    PIO_TCC_PDEC,
+    PIO_COM,
+    PIO_SDHC,
+    PIO_I2S,
+    PIO_PCC,
+    PIO_GMAC,
+    PIO_AC_CLK,
+    PIO_CCL,
+    PIO_DIGITAL,
+    PIO_INPUT,
+    PIO_INPUT_PULLUP,
+    PIO_OUTPUT
+} EPioType;
+
+inline int pinPeripheral(uint32_t pin, EPioType type) {
+    (void)pin;
+    (void)type;
+    return 0;
+}
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+// Binary format of the RP2040 SD sample log. The logger
+// (rp2040/include/data_logger.h) and the host exporter
+// (rp2040/tools/sdlog.cpp) both include this header so the layout can only
+// change in one place.
+//
+// A log file is a sequence of BLOCK_SIZE blocks, each written whole at a
+// block-aligned offset. Block 0 is a file header naming the channels; the
+// data blocks follow. Files are preallocated with zero blocks, so the log
+// ends at the first all-zero block.
+//
+//   offset 0  magic          MAGIC, little endian
+//          2  version        FORMAT_VERSION
+//          3  kind           BlockKind
+//          4  sequence       block counter, continues across files and reboots
+//          8  unixTime       Unix seconds paired with referenceTimestamp, 0 if unknown
+//         12  referenceTimestamp
+//         16  minTimestamp   smallest record timestamp in the block
+//         20  maxTimestamp   largest record timestamp in the block
+//         24  count          records in the payload
+//         26  length         payload bytes used
+//         28  payload        PAYLOAD_SIZE bytes, zero padded
+//        508  crc            CRC-32 (IEEE) over bytes 0..507, little endian
+//
+// Timestamps are SAMD51 millis(); unixTime/referenceTimestamp place them
+// in wall-clock time. minTimestamp/maxTimestamp index the file, so a time
+// range is found by binary search over block headers.
+//
+// A data record is
+//
+//   channel    one byte
+//   timestamp  zigzag varint, delta from the previous record's timestamp
+//              (the first record's from referenceTimestamp)
+//   value      zigzag varint, delta of value * SCALE from the channel's
+//              previous record in this block (the first from 0)
+//
+// so every block decodes on its own. NAN is stored as NAN_VALUE. The file
+// header payload is the channel count followed by that many NUL-terminated
+// names.
+namespace SampleLog {
+    constexpr uint16_t MAGIC = 0x4C53;      // "SL"
+    constexpr uint8_t FORMAT_VERSION = 1;
+    constexpr size_t BLOCK_SIZE = 512;
+    constexpr size_t HEADER_SIZE = 28;
+    constexpr size_t CRC_SIZE = 4;
+    constexpr size_t PAYLOAD_SIZE = BLOCK_SIZE - HEADER_SIZE - CRC_SIZE;
+    constexpr size_t MAX_RECORD_SIZE = 1 + 5 + 5;   // Both deltas fit in 34 bits
+    constexpr float SCALE = 1000.0f;        // Three decimals, as the JSON log had
+    constexpr int32_t NAN_VALUE = INT32_MIN;
+
+    enum BlockKind : uint8_t {
+        BLOCK_FILE_HEADER = 1,
+        BLOCK_DATA = 2
+    };
+
+    struct __attribute__((packed)) BlockHeader {
+        uint16_t magic;
+        uint8_t version;
+        uint8_t kind;
+        uint32_t sequence;
+        uint32_t unixTime;
+        uint32_t referenceTimestamp;
+        uint32_t minTimestamp;
+        uint32_t maxTimestamp;
+        uint16_t count;
+        uint16_t length;
+    };
+
+    static_assert(sizeof(BlockHeader) == HEADER_SIZE, "BlockHeader layout changed");
+
+    struct Record {
+        uint8_t channel;
+        uint32_t timestamp;
+        float value;
+    };
+
+    // CRC-32 (IEEE 802.3): poly 0xEDB88320 reflected, init and xorout 0xFFFFFFFF
+    inline uint32_t crc32(const uint8_t* data, size_t length) {
+        uint32_t crc = 0xFFFFFFFF;
+        for (size_t i = 0; i < length; i++) {
+            crc ^= data[i];
+            for (uint8_t bit = 0; bit < 8; bit++) {
+                crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+            }
+        }
+        return ~crc;
+    }
+
+    inline uint64_t zigzag(int64_t value) {
+        return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+    }
+
+    inline int64_t unzigzag(uint64_t value) {
+        return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+    }
+
+    inline size_t putVarint(uint8_t* out, uint64_t value) {
+        size_t length = 0;
+        while (value >= 0x80) {
+            out[length++] = (uint8_t)value | 0x80;
+            value >>= 7;
+        }
+        out[length++] = (uint8_t)value;
+        return length;
+    }
+
+    // Returns bytes consumed, 0 if the varint runs past end
+    inline size_t getVarint(const uint8_t* in, const uint8_t* end, uint64_t& value) {
+        value = 0;
+        for (size_t i = 0; i < 10 && in + i < end; i++) {
+            value |= (uint64_t)(in[i] & 0x7F) << (7 * i);
+            if (!(in[i] & 0x80)) return i + 1;
+        }
+        return 0;
+    }
+
+    inline int32_t quantize(float value) {
+        if (isnan(value)) return NAN_VALUE;
+        float scaled = roundf(value * SCALE);
+        if (scaled >= 2147483520.0f) return INT32_MAX;
+        if (scaled <= -2147483520.0f) return INT32_MIN + 1;
+        return (int32_t)scaled;
+    }
+
+    inline float dequantize(int32_t value) {
+        return value == NAN_VALUE ? NAN : value / SCALE;
+    }
+
+    // A block being filled in RAM. finish() stamps the header and CRC so the
+    // block can be written, and may be called again after more appends.
+    class BlockWriter {
+    public:
+        static constexpr uint8_t MAX_CHANNELS = 32;
+
+        void begin(BlockKind kind, uint32_t sequence, uint32_t unixTime, uint32_t referenceTimestamp) {
+            memset(block, 0, BLOCK_SIZE);
+            header = {MAGIC, FORMAT_VERSION, kind, sequence, unixTime, referenceTimestamp, 0, 0, 0, 0};
+            memset(previous, 0, sizeof(previous));
+            previousTimestamp = referenceTimestamp;
+        }
+
+        // False if the block is full; start the next one and append there
+        bool append(uint8_t channel, uint32_t timestamp, float value) {
+            if (channel >= MAX_CHANNELS || header.length + MAX_RECORD_SIZE > PAYLOAD_SIZE) return false;
+            if (header.count == 0) {
+                header.minTimestamp = timestamp;
+                header.maxTimestamp = timestamp;
+            }
+
+            int32_t quantized = quantize(value);
+            uint8_t* out = block + HEADER_SIZE + header.length;
+            size_t length = 0;
+            out[length++] = channel;
+            length += putVarint(out + length, zigzag((int64_t)(int32_t)(timestamp - previousTimestamp)));
+            length += putVarint(out + length, zigzag((int64_t)quantized - previous[channel]));
+
+            header.length += length;
+            header.count++;
+            previous[channel] = quantized;
+            previousTimestamp = timestamp;
+            if ((int32_t)(timestamp - header.minTimestamp) < 0) header.minTimestamp = timestamp;
+            if ((int32_t)(timestamp - header.maxTimestamp) > 0) header.maxTimestamp = timestamp;
+            return true;
+        }
+
+        // Raw payload bytes, for the file header
+        bool appendBytes(const void* data, size_t length) {
+            if (header.length + length > PAYLOAD_SIZE) return false;
+            memcpy(block + HEADER_SIZE + header.length, data, length);
+            header.length += length;
+            return true;
+        }
+
+        const uint8_t* finish() {
+            memcpy(block, &header, HEADER_SIZE);
+            uint32_t crc = crc32(block, BLOCK_SIZE - CRC_SIZE);
+            memcpy(block + BLOCK_SIZE - CRC_SIZE, &crc, CRC_SIZE);
+            return block;
+        }
+
+        // Place a block opened before the clock was known; the Unix time
+        // must be the one at referenceTimestamp()
+        void setUnixTime(uint32_t unixTime) { header.unixTime = unixTime; }
+        uint32_t unixTime() const { return header.unixTime; }
+        uint32_t referenceTimestamp() const { return header.referenceTimestamp; }
+
+        uint16_t count() const { return header.count; }
+        uint16_t length() const { return header.length; }
+        bool empty() const { return header.count == 0; }
+        uint32_t sequence() const { return header.sequence; }
+
+    private:
+        uint8_t block[BLOCK_SIZE];
+        BlockHeader header = {};
+        int32_t previous[MAX_CHANNELS];
+        uint32_t previousTimestamp = 0;
+    };
+
+    // Check a block read back from the card
+    inline bool validBlock(const uint8_t* block, BlockHeader& header) {
+        memcpy(&header, block, HEADER_SIZE);
+        if (header.magic != MAGIC || header.version != FORMAT_VERSION) return false;
+        if (header.length > PAYLOAD_SIZE) return false;
+        uint32_t crc;
+        memcpy(&crc, block + BLOCK_SIZE - CRC_SIZE, CRC_SIZE);
+        return crc == crc32(block, BLOCK_SIZE - CRC_SIZE);
+    }
+
+    // Walk the records of a valid data block; false if the payload is malformed
+    template <typename Visitor>
+    bool decodeBlock(const uint8_t* block, const BlockHeader& header, Visitor visit) {
+        const uint8_t* in = block + HEADER_SIZE;
+        const uint8_t* end = in + header.length;
+        int32_t previous[BlockWriter::MAX_CHANNELS] = {};
+        uint32_t timestamp = header.referenceTimestamp;
+
+        for (uint16_t i = 0; i < header.count; i++) {
+            if (in >= end) return false;
+            uint8_t channel = *in++;
+            if (channel >= BlockWriter::MAX_CHANNELS) return false;
+
+            uint64_t delta, value;
+            size_t used = getVarint(in, end, delta);
+            if (!used) return false;
+            in += used;
+            used = getVarint(in, end, value);
+            if (!used) return false;
+            in += used;
+
+            timestamp += (uint32_t)unzigzag(delta);
+
+            previous[channel] = (int32_t)((int64_t)previous[channel] + unzigzag(value));
+            visit(Record{channel, timestamp, dequantize(previous[channel])});
+        }
+        return true;
+    }
+}
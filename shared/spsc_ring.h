@@ -0,0 +1,57 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+
+// Lock-free single-producer/single-consumer ring buffer. The producer may run
+// in an ISR and the consumer in the main loop (or vice versa), or the two
+// sides may run on different RP2040 cores; neither side ever disables
+// interrupts or takes a lock. Capacity must be a power of two.
+template <typename T, uint16_t N>
+class SpscRing {
+    static_assert((N & (N - 1)) == 0, "SpscRing capacity must be a power of two");
+
+public:
+    // Producer side; returns false and drops the item if the ring is full
+    bool push(const T& item) {
+        uint16_t head = head_.load(std::memory_order_relaxed);
+        uint16_t next = (head + 1) & (N - 1);
+        if (next == tail_.load(std::memory_order_acquire)) {
+            overflows_ = overflows_ + 1;
+            return false;
+        }
+        items_[head] = item;
+        head_.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side; returns false if the ring is empty
+    bool pop(T& item) {
+        uint16_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = items_[tail];
+        tail_.store((tail + 1) & (N - 1), std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return tail_.load(std::memory_order_acquire) == head_.load(std::memory_order_acquire);
+    }
+
+    uint16_t size() const {
+        return (head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire)) & (N - 1);
+    }
+
+    // Number of items the producer had to drop because the consumer fell behind
+    uint32_t overflows() const {
+        return overflows_;
+    }
+
+private:
+    T items_[N];
+    std::atomic<uint16_t> head_{0};
+    std::atomic<uint16_t> tail_{0};
+    volatile uint32_t overflows_ = 0;
+};